@@ -0,0 +1,67 @@
+#pragma once
+
+#include "richard/data_loader.hpp"
+#include "richard/data_details.hpp"
+#include "richard/mapped_file.hpp"
+#include <istream>
+#include <ostream>
+
+namespace richard {
+
+// Loads samples from a packed binary data set, which is memory mapped rather than parsed.
+//
+// The file holds a fixed size header (shape, normalization, sample count), the class labels, then
+// one fixed-stride record per sample: a uint32 class id followed by the values. Values are either
+// raw uint8s, which packed samples refer to in place without copying, or already normalized
+// floats. All fields are little-endian.
+class BinaryDataLoader : public DataLoader {
+  public:
+    BinaryDataLoader(MappedFilePtr file, size_t fetchSize);
+
+    void seekToBeginning() override;
+    std::vector<Sample> loadSamples() override;
+
+    inline const Size3& shape() const;
+    inline const std::vector<std::string>& labels() const;
+    inline const NormalizationParams& normalization() const;
+    inline size_t numSamples() const;
+
+  private:
+    // Shared with the packed samples handed out, which point into it
+    std::shared_ptr<const MappedFile> m_file;
+    Size3 m_shape;
+    std::vector<std::string> m_labels;
+    NormalizationParams m_normalization;
+    bool m_uint8Values;
+    size_t m_numSamples;
+    size_t m_recordsOffset;
+    size_t m_recordStride;
+    size_t m_next;
+};
+
+const Size3& BinaryDataLoader::shape() const {
+  return m_shape;
+}
+
+const std::vector<std::string>& BinaryDataLoader::labels() const {
+  return m_labels;
+}
+
+const NormalizationParams& BinaryDataLoader::normalization() const {
+  return m_normalization;
+}
+
+size_t BinaryDataLoader::numSamples() const {
+  return m_numSamples;
+}
+
+// Reads the magic number from the stream's current position, leaving the stream in an
+// unspecified state
+bool isBinaryDataSet(std::istream& stream);
+
+// Writes every sample from source to the stream in the binary format. The source is read twice,
+// first to decide whether the values fit in uint8s, and is left at its end.
+void writeBinaryDataSet(DataLoader& source, const DataDetails& dataDetails,
+  std::ostream& stream);
+
+}
@@ -31,6 +31,8 @@ class Classifier {
     void writeToStream(std::ostream& stream) const;
     void train(LabelledDataSet& trainingData);
     Results test(LabelledDataSet& testData) const;
+    // Post-training int8 quantization for faster evaluation. See NeuralNet::quantize.
+    void quantize(LabelledDataSet& calibrationData, size_t maxSamples);
     ModelDetails modelDetails() const;
 
     // Called from another thread
@@ -42,6 +44,11 @@ class Classifier {
     EventSystem& m_eventSystem;
     std::unique_ptr<NeuralNet> m_neuralNet;
     bool m_isTrained;
+    // Samples per call to NeuralNet::evaluateBatch, from the optional "testBatchSize"
+    size_t m_testBatchSize;
+    // Threads that test evaluates batches on, from the optional "testThreads". 0 means one per
+    // hardware thread. Always 1 with GPU acceleration.
+    size_t m_testThreads;
 };
 
 }
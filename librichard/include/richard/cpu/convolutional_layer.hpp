@@ -23,10 +23,20 @@ class ConvolutionalLayer : public Layer {
     const DataArray& activations() const override;
     const DataArray& inputDelta() const override;
     void trainForward(const DataArray& inputs) override;
-    DataArray evalForward(const DataArray& inputs) const override;
+    void evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const override;
     void updateDeltas(const DataArray& inputs, const DataArray& outputDelta) override;
     void updateParams(size_t epoch) override;
     void writeToStream(std::ostream& stream) const override;
+    const Matrix& batchActivations() const override;
+    const Matrix& batchInputDelta() const override;
+    void trainForwardBatch(const Matrix& inputs) override;
+    void updateDeltasBatch(const Matrix& inputs, const Matrix& outputDelta) override;
+    void copyParams(const Layer& source) override;
+    void mergeDeltas(Layer& source) override;
+    void calibrate(const DataArray& inputs) override;
+    void quantize() override;
+    void prune() override {}
+    void finishTraining() override {}
 
     // Exposed for testing
     //
@@ -37,19 +47,50 @@ class ConvolutionalLayer : public Layer {
   private:
     void initialize(const Config& config, const Size3& inputShape);
     size_t numOutputs() const;
-    void forwardPass(const Array3& inputs, Array3& Z) const;
+    void forwardPass(const Array3& inputs, Array3& Z, Matrix& cols) const;
+    void backpropagate(const Array3& inputs, const Array3& Z, const Array3& deltaA,
+      Array3& inputDelta);
+    void transposeFilters();
+    bool forwardUsesIm2col() const;
 
-    std::vector<Filter> m_filters;
+    // One filter per row, each laid out as a Kernel, so a convolution over every filter is a
+    // single product with the im2col lowering of the input
+    Matrix m_W;
+    Vector m_B;
+    Matrix m_deltaW;
+    Vector m_deltaB;
+    Matrix m_cols;
+    Matrix m_colsDelta;
+    // Chosen by cost model for large kernels
+    bool m_fftForward;
+    bool m_fftInputDelta;
+    Matrix m_transposedW;
+    // Set by quantize(), after which evalForward works in int8
+    bool m_quantized;
+    netfloat_t m_inputRange;
+    QuantizedMatrix m_quantizedW;
     Array3 m_Z;
     Array3 m_A;
+    Array3 m_delta;
     Array3 m_inputDelta;
-    std::vector<Filter> m_paramDeltas;
+    Matrix m_batchZ;
+    Matrix m_batchA;
+    Matrix m_batchDelta;
+    Matrix m_batchInputDelta;
+    // The whole mini-batch lowered at once, and its feature maps or deltas with one filter per
+    // row, so each step of training is a single product
+    Matrix m_batchCols;
+    Matrix m_batchColsDelta;
+    Matrix m_batchMaps;
+    size_t m_kernelW;
+    size_t m_kernelH;
     size_t m_inputW;
     size_t m_inputH;
     size_t m_inputDepth;
     netfloat_t m_learnRate;
     netfloat_t m_learnRateDecay;
     netfloat_t m_dropoutRate;
+    Random m_random;
 };
 
 }
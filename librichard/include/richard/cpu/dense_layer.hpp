@@ -17,10 +17,21 @@ class DenseLayer : public Layer {
     const DataArray& activations() const override;
     const DataArray& inputDelta() const override;
     void trainForward(const DataArray& inputs) override;
-    DataArray evalForward(const DataArray& inputs) const override;
+    void evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const override;
+    void evalForwardBatch(const Matrix& inputs, Matrix& outputs) const override;
     void updateDeltas(const DataArray& inputs, const DataArray& outputDelta) override;
     void updateParams(size_t epoch) override;
     void writeToStream(std::ostream& stream) const override;
+    const Matrix& batchActivations() const override;
+    const Matrix& batchInputDelta() const override;
+    void trainForwardBatch(const Matrix& inputs) override;
+    void updateDeltasBatch(const Matrix& inputs, const Matrix& outputDelta) override;
+    void copyParams(const Layer& source) override;
+    void mergeDeltas(Layer& source) override;
+    void calibrate(const DataArray& inputs) override;
+    void quantize() override;
+    void prune() override;
+    void finishTraining() override;
 
     // Exposed for testing
     //
@@ -34,19 +45,44 @@ class DenseLayer : public Layer {
 
   private:
     void initialize(const Config& config, size_t inputSize);
+    void resizeBatch(size_t batchSize);
+    void allocateSparseDeltas();
+    void markSparseColumn(uint32_t column);
 
     Matrix m_W;
     Vector m_B;
     Vector m_Z;
     Vector m_A;
+    Vector m_delta;
     Vector m_inputDelta;
     Vector m_deltaB;
     Matrix m_deltaW;
+    Matrix m_batchZ;
+    Matrix m_batchA;
+    Matrix m_batchDelta;
+    Matrix m_batchInputDelta;
     netfloat_t m_learnRate;
     netfloat_t m_learnRateDecay;
     netfloat_t m_dropoutRate;
-    ActivationFn m_activationFn;
-    ActivationFn m_activationFnPrime;
+    Random m_random;
+    Activation m_activation;
+    InferenceWeights m_inferenceW;
+    Pruning m_pruning;
+
+    // Mini-batches whose inputs are mostly zeros are multiplied in sparse form. The products are
+    // over rows of W^T (one per input), which updateParams keeps in step with m_W for as long as
+    // sparse batches keep arriving. It's only changed between mini-batches, so the replicas can
+    // copy it while the first worker's batch is in progress.
+    SparseMatrix m_sparseInputs;
+    bool m_sparseBatch;
+    bool m_sparseInputsSeen;
+    Matrix m_Wt;
+    bool m_WtCurrent;
+    // The sparse batches' weight deltas, W^T-shaped, and the inputs (rows) they're non-zero for
+    Matrix m_deltaWt;
+    std::vector<uint32_t> m_sparseColumns;
+    std::vector<uint8_t> m_isSparseColumn;
+    bool m_denseDeltas;
 };
 
 }
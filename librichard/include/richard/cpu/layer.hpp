@@ -7,26 +7,179 @@
 #include <cmath>
 
 namespace richard {
+
+class Config;
+
 namespace cpu {
 
 using ActivationFn = std::function<netfloat_t(netfloat_t)>;
 using CostDerivativesFn = std::function<Vector(const Vector&, const Vector&)>;
 
-const ActivationFn sigmoid = [](netfloat_t x) {
-  return static_cast<netfloat_t>(1.0 / (1.0 + exp(-x)));
+// Activation functions, resolved at compile time. The call operator acts on a single value, and
+// apply() computes R[i] = f(X[i]) over a whole array with the SIMD kernels.
+//
+struct Sigmoid {
+  netfloat_t operator()(netfloat_t x) const {
+    return 1.f / (1.f + std::exp(-x));
+  }
+
+  static void apply(const netfloat_t* X, netfloat_t* R, size_t n) {
+    simd::kernels().sigmoid(X, R, n);
+  }
 };
 
-const ActivationFn sigmoidPrime = [](netfloat_t x) {
-  netfloat_t sigX = sigmoid(x);
-  return static_cast<netfloat_t>(sigX * (1.0 - sigX));
+struct SigmoidPrime {
+  netfloat_t operator()(netfloat_t x) const {
+    netfloat_t sigX = Sigmoid{}(x);
+    return sigX * (1.f - sigX);
+  }
+
+  static void apply(const netfloat_t* X, netfloat_t* R, size_t n) {
+    simd::kernels().sigmoidPrime(X, R, n);
+  }
 };
 
-const ActivationFn relu = [](netfloat_t x) {
-  return x < 0.f ? 0.f : x;
+struct Relu {
+  netfloat_t operator()(netfloat_t x) const {
+    return x < 0.f ? 0.f : x;
+  }
+
+  static void apply(const netfloat_t* X, netfloat_t* R, size_t n) {
+    simd::kernels().relu(X, R, n);
+  }
 };
 
-const ActivationFn reluPrime = [](netfloat_t x) {
-  return x < 0.f ? 0.f : 1.f;
+struct ReluPrime {
+  netfloat_t operator()(netfloat_t x) const {
+    return x < 0.f ? 0.f : 1.f;
+  }
+
+  static void apply(const netfloat_t* X, netfloat_t* R, size_t n) {
+    simd::kernels().reluPrime(X, R, n);
+  }
+};
+
+constexpr Sigmoid sigmoid{};
+constexpr SigmoidPrime sigmoidPrime{};
+constexpr Relu relu{};
+constexpr ReluPrime reluPrime{};
+
+// An activation function and its derivative, chosen when a layer is configured
+class Activation {
+  public:
+    enum class Type {
+      sigmoid,
+      relu,
+      custom
+    };
+
+    explicit Activation(Type type = Type::sigmoid)
+      : m_type(type) {
+
+      ASSERT_MSG(type != Type::custom, "Custom activations must supply their functions");
+    }
+
+    // Arbitrary functions, applied an element at a time. Intended for testing.
+    Activation(const ActivationFn& f, const ActivationFn& fPrime)
+      : m_type(Type::custom)
+      , m_f(f)
+      , m_fPrime(fPrime) {}
+
+    // R[i] = f(X[i])
+    void apply(const netfloat_t* X, netfloat_t* R, size_t n) const {
+      switch (m_type) {
+        case Type::sigmoid: Sigmoid::apply(X, R, n); break;
+        case Type::relu: Relu::apply(X, R, n); break;
+        case Type::custom: applyCustom(m_f, X, R, n); break;
+      }
+    }
+
+    // R[i] = f'(X[i])
+    void applyPrime(const netfloat_t* X, netfloat_t* R, size_t n) const {
+      switch (m_type) {
+        case Type::sigmoid: SigmoidPrime::apply(X, R, n); break;
+        case Type::relu: ReluPrime::apply(X, R, n); break;
+        case Type::custom: applyCustom(m_fPrime, X, R, n); break;
+      }
+    }
+
+  private:
+    static void applyCustom(const ActivationFn& f, const netfloat_t* X, netfloat_t* R,
+      size_t n) {
+
+      for (size_t i = 0; i < n; ++i) {
+        R[i] = f(X[i]);
+      }
+    }
+
+    Type m_type;
+    ActivationFn m_f;
+    ActivationFn m_fPrime;
+};
+
+// Magnitude pruning of a layer's weights, from the layer's optional "pruning" config. This
+// has either a "threshold", below which weights are zeroed, or a target "sparsity", the
+// fraction of the weights to zero.
+class Pruning {
+  public:
+    Pruning();
+    explicit Pruning(const Config& config);
+
+    bool enabled() const {
+      return m_enabled;
+    }
+
+    void apply(Matrix& W) const;
+
+  private:
+    bool m_enabled;
+    netfloat_t m_threshold;
+    netfloat_t m_sparsity;
+};
+
+// The weights a dense or output layer uses for inference, held in the precision given by the
+// layer's optional "inferencePrecision" config ("float32", "float16" or "bfloat16"). Training
+// always works on the float32 weights, and update() must be called whenever they change.
+class InferenceWeights {
+  public:
+    explicit InferenceWeights(Precision precision = Precision::float32);
+
+    // Repacks W. At float32, W is used directly and there's nothing to do.
+    void update(const Matrix& W);
+    // Training changes W once per mini-batch, so rather than repacking each time, invalidate()
+    // marks the packed weights out of date, and refresh() repacks them only if they are.
+    // evaluate() throws if they aren't current.
+    void invalidate();
+    void refresh(const Matrix& W);
+
+    // y = f(Wx + b)
+    void evaluate(const Matrix& W, const Vector& x, const Vector& b, Vector& y,
+      const Activation& activation) const;
+    // The same for each row x of X, giving the rows of Y. At float32 this is a single matrix
+    // product; the other representations fall back to one row at a time.
+    void evaluateBatch(const Matrix& W, const Matrix& X, const Vector& b, Matrix& Y,
+      const Activation& activation) const;
+
+    // Post-training quantization. calibrate() records the largest input magnitude seen, and
+    // quantize() switches evaluate() to int8 weights and inputs covering that range. Any
+    // later update() requantizes.
+    void calibrate(const DataArray& inputs);
+    void quantize(const Matrix& W);
+
+    // For pruned weights, switches evaluate() to a sparse product over the non-zero weights.
+    // Quantization takes precedence.
+    void sparsify(const Matrix& W);
+
+  private:
+    Precision m_precision;
+    PackedMatrix<float16_t> m_float16;
+    PackedMatrix<bfloat16_t> m_bfloat16;
+    bool m_quantized;
+    netfloat_t m_inputRange;
+    QuantizedMatrix m_int8;
+    bool m_sparse;
+    SparseMatrix m_sparseW;
+    bool m_current;
 };
 
 // Partial derivatives of quadraticCost with respect to the activations
@@ -43,11 +196,48 @@ class Layer {
     virtual const DataArray& activations() const = 0;
     virtual const DataArray& inputDelta() const = 0;
     virtual void trainForward(const DataArray& inputs) = 0;
-    virtual DataArray evalForward(const DataArray& inputs) const = 0;
     virtual void updateDeltas(const DataArray& inputs, const DataArray& outputDelta) = 0;
     virtual void updateParams(size_t epoch) = 0;
     virtual void writeToStream(std::ostream& stream) const = 0;
 
+    // Inference. evalForwardInto reads the layer's inputs and writes calcProduct(outputSize())
+    // values to outputs, which mustn't overlap them. It's safe to call from several threads at
+    // once, and doesn't allocate once each thread's scratch buffers have grown to size.
+    //
+    virtual void evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const = 0;
+    DataArray evalForward(const DataArray& inputs) const;
+    // One sample per row. By default, calls evalForwardInto on each row in turn.
+    virtual void evalForwardBatch(const Matrix& inputs, Matrix& outputs) const;
+
+    // Mini-batch training, with one sample per row. The parameter deltas accumulate over the
+    // batch exactly as they would over the same samples passed one at a time.
+    //
+    virtual const Matrix& batchActivations() const = 0;
+    virtual const Matrix& batchInputDelta() const = 0;
+    virtual void trainForwardBatch(const Matrix& inputs) = 0;
+    virtual void updateDeltasBatch(const Matrix& inputs, const Matrix& outputDelta) = 0;
+
+    // Data-parallel training gives each worker thread a replica of the layer, constructed from
+    // the same config. copyParams overwrites the replica's parameters with the source's, and
+    // mergeDeltas adds the source's accumulated parameter deltas to this layer's and zeroes
+    // them in the source.
+    //
+    virtual void copyParams(const Layer& source) = 0;
+    virtual void mergeDeltas(Layer& source) = 0;
+
+    // Post-training quantization to int8. Each call to calibrate is passed one sample's inputs
+    // to the layer, taken from a representative set, and quantize then switches evalForward to
+    // int8 arithmetic over the range of inputs seen. Training is unaffected.
+    //
+    virtual void calibrate(const DataArray& inputs) = 0;
+    virtual void quantize() = 0;
+
+    // Applies the layer's configured pruning, if any. Called at the end of each training epoch.
+    virtual void prune() = 0;
+    // Brings anything evalForward depends on up to date with the trained parameters. Called
+    // once training ends.
+    virtual void finishTraining() = 0;
+
     virtual ~Layer() {}
 };
 
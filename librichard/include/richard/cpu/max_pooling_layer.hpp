@@ -17,10 +17,20 @@ class MaxPoolingLayer : public Layer {
     const DataArray& activations() const override;
     const DataArray& inputDelta() const override;
     void trainForward(const DataArray& inputs) override;
-    DataArray evalForward(const DataArray& inputs) const override;
+    void evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const override;
     void updateDeltas(const DataArray& inputs, const DataArray& outputDelta) override;
     void updateParams(size_t) override {}
     void writeToStream(std::ostream&) const override {}
+    const Matrix& batchActivations() const override;
+    const Matrix& batchInputDelta() const override;
+    void trainForwardBatch(const Matrix& inputs) override;
+    void updateDeltasBatch(const Matrix& inputs, const Matrix& outputDelta) override;
+    void copyParams(const Layer&) override {}
+    void mergeDeltas(Layer&) override {}
+    void calibrate(const DataArray&) override {}
+    void quantize() override {}
+    void prune() override {}
+    void finishTraining() override {}
 
     // Exposed for testing
     //
@@ -28,6 +38,8 @@ class MaxPoolingLayer : public Layer {
     const Array3& test_mask() const;
 
   private:
+    void forwardPass(const Array3& image, Array3& Z, Array3& mask) const;
+    void backpropagate(const Array3& delta, const Array3& mask, Array3& inputDelta) const;
     void padDelta(const Array3& delta, const Array3& mask, Array3& paddedDelta) const;
     void backpropFromDenseLayer(const Layer& nextLayer, Array3& delta);
     void backpropFromConvLayer(const std::vector<ConvolutionalLayer::Filter>& filters,
@@ -41,6 +53,9 @@ class MaxPoolingLayer : public Layer {
     size_t m_inputH;
     size_t m_inputDepth;
     Array3 m_mask;
+    Matrix m_batchZ;
+    Matrix m_batchMask;
+    Matrix m_batchInputDelta;
 };
 
 }
@@ -17,10 +17,21 @@ class OutputLayer : public Layer {
     const DataArray& activations() const override;
     const DataArray& inputDelta() const override;
     void trainForward(const DataArray& inputs) override;
-    DataArray evalForward(const DataArray& inputs) const override;
+    void evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const override;
+    void evalForwardBatch(const Matrix& inputs, Matrix& outputs) const override;
     void updateDeltas(const DataArray& inputs, const DataArray& outputs) override;
     void updateParams(size_t epoch) override;
     void writeToStream(std::ostream& stream) const override;
+    const Matrix& batchActivations() const override;
+    const Matrix& batchInputDelta() const override;
+    void trainForwardBatch(const Matrix& inputs) override;
+    void updateDeltasBatch(const Matrix& inputs, const Matrix& outputs) override;
+    void copyParams(const Layer& source) override;
+    void mergeDeltas(Layer& source) override;
+    void calibrate(const DataArray& inputs) override;
+    void quantize() override;
+    void prune() override;
+    void finishTraining() override;
 
     // Exposed for testing
     //
@@ -34,18 +45,25 @@ class OutputLayer : public Layer {
 
   private:
     void initialize(const Config& config, size_t inputSize);
+    void resizeBatch(size_t batchSize);
 
     Matrix m_W;
     Vector m_B;
     Vector m_Z;
     Vector m_A;
+    Vector m_delta;
     Vector m_inputDelta;
     Vector m_deltaB;
     Matrix m_deltaW;
+    Matrix m_batchZ;
+    Matrix m_batchA;
+    Matrix m_batchDelta;
+    Matrix m_batchInputDelta;
     netfloat_t m_learnRate;
     netfloat_t m_learnRateDecay;
-    ActivationFn m_activationFn;
-    ActivationFn m_activationFnPrime;
+    Activation m_activation;
+    InferenceWeights m_inferenceW;
+    Pruning m_pruning;
 };
 
 }
@@ -2,23 +2,40 @@
 
 #include "richard/data_loader.hpp"
 #include "richard/data_details.hpp"
+#include "richard/thread_pool.hpp"
 #include <fstream>
 #include <memory>
+#include <map>
+#include <string_view>
 
 namespace richard {
 
 class CsvDataLoader : public DataLoader {
   public:
+    // The file is read in large blocks, and each fetch's lines are parsed across numThreads
+    // threads (0 for one per hardware thread). Each line's label must be one of labels.
     CsvDataLoader(std::unique_ptr<std::istream>, size_t inputSize,
-      const NormalizationParams& normalization, size_t fetchSize);
+      const std::vector<std::string>& labels, const NormalizationParams& normalization,
+      size_t fetchSize, size_t numThreads = 1);
 
     void seekToBeginning() override;
     std::vector<Sample> loadSamples() override;
 
   private:
+    bool readBlock();
+    void parseLine(const char* begin, const char* end, uint32_t& classId,
+      netfloat_t* values) const;
+
     size_t m_inputSize;
+    std::map<std::string, uint32_t, std::less<>> m_classIds;
     NormalizationParams m_normalization;
     std::unique_ptr<std::istream> m_stream;
+    ThreadPool m_threadPool;
+    // Unparsed text read from the stream is held in m_buffer[m_begin, m_end). The buffer is
+    // never empty, so data() is always valid to pass to memmove and memchr
+    std::vector<char> m_buffer;
+    size_t m_begin;
+    size_t m_end;
 };
 
 }
@@ -2,20 +2,66 @@
 
 #include "richard/math.hpp"
 #include "richard/config.hpp"
+#include "richard/data_details.hpp"
 #include <vector>
 #include <memory>
 
 namespace richard {
 
-struct Sample {
-  Sample(const std::string& label, const Array3& data)
-    : label(label)
-    , data(data) {}
+// A sample's values are held either as netfloat_ts, or as raw bytes, such as image pixels, along
+// with the normalization to apply to them. Bytes take a quarter of the memory, and are normalized
+// as they're copied into a network's inputs.
+//
+// Samples are move-only. A loader builds each sample's storage once and moves it into place, and
+// it's only read again when copied into a network's inputs. Bytes that already sit in memory, such
+// as a mapped file, needn't be copied at all: the sample can refer to them and share ownership of
+// whatever holds them.
+class Sample {
+  public:
+    Sample(uint32_t classId, Array3&& data);
+    Sample(uint32_t classId, const Size3& shape, std::vector<uint8_t>&& bytes,
+      const NormalizationParams& normalization);
+    Sample(uint32_t classId, const Size3& shape, const uint8_t* bytes,
+      std::shared_ptr<const void> owner, const NormalizationParams& normalization);
+
+    Sample(const Sample&) = delete;
+    Sample& operator=(const Sample&) = delete;
+    Sample(Sample&&) = default;
+    Sample& operator=(Sample&&) = default;
+
+    // Index into DataDetails::classLabels
+    uint32_t classId;
 
-  std::string label; // TODO: Replace with reference/pointer/id
-  Array3 data;
+    inline const Size3& shape() const;
+    inline size_t size() const;
+    inline bool isPacked() const;
+
+    // Writes the normalized values to R, which must have room for size() values
+    void copyTo(netfloat_t* R) const;
+    Array3 toArray3() const;
+
+  private:
+    Size3 m_shape;
+    Array3 m_data;
+    std::vector<uint8_t> m_bytes;
+    std::shared_ptr<const void> m_owner;
+    // Points into m_bytes or memory held by m_owner, or is null if the values are in m_data
+    const uint8_t* m_packed;
+    NormalizationParams m_normalization;
 };
 
+const Size3& Sample::shape() const {
+  return m_shape;
+}
+
+size_t Sample::size() const {
+  return m_shape[0] * m_shape[1] * m_shape[2];
+}
+
+bool Sample::isPacked() const {
+  return m_packed != nullptr;
+}
+
 class DataLoader {
   public:
     DataLoader(size_t fetchSize);
@@ -40,7 +86,6 @@ size_t DataLoader::fetchSize() const {
 }
 
 class FileSystem;
-class DataDetails;
 
 DataLoaderPtr createDataLoader(FileSystem& fileSystem, const Config& config,
   const std::string& samplesPath, const DataDetails& dataDetails);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "richard/mapped_file.hpp"
 #include <fstream>
 #include <memory>
 #include <filesystem>
@@ -14,6 +15,7 @@ class FileSystem {
 
     virtual std::string loadTextFile(const std::filesystem::path& path) = 0;
     virtual std::vector<uint8_t> loadBinaryFile(const std::filesystem::path& path) = 0;
+    virtual MappedFilePtr mapFileForReading(const std::filesystem::path& path) = 0;
 
     virtual ~FileSystem() {}
 };
@@ -29,7 +29,7 @@ class ConvolutionalLayer : public Layer {
     GpuBufferHandle inputDeltaBuffer() const override;
     void retrieveBuffers() override;
     Size3 outputSize() const override;
-    void evalForward() override;
+    void evalForward(uint32_t sampleIndex) override;
     void trainForward() override;
     void backprop() override;
     void updateParams() override;
@@ -64,6 +64,7 @@ class ConvolutionalLayer : public Layer {
     netfloat_t m_learnRate;
     netfloat_t m_learnRateDecay;
     netfloat_t m_dropoutRate;
+    Random m_random;
     bool m_isFirstLayer;
     Vector m_kernelData;
     Vector m_biasData;
@@ -29,7 +29,7 @@ class DenseLayer : public Layer {
     GpuBufferHandle inputDeltaBuffer() const override;
     void retrieveBuffers() override;
     Size3 outputSize() const override;
-    void evalForward() override;
+    void evalForward(uint32_t sampleIndex) override;
     void trainForward() override;
     void backprop() override;
     void updateParams() override;
@@ -59,6 +59,7 @@ class DenseLayer : public Layer {
     netfloat_t m_learnRate;
     netfloat_t m_learnRateDecay;
     netfloat_t m_dropoutRate;
+    Random m_random;
     size_t m_inputSize;
     bool m_isFirstLayer;
     size_t m_size;
@@ -20,7 +20,9 @@ class Layer {
     virtual GpuBufferHandle inputDeltaBuffer() const = 0;
     virtual void retrieveBuffers() = 0;
     virtual Size3 outputSize() const = 0;
-    virtual void evalForward() = 0;
+    // Evaluation runs a batch of samples in one submission. sampleIndex selects the sample's
+    // inputs in the first layer and its row of outputs in the output layer.
+    virtual void evalForward(uint32_t sampleIndex) = 0;
     virtual void trainForward() = 0;
     virtual void backprop() = 0;
     virtual void updateParams() = 0;
@@ -15,7 +15,7 @@ namespace gpu {
 class MaxPoolingLayer : public Layer {
   public:
     MaxPoolingLayer(Gpu& gpu, FileSystem& fileSystem, const PlatformPaths& platformPaths,
-      const Config& config, const Size3& inputShape);
+      const Config& config, const Size3& inputShape, bool isFirstLayer);
 
     void allocateGpuBuffers() override;
     void createGpuShaders(GpuBufferHandle inputBuffer, GpuBufferHandle statusBuffer,
@@ -27,7 +27,7 @@ class MaxPoolingLayer : public Layer {
     GpuBufferHandle inputDeltaBuffer() const override;
     void retrieveBuffers() override;
     Size3 outputSize() const override;
-    void evalForward() override;
+    void evalForward(uint32_t sampleIndex) override;
     void trainForward() override;
     void backprop() override;
     void updateParams() override;
@@ -39,7 +39,7 @@ class MaxPoolingLayer : public Layer {
 
   private:
     void createEvalForwardShader(GpuBufferHandle inputBuffer);
-    void createTrainForwardShader(GpuBufferHandle inputBuffer);
+    void createTrainForwardShader(GpuBufferHandle statusBuffer, GpuBufferHandle inputBuffer);
     void createBackpropShader(const Layer* nextLayer);
 
     Gpu& m_gpu;
@@ -50,6 +50,7 @@ class MaxPoolingLayer : public Layer {
     size_t m_inputW;
     size_t m_inputH;
     size_t m_inputDepth;
+    bool m_isFirstLayer;
     GpuBuffer m_bufferZ;
     GpuBuffer m_bufferMask;
     GpuBuffer m_bufferInputDelta;
@@ -14,10 +14,12 @@ namespace gpu {
 
 class OutputLayer : public Layer {
   public:
+    // evalBatchSize is the number of samples evaluated per submission, each of which gets a
+    // row of the evaluation outputs
     OutputLayer(Gpu& gpu, FileSystem& fileSystem, const PlatformPaths& platformPaths,
-      const Config& obj, size_t inputSize);
+      const Config& obj, size_t inputSize, size_t evalBatchSize = 1);
     OutputLayer(Gpu& gpu, FileSystem& fileSystem, const PlatformPaths& platformPaths,
-      const Config& obj, std::istream& stream, size_t inputSize);
+      const Config& obj, std::istream& stream, size_t inputSize, size_t evalBatchSize = 1);
 
     void allocateGpuBuffers() override;
     void createGpuShaders(GpuBufferHandle inputBuffer, GpuBufferHandle statusBuffer,
@@ -29,12 +31,14 @@ class OutputLayer : public Layer {
     GpuBufferHandle inputDeltaBuffer() const override;
     void retrieveBuffers() override;
     Size3 outputSize() const override;
-    void evalForward() override;
+    void evalForward(uint32_t sampleIndex) override;
     void trainForward() override;
     void backprop() override;
     void updateParams() override;
     void writeToStream(std::ostream& stream) const override;
     const Vector& activations() const;
+    // Copies the outputs of the last numSamples evaluations, one row per sample
+    void retrieveEvalOutputs(netfloat_t* outputs, size_t numSamples) const;
 
     // Exposed for testing
     //
@@ -46,7 +50,7 @@ class OutputLayer : public Layer {
     const Vector& test_B() const;
 
   private:
-    void initialize(const Config& obj, size_t inputSize);
+    void initialize(const Config& obj, size_t inputSize, size_t evalBatchSize);
     void createEvalForwardShader(GpuBufferHandle inputBuffer);
     void createTrainForwardShader(GpuBufferHandle inputBuffer);
     void createBackpropDeltaShader(GpuBufferHandle statusBuffer, GpuBufferHandle inputBuffer,
@@ -61,6 +65,7 @@ class OutputLayer : public Layer {
     netfloat_t m_learnRateDecay;
     size_t m_inputSize;
     size_t m_size;
+    size_t m_evalBatchSize;
     Vector m_B;
     Matrix m_W;
     mutable Vector m_A;
@@ -68,6 +73,7 @@ class OutputLayer : public Layer {
     GpuBuffer m_bufferW;
     GpuBuffer m_bufferZ;
     GpuBuffer m_bufferA;
+    GpuBuffer m_bufferEvalA;
     GpuBuffer m_bufferD;
     GpuBuffer m_bufferInputDelta;
     GpuBuffer m_bufferDeltaB;
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "richard/types.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace richard {
+
+// 16-bit floating point storage formats. They only hold values. Arithmetic is done after
+// converting to netfloat_t, so sums and products keep full precision.
+//
+// IEEE 754 half precision, with 5 exponent bits and 10 mantissa bits
+struct float16_t {
+  uint16_t bits;
+};
+
+// The upper half of a float, with 8 exponent bits and 7 mantissa bits
+struct bfloat16_t {
+  uint16_t bits;
+};
+
+static_assert(sizeof(float16_t) == 2 && sizeof(bfloat16_t) == 2);
+
+// Storage precision of a layer's weights
+enum class Precision {
+  float32,
+  float16,
+  bfloat16
+};
+
+// Accepts "float32", "float16" or "bfloat16"
+Precision parsePrecision(const std::string& name);
+
+// Conversions from netfloat_t round to nearest, ties to even
+//
+inline float16_t toFloat16(netfloat_t x) {
+  uint32_t u;
+  memcpy(&u, &x, sizeof(u));
+
+  uint16_t sign = static_cast<uint16_t>((u >> 16) & 0x8000);
+  u &= 0x7fffffff;
+
+  uint16_t h;
+  if (u >= 0x47800000) {
+    // Too large, infinite or NaN
+    h = u > 0x7f800000 ? 0x7e00 : 0x7c00;
+  }
+  else if (u < 0x38800000) {
+    // Subnormal or zero. Adding 0.5 lines the half's mantissa up with the bottom of the float's,
+    // and lets the FPU do the rounding.
+    netfloat_t f;
+    memcpy(&f, &u, sizeof(f));
+    f += 0.5f;
+    memcpy(&u, &f, sizeof(u));
+    h = static_cast<uint16_t>(u - 0x3f000000);
+  }
+  else {
+    uint32_t mantissaOdd = (u >> 13) & 1;
+    u += 0xc8000fff + mantissaOdd;
+    h = static_cast<uint16_t>(u >> 13);
+  }
+
+  return float16_t{ static_cast<uint16_t>(sign | h) };
+}
+
+inline netfloat_t toNetfloat(float16_t x) {
+  uint32_t u = static_cast<uint32_t>(x.bits & 0x7fff) << 13;
+  uint32_t exponent = u & 0x0f800000;
+  u += 0x38000000;
+
+  if (exponent == 0x0f800000) {
+    // Infinite or NaN
+    u += 0x38000000;
+  }
+  else if (exponent == 0) {
+    // Subnormal, so renormalise
+    u += 0x00800000;
+    netfloat_t f;
+    memcpy(&f, &u, sizeof(f));
+    f -= 6.103515625e-05f;
+    memcpy(&u, &f, sizeof(u));
+  }
+
+  u |= static_cast<uint32_t>(x.bits & 0x8000) << 16;
+
+  netfloat_t f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline bfloat16_t toBfloat16(netfloat_t x) {
+  uint32_t u;
+  memcpy(&u, &x, sizeof(u));
+
+  if ((u & 0x7fffffff) > 0x7f800000) {
+    // Keep NaNs quiet, rather than letting rounding carry into the exponent
+    return bfloat16_t{ static_cast<uint16_t>((u | 0x00400000) >> 16) };
+  }
+
+  u += 0x7fff + ((u >> 16) & 1);
+  return bfloat16_t{ static_cast<uint16_t>(u >> 16) };
+}
+
+inline netfloat_t toNetfloat(bfloat16_t x) {
+  uint32_t u = static_cast<uint32_t>(x.bits) << 16;
+
+  netfloat_t f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+template<typename S>
+S fromNetfloat(netfloat_t x);
+
+template<>
+inline float16_t fromNetfloat<float16_t>(netfloat_t x) {
+  return toFloat16(x);
+}
+
+template<>
+inline bfloat16_t fromNetfloat<bfloat16_t>(netfloat_t x) {
+  return toBfloat16(x);
+}
+
+}
@@ -16,11 +16,14 @@ class ImageDataLoader : public DataLoader {
 
   private:
     struct ClassCursor {
-      ClassCursor(const std::string& label, const std::filesystem::directory_iterator& i)
+      ClassCursor(const std::string& label, uint32_t classId,
+        const std::filesystem::directory_iterator& i)
         : label(label)
+        , classId(classId)
         , i(i) {}
 
       std::string label;
+      uint32_t classId;
       std::filesystem::directory_iterator i;
     };
 
@@ -3,7 +3,6 @@
 #include "richard/math.hpp"
 #include "richard/data_loader.hpp"
 #include "richard/types.hpp"
-#include <map>
 #include <string>
 #include <memory>
 
@@ -20,7 +19,7 @@ class LabelledDataSet {
     virtual void seekToBeginning();
 
     inline const std::vector<std::string>& labels() const;
-    inline const Vector& classOutputVector(const std::string& label) const;
+    inline ConstVectorView classOutputVector(uint32_t classId) const;
     inline size_t fetchSize() const;
 
     virtual ~LabelledDataSet() {}
@@ -28,15 +27,17 @@ class LabelledDataSet {
   private:
     DataLoaderPtr m_loader;
     std::vector<std::string> m_labels;
-    std::map<std::string, Vector> m_classOutputVectors;
+    // One-hot output vector of each class, one per row
+    Matrix m_classOutputVectors;
 };
 
 inline const std::vector<std::string>& LabelledDataSet::labels() const {
   return m_labels;
 }
 
-inline const Vector& LabelledDataSet::classOutputVector(const std::string& label) const {
-  return m_classOutputVectors.at(label);
+inline ConstVectorView LabelledDataSet::classOutputVector(uint32_t classId) const {
+  DBG_ASSERT(classId < m_labels.size());
+  return m_classOutputVectors.slice(classId);
 }
 
 inline size_t LabelledDataSet::fetchSize() const {
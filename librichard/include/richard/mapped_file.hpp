@@ -0,0 +1,25 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace richard {
+
+// Read-only access to the whole of a file's contents, which stay valid for the object's lifetime
+class MappedFile {
+  public:
+    virtual const uint8_t* data() const = 0;
+    virtual size_t size() const = 0;
+
+    virtual ~MappedFile() {}
+};
+
+using MappedFilePtr = std::unique_ptr<MappedFile>;
+
+// Memory maps the file. Pages are read in by the OS as they're touched and stay cached between
+// passes over the file.
+MappedFilePtr mapFile(const std::filesystem::path& path);
+
+}
@@ -2,22 +2,35 @@
 
 #include "richard/exception.hpp"
 #include "richard/types.hpp"
+#include "richard/simd.hpp"
+#include "richard/random.hpp"
+#include "richard/memory.hpp"
 #include <memory>
 #include <initializer_list>
 #include <stdexcept>
 #include <functional>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <iosfwd>
 
 namespace richard {
 
 class DataArray {
   public:
     DataArray();
-    explicit DataArray(size_t size);
+    // With zero = false, the contents are left uninitialised. Storage comes from the tensor
+    // pool (see memory.hpp), aligned to memory::ALIGNMENT.
+    explicit DataArray(size_t size, bool zero = true);
 
     DataArray(const DataArray& cpy);
     DataArray(DataArray&& mv);
     DataArray& operator=(const DataArray& cpy);
     DataArray& operator=(DataArray&& mv);
+    ~DataArray();
 
     inline netfloat_t* data();
     inline const netfloat_t* data() const;
@@ -32,16 +45,16 @@ class DataArray {
     friend std::ostream& operator<<(std::ostream& os, const DataArray& v);
 
   private:
-    std::unique_ptr<netfloat_t[]> m_data;
+    netfloat_t* m_data;
     size_t m_size;
 };
 
 netfloat_t* DataArray::data() {
-  return m_data.get();
+  return m_data;
 }
 
 const netfloat_t* DataArray::data() const {
-  return m_data.get();
+  return m_data;
 }
 
 size_t DataArray::size() const {
@@ -49,19 +62,347 @@ size_t DataArray::size() const {
 }
 
 netfloat_t& DataArray::operator[](size_t i) {
-  return m_data.get()[i];
+  return m_data[i];
 }
 
 const netfloat_t& DataArray::operator[](size_t i) const {
-  return m_data.get()[i];
+  return m_data[i];
 }
 
 class Vector;
-using VectorPtr = std::unique_ptr<Vector>;
-using ConstVectorPtr = std::unique_ptr<const Vector>;
+class Matrix;
+class Kernel;
+
+// Element-wise arithmetic between Vectors, Matrices and Kernels is lazy. The operators return
+// an expression tree, which is evaluated in a single pass, a block at a time, when it's
+// assigned to (or used to construct) an object, so no temporaries are allocated. Operands
+// that are temporaries themselves are moved into the tree.
+namespace expr {
+
+// Elements per block. Each interior node of the tree keeps its operands' blocks on the stack.
+const size_t BLOCK_SIZE = 256;
+
+template<typename T>
+struct IsTensor : std::false_type {};
+
+template<> struct IsTensor<Vector> : std::true_type {};
+template<> struct IsTensor<Matrix> : std::true_type {};
+template<> struct IsTensor<Kernel> : std::true_type {};
+
+class ExpressionBase {};
+
+template<typename Derived, typename T>
+class Expression : public ExpressionBase {
+  public:
+    using result_t = T;
+
+    inline const Derived& self() const;
+    inline size_t size() const;
+
+    // dst may alias any of the expression's operands
+    inline void evaluateInto(netfloat_t* dst) const;
+
+    // Calls fn(offset, values, n) for each block of the result
+    template<typename F>
+    inline void forEachBlock(F&& fn) const;
+
+    inline T eval() const;
+    inline netfloat_t sum() const;
+    inline netfloat_t squareMagnitude() const;
+    inline netfloat_t magnitude() const;
+};
+
+// Leaf referring to an object, which must outlive the expression
+template<typename T>
+class Ref : public Expression<Ref<T>, T> {
+  public:
+    explicit Ref(const T& x)
+      : m_x(x) {}
+
+    const T& shape() const {
+      return m_x;
+    }
+
+    const netfloat_t* evaluateBlock(size_t i, size_t, netfloat_t*) const {
+      return m_x.data() + i;
+    }
+
+  private:
+    const T& m_x;
+};
+
+// Leaf that owns a temporary
+template<typename T>
+class Owned : public Expression<Owned<T>, T> {
+  public:
+    explicit Owned(T&& x)
+      : m_x(std::move(x)) {}
+
+    const T& shape() const {
+      return m_x;
+    }
+
+    const netfloat_t* evaluateBlock(size_t i, size_t, netfloat_t*) const {
+      return m_x.data() + i;
+    }
+
+  private:
+    T m_x;
+};
+
+struct Add {
+  static void apply(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+    simd::kernels().add(A, B, R, n);
+  }
+};
+
+struct Subtract {
+  static void apply(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+    simd::kernels().subtract(A, B, R, n);
+  }
+};
+
+struct Divide {
+  static void apply(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      R[i] = A[i] / B[i];
+    }
+  }
+};
+
+struct AddScalar {
+  static void apply(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+    simd::kernels().addScalar(A, x, R, n);
+  }
+};
+
+struct MultiplyScalar {
+  static void apply(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+    simd::kernels().multiplyScalar(A, x, R, n);
+  }
+};
+
+struct DivideScalar {
+  static void apply(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+    simd::kernels().divideScalar(A, x, R, n);
+  }
+};
+
+template<typename Op, typename L, typename R>
+class Binary : public Expression<Binary<Op, L, R>, typename L::result_t> {
+  public:
+    static_assert(std::is_same_v<typename L::result_t, typename R::result_t>,
+      "Operands must be of the same type");
+
+    Binary(L lhs, R rhs)
+      : m_lhs(std::move(lhs))
+      , m_rhs(std::move(rhs)) {
+
+      DBG_ASSERT(m_lhs.size() == m_rhs.size());
+    }
+
+    const typename L::result_t& shape() const {
+      return m_lhs.shape();
+    }
+
+    // Each operand is evaluated into its own buffer, so that writing the result can't
+    // overwrite an operand that aliases the destination before it's been read
+    const netfloat_t* evaluateBlock(size_t i, size_t n, netfloat_t* buffer) const {
+      netfloat_t lhsBuffer[BLOCK_SIZE];
+      netfloat_t rhsBuffer[BLOCK_SIZE];
+
+      Op::apply(m_lhs.evaluateBlock(i, n, lhsBuffer), m_rhs.evaluateBlock(i, n, rhsBuffer),
+        buffer, n);
+
+      return buffer;
+    }
+
+  private:
+    L m_lhs;
+    R m_rhs;
+};
+
+template<typename Op, typename E>
+class Scalar : public Expression<Scalar<Op, E>, typename E::result_t> {
+  public:
+    Scalar(E e, netfloat_t x)
+      : m_e(std::move(e))
+      , m_x(x) {}
+
+    const typename E::result_t& shape() const {
+      return m_e.shape();
+    }
+
+    const netfloat_t* evaluateBlock(size_t i, size_t n, netfloat_t* buffer) const {
+      Op::apply(m_e.evaluateBlock(i, n, buffer), m_x, buffer, n);
+      return buffer;
+    }
+
+  private:
+    E m_e;
+    netfloat_t m_x;
+};
+
+template<typename X>
+constexpr bool isOperand() {
+  using D = std::decay_t<X>;
+  return IsTensor<D>::value || std::is_base_of_v<ExpressionBase, D>;
+}
+
+template<typename X, typename = void>
+struct ResultOf {
+  using type = std::decay_t<X>;
+};
+
+template<typename X>
+struct ResultOf<X, std::void_t<typename std::decay_t<X>::result_t>> {
+  using type = typename std::decay_t<X>::result_t;
+};
+
+template<typename A, typename B>
+using EnableIfOperands = std::enable_if_t<isOperand<A>() && isOperand<B>() &&
+  std::is_same_v<typename ResultOf<A>::type, typename ResultOf<B>::type>>;
+
+template<typename A>
+using EnableIfOperand = std::enable_if_t<isOperand<A>()>;
+
+template<typename X>
+auto toNode(X&& x) {
+  using D = std::decay_t<X>;
+
+  if constexpr (!IsTensor<D>::value) {
+    return D(std::forward<X>(x));
+  }
+  else if constexpr (std::is_lvalue_reference_v<X>) {
+    return Ref<D>(x);
+  }
+  else {
+    return Owned<D>(std::move(x));
+  }
+}
+
+template<typename Op, typename A, typename B>
+auto makeBinary(A&& a, B&& b) {
+  using L = decltype(toNode(std::forward<A>(a)));
+  using R = decltype(toNode(std::forward<B>(b)));
+  return Binary<Op, L, R>(toNode(std::forward<A>(a)), toNode(std::forward<B>(b)));
+}
+
+template<typename Op, typename A>
+auto makeScalar(A&& a, netfloat_t x) {
+  using E = decltype(toNode(std::forward<A>(a)));
+  return Scalar<Op, E>(toNode(std::forward<A>(a)), x);
+}
+
+}
+
+template<typename A, typename B, typename = expr::EnableIfOperands<A, B>>
+auto operator+(A&& a, B&& b) {
+  return expr::makeBinary<expr::Add>(std::forward<A>(a), std::forward<B>(b));
+}
+
+template<typename A, typename B, typename = expr::EnableIfOperands<A, B>>
+auto operator-(A&& a, B&& b) {
+  return expr::makeBinary<expr::Subtract>(std::forward<A>(a), std::forward<B>(b));
+}
+
+// Element-wise
+template<typename A, typename B, typename = expr::EnableIfOperands<A, B>>
+auto operator/(A&& a, B&& b) {
+  return expr::makeBinary<expr::Divide>(std::forward<A>(a), std::forward<B>(b));
+}
+
+template<typename A, typename = expr::EnableIfOperand<A>>
+auto operator+(A&& a, netfloat_t x) {
+  return expr::makeScalar<expr::AddScalar>(std::forward<A>(a), x);
+}
+
+template<typename A, typename = expr::EnableIfOperand<A>>
+auto operator-(A&& a, netfloat_t x) {
+  return expr::makeScalar<expr::AddScalar>(std::forward<A>(a), -x);
+}
+
+template<typename A, typename = expr::EnableIfOperand<A>>
+auto operator*(A&& a, netfloat_t x) {
+  return expr::makeScalar<expr::MultiplyScalar>(std::forward<A>(a), x);
+}
+
+template<typename A, typename = expr::EnableIfOperand<A>>
+auto operator/(A&& a, netfloat_t x) {
+  return expr::makeScalar<expr::DivideScalar>(std::forward<A>(a), x);
+}
+
+// A non-owning Vector, Matrix or Kernel over existing storage, returned by value from
+// createShallow, slice and subvector, so wrapping a pointer costs no allocation. It
+// dereferences like a pointer to the tensor it wraps and converts to a reference to it, so
+// views can be passed straight to the math routines.
+//
+// Views can only be initialised from the functions that create them. Copying one would copy
+// the wrapped tensor, and with it the data.
+template<typename T>
+class View {
+  public:
+    View(const View&) = delete;
+    View& operator=(const View&) = delete;
+
+    // A view of mutable data is also a view of const data
+    template<typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+    View(View<U>&& view)
+      : m_tensor(view.m_tensor.alias()) {}
+
+    inline T& operator*() const {
+      return m_tensor;
+    }
+
+    inline T* operator->() const {
+      return &m_tensor;
+    }
+
+    inline operator T&() const {
+      return m_tensor;
+    }
+
+  private:
+    template<typename> friend class View;
+    friend class Vector;
+    friend class Matrix;
+    friend class Kernel;
+
+    template<typename... Args>
+    explicit View(Args&&... args)
+      : m_tensor(std::forward<Args>(args)...) {}
+
+    mutable std::remove_const_t<T> m_tensor;
+};
+
+using VectorView = View<Vector>;
+using ConstVectorView = View<const Vector>;
 using Array = Vector;
-using ArrayPtr = VectorPtr;
-using ConstArrayPtr = ConstVectorPtr;
+using ArrayView = VectorView;
+using ConstArrayView = ConstVectorView;
+
+// Functions passed to computeTransform and transformInPlace are resolved at compile time. If
+// one also provides a static apply(const netfloat_t* X, netfloat_t* R, size_t n) that processes
+// a whole array at once (e.g. with the SIMD kernels), that's used instead of calling it per
+// element.
+template<typename F, typename = void>
+struct HasArrayApply : std::false_type {};
+
+template<typename F>
+struct HasArrayApply<F, std::void_t<decltype(F::apply(std::declval<const netfloat_t*>(),
+  std::declval<netfloat_t*>(), size_t(0)))>> : std::true_type {};
+
+template<typename F>
+void transformArray(F& f, const netfloat_t* X, netfloat_t* R, size_t n) {
+  if constexpr (HasArrayApply<std::decay_t<F>>::value) {
+    std::decay_t<F>::apply(X, R, n);
+  }
+  else {
+    for (size_t i = 0; i < n; ++i) {
+      R[i] = f(X[i]);
+    }
+  }
+}
 
 class Vector {
   public:
@@ -72,6 +413,8 @@ class Vector {
     Vector(DataArray&& data);
     Vector(const Vector& cpy);
     Vector(Vector&& mv);
+    template<typename E>
+    Vector(const expr::Expression<E, Vector>& e);
 
     inline bool isShallow() const;
     inline const DataArray& storage() const;
@@ -82,6 +425,8 @@ class Vector {
 
     Vector& operator=(const Vector& rhs);
     Vector& operator=(Vector&& rhs);
+    template<typename E>
+    Vector& operator=(const expr::Expression<E, Vector>& e);
 
     inline netfloat_t& operator[](size_t i);
     inline const netfloat_t& operator[](size_t i) const;
@@ -93,7 +438,7 @@ class Vector {
 
     void zero();
     void normalize();
-    Vector& randomize(netfloat_t standardDeviation);
+    Vector& randomize(netfloat_t standardDeviation, Random& random = defaultRandom());
     void fill(netfloat_t x);
 
     netfloat_t sum() const;
@@ -101,47 +446,55 @@ class Vector {
     netfloat_t squareMagnitude() const;
     netfloat_t dot(const Vector& rhs) const;
 
-    Vector operator+(const Vector& rhs) const;
-    Vector operator-(const Vector& rhs) const;
     Vector hadamard(const Vector& rhs) const;
-    Vector operator/(const Vector& rhs) const;
-
-    Vector operator+(netfloat_t x) const;
-    Vector operator-(netfloat_t x) const;
-    Vector operator*(netfloat_t x) const;
-    Vector operator/(netfloat_t x) const;
 
     Vector& operator+=(const Vector& rhs);
     Vector& operator-=(const Vector& rhs);
 
+    template<typename E>
+    Vector& operator+=(const expr::Expression<E, Vector>& e);
+    template<typename E>
+    Vector& operator-=(const expr::Expression<E, Vector>& e);
+
     Vector& operator+=(netfloat_t x);
     Vector& operator-=(netfloat_t x);
     Vector& operator*=(netfloat_t x);
     Vector& operator/=(netfloat_t x);
 
-    Vector computeTransform(const std::function<netfloat_t(netfloat_t)>& f) const;
-    void transformInPlace(const std::function<netfloat_t(netfloat_t)>& f);
+    template<typename F>
+    Vector computeTransform(F f) const;
+    template<typename F>
+    void transformInPlace(F f);
 
     // Returns shallow Vector
-    inline VectorPtr subvector(size_t from, size_t size);
-    inline ConstVectorPtr subvector(size_t from, size_t size) const;
+    inline VectorView subvector(size_t from, size_t size);
+    inline ConstVectorView subvector(size_t from, size_t size) const;
 
-    static VectorPtr createShallow(DataArray& data);
-    static ConstVectorPtr createShallow(const DataArray& data);
-    static VectorPtr createShallow(netfloat_t* data, size_t size);
-    static ConstVectorPtr createShallow(const netfloat_t* data, size_t size);
+    static VectorView createShallow(DataArray& data);
+    static ConstVectorView createShallow(const DataArray& data);
+    static VectorView createShallow(netfloat_t* data, size_t size);
+    static ConstVectorView createShallow(const netfloat_t* data, size_t size);
 
     friend std::ostream& operator<<(std::ostream& os, const Vector& v);
 
   private:
+    template<typename> friend class View;
+
     // Creates a shallow Vector
     Vector(netfloat_t* data, size_t size);
 
+    // Returns a shallow Vector over the same data
+    inline Vector alias() const;
+
     DataArray m_storage;
     netfloat_t* m_data;
     size_t m_size;
 };
 
+Vector Vector::alias() const {
+  return Vector(m_data, m_size);
+}
+
 bool Vector::isShallow() const {
   return m_storage.size() == 0 && m_data != nullptr;
 }
@@ -180,20 +533,20 @@ bool Vector::operator!=(const Vector& rhs) const {
   return !(*this == rhs);
 }
 
-VectorPtr Vector::subvector(size_t from, size_t size) {
-  return VectorPtr(new Vector(m_data + from, size));
+VectorView Vector::subvector(size_t from, size_t size) {
+  return VectorView(m_data + from, size);
 }
 
-ConstVectorPtr Vector::subvector(size_t from, size_t size) const {
-  return ConstVectorPtr(new Vector(m_data + from, size));
+ConstVectorView Vector::subvector(size_t from, size_t size) const {
+  return ConstVectorView(m_data + from, size);
 }
 
 class Matrix;
-using MatrixPtr = std::unique_ptr<Matrix>;
-using ConstMatrixPtr = std::unique_ptr<const Matrix>;
+using MatrixView = View<Matrix>;
+using ConstMatrixView = View<const Matrix>;
 using Array2 = Matrix;
-using Array2Ptr = MatrixPtr;
-using ConstArray2Ptr = ConstMatrixPtr;
+using Array2View = MatrixView;
+using ConstArray2View = ConstMatrixView;
 
 class Matrix {
   public:
@@ -204,6 +557,8 @@ class Matrix {
     Matrix(DataArray&& data, size_t cols, size_t rows);
     Matrix(const Matrix& cpy);
     Matrix(Matrix&& mv);
+    template<typename E>
+    Matrix(const expr::Expression<E, Matrix>& e);
 
     inline bool isShallow() const;
     inline const DataArray& storage() const;
@@ -224,17 +579,11 @@ class Matrix {
 
     Matrix& operator=(const Matrix& rhs);
     Matrix& operator=(Matrix&& rhs);
+    template<typename E>
+    Matrix& operator=(const expr::Expression<E, Matrix>& e);
 
     Vector operator*(const Vector& rhs) const;
 
-    Matrix operator+(const Matrix& rhs) const;
-    Matrix operator-(const Matrix& rhs) const;
-
-    Matrix operator+(netfloat_t x) const;
-    Matrix operator-(netfloat_t x) const;
-    Matrix operator*(netfloat_t x) const;
-    Matrix operator/(netfloat_t x) const;
-
     Matrix& operator+=(netfloat_t x);
     Matrix& operator-=(netfloat_t x);
     Matrix& operator*=(netfloat_t x);
@@ -242,6 +591,10 @@ class Matrix {
 
     Matrix& operator+=(const Matrix& rhs);
     Matrix& operator-=(const Matrix& rhs);
+    template<typename E>
+    Matrix& operator+=(const expr::Expression<E, Matrix>& e);
+    template<typename E>
+    Matrix& operator-=(const expr::Expression<E, Matrix>& e);
 
     Matrix hadamard(const Matrix& rhs) const;
 
@@ -249,38 +602,49 @@ class Matrix {
 
     void zero();
     void fill(netfloat_t x);
-    Matrix& randomize(netfloat_t standardDeviation);
+    Matrix& randomize(netfloat_t standardDeviation, Random& random = defaultRandom());
 
     netfloat_t sum() const;
     Matrix transpose() const;
 
-    Matrix computeTransform(const std::function<netfloat_t(netfloat_t)>& f) const;
-    void transformInPlace(const std::function<netfloat_t(netfloat_t)>& f);
+    template<typename F>
+    Matrix computeTransform(F f) const;
+    template<typename F>
+    void transformInPlace(F f);
 
     // Returns shallow Vector
-    inline VectorPtr slice(size_t row);
-    inline ConstVectorPtr slice(size_t row) const;
+    inline VectorView slice(size_t row);
+    inline ConstVectorView slice(size_t row) const;
 
     bool operator==(const Matrix& rhs) const;
     inline bool operator!=(const Matrix& rhs) const;
 
-    static MatrixPtr createShallow(DataArray& data, size_t cols, size_t rows);
-    static ConstMatrixPtr createShallow(const DataArray& data, size_t cols, size_t rows);
-    static MatrixPtr createShallow(netfloat_t* data, size_t cols, size_t rows);
-    static ConstMatrixPtr createShallow(const netfloat_t* data, size_t cols, size_t rows);
+    static MatrixView createShallow(DataArray& data, size_t cols, size_t rows);
+    static ConstMatrixView createShallow(const DataArray& data, size_t cols, size_t rows);
+    static MatrixView createShallow(netfloat_t* data, size_t cols, size_t rows);
+    static ConstMatrixView createShallow(const netfloat_t* data, size_t cols, size_t rows);
 
     friend std::ostream& operator<<(std::ostream& os, const Matrix& m);
 
   private:
+    template<typename> friend class View;
+
     // Creates a shallow Matrix
     Matrix(netfloat_t* data, size_t cols, size_t rows);
 
+    // Returns a shallow Matrix over the same data
+    inline Matrix alias() const;
+
     DataArray m_storage;
     netfloat_t* m_data;
     size_t m_rows;
     size_t m_cols;
 };
 
+Matrix Matrix::alias() const {
+  return Matrix(m_data, m_cols, m_rows);
+}
+
 bool Matrix::isShallow() const {
   return m_storage.size() == 0 && m_data != nullptr;
 }
@@ -331,12 +695,12 @@ size_t Matrix::H() const {
   return m_rows;
 }
 
-VectorPtr Matrix::slice(size_t row) {
+VectorView Matrix::slice(size_t row) {
   return Vector::createShallow(m_data + row * m_cols, m_cols);
 }
 
-ConstVectorPtr Matrix::slice(size_t row) const {
-  return Vector::createShallow(m_data + row * m_cols, m_cols);
+ConstVectorView Matrix::slice(size_t row) const {
+  return ConstVectorView(m_data + row * m_cols, m_cols);
 }
 
 bool Matrix::operator!=(const Matrix& rhs) const {
@@ -344,11 +708,11 @@ bool Matrix::operator!=(const Matrix& rhs) const {
 }
 
 class Kernel;
-using KernelPtr = std::unique_ptr<Kernel>;
-using ConstKernelPtr = std::unique_ptr<const Kernel>;
+using KernelView = View<Kernel>;
+using ConstKernelView = View<const Kernel>;
 using Array3 = Kernel;
-using Array3Ptr = KernelPtr;
-using ConstArray3Ptr = ConstKernelPtr;
+using Array3View = KernelView;
+using ConstArray3View = ConstKernelView;
 
 class Kernel {
   public:
@@ -365,6 +729,8 @@ class Kernel {
     Kernel(DataArray&& data, const Size3& shape);
     Kernel(const Kernel& cpy);
     Kernel(Kernel&& mv);
+    template<typename E>
+    Kernel(const expr::Expression<E, Kernel>& e);
 
     inline void setData(DataArray&& data);
 
@@ -387,21 +753,15 @@ class Kernel {
 
     Kernel& operator=(const Kernel& rhs);
     Kernel& operator=(Kernel&& rhs);
+    template<typename E>
+    Kernel& operator=(const expr::Expression<E, Kernel>& e);
 
     void zero();
     void fill(netfloat_t x);
-    Kernel& randomize(netfloat_t standardDeviation);
+    Kernel& randomize(netfloat_t standardDeviation, Random& random = defaultRandom());
 
     Kernel hadamard(const Kernel& rhs) const;
 
-    Kernel operator+(const Kernel& rhs) const;
-    Kernel operator-(const Kernel& rhs) const;
-
-    Kernel operator+(netfloat_t x) const;
-    Kernel operator-(netfloat_t x) const;
-    Kernel operator*(netfloat_t x) const;
-    Kernel operator/(netfloat_t x) const;
-
     Kernel& operator+=(netfloat_t x);
     Kernel& operator-=(netfloat_t x);
     Kernel& operator*=(netfloat_t x);
@@ -409,31 +769,42 @@ class Kernel {
 
     Kernel& operator+=(const Kernel& rhs);
     Kernel& operator-=(const Kernel& rhs);
+    template<typename E>
+    Kernel& operator+=(const expr::Expression<E, Kernel>& e);
+    template<typename E>
+    Kernel& operator-=(const expr::Expression<E, Kernel>& e);
 
-    Kernel computeTransform(const std::function<netfloat_t(netfloat_t)>& f) const;
-    void transformInPlace(const std::function<netfloat_t(netfloat_t)>& f);
+    template<typename F>
+    Kernel computeTransform(F f) const;
+    template<typename F>
+    void transformInPlace(F f);
 
-    inline MatrixPtr slice(size_t z);
-    inline ConstMatrixPtr slice(size_t z) const;
+    inline MatrixView slice(size_t z);
+    inline ConstMatrixView slice(size_t z) const;
 
     bool operator==(const Kernel& rhs) const;
     inline bool operator!=(const Kernel& rhs) const;
 
-    static KernelPtr createShallow(DataArray& data, size_t W, size_t H, size_t D);
-    inline static KernelPtr createShallow(DataArray& data, const Size3& shape);
-    static ConstKernelPtr createShallow(const DataArray& data, size_t W, size_t H, size_t D);
-    inline static ConstKernelPtr createShallow(const DataArray& data, const Size3& shape);
-    static KernelPtr createShallow(netfloat_t* data, size_t W, size_t H, size_t D);
-    inline static KernelPtr createShallow(netfloat_t* data, const Size3& shape);
-    static ConstKernelPtr createShallow(const netfloat_t* data, size_t W, size_t H, size_t D);
-    inline static ConstKernelPtr createShallow(const netfloat_t* data, const Size3& shape);
+    static KernelView createShallow(DataArray& data, size_t W, size_t H, size_t D);
+    inline static KernelView createShallow(DataArray& data, const Size3& shape);
+    static ConstKernelView createShallow(const DataArray& data, size_t W, size_t H, size_t D);
+    inline static ConstKernelView createShallow(const DataArray& data, const Size3& shape);
+    static KernelView createShallow(netfloat_t* data, size_t W, size_t H, size_t D);
+    inline static KernelView createShallow(netfloat_t* data, const Size3& shape);
+    static ConstKernelView createShallow(const netfloat_t* data, size_t W, size_t H, size_t D);
+    inline static ConstKernelView createShallow(const netfloat_t* data, const Size3& shape);
 
     friend std::ostream& operator<<(std::ostream& os, const Kernel& k);
 
   private:
+    template<typename> friend class View;
+
     // Creates a shallow Kernel
     Kernel(netfloat_t* data, size_t W, size_t H, size_t D);
 
+    // Returns a shallow Kernel over the same data
+    inline Kernel alias() const;
+
     DataArray m_storage;
     netfloat_t* m_data;
     size_t m_D;
@@ -441,19 +812,19 @@ class Kernel {
     size_t m_W;
 };
 
-KernelPtr Kernel::createShallow(DataArray& data, const Size3& shape) {
+KernelView Kernel::createShallow(DataArray& data, const Size3& shape) {
   return Kernel::createShallow(data, shape[0], shape[1], shape[2]);
 }
 
-ConstKernelPtr Kernel::createShallow(const DataArray& data, const Size3& shape) {
+ConstKernelView Kernel::createShallow(const DataArray& data, const Size3& shape) {
   return Kernel::createShallow(data, shape[0], shape[1], shape[2]);
 }
 
-KernelPtr Kernel::createShallow(netfloat_t* data, const Size3& shape) {
+KernelView Kernel::createShallow(netfloat_t* data, const Size3& shape) {
   return Kernel::createShallow(data, shape[0], shape[1], shape[2]);
 }
 
-ConstKernelPtr Kernel::createShallow(const netfloat_t* data, const Size3& shape) {
+ConstKernelView Kernel::createShallow(const netfloat_t* data, const Size3& shape) {
   return Kernel::createShallow(data, shape[0], shape[1], shape[2]);
 }
 
@@ -464,6 +835,10 @@ inline void Kernel::setData(DataArray&& data) {
   m_data = m_storage.data();
 }
 
+Kernel Kernel::alias() const {
+  return Kernel(m_data, m_W, m_H, m_D);
+}
+
 bool Kernel::isShallow() const {
   return m_storage.size() == 0 && m_data != nullptr;
 }
@@ -514,18 +889,283 @@ size_t Kernel::D() const {
   return m_D;
 }
 
-MatrixPtr Kernel::slice(size_t z) {
+MatrixView Kernel::slice(size_t z) {
   return Matrix::createShallow(m_data + z * m_W * m_H, m_W, m_H);
 }
 
-ConstMatrixPtr Kernel::slice(size_t z) const {
-  return Matrix::createShallow(m_data + z * m_W * m_H, m_W, m_H);
+ConstMatrixView Kernel::slice(size_t z) const {
+  return ConstMatrixView(m_data + z * m_W * m_H, m_W, m_H);
 }
 
 bool Kernel::operator!=(const Kernel& rhs) const {
   return !(*this == rhs);
 }
 
+namespace expr {
+
+template<typename Derived, typename T>
+const Derived& Expression<Derived, T>::self() const {
+  return static_cast<const Derived&>(*this);
+}
+
+template<typename Derived, typename T>
+size_t Expression<Derived, T>::size() const {
+  return self().shape().size();
+}
+
+template<typename Derived, typename T>
+void Expression<Derived, T>::evaluateInto(netfloat_t* dst) const {
+  const size_t n = size();
+
+  for (size_t i = 0; i < n; i += BLOCK_SIZE) {
+    size_t blockSize = std::min(BLOCK_SIZE, n - i);
+
+    const netfloat_t* values = self().evaluateBlock(i, blockSize, dst + i);
+    if (values != dst + i) {
+      memcpy(dst + i, values, blockSize * sizeof(netfloat_t));
+    }
+  }
+}
+
+template<typename Derived, typename T>
+template<typename F>
+void Expression<Derived, T>::forEachBlock(F&& fn) const {
+  const size_t n = size();
+  netfloat_t buffer[BLOCK_SIZE];
+
+  for (size_t i = 0; i < n; i += BLOCK_SIZE) {
+    size_t blockSize = std::min(BLOCK_SIZE, n - i);
+    fn(i, self().evaluateBlock(i, blockSize, buffer), blockSize);
+  }
+}
+
+template<typename Derived, typename T>
+T Expression<Derived, T>::eval() const {
+  return T(*this);
+}
+
+template<typename Derived, typename T>
+netfloat_t Expression<Derived, T>::sum() const {
+  netfloat_t total = 0;
+  forEachBlock([&](size_t, const netfloat_t* values, size_t n) {
+    total += simd::kernels().sum(values, n);
+  });
+  return total;
+}
+
+template<typename Derived, typename T>
+netfloat_t Expression<Derived, T>::squareMagnitude() const {
+  netfloat_t total = 0;
+  forEachBlock([&](size_t, const netfloat_t* values, size_t n) {
+    total += simd::kernels().dot(values, values, n);
+  });
+  return total;
+}
+
+template<typename Derived, typename T>
+netfloat_t Expression<Derived, T>::magnitude() const {
+  return sqrt(squareMagnitude());
+}
+
+template<typename E>
+void addInto(const E& e, netfloat_t* dst) {
+  e.forEachBlock([&](size_t i, const netfloat_t* values, size_t n) {
+    simd::kernels().add(dst + i, values, dst + i, n);
+  });
+}
+
+template<typename E>
+void subtractFrom(const E& e, netfloat_t* dst) {
+  e.forEachBlock([&](size_t i, const netfloat_t* values, size_t n) {
+    simd::kernels().subtract(dst + i, values, dst + i, n);
+  });
+}
+
+}
+
+template<typename E>
+Vector::Vector(const expr::Expression<E, Vector>& e)
+  : Vector(DataArray(e.size(), false)) {
+
+  e.evaluateInto(m_data);
+}
+
+template<typename E>
+Vector& Vector::operator=(const expr::Expression<E, Vector>& e) {
+  if (e.size() == m_size) {
+    e.evaluateInto(m_data);
+  }
+  else {
+    DBG_ASSERT(!isShallow());
+    *this = Vector(e);
+  }
+
+  return *this;
+}
+
+template<typename E>
+Vector& Vector::operator+=(const expr::Expression<E, Vector>& e) {
+  DBG_ASSERT(e.size() == m_size);
+
+  expr::addInto(e, m_data);
+  return *this;
+}
+
+template<typename E>
+Vector& Vector::operator-=(const expr::Expression<E, Vector>& e) {
+  DBG_ASSERT(e.size() == m_size);
+
+  expr::subtractFrom(e, m_data);
+  return *this;
+}
+
+template<typename E>
+Matrix::Matrix(const expr::Expression<E, Matrix>& e)
+  : Matrix(DataArray(e.size(), false), e.self().shape().cols(), e.self().shape().rows()) {
+
+  e.evaluateInto(m_data);
+}
+
+template<typename E>
+Matrix& Matrix::operator=(const expr::Expression<E, Matrix>& e) {
+  const Matrix& shape = e.self().shape();
+
+  if (e.size() == size()) {
+    DBG_ASSERT(!isShallow() || (shape.cols() == m_cols && shape.rows() == m_rows));
+
+    e.evaluateInto(m_data);
+    m_cols = shape.cols();
+    m_rows = shape.rows();
+  }
+  else {
+    DBG_ASSERT(!isShallow());
+    *this = Matrix(e);
+  }
+
+  return *this;
+}
+
+template<typename E>
+Matrix& Matrix::operator+=(const expr::Expression<E, Matrix>& e) {
+  DBG_ASSERT(e.size() == size());
+
+  expr::addInto(e, m_data);
+  return *this;
+}
+
+template<typename E>
+Matrix& Matrix::operator-=(const expr::Expression<E, Matrix>& e) {
+  DBG_ASSERT(e.size() == size());
+
+  expr::subtractFrom(e, m_data);
+  return *this;
+}
+
+template<typename E>
+Kernel::Kernel(const expr::Expression<E, Kernel>& e)
+  : Kernel(DataArray(e.size(), false), e.self().shape().W(), e.self().shape().H(),
+    e.self().shape().D()) {
+
+  e.evaluateInto(m_data);
+}
+
+template<typename E>
+Kernel& Kernel::operator=(const expr::Expression<E, Kernel>& e) {
+  const Kernel& shape = e.self().shape();
+
+  if (e.size() == size()) {
+    DBG_ASSERT(!isShallow() || shape.shape() == this->shape());
+
+    e.evaluateInto(m_data);
+    m_W = shape.W();
+    m_H = shape.H();
+    m_D = shape.D();
+  }
+  else {
+    DBG_ASSERT(!isShallow());
+    *this = Kernel(e);
+  }
+
+  return *this;
+}
+
+template<typename E>
+Kernel& Kernel::operator+=(const expr::Expression<E, Kernel>& e) {
+  DBG_ASSERT(e.size() == size());
+
+  expr::addInto(e, m_data);
+  return *this;
+}
+
+template<typename E>
+Kernel& Kernel::operator-=(const expr::Expression<E, Kernel>& e) {
+  DBG_ASSERT(e.size() == size());
+
+  expr::subtractFrom(e, m_data);
+  return *this;
+}
+
+template<typename F>
+Vector Vector::computeTransform(F f) const {
+  Vector v(DataArray(m_size, false));
+  transformArray(f, m_data, v.m_data, m_size);
+  return v;
+}
+
+template<typename F>
+void Vector::transformInPlace(F f) {
+  transformArray(f, m_data, m_data, m_size);
+}
+
+template<typename F>
+Matrix Matrix::computeTransform(F f) const {
+  Matrix m(DataArray(size(), false), m_cols, m_rows);
+  transformArray(f, m_data, m.m_data, size());
+  return m;
+}
+
+template<typename F>
+void Matrix::transformInPlace(F f) {
+  transformArray(f, m_data, m_data, size());
+}
+
+template<typename F>
+Kernel Kernel::computeTransform(F f) const {
+  Kernel K(DataArray(size(), false), m_W, m_H, m_D);
+  transformArray(f, m_data, K.m_data, size());
+  return K;
+}
+
+template<typename F>
+void Kernel::transformInPlace(F f) {
+  transformArray(f, m_data, m_data, size());
+}
+
+template<typename E, typename T>
+bool operator==(const expr::Expression<E, T>& lhs, const T& rhs) {
+  return T(lhs) == rhs;
+}
+
+template<typename E, typename T>
+bool operator==(const T& lhs, const expr::Expression<E, T>& rhs) {
+  return lhs == T(rhs);
+}
+
+template<typename E, typename T>
+bool operator!=(const expr::Expression<E, T>& lhs, const T& rhs) {
+  return !(lhs == rhs);
+}
+
+template<typename E, typename T>
+bool operator!=(const T& lhs, const expr::Expression<E, T>& rhs) {
+  return !(lhs == rhs);
+}
+
+template<typename E, typename T>
+std::ostream& operator<<(std::ostream& os, const expr::Expression<E, T>& e) {
+  return os << T(e);
+}
+
 void computeCrossCorrelation(const Array3& image, const Kernel& kernel, Array2& result,
   bool flipKernel = false);
 
@@ -543,16 +1183,16 @@ inline void computeFullConvolution(const Array3& image, const Kernel& kernel, Ar
 inline void computeCrossCorrelation(const Array2& image, const Matrix& kernel, Array2& result,
   bool flipKernel = false) {
 
-  ConstArray3Ptr pImage = Array3::createShallow(image.data(), image.W(), image.H(), 1);
-  ConstArray3Ptr pKernel = Array3::createShallow(kernel.data(), kernel.W(), kernel.H(), 1);
+  ConstArray3View pImage = Array3::createShallow(image.data(), image.W(), image.H(), 1);
+  ConstArray3View pKernel = Array3::createShallow(kernel.data(), kernel.W(), kernel.H(), 1);
   computeCrossCorrelation(*pImage, *pKernel, result, flipKernel);
 }
 
 inline void computeFullCrossCorrelation(const Array2& image, const Matrix& kernel, Array2& result,
   bool flipKernel = false) {
 
-  ConstArray3Ptr pImage = Array3::createShallow(image.data(), image.W(), image.H(), 1);
-  ConstArray3Ptr pKernel = Array3::createShallow(kernel.data(), kernel.W(), kernel.H(), 1);
+  ConstArray3View pImage = Array3::createShallow(image.data(), image.W(), image.H(), 1);
+  ConstArray3View pKernel = Array3::createShallow(kernel.data(), kernel.W(), kernel.H(), 1);
   computeFullCrossCorrelation(*pImage, *pKernel, result, flipKernel);
 }
 
@@ -564,6 +1204,247 @@ inline void computeFullConvolution(const Array2& image, const Matrix& kernel, Ar
   computeFullCrossCorrelation(image, kernel, result, true);
 }
 
+// Lowers image for a valid cross-correlation with kW x kH x image.D() kernels. Row
+// (z * kH + j) * kW + i of result holds, for each output position in turn, the image element
+// that kernel element (i, j, z) is multiplied by. The cross-correlation with a stack of kernels,
+// one per row of a matrix, is then a single matrix product.
+void im2col(const Array3& image, size_t kW, size_t kH, Matrix& result);
+
+// The adjoint of im2col. Each element of cols is added to the image element it was taken from.
+void col2im(const Matrix& cols, size_t kW, size_t kH, Array3& image);
+
+// Lowers a batch of images of the given shape, one per row of images, side by side, so that
+// columns [b * n, (b + 1) * n) of result are im2col of image b, where n is the number of output
+// positions. A stack of kernels is then correlated with the whole batch in a single product.
+void im2col(const Matrix& images, const Size3& shape, size_t kW, size_t kH, Matrix& result);
+
+// The adjoint of the batched im2col.
+void col2im(const Matrix& cols, size_t kW, size_t kH, const Size3& shape, Matrix& images);
+
+// Valid cross-correlation of image with a stack of 3 x 3 x image.D() kernels, one per row of
+// kernels in Kernel layout, using the Winograd F(2x2, 3x3) transform. Row k of result holds
+// the feature map for kernel k. Equivalent to the im2col product to within rounding.
+void computeWinogradCrossCorrelation(const Array3& image, const Matrix& kernels, Matrix& result);
+
+// Frequency-domain equivalents of computeCrossCorrelation and computeFullCrossCorrelation.
+// These avoid the kW * kH cost per output element, so are faster for large kernels.
+void computeFftCrossCorrelation(const Array3& image, const Kernel& kernel, Array2& result,
+  bool flipKernel = false);
+
+void computeFftFullCrossCorrelation(const Array3& image, const Kernel& kernel, Array2& result,
+  bool flipKernel = false);
+
+// As above, for a stack of kW x kH x image.D() kernels, one per row of kernels in Kernel
+// layout. Row k of result holds the feature map for kernel k. The image is transformed once
+// and shared between all the kernels.
+void computeFftCrossCorrelation(const Array3& image, const Matrix& kernels, size_t kW,
+  size_t kH, Matrix& result, bool flipKernel = false);
+
+void computeFftFullCrossCorrelation(const Array3& image, const Matrix& kernels, size_t kW,
+  size_t kH, Matrix& result, bool flipKernel = false);
+
+// Cost model for choosing between the FFT functions and a direct (im2col) correlation of an
+// imW x imH x imD image with numKernels kW x kH kernels
+bool fftCorrelationIsCheaper(size_t imW, size_t imH, size_t imD, size_t kW, size_t kH,
+  size_t numKernels, bool full);
+
 Matrix outerProduct(const Vector& A, const Vector& B);
 
+// Cache-blocked matrix products that write into a preallocated result. With accumulate set,
+// the product is added to the existing contents of result, which mustn't alias the inputs.
+//
+void outerProduct(const Vector& A, const Vector& B, Matrix& result, bool accumulate = false);
+
+// result = Ax
+void multiply(const Matrix& A, const Vector& x, Vector& result, bool accumulate = false);
+
+// result = A^T x
+void transposeMultiply(const Matrix& A, const Vector& x, Vector& result, bool accumulate = false);
+
+// result = AB
+void multiply(const Matrix& A, const Matrix& B, Matrix& result, bool accumulate = false);
+
+// result = A^T B
+void transposeMultiply(const Matrix& A, const Matrix& B, Matrix& result, bool accumulate = false);
+
+// result = AB^T
+void multiplyTranspose(const Matrix& A, const Matrix& B, Matrix& result, bool accumulate = false);
+
+// result = A^T, into a preallocated result
+void transpose(const Matrix& A, Matrix& result);
+
+// In-place BLAS-style updates, which avoid materialising the scaled or outer-product operand
+//
+// Y += aX
+void axpy(netfloat_t a, const Vector& X, Vector& Y);
+void axpy(netfloat_t a, const Matrix& X, Matrix& Y);
+void axpy(netfloat_t a, const Kernel& X, Kernel& Y);
+
+// A += a x y^T
+void ger(netfloat_t a, const Vector& x, const Vector& y, Matrix& A);
+
+// Z = Ax + b and Y = f(Z), with f applied to each run of rows as soon as they're done. f takes
+// (Z, Y, n) and should compute Y[i] = f(Z[i]) for i < n. Y may be the same object as Z, in
+// which case only f(Z) is kept.
+void gemv(const Matrix& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f);
+
+// A Matrix stored in one of the 16-bit formats in half.hpp, for bandwidth-bound products where
+// the reduced precision is acceptable. S is float16_t or bfloat16_t.
+template<typename S>
+class PackedMatrix {
+  public:
+    PackedMatrix();
+    explicit PackedMatrix(const Matrix& M);
+
+    // Overwrites the contents with M, reusing the storage if the size hasn't changed
+    void pack(const Matrix& M);
+    Matrix unpack() const;
+
+    const S* data() const {
+      return m_data.data();
+    }
+
+    size_t cols() const {
+      return m_cols;
+    }
+
+    size_t rows() const {
+      return m_rows;
+    }
+
+  private:
+    std::vector<S> m_data;
+    size_t m_cols;
+    size_t m_rows;
+};
+
+// gemv with A widened to netfloat_t as it's read, so it moves half the bytes
+template<typename S>
+void gemv(const PackedMatrix<S>& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f);
+
+// A Matrix quantized to int8 for inference, with a scale per row (per output channel), so that
+// M[i][j] ~= scale(i) * data()[i * cols() + j]. The inputs it's multiplied with are quantized
+// with a single scale, chosen so that magnitudes up to inputRange are representable. Larger
+// inputs saturate.
+class QuantizedMatrix {
+  public:
+    QuantizedMatrix();
+    QuantizedMatrix(const Matrix& M, netfloat_t inputRange);
+
+    // Overwrites the contents with M, reusing the storage if the size hasn't changed
+    void quantize(const Matrix& M, netfloat_t inputRange);
+    Matrix dequantize() const;
+
+    // R[i] = round(x[i] / inputScale()), saturating at +/-127
+    void quantizeInputs(const netfloat_t* x, int8_t* R, size_t n) const;
+
+    const int8_t* data() const {
+      return m_data.data();
+    }
+
+    const netfloat_t* scales() const {
+      return m_scales.data();
+    }
+
+    netfloat_t inputScale() const {
+      return m_inputScale;
+    }
+
+    size_t cols() const {
+      return m_cols;
+    }
+
+    size_t rows() const {
+      return m_rows;
+    }
+
+  private:
+    std::vector<int8_t> m_data;
+    std::vector<netfloat_t> m_scales;
+    netfloat_t m_inputScale;
+    size_t m_cols;
+    size_t m_rows;
+};
+
+// The largest magnitude in A, for calibrating the input range of a QuantizedMatrix
+netfloat_t maxMagnitude(const DataArray& A);
+
+// gemv with x quantized to int8 and the products accumulated in int32
+void gemv(const QuantizedMatrix& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f);
+
+// A Matrix in compressed sparse row (CSR) format, holding only the non-zero elements, for
+// products with pruned weights. The elements of row i are values()[k] in column columns()[k],
+// for rowStarts()[i] <= k < rowStarts()[i + 1].
+class SparseMatrix {
+  public:
+    SparseMatrix();
+    explicit SparseMatrix(const Matrix& M);
+    // Reads the format written by writeToStream
+    SparseMatrix(std::istream& stream, size_t cols, size_t rows);
+
+    void writeToStream(std::ostream& stream) const;
+    Matrix toDense() const;
+
+    const netfloat_t* values() const {
+      return m_values.data();
+    }
+
+    const uint32_t* columns() const {
+      return m_columns.data();
+    }
+
+    const uint32_t* rowStarts() const {
+      return m_rowStarts.data();
+    }
+
+    size_t nonZeros() const {
+      return m_values.size();
+    }
+
+    size_t cols() const {
+      return m_cols;
+    }
+
+    size_t rows() const {
+      return m_rows;
+    }
+
+  private:
+    std::vector<netfloat_t> m_values;
+    std::vector<uint32_t> m_columns;
+    std::vector<uint32_t> m_rowStarts;
+    size_t m_cols;
+    size_t m_rows;
+};
+
+// gemv over the non-zero elements of A only
+void gemv(const SparseMatrix& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f);
+
+// Products with a sparse left operand, costing one axpy over a row of B per non-zero of A, so
+// that mostly-zero inputs skip the rows of B they'd only multiply by zero
+//
+// result = AB
+void multiply(const SparseMatrix& A, const Matrix& B, Matrix& result, bool accumulate = false);
+
+// result = A^T B
+void transposeMultiply(const SparseMatrix& A, const Matrix& B, Matrix& result,
+  bool accumulate = false);
+
+// Magnitude pruning. Zeroes the elements of M smaller in magnitude than threshold.
+void pruneBelow(Matrix& M, netfloat_t threshold);
+
+// The magnitude below which the given fraction of M's elements lie, so pruning below it reaches
+// that sparsity
+netfloat_t magnitudeQuantile(const Matrix& M, netfloat_t fraction);
+
+// Valid cross-correlation of image with a stack of kW x kH x image.D() quantized kernels, one per
+// row of kernels in Kernel layout, as computeWinogradCrossCorrelation. The image is quantized and
+// lowered once, so the correlation is a single int8 product vectorised along output positions.
+void computeQuantizedCrossCorrelation(const Array3& image, const QuantizedMatrix& kernels,
+  size_t kW, size_t kH, Matrix& result);
+
 }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "richard/types.hpp"
+#include <cstddef>
+
+namespace richard {
+namespace memory {
+
+// Tensor storage is aligned to a cache line, which is also the width of the widest SIMD
+// registers
+const size_t ALIGNMENT = 64;
+
+// Returns an uninitialised buffer of n elements, aligned to ALIGNMENT, or nullptr if n is 0.
+//
+// Buffers are recycled through per-thread free lists, one per power-of-two size class, so once
+// a training or inference loop reaches a steady state its temporaries no longer reach the
+// system allocator.
+netfloat_t* allocate(size_t n);
+
+// Returns a buffer obtained from allocate(n) to the calling thread's free lists. This needn't
+// be the thread that allocated it.
+void release(netfloat_t* ptr, size_t n);
+
+// Frees every buffer held in the calling thread's free lists
+void trim();
+
+struct PoolStats {
+  size_t cachedBytes;         // Held in the calling thread's free lists
+  size_t systemAllocations;   // Made by the calling thread since it started
+};
+
+PoolStats poolStats();
+
+}
+}
@@ -3,6 +3,7 @@
 #include "richard/math.hpp"
 #include "richard/types.hpp"
 #include "richard/event_system.hpp"
+#include "richard/random.hpp"
 #include <vector>
 
 namespace richard {
@@ -17,10 +18,19 @@ struct Hyperparams {
   uint32_t epochs;
   uint32_t batchSize;
   uint32_t miniBatchSize;
+  // Worker threads used for training, where 0 means one per hardware thread
+  uint32_t threads;
+  // Seeds the weight initialisation and dropout, so that runs are reproducible
+  uint64_t seed;
 
   static const Config& exampleConfig();
 };
 
+// Each layer draws from its own stream. The net adds "seed" and "stream" to the config it
+// constructs the layer from.
+void setLayerStream(Config& layerConfig, uint64_t seed, uint64_t stream);
+Random layerRandom(const Config& layerConfig);
+
 struct ESampleProcessed : public Event {
   ESampleProcessed(uint32_t sample, uint32_t samples)
     : Event(name)
@@ -70,8 +80,17 @@ class NeuralNet {
     virtual void writeToStream(std::ostream& stream) const = 0;
     virtual void train(LabelledDataSet& data) = 0;
     virtual Vector evaluate(const Array3& inputs) const = 0;
+    // As evaluate, but writes into outputs, which must already have the output layer's size
+    virtual void evaluateInto(const Array3& inputs, Vector& outputs) const = 0;
+    // Evaluates many samples at once, one flattened sample per row of inputs, giving one row of
+    // outputs per sample
+    virtual Matrix evaluateBatch(const Matrix& inputs) const = 0;
     virtual ModelDetails modelDetails() const = 0;
 
+    // Post-training int8 quantization, calibrated on up to maxSamples samples from data. Only
+    // evaluate is affected.
+    virtual void quantize(LabelledDataSet& data, size_t maxSamples) = 0;
+
     // Called from another thread
     virtual void abort() = 0;
 
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "richard/types.hpp"
+#include <cstdint>
+#include <cstddef>
+
+namespace richard {
+
+// Philox4x32-10, a counter-based generator (Salmon et al., "Parallel Random Numbers: As Easy as
+// 1, 2, 3"). Each block of four outputs is a fixed function of the seed, the stream and a
+// counter, so generators with different streams are independent, and the blocks of a bulk
+// request can be computed side by side.
+//
+// Every call starts from a fresh block, so the values drawn depend only on the seed, the stream
+// and the sequence of calls made.
+class Random {
+  public:
+    explicit Random(uint64_t seed = 0, uint64_t stream = 0);
+
+    uint32_t next();
+    void generate(uint32_t* R, size_t n);
+
+    // R[i] uniform in [0, 1)
+    void uniform(netfloat_t* R, size_t n);
+    // R[i] normally distributed with mean 0
+    void normal(netfloat_t* R, netfloat_t standardDeviation, size_t n);
+    // Zeroes each A[i] with probability rate
+    void dropout(netfloat_t* A, netfloat_t rate, size_t n);
+
+  private:
+    uint32_t m_key[2];
+    uint64_t m_stream;
+    uint64_t m_counter;
+};
+
+// The generator that randomize uses when it isn't given one. Each thread has its own stream.
+Random& defaultRandom();
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "richard/types.hpp"
+#include "richard/half.hpp"
+#include <string>
+
+namespace richard {
+namespace simd {
+
+enum class InstructionSet {
+  scalar,
+  avx2,
+  avx512,
+  neon
+};
+
+// The number of rows of C (or A) processed together by the matrix product kernels
+const size_t TILE_ROWS = 4;
+
+// Element-wise kernels over contiguous arrays of length n. The result array may alias either
+// of the inputs.
+//
+// The matrix product kernels hold a register tile of results across the whole of the inner
+// dimension, and are driven over cache-sized blocks by the functions in math.hpp.
+struct Kernels {
+  InstructionSet instructionSet;
+
+  void (*add)(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n);
+  void (*subtract)(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n);
+  void (*multiply)(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n);
+  void (*addScalar)(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n);
+  void (*multiplyScalar)(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n);
+  void (*divideScalar)(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n);
+  // Y += aX
+  void (*axpy)(netfloat_t a, const netfloat_t* X, netfloat_t* Y, size_t n);
+  void (*fill)(netfloat_t* R, netfloat_t x, size_t n);
+  netfloat_t (*sum)(const netfloat_t* A, size_t n);
+  netfloat_t (*dot)(const netfloat_t* A, const netfloat_t* B, size_t n);
+
+  // C[i * ldc + j] += sum_k A[i * rsA + k * csA] * B[k * ldb + j]
+  // for i < rows (at most TILE_ROWS), j < n, k < depth
+  void (*multiplyAccumulate)(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+    size_t ldb, netfloat_t* C, size_t ldc, size_t rows, size_t depth, size_t n);
+
+  // R[i] = sum_j A[i * lda + j] * x[j] for i < rows (at most TILE_ROWS), j < n
+  void (*dotRows)(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R,
+    size_t rows, size_t n);
+
+  // Activation functions and their derivatives, R[i] = f(A[i]). The vectorised sigmoid uses a
+  // polynomial approximation of exp, accurate to within a few ulp.
+  void (*sigmoid)(const netfloat_t* A, netfloat_t* R, size_t n);
+  void (*sigmoidPrime)(const netfloat_t* A, netfloat_t* R, size_t n);
+  void (*relu)(const netfloat_t* A, netfloat_t* R, size_t n);
+  void (*reluPrime)(const netfloat_t* A, netfloat_t* R, size_t n);
+
+  // Conversions to and from the 16-bit storage formats in half.hpp
+  void (*toFloat16)(const netfloat_t* A, float16_t* R, size_t n);
+  void (*fromFloat16)(const float16_t* A, netfloat_t* R, size_t n);
+  void (*toBfloat16)(const netfloat_t* A, bfloat16_t* R, size_t n);
+  void (*fromBfloat16)(const bfloat16_t* A, netfloat_t* R, size_t n);
+
+  // dotRows with A stored in a 16-bit format. Each element of A is widened on load, and the
+  // products are summed in netfloat_t.
+  void (*dotRowsFloat16)(const float16_t* A, size_t lda, const netfloat_t* x, netfloat_t* R,
+    size_t rows, size_t n);
+  void (*dotRowsBfloat16)(const bfloat16_t* A, size_t lda, const netfloat_t* x, netfloat_t* R,
+    size_t rows, size_t n);
+
+  // Quantization to int8, R[i] = round(A[i] * scale), saturating at +/-127 so that products of
+  // two quantized values can be paired in 16 bits. Rounds half to even.
+  void (*toInt8)(const netfloat_t* A, int8_t* R, netfloat_t scale, size_t n);
+
+  // dotRows over int8 values, accumulated exactly in int32. Elements must lie in [-127, 127].
+  void (*dotRowsInt8)(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t rows,
+    size_t n);
+
+  // An int8 product vectorised along the columns of B rather than the depth, for lowered images,
+  // whose depth is often too short to fill a vector. B is packed four rows to a word, so element
+  // (k, j) of B is B[(k / 4) * ldb + 4 * j + k % 4], and is zero beyond depth. Then
+  // R[i * ldr + j] = sum_k A[i * lda + k] * B(k, j) for i < rows (at most TILE_ROWS), j < n,
+  // k < depth. Elements must lie in [-127, 127].
+  void (*multiplyInt8)(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+    size_t ldr, size_t rows, size_t depth, size_t n);
+
+  // R[i] = (A[i] - min) / (max - min), the same as normalize in data_details.hpp. Widens samples
+  // held as raw bytes.
+  void (*normalizeUint8)(const uint8_t* A, netfloat_t min, netfloat_t max, netfloat_t* R,
+    size_t n);
+
+  // The Philox4x32-10 generator in random.hpp. Writes the four-word blocks for counters
+  // counter, counter + 1, ..., counter + blocks - 1 to R, one after another.
+  void (*philox)(const uint32_t* key, uint64_t stream, uint64_t counter, uint32_t* R,
+    size_t blocks);
+};
+
+// The best instruction set supported by both the build and the host CPU
+InstructionSet detectInstructionSet();
+
+// Kernels for the detected instruction set, selected once on first use
+const Kernels& kernels();
+
+// Returns nullptr if the instruction set isn't available on this machine
+const Kernels* kernels(InstructionSet instructionSet);
+
+std::string instructionSetName(InstructionSet instructionSet);
+
+}
+}
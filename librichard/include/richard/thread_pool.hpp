@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+namespace richard {
+
+class ThreadPool {
+  public:
+    // With numThreads = 0, uses one thread per hardware thread. The calling thread counts as
+    // one of them.
+    explicit ThreadPool(size_t numThreads = 0);
+
+    size_t numThreads() const;
+
+    // Calls fn(i) for each i in [0, n) across the pool and returns once they've all completed.
+    // If any call throws, the first exception is rethrown here.
+    void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+    ~ThreadPool();
+
+  private:
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_jobDone;
+    const std::function<void(size_t)>* m_fn;
+    size_t m_numTasks;
+    std::atomic<size_t> m_nextTask;
+    size_t m_generation;
+    size_t m_busyWorkers;
+    std::exception_ptr m_exception;
+    bool m_stop;
+};
+
+using ThreadPoolPtr = std::unique_ptr<ThreadPool>;
+
+}
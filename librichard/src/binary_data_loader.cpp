@@ -0,0 +1,246 @@
+#include "richard/binary_data_loader.hpp"
+#include "richard/exception.hpp"
+#include "richard/utils.hpp"
+#include <cstring>
+#include <cmath>
+
+namespace richard {
+namespace {
+
+const char MAGIC[8] = { 'R', 'I', 'C', 'H', 'D', 'S', 'E', 'T' };
+const uint32_t VERSION = 1;
+
+// Records start on a cache line
+const size_t RECORDS_ALIGNMENT = 64;
+
+// Raw values closer than this to an integer in [0, 255] are stored as uint8s
+const double UINT8_TOLERANCE = 1e-3;
+
+enum class ElementType : uint32_t {
+  Uint8 = 0,
+  Float32 = 1
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  ElementType elementType;
+  uint32_t shape[3];
+  float normMin;
+  float normMax;
+  uint32_t numClasses;
+  uint64_t numSamples;
+  uint64_t recordsOffset;
+  uint64_t recordStride;
+};
+
+static_assert(sizeof(Header) == 64);
+
+size_t roundUp(size_t x, size_t multiple) {
+  return (x + multiple - 1) / multiple * multiple;
+}
+
+size_t elementSize(ElementType type) {
+  return type == ElementType::Uint8 ? sizeof(uint8_t) : sizeof(float);
+}
+
+template<typename T>
+void writeValue(std::ostream& stream, const T& value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Whether all values from source are integers in [0, 255] before normalization. Also counts the
+// samples.
+bool valuesFitUint8(DataLoader& source, const DataDetails& dataDetails, size_t& numSamples) {
+  const NormalizationParams& norm = dataDetails.normalization;
+  const size_t inputSize = calcProduct(dataDetails.shape);
+
+  bool fits = true;
+  numSamples = 0;
+
+  std::vector<netfloat_t> values(inputSize);
+  std::vector<Sample> samples = source.loadSamples();
+  while (samples.size() > 0) {
+    for (const Sample& sample : samples) {
+      ASSERT_MSG(sample.size() == inputSize, "Expected sample of size " << inputSize
+        << ", got " << sample.size());
+
+      sample.copyTo(values.data());
+
+      for (size_t i = 0; fits && i < inputSize; ++i) {
+        double x = static_cast<double>(values[i]) * (norm.max - norm.min) + norm.min;
+        double rounded = std::round(x);
+        fits = rounded >= 0.0 && rounded <= 255.0 && std::abs(x - rounded) < UINT8_TOLERANCE;
+      }
+    }
+
+    numSamples += samples.size();
+    samples = source.loadSamples();
+  }
+
+  return fits;
+}
+
+}
+
+BinaryDataLoader::BinaryDataLoader(MappedFilePtr file, size_t fetchSize)
+  : DataLoader(fetchSize)
+  , m_file(std::move(file))
+  , m_next(0) {
+
+  ASSERT_MSG(m_file->size() >= sizeof(Header), "File is too small for a data set");
+
+  Header header;
+  memcpy(&header, m_file->data(), sizeof(Header));
+
+  ASSERT_MSG(memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0, "File is not a binary data set");
+  ASSERT_MSG(header.version == VERSION, "Unsupported data set version " << header.version);
+  ASSERT_MSG(header.elementType == ElementType::Uint8 || header.elementType == ElementType::Float32,
+    "Unrecognised element type " << static_cast<uint32_t>(header.elementType));
+
+  m_shape = { header.shape[0], header.shape[1], header.shape[2] };
+  m_normalization.min = header.normMin;
+  m_normalization.max = header.normMax;
+  m_uint8Values = header.elementType == ElementType::Uint8;
+  m_numSamples = header.numSamples;
+  m_recordsOffset = header.recordsOffset;
+  m_recordStride = header.recordStride;
+
+  ASSERT_MSG(m_recordStride >= sizeof(uint32_t) + calcProduct(m_shape)
+    * elementSize(header.elementType), "Record stride too small for sample shape");
+  ASSERT_MSG(m_recordsOffset <= m_file->size()
+    && m_numSamples <= (m_file->size() - m_recordsOffset) / m_recordStride,
+    "Data set file is truncated");
+
+  const uint8_t* p = m_file->data() + sizeof(Header);
+  for (uint32_t i = 0; i < header.numClasses; ++i) {
+    uint32_t length = 0;
+    ASSERT_MSG(p + sizeof(length) <= m_file->data() + m_recordsOffset, "Bad class labels");
+    memcpy(&length, p, sizeof(length));
+    p += sizeof(length);
+
+    ASSERT_MSG(p + length <= m_file->data() + m_recordsOffset, "Bad class labels");
+    m_labels.emplace_back(reinterpret_cast<const char*>(p), length);
+    p += length;
+  }
+}
+
+void BinaryDataLoader::seekToBeginning() {
+  m_next = 0;
+}
+
+std::vector<Sample> BinaryDataLoader::loadSamples() {
+  const size_t inputSize = calcProduct(m_shape);
+  const size_t n = std::min(fetchSize(), m_numSamples - m_next);
+
+  std::vector<Sample> samples;
+  samples.reserve(n);
+
+  const uint8_t* record = m_file->data() + m_recordsOffset + m_next * m_recordStride;
+  for (size_t i = 0; i < n; ++i, record += m_recordStride) {
+    uint32_t classId = 0;
+    memcpy(&classId, record, sizeof(classId));
+    ASSERT_MSG(classId < m_labels.size(), "Class id " << classId << " out of range");
+
+    const uint8_t* payload = record + sizeof(classId);
+
+    if (m_uint8Values) {
+      samples.emplace_back(classId, m_shape, payload, m_file, m_normalization);
+    }
+    else {
+      Array3 values(m_shape[0], m_shape[1], m_shape[2]);
+      memcpy(values.data(), payload, inputSize * sizeof(float));
+      samples.emplace_back(classId, std::move(values));
+    }
+  }
+
+  m_next += n;
+
+  return samples;
+}
+
+bool isBinaryDataSet(std::istream& stream) {
+  char magic[sizeof(MAGIC)];
+  stream.read(magic, sizeof(magic));
+
+  return stream.gcount() == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void writeBinaryDataSet(DataLoader& source, const DataDetails& dataDetails,
+  std::ostream& stream) {
+
+  static_assert(sizeof(netfloat_t) == sizeof(float));
+
+  const NormalizationParams& norm = dataDetails.normalization;
+  const size_t inputSize = calcProduct(dataDetails.shape);
+
+  source.seekToBeginning();
+
+  size_t numSamples = 0;
+  bool uint8Values = valuesFitUint8(source, dataDetails, numSamples);
+  ElementType elementType = uint8Values ? ElementType::Uint8 : ElementType::Float32;
+
+  size_t labelsSize = 0;
+  for (const std::string& label : dataDetails.classLabels) {
+    labelsSize += sizeof(uint32_t) + label.size();
+  }
+
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.elementType = elementType;
+  header.shape[0] = static_cast<uint32_t>(dataDetails.shape[0]);
+  header.shape[1] = static_cast<uint32_t>(dataDetails.shape[1]);
+  header.shape[2] = static_cast<uint32_t>(dataDetails.shape[2]);
+  header.normMin = norm.min;
+  header.normMax = norm.max;
+  header.numClasses = static_cast<uint32_t>(dataDetails.classLabels.size());
+  header.numSamples = numSamples;
+  header.recordsOffset = roundUp(sizeof(Header) + labelsSize, RECORDS_ALIGNMENT);
+  header.recordStride = roundUp(sizeof(uint32_t) + inputSize * elementSize(elementType),
+    sizeof(uint32_t));
+
+  writeValue(stream, header);
+  for (const std::string& label : dataDetails.classLabels) {
+    writeValue(stream, static_cast<uint32_t>(label.size()));
+    stream.write(label.data(), label.size());
+  }
+
+  std::vector<char> padding(header.recordsOffset - sizeof(Header) - labelsSize, 0);
+  stream.write(padding.data(), padding.size());
+
+  std::vector<char> record(header.recordStride, 0);
+  std::vector<netfloat_t> values(inputSize);
+
+  source.seekToBeginning();
+
+  std::vector<Sample> samples = source.loadSamples();
+  while (samples.size() > 0) {
+    for (const Sample& sample : samples) {
+      ASSERT_MSG(sample.classId < dataDetails.classLabels.size(), "Class id " << sample.classId
+        << " out of range");
+
+      memcpy(record.data(), &sample.classId, sizeof(uint32_t));
+      char* payload = record.data() + sizeof(uint32_t);
+      sample.copyTo(values.data());
+
+      if (uint8Values) {
+        for (size_t j = 0; j < inputSize; ++j) {
+          netfloat_t x = values[j] * (norm.max - norm.min) + norm.min;
+          payload[j] = static_cast<char>(static_cast<uint8_t>(std::round(x)));
+        }
+      }
+      else {
+        memcpy(payload, values.data(), inputSize * sizeof(float));
+      }
+
+      stream.write(record.data(), record.size());
+    }
+
+    samples = source.loadSamples();
+  }
+
+  ASSERT_MSG(stream.good(), "Error writing data set");
+}
+
+}
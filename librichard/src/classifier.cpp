@@ -4,9 +4,11 @@
 #include "richard/data_details.hpp"
 #include "richard/utils.hpp"
 #include "richard/logger.hpp"
+#include "richard/thread_pool.hpp"
 #include "richard/cpu/cpu_neural_net.hpp"
 #include "richard/gpu/gpu_neural_net.hpp"
 #include <limits>
+#include <algorithm>
 #include <future>
 
 namespace richard {
@@ -28,13 +30,78 @@ bool outputsMatch(const Vector& x, const Vector& y) {
   return largestComponent(x) == largestComponent(y);
 }
 
+const size_t DEFAULT_TEST_BATCH_SIZE = 64;
+
+size_t testBatchSize(const Config& config) {
+  size_t batchSize = config.contains("testBatchSize") ?
+    config.getNumber<size_t>("testBatchSize") : DEFAULT_TEST_BATCH_SIZE;
+
+  ASSERT_MSG(batchSize > 0, "testBatchSize must be positive");
+  return batchSize;
+}
+
+// The GPU backend evaluates through buffers shared by every call, so is always tested on one
+// thread
+size_t testThreads(const Config& config, bool gpuAccelerated) {
+  if (gpuAccelerated) {
+    return 1;
+  }
+  return config.contains("testThreads") ? config.getNumber<size_t>("testThreads") : 1;
+}
+
+struct BatchResults {
+  size_t good = 0;
+  size_t bad = 0;
+  netfloat_t cost = 0.0;
+  std::vector<bool> guesses;
+};
+
+BatchResults testBatch(const NeuralNet& neuralNet, const LabelledDataSet& testData,
+  const Sample* samples, size_t numSamples) {
+
+  size_t netInputSize = calcProduct(neuralNet.inputSize());
+
+  thread_local Matrix X;
+  if (X.cols() != netInputSize || X.rows() != numSamples) {
+    X = Matrix(netInputSize, numSamples);
+  }
+
+  for (size_t i = 0; i < numSamples; ++i) {
+    const Sample& sample = samples[i];
+
+    DBG_ASSERT_MSG(sample.size() == netInputSize,
+      "Expected sample of size " << netInputSize << ", got " << sample.size());
+
+    sample.copyTo(X.data() + i * netInputSize);
+  }
+
+  const Matrix Y = neuralNet.evaluateBatch(X);
+  const auto& costFn = neuralNet.costFn();
+
+  BatchResults results;
+  for (size_t i = 0; i < numSamples; ++i) {
+    ConstVectorView actual = Y.slice(i);
+    ConstVectorView expected = testData.classOutputVector(samples[i].classId);
+
+    bool match = outputsMatch(*actual, *expected);
+    results.good += match;
+    results.bad += !match;
+    results.guesses.push_back(match);
+    results.cost += costFn(*actual, *expected);
+  }
+
+  return results;
+}
+
 }
 
 Classifier::Classifier(const DataDetails& dataDetails, const Config& config, std::istream& stream,
   EventSystem& eventSystem, FileSystem& fileSystem, const PlatformPaths& platformPaths,
   Logger& logger, bool gpuAccelerated)
   : m_eventSystem(eventSystem)
-  , m_isTrained(false) {
+  , m_isTrained(false)
+  , m_testBatchSize(testBatchSize(config))
+  , m_testThreads(testThreads(config, gpuAccelerated)) {
 
   if (gpuAccelerated) {
     m_neuralNet = gpu::createNeuralNet(dataDetails.shape, config.getObject("network"), stream,
@@ -53,7 +120,9 @@ Classifier::Classifier(const DataDetails& dataDetails, const Config& config,
   Logger& logger, bool gpuAccelerated)
   : m_eventSystem(eventSystem)
   , m_neuralNet(nullptr)
-  , m_isTrained(false) {
+  , m_isTrained(false)
+  , m_testBatchSize(testBatchSize(config))
+  , m_testThreads(testThreads(config, gpuAccelerated)) {
 
   if (gpuAccelerated) {
     m_neuralNet = gpu::createNeuralNet(dataDetails.shape, config.getObject("network"),
@@ -85,9 +154,7 @@ Classifier::Results Classifier::test(LabelledDataSet& testData) const {
 
   Results results;
 
-  const auto& costFn = m_neuralNet->costFn();
-
-  [[maybe_unused]] size_t netInputSize = calcProduct(m_neuralNet->inputSize());
+  ThreadPool threadPool(m_testThreads);
 
   auto pendingSamples = std::async([&]() { return testData.loadSamples(); });
   std::vector<Sample> samples = pendingSamples.get();
@@ -97,24 +164,24 @@ Classifier::Results Classifier::test(LabelledDataSet& testData) const {
   while (samples.size() > 0) {
     pendingSamples = std::async([&]() { return testData.loadSamples(); });
 
-    for (const auto& sample : samples) {
-      DBG_ASSERT_MSG(sample.data.size() == netInputSize,
-        "Expected sample of size " << netInputSize << ", got " << sample.data.size());
+    // The workers take batches as they become free. Each batch has its own results, which are
+    // merged in order afterwards so the guesses come out in the order of the samples.
+    size_t numBatches = (samples.size() + m_testBatchSize - 1) / m_testBatchSize;
+    std::vector<BatchResults> batchResults(numBatches);
 
-      Vector actual = m_neuralNet->evaluate(sample.data);
-      Vector expected = testData.classOutputVector(sample.label);
+    threadPool.parallelFor(numBatches, [&](size_t batch) {
+      size_t first = batch * m_testBatchSize;
+      size_t n = std::min(m_testBatchSize, samples.size() - first);
 
-      if (outputsMatch(actual, expected)) {
-        ++results.good;
-        results.guesses.push_back(true);
-      }
-      else {
-        ++results.bad;
-        results.guesses.push_back(false);
-      }
+      batchResults[batch] = testBatch(*m_neuralNet, testData, samples.data() + first, n);
+    });
 
-      totalCost += costFn(actual, expected);
-      ++totalSamples;
+    for (const auto& batch : batchResults) {
+      results.good += batch.good;
+      results.bad += batch.bad;
+      results.guesses.insert(results.guesses.end(), batch.guesses.begin(), batch.guesses.end());
+      totalCost += batch.cost;
+      totalSamples += batch.guesses.size();
     }
 
     samples = pendingSamples.get();
@@ -125,6 +192,12 @@ Classifier::Results Classifier::test(LabelledDataSet& testData) const {
   return results;
 }
 
+void Classifier::quantize(LabelledDataSet& calibrationData, size_t maxSamples) {
+  ASSERT_MSG(m_isTrained, "Classifier not trained");
+
+  m_neuralNet->quantize(calibrationData, maxSamples);
+}
+
 void Classifier::abort() {
   m_neuralNet->abort();
 }
@@ -133,6 +206,8 @@ const Config& Classifier::exampleConfig() {
   static Config config = []() {
     Config c;
     c.setObject("network", NeuralNet::exampleConfig());
+    c.setNumber("testBatchSize", DEFAULT_TEST_BATCH_SIZE);
+    c.setNumber("testThreads", 1);
     return c;
   }();
   
@@ -3,7 +3,8 @@
 #include "richard/exception.hpp"
 #include "richard/utils.hpp"
 #include "richard/config.hpp"
-#include <random>
+#include "richard/neural_net.hpp"
+#include <cstring>
 
 namespace richard {
 namespace cpu {
@@ -17,10 +18,10 @@ ConvolutionalLayer::ConvolutionalLayer(const Config& config, std::istream& strea
 
   initialize(config, inputShape);
 
-  for (Filter& filter : m_filters) {
-    stream.read(reinterpret_cast<char*>(&filter.b), sizeof(netfloat_t));
-    stream.read(reinterpret_cast<char*>(filter.K.data()),
-      filter.K.W() * filter.K.H() * filter.K.D() * sizeof(netfloat_t));
+  for (size_t i = 0; i < m_W.rows(); ++i) {
+    stream.read(reinterpret_cast<char*>(&m_B[i]), sizeof(netfloat_t));
+    stream.read(reinterpret_cast<char*>(m_W.data() + i * m_W.cols()),
+      m_W.cols() * sizeof(netfloat_t));
   }
 }
 
@@ -34,6 +35,7 @@ void ConvolutionalLayer::initialize(const Config& config, const Size3& inputShap
   m_learnRateDecay = config.getNumber<netfloat_t>("learnRateDecay");
   size_t depth = config.getNumber<size_t>("depth");
   m_dropoutRate = config.getNumber<netfloat_t>("dropoutRate");
+  m_random = layerRandom(config);
 
   ASSERT_MSG(kernelSize[0] <= m_inputW,
     "Kernel width " << kernelSize[0] << " is larger than input width " << m_inputW);
@@ -41,17 +43,36 @@ void ConvolutionalLayer::initialize(const Config& config, const Size3& inputShap
   ASSERT_MSG(kernelSize[1] <= m_inputH,
     "Kernel height " << kernelSize[1] << " is larger than input height " << m_inputH);
 
-  for (size_t i = 0; i < depth; ++i) {
-    m_filters.push_back(Filter{ Kernel(kernelSize[0], kernelSize[1], m_inputDepth), 0.f });
-    m_filters.back().K.randomize(0.1f);
+  m_kernelW = kernelSize[0];
+  m_kernelH = kernelSize[1];
 
-    m_paramDeltas.push_back(Filter{ Kernel(kernelSize[0], kernelSize[1], m_inputDepth), 0.f });
-  }
+  size_t kernelSz = m_kernelW * m_kernelH * m_inputDepth;
+
+  m_W = Matrix(kernelSz, depth);
+  m_W.randomize(0.1f, m_random);
+  m_B = Vector(depth);
+  m_deltaW = Matrix(kernelSz, depth);
+  m_deltaB = Vector(depth);
 
   auto sz = outputSize();
   m_Z = Array3(sz[0], sz[1], sz[2]);
   m_A = Array3(sz[0], sz[1], sz[2]);
+  m_delta = Array3(sz[0], sz[1], sz[2]);
   m_inputDelta = Array3(m_inputW, m_inputH, m_inputDepth);
+  m_cols = Matrix(sz[0] * sz[1], kernelSz);
+  m_colsDelta = Matrix(sz[0] * sz[1], kernelSz);
+
+  m_fftForward = fftCorrelationIsCheaper(m_inputW, m_inputH, m_inputDepth, m_kernelW,
+    m_kernelH, depth, false);
+  m_fftInputDelta = fftCorrelationIsCheaper(sz[0], sz[1], depth, m_kernelW, m_kernelH,
+    m_inputDepth, true);
+
+  if (m_fftInputDelta) {
+    m_transposedW = Matrix(m_kernelW * m_kernelH * depth, m_inputDepth);
+  }
+
+  m_quantized = false;
+  m_inputRange = 0.f;
 }
 
 const DataArray& ConvolutionalLayer::activations() const {
@@ -63,11 +84,10 @@ const DataArray& ConvolutionalLayer::inputDelta() const {
 }
 
 Size3 ConvolutionalLayer::outputSize() const {
-  DBG_ASSERT(!m_filters.empty());
   return {
-    m_inputW - m_filters[0].K.W() + 1,
-    m_inputH - m_filters[0].K.H() + 1,
-    m_filters.size()
+    m_inputW - m_kernelW + 1,
+    m_inputH - m_kernelH + 1,
+    m_W.rows()
   };
 }
 
@@ -76,133 +96,342 @@ size_t ConvolutionalLayer::numOutputs() const {
   return os[0] * os[1] * os[2];
 }
 
-void ConvolutionalLayer::forwardPass(const Array3& inputs, Array3& Z) const {
-  size_t depth = m_filters.size();
-
-  for (size_t slice = 0; slice < depth; ++slice) {
-    Array2Ptr featureMap = Z.slice(slice);
+void ConvolutionalLayer::forwardPass(const Array3& inputs, Array3& Z, Matrix& cols) const {
+  MatrixView pZ = Matrix::createShallow(Z.data(), Z.W() * Z.H(), Z.D());
+  Matrix& featureMaps = *pZ;
 
-    const Kernel& K = m_filters[slice].K;
-    netfloat_t b = m_filters[slice].b;
-
-    computeCrossCorrelation(inputs, K, *featureMap);
+  if (m_kernelW == 3 && m_kernelH == 3) {
+    computeWinogradCrossCorrelation(inputs, m_W, featureMaps);
+  }
+  else if (m_fftForward) {
+    computeFftCrossCorrelation(inputs, m_W, m_kernelW, m_kernelH, featureMaps);
+  }
+  else {
+    im2col(inputs, m_kernelW, m_kernelH, cols);
+    multiply(m_W, cols, featureMaps);
+  }
 
-    *featureMap += b;
+  for (size_t slice = 0; slice < featureMaps.rows(); ++slice) {
+    *featureMaps.slice(slice) += m_B[slice];
   }
 }
 
 void ConvolutionalLayer::trainForward(const DataArray& inputs) {
-  auto shouldDrop = [this]() {
-    return rand() / (RAND_MAX + 1.0) < m_dropoutRate;
-  };
-  
-  auto reluWithDropout = [&](netfloat_t x) -> netfloat_t {
-    return shouldDrop() ? 0.f : relu(x); 
-  };
-
-  ConstArray3Ptr pX = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
+  ConstArray3View pX = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
   const Array3& X = *pX;
 
-  forwardPass(X, m_Z);
+  forwardPass(X, m_Z, m_cols);
+
+  Relu::apply(m_Z.data(), m_A.data(), m_Z.size());
 
-  m_A = m_Z.computeTransform(reluWithDropout);
+  m_random.dropout(m_A.data(), m_dropoutRate, m_A.size());
 }
 
-DataArray ConvolutionalLayer::evalForward(const DataArray& inputs) const {
-  ConstArray3Ptr pX = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
+void ConvolutionalLayer::evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const {
+  ConstArray3View pX = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
   const Array3& X = *pX;
 
-  auto sz = outputSize();
-  Array3 Z(sz[0], sz[1], sz[2]);
+  Array3View pZ = Array3::createShallow(outputs, outputSize());
+  Array3& Z = *pZ;
 
-  forwardPass(X, Z);
+  if (m_quantized) {
+    MatrixView pZ = Matrix::createShallow(Z.data(), Z.W() * Z.H(), Z.D());
+    Matrix& featureMaps = *pZ;
 
-  Z.transformInPlace(relu);
+    computeQuantizedCrossCorrelation(X, m_quantizedW, m_kernelW, m_kernelH, featureMaps);
+
+    for (size_t slice = 0; slice < featureMaps.rows(); ++slice) {
+      *featureMaps.slice(slice) += m_B[slice];
+    }
+  }
+  else {
+    // m_cols belongs to training, and evaluation may be running on several threads
+    thread_local std::vector<netfloat_t> colsBuffer;
+    colsBuffer.resize(m_cols.size());
+
+    MatrixView cols = Matrix::createShallow(colsBuffer.data(), m_cols.cols(), m_cols.rows());
+    forwardPass(X, Z, *cols);
+  }
 
-  return Z.storage();
+  Z.transformInPlace(relu);
 }
 
 void ConvolutionalLayer::updateDeltas(const DataArray& layerInputs, const DataArray& outputDelta) {
-  size_t fmW = outputSize()[0];
-  size_t fmH = outputSize()[1];
-  size_t depth = m_filters.size();
+  auto sz = outputSize();
+
+  ConstArray3View pDeltaA = Array3::createShallow(outputDelta, sz[0], sz[1], sz[2]);
+  ConstArray3View pInputs = Array3::createShallow(layerInputs, m_inputW, m_inputH, m_inputDepth);
 
-  ConstArray3Ptr pDeltaA = Array3::createShallow(outputDelta, fmW, fmH, depth);
-  const Array3& deltaA = *pDeltaA;
+  backpropagate(*pInputs, m_Z, *pDeltaA, m_inputDelta);
+}
 
-  ConstArray3Ptr pInputs3 = Array3::createShallow(layerInputs, m_inputW, m_inputH, m_inputDepth);
-  const Array3& inputs3 = *pInputs3;
+void ConvolutionalLayer::transposeFilters() {
+  // Slice z of input delta sums the full convolutions of each delta with slice z of its filter,
+  // so regroup the filter slices by z to form one kernel per input channel
+  const size_t kernelArea = m_kernelW * m_kernelH;
+  const size_t numFilters = m_W.rows();
 
-  Array3 delta3 = deltaA.hadamard(m_Z.computeTransform(reluPrime));
-  m_inputDelta.zero();
+  for (size_t z = 0; z < m_inputDepth; ++z) {
+    for (size_t f = 0; f < numFilters; ++f) {
+      memcpy(m_transposedW.data() + z * m_transposedW.cols() + f * kernelArea,
+        m_W.data() + f * m_W.cols() + z * kernelArea, kernelArea * sizeof(netfloat_t));
+    }
+  }
+}
 
-  Array2 dInputDelta(m_inputDelta.W(), m_inputDelta.H());
-  DBG_ASSERT(m_filters.size() > 0);
-  Array2 dDeltaK(m_filters[0].K.W(), m_filters[0].K.H());
+void ConvolutionalLayer::backpropagate(const Array3& inputs, const Array3& Z,
+  const Array3& deltaA, Array3& inputDelta) {
 
-  for (size_t slice = 0; slice < depth; ++slice) {
-    const Kernel& K = m_filters[slice].K;
-    Kernel& deltaK3 = m_paramDeltas[slice].K;
-    netfloat_t& db = m_paramDeltas[slice].b;
+  ReluPrime::apply(Z.data(), m_delta.data(), m_delta.size());
+  for (size_t i = 0; i < m_delta.size(); ++i) {
+    m_delta.data()[i] *= deltaA.data()[i];
+  }
 
-    ConstArray2Ptr pDelta = delta3.slice(slice);
-    const Array2& delta = *pDelta;
+  ConstMatrixView pDelta = Matrix::createShallow(m_delta.data(), m_delta.W() * m_delta.H(),
+    m_delta.D());
+  const Matrix& delta = *pDelta;
 
-    for (size_t z = 0; z < K.D(); ++z) {
-      ConstArray2Ptr pW = K.slice(z);
-      const Array2& W = *pW;
+  // Weight gradients are the correlation of the inputs with the deltas
+  im2col(inputs, m_kernelW, m_kernelH, m_cols);
+  multiplyTranspose(delta, m_cols, m_deltaW, true);
 
-      Array2Ptr pInputDelta = m_inputDelta.slice(z);
-      Array2& inputDelta = *pInputDelta;
+  for (size_t slice = 0; slice < delta.rows(); ++slice) {
+    m_deltaB[slice] += delta.slice(slice)->sum();
+  }
 
-      computeFullConvolution(W, delta, dInputDelta);
+  // Input deltas are the full convolution of the deltas with the kernels, which is the adjoint
+  // of the forward lowering
+  if (m_fftInputDelta) {
+    transposeFilters();
 
-      inputDelta += dInputDelta;
+    MatrixView pInputDelta = Matrix::createShallow(inputDelta.data(),
+      inputDelta.W() * inputDelta.H(), inputDelta.D());
 
-      ConstArray2Ptr pInputs = inputs3.slice(z);
-      const Array2& inputs = *pInputs;
+    computeFftFullCrossCorrelation(m_delta, m_transposedW, m_kernelW, m_kernelH, *pInputDelta,
+      true);
+  }
+  else {
+    transposeMultiply(m_W, delta, m_colsDelta);
 
-      Array2Ptr pDeltaK = deltaK3.slice(z);
-      Array2& deltaK = *pDeltaK;
+    inputDelta.zero();
+    col2im(m_colsDelta, m_kernelW, m_kernelH, inputDelta);
+  }
+}
+
+const Matrix& ConvolutionalLayer::batchActivations() const {
+  return m_batchA;
+}
+
+const Matrix& ConvolutionalLayer::batchInputDelta() const {
+  return m_batchInputDelta;
+}
 
-      computeCrossCorrelation(inputs, delta, dDeltaK);
-      deltaK += dDeltaK;
+bool ConvolutionalLayer::forwardUsesIm2col() const {
+  return !(m_kernelW == 3 && m_kernelH == 3) && !m_fftForward;
+}
+
+namespace {
+
+// Between a batch of feature maps with one sample per row, and the same maps with one filter per
+// row, as the batched im2col product computes them
+void samplesToFilters(const Matrix& samples, size_t mapSize, Matrix& filters) {
+  const size_t numFilters = filters.rows();
+
+  for (size_t b = 0; b < samples.rows(); ++b) {
+    for (size_t f = 0; f < numFilters; ++f) {
+      memcpy(filters.data() + f * filters.cols() + b * mapSize,
+        samples.data() + b * samples.cols() + f * mapSize, mapSize * sizeof(netfloat_t));
     }
+  }
+}
 
-    db += delta.sum();
+void filtersToSamples(const Matrix& filters, size_t mapSize, Matrix& samples) {
+  const size_t numFilters = filters.rows();
+
+  for (size_t b = 0; b < samples.rows(); ++b) {
+    for (size_t f = 0; f < numFilters; ++f) {
+      memcpy(samples.data() + b * samples.cols() + f * mapSize,
+        filters.data() + f * filters.cols() + b * mapSize, mapSize * sizeof(netfloat_t));
+    }
   }
 }
 
+}
+
+void ConvolutionalLayer::trainForwardBatch(const Matrix& inputs) {
+  DBG_ASSERT(inputs.cols() == m_inputW * m_inputH * m_inputDepth);
+
+  auto sz = outputSize();
+  size_t mapSize = sz[0] * sz[1];
+  size_t batchSize = inputs.rows();
+
+  if (m_batchZ.rows() != batchSize) {
+    m_batchZ = Matrix(numOutputs(), batchSize);
+    m_batchA = Matrix(numOutputs(), batchSize);
+    m_batchDelta = Matrix(numOutputs(), batchSize);
+    m_batchInputDelta = Matrix(m_inputW * m_inputH * m_inputDepth, batchSize);
+    m_batchCols = Matrix(mapSize * batchSize, m_W.cols());
+    m_batchColsDelta = Matrix(mapSize * batchSize, m_W.cols());
+    m_batchMaps = Matrix(mapSize * batchSize, m_W.rows());
+  }
+
+  if (forwardUsesIm2col()) {
+    im2col(inputs, { m_inputW, m_inputH, m_inputDepth }, m_kernelW, m_kernelH, m_batchCols);
+    multiply(m_W, m_batchCols, m_batchMaps);
+
+    for (size_t f = 0; f < m_batchMaps.rows(); ++f) {
+      *m_batchMaps.slice(f) += m_B[f];
+    }
+
+    filtersToSamples(m_batchMaps, mapSize, m_batchZ);
+  }
+  else {
+    // The Winograd and FFT correlations work an image at a time
+    for (size_t i = 0; i < batchSize; ++i) {
+      ConstArray3View pX = Array3::createShallow(inputs.data() + i * inputs.cols(), m_inputW,
+        m_inputH, m_inputDepth);
+      Array3View pZ = Array3::createShallow(m_batchZ.data() + i * m_batchZ.cols(), sz);
+
+      forwardPass(*pX, *pZ, m_cols);
+    }
+  }
+
+  Relu::apply(m_batchZ.data(), m_batchA.data(), m_batchZ.size());
+
+  m_random.dropout(m_batchA.data(), m_dropoutRate, m_batchA.size());
+}
+
+void ConvolutionalLayer::updateDeltasBatch(const Matrix& inputs, const Matrix& outputDelta) {
+  DBG_ASSERT(inputs.rows() == m_batchZ.rows());
+  DBG_ASSERT(outputDelta.rows() == m_batchZ.rows());
+
+  auto sz = outputSize();
+  size_t mapSize = sz[0] * sz[1];
+
+  ReluPrime::apply(m_batchZ.data(), m_batchDelta.data(), m_batchDelta.size());
+  for (size_t i = 0; i < m_batchDelta.size(); ++i) {
+    m_batchDelta.data()[i] *= outputDelta.data()[i];
+  }
+
+  samplesToFilters(m_batchDelta, mapSize, m_batchMaps);
+
+  // Weight gradients are the correlation of the inputs with the deltas. The forward pass has
+  // already lowered the inputs if it went by im2col
+  if (!forwardUsesIm2col()) {
+    im2col(inputs, { m_inputW, m_inputH, m_inputDepth }, m_kernelW, m_kernelH, m_batchCols);
+  }
+  multiplyTranspose(m_batchMaps, m_batchCols, m_deltaW, true);
+
+  for (size_t f = 0; f < m_batchMaps.rows(); ++f) {
+    m_deltaB[f] += m_batchMaps.slice(f)->sum();
+  }
+
+  // Input deltas are the adjoint of the forward lowering
+  if (m_fftInputDelta) {
+    transposeFilters();
+
+    // The FFT correlation works an image at a time
+    for (size_t i = 0; i < inputs.rows(); ++i) {
+      ConstArray3View pDelta = Array3::createShallow(
+        m_batchDelta.data() + i * m_batchDelta.cols(), sz);
+      MatrixView pInputDelta = Matrix::createShallow(
+        m_batchInputDelta.data() + i * m_batchInputDelta.cols(), m_inputW * m_inputH,
+        m_inputDepth);
+
+      computeFftFullCrossCorrelation(*pDelta, m_transposedW, m_kernelW, m_kernelH,
+        *pInputDelta, true);
+    }
+  }
+  else {
+    transposeMultiply(m_W, m_batchMaps, m_batchColsDelta);
+
+    m_batchInputDelta.zero();
+    col2im(m_batchColsDelta, m_kernelW, m_kernelH, { m_inputW, m_inputH, m_inputDepth },
+      m_batchInputDelta);
+  }
+}
+
+void ConvolutionalLayer::copyParams(const Layer& source) {
+  const ConvolutionalLayer& src = dynamic_cast<const ConvolutionalLayer&>(source);
+
+  m_W = src.m_W;
+  m_B = src.m_B;
+
+  if (m_quantized) {
+    m_quantizedW.quantize(m_W, m_inputRange);
+  }
+}
+
+void ConvolutionalLayer::mergeDeltas(Layer& source) {
+  ConvolutionalLayer& src = dynamic_cast<ConvolutionalLayer&>(source);
+
+  m_deltaW += src.m_deltaW;
+  m_deltaB += src.m_deltaB;
+
+  src.m_deltaW.zero();
+  src.m_deltaB.zero();
+}
+
+void ConvolutionalLayer::calibrate(const DataArray& inputs) {
+  m_inputRange = std::max(m_inputRange, maxMagnitude(inputs));
+}
+
+void ConvolutionalLayer::quantize() {
+  m_quantized = true;
+  m_quantizedW.quantize(m_W, m_inputRange);
+}
+
 void ConvolutionalLayer::updateParams(size_t epoch) {
   netfloat_t learnRate = m_learnRate * static_cast<netfloat_t>(pow(m_learnRateDecay, epoch));
 
-  for (size_t slice = 0; slice < m_filters.size(); ++slice) {
-    m_filters[slice].K -= m_paramDeltas[slice].K * learnRate;
-    m_filters[slice].b -= m_paramDeltas[slice].b * learnRate;
+  axpy(-learnRate, m_deltaW, m_W);
+  axpy(-learnRate, m_deltaB, m_B);
 
-    m_paramDeltas[slice].K.zero();
-    m_paramDeltas[slice].b = 0.0;
+  if (m_quantized) {
+    m_quantizedW.quantize(m_W, m_inputRange);
   }
+
+  m_deltaW.zero();
+  m_deltaB.zero();
 }
 
 void ConvolutionalLayer::writeToStream(std::ostream& stream) const {
-  for (const Filter& filter : m_filters) {
-    stream.write(reinterpret_cast<const char*>(&filter.b), sizeof(netfloat_t));
-    stream.write(reinterpret_cast<const char*>(filter.K.data()),
-      filter.K.size() * sizeof(netfloat_t));
+  for (size_t i = 0; i < m_W.rows(); ++i) {
+    stream.write(reinterpret_cast<const char*>(&m_B[i]), sizeof(netfloat_t));
+    stream.write(reinterpret_cast<const char*>(m_W.data() + i * m_W.cols()),
+      m_W.cols() * sizeof(netfloat_t));
   }
 }
 
 void ConvolutionalLayer::test_setFilters(const std::vector<Filter>& filters) {
-  m_filters = filters;
+  ASSERT(filters.size() == m_W.rows());
+
+  for (size_t i = 0; i < filters.size(); ++i) {
+    ASSERT(filters[i].K.size() == m_W.cols());
+
+    memcpy(m_W.data() + i * m_W.cols(), filters[i].K.data(), m_W.cols() * sizeof(netfloat_t));
+    m_B[i] = filters[i].b;
+  }
 }
 
 const std::vector<ConvolutionalLayer::Filter> ConvolutionalLayer::test_filters() const {
-  return m_filters;
+  std::vector<Filter> filters;
+  for (size_t i = 0; i < m_W.rows(); ++i) {
+    ConstKernelView K = Kernel::createShallow(m_W.data() + i * m_W.cols(), m_kernelW, m_kernelH,
+      m_inputDepth);
+    filters.push_back(Filter{ *K, m_B[i] });
+  }
+  return filters;
 }
 
 const std::vector<ConvolutionalLayer::Filter> ConvolutionalLayer::test_filterDeltas() const {
-  return m_paramDeltas;
+  std::vector<Filter> deltas;
+  for (size_t i = 0; i < m_deltaW.rows(); ++i) {
+    ConstKernelView K = Kernel::createShallow(m_deltaW.data() + i * m_deltaW.cols(), m_kernelW,
+      m_kernelH, m_inputDepth);
+    deltas.push_back(Filter{ *K, m_deltaB[i] });
+  }
+  return deltas;
 }
 
 }
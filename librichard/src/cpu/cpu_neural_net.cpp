@@ -7,7 +7,9 @@
 #include "richard/labelled_data_set.hpp"
 #include "richard/config.hpp"
 #include "richard/event_system.hpp"
+#include "richard/thread_pool.hpp"
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <algorithm>
 #include <sstream>
@@ -36,7 +38,10 @@ class CpuNeuralNetImpl : public CpuNeuralNet {
     void writeToStream(std::ostream& s) const override;
     void train(LabelledDataSet& data) override;
     Vector evaluate(const Array3& inputs) const override;
+    void evaluateInto(const Array3& inputs, Vector& outputs) const override;
+    Matrix evaluateBatch(const Matrix& inputs) const override;
     ModelDetails modelDetails() const override;
+    void quantize(LabelledDataSet& data, size_t maxSamples) override;
 
     void abort() override;
 
@@ -48,8 +53,9 @@ class CpuNeuralNetImpl : public CpuNeuralNet {
     void initialize(const Size3& inputShape, const Config& config, std::istream* stream);
     LayerPtr constructLayer(const Config& obj, const Size3& prevLayerSize,
       std::istream* stream) const;
-    netfloat_t feedForward(const Array3& x, const Vector& y);
-    void backPropagate(const Array3& x, const Vector& y);
+    void createReplicas(size_t numReplicas);
+    netfloat_t feedForward(std::vector<LayerPtr>& layers, const Matrix& X, const Matrix& Y);
+    void backPropagate(std::vector<LayerPtr>& layers, const Matrix& X, const Matrix& Y);
     void updateParams(size_t epoch);
 
     EventSystem& m_eventSystem;
@@ -57,6 +63,12 @@ class CpuNeuralNetImpl : public CpuNeuralNet {
     Size3 m_inputShape;
     Hyperparams m_params;
     std::vector<LayerPtr> m_layers;
+    std::vector<Config> m_layerConfigs;
+    // Size of the largest activations that evaluate passes between layers
+    size_t m_maxActivationSize;
+    ThreadPoolPtr m_threadPool;
+    // One copy of the layers per additional worker thread
+    std::vector<std::vector<LayerPtr>> m_replicas;
     std::atomic<bool> m_abort;
 };
 
@@ -88,6 +100,8 @@ void CpuNeuralNetImpl::initialize(const Size3& inputShape, const Config& config,
     auto layersConfig = config.getObjectArray("hiddenLayers");
 
     for (auto layerConfig : layersConfig) {
+      setLayerStream(layerConfig, m_params.seed, m_layerConfigs.size());
+      m_layerConfigs.push_back(layerConfig);
       m_layers.push_back(constructLayer(layerConfig, prevLayerSize, stream));
       prevLayerSize = m_layers.back()->outputSize();
     }
@@ -95,14 +109,22 @@ void CpuNeuralNetImpl::initialize(const Size3& inputShape, const Config& config,
 
   auto outLayerConfig = config.getObject("outputLayer");
   outLayerConfig.setString("type", "output");
+  setLayerStream(outLayerConfig, m_params.seed, m_layerConfigs.size());
+  m_layerConfigs.push_back(outLayerConfig);
   m_layers.push_back(constructLayer(outLayerConfig, prevLayerSize, stream));
+
+  m_maxActivationSize = 0;
+  for (size_t i = 0; i + 1 < m_layers.size(); ++i) {
+    m_maxActivationSize = std::max(m_maxActivationSize, calcProduct(m_layers[i]->outputSize()));
+  }
 }
 
 ModelDetails CpuNeuralNetImpl::modelDetails() const {
   return ModelDetails{
     { "Batch size", std::to_string(m_params.batchSize) },
     { "Mini-batch size", std::to_string(m_params.miniBatchSize) },
-    { "Epochs", std::to_string(m_params.epochs) }
+    { "Epochs", std::to_string(m_params.epochs) },
+    { "Threads", std::to_string(m_params.threads) }
   };
 }
 
@@ -154,34 +176,64 @@ Size3 CpuNeuralNetImpl::inputSize() const {
   return m_inputShape;
 }
 
-netfloat_t CpuNeuralNetImpl::feedForward(const Array3& x, const Vector& y) {
-  const DataArray* A = &x.storage();
-  for (auto& layer : m_layers) {
-    layer->trainForward(*A);
-    A = &layer->activations();
+// Each row of X is a sample and the same row of Y its expected output
+netfloat_t CpuNeuralNetImpl::feedForward(std::vector<LayerPtr>& layers, const Matrix& X,
+  const Matrix& Y) {
+
+  const Matrix* A = &X;
+  for (auto& layer : layers) {
+    layer->trainForwardBatch(*A);
+    A = &layer->batchActivations();
   }
 
-  ConstVectorPtr outputs = Vector::createShallow(*A);
+  netfloat_t cost = 0.0;
+  for (size_t i = 0; i < A->rows(); ++i) {
+    cost += quadraticCost(*A->slice(i), *Y.slice(i));
+  }
 
-  return quadraticCost(*outputs, y);
+  return cost;
 }
 
-void CpuNeuralNetImpl::backPropagate(const Array3& x, const Vector& y) {
-  int numLayers = static_cast<int>(m_layers.size());
+void CpuNeuralNetImpl::backPropagate(std::vector<LayerPtr>& layers, const Matrix& X,
+  const Matrix& Y) {
+
+  int numLayers = static_cast<int>(layers.size());
 
   for (int i = numLayers - 1; i >= 0; --i) {
     if (i == numLayers - 1) {
-      m_layers[i]->updateDeltas(m_layers[i - 1]->activations(), y.storage());
+      layers[i]->updateDeltasBatch(layers[i - 1]->batchActivations(), Y);
     }
     else if (i == 0) {
-      m_layers[i]->updateDeltas(x.storage(), m_layers[i + 1]->inputDelta());
+      layers[i]->updateDeltasBatch(X, layers[i + 1]->batchInputDelta());
     }
     else {
-      m_layers[i]->updateDeltas(m_layers[i - 1]->activations(), m_layers[i + 1]->inputDelta());
+      layers[i]->updateDeltasBatch(layers[i - 1]->batchActivations(),
+        layers[i + 1]->batchInputDelta());
     }
   }
 }
 
+void CpuNeuralNetImpl::createReplicas(size_t numReplicas) {
+  m_replicas.clear();
+
+  for (size_t i = 0; i < numReplicas; ++i) {
+    std::vector<LayerPtr> layers;
+    Size3 prevLayerSize = m_inputShape;
+
+    // The replicas' parameters are overwritten by copyParams, but each needs its own streams for
+    // dropout
+    for (size_t l = 0; l < m_layerConfigs.size(); ++l) {
+      Config layerConfig = m_layerConfigs[l];
+      setLayerStream(layerConfig, m_params.seed, (i + 1) * m_layerConfigs.size() + l);
+
+      layers.push_back(constructLayer(layerConfig, prevLayerSize, nullptr));
+      prevLayerSize = layers.back()->outputSize();
+    }
+
+    m_replicas.push_back(std::move(layers));
+  }
+}
+
 void CpuNeuralNetImpl::updateParams(size_t epoch) { 
   for (auto& layer : m_layers) {
     layer->updateParams(epoch);
@@ -190,6 +242,12 @@ void CpuNeuralNetImpl::updateParams(size_t epoch) {
 
 void CpuNeuralNetImpl::train(LabelledDataSet& trainingData) {
   m_abort = false;
+
+  if (m_threadPool == nullptr) {
+    m_threadPool = std::make_unique<ThreadPool>(m_params.threads);
+    createReplicas(m_threadPool->numThreads() - 1);
+  }
+
   for (uint32_t epoch = 0; epoch < m_params.epochs; ++epoch) {
     if (m_abort) {
       break;
@@ -200,32 +258,82 @@ void CpuNeuralNetImpl::train(LabelledDataSet& trainingData) {
     netfloat_t cost = 0.0;
     uint32_t samplesProcessed = 0;
 
+    // Samples are gathered into the rows of X and Y, and each mini-batch goes through the
+    // layers as a single matrix
+    Matrix X(calcProduct(m_inputShape), m_params.miniBatchSize);
+    Matrix Y(calcProduct(m_layers.back()->outputSize()), m_params.miniBatchSize);
+    size_t batchRows = 0;
+
+    // The rows of the mini-batch are shared out between the workers. Each accumulates
+    // parameter deltas in its own copy of the layers, and these are merged before the update.
+    auto processMiniBatch = [&]() {
+      size_t rowsPerWorker = (batchRows + m_threadPool->numThreads() - 1) /
+        m_threadPool->numThreads();
+      size_t numWorkers = (batchRows + rowsPerWorker - 1) / rowsPerWorker;
+      std::vector<netfloat_t> workerCost(numWorkers, 0.0);
+
+      m_threadPool->parallelFor(numWorkers, [&](size_t worker) {
+        std::vector<LayerPtr>& layers = worker == 0 ? m_layers : m_replicas[worker - 1];
+
+        if (worker != 0) {
+          for (size_t l = 0; l < layers.size(); ++l) {
+            layers[l]->copyParams(*m_layers[l]);
+          }
+        }
+
+        size_t firstRow = worker * rowsPerWorker;
+        size_t rows = std::min(rowsPerWorker, batchRows - firstRow);
+
+        ConstMatrixView pX = Matrix::createShallow(X.data() + firstRow * X.cols(), X.cols(), rows);
+        ConstMatrixView pY = Matrix::createShallow(Y.data() + firstRow * Y.cols(), Y.cols(), rows);
+
+        workerCost[worker] = feedForward(layers, *pX, *pY);
+        backPropagate(layers, *pX, *pY);
+      });
+
+      for (size_t worker = 1; worker < numWorkers; ++worker) {
+        for (size_t l = 0; l < m_layers.size(); ++l) {
+          m_layers[l]->mergeDeltas(*m_replicas[worker - 1][l]);
+        }
+      }
+
+      for (netfloat_t c : workerCost) {
+        cost += c;
+      }
+
+      updateParams(epoch);
+
+      for (size_t i = 0; i < batchRows; ++i) {
+        uint32_t sample = samplesProcessed - static_cast<uint32_t>(batchRows - i);
+        m_eventSystem.raise(ESampleProcessed{sample, m_params.batchSize});
+      }
+
+      batchRows = 0;
+    };
+
     auto pendingSamples = std::async([&]() { return trainingData.loadSamples(); });
     std::vector<Sample> samples = pendingSamples.get();
 
     while (samples.size() > 0) {
       pendingSamples = std::async([&]() { return trainingData.loadSamples(); });
 
-      DBG_ASSERT_MSG(samples[0].data.size() == calcProduct(m_inputShape),
-        "Sample size is " << samples[0].data.size() << ", expected " << calcProduct(m_inputShape));
+      DBG_ASSERT_MSG(samples[0].size() == calcProduct(m_inputShape),
+        "Sample size is " << samples[0].size() << ", expected " << calcProduct(m_inputShape));
 
       for (size_t i = 0; i < samples.size(); ++i) {
         const auto& sample = samples[i];
-        const Array3& x = sample.data;
-        const Vector& y = trainingData.classOutputVector(sample.label);
-
-        cost += feedForward(x, y);
-        backPropagate(x, y);
-
-        bool lastSample = (samplesProcessed + 1) == m_params.batchSize;
-        if (((samplesProcessed + 1) % m_params.miniBatchSize == 0) || lastSample) {
-          updateParams(epoch);
-        }
+        ConstVectorView y = trainingData.classOutputVector(sample.classId);
 
-        m_eventSystem.raise(ESampleProcessed{samplesProcessed, m_params.batchSize});
+        sample.copyTo(X.data() + batchRows * X.cols());
+        memcpy(Y.data() + batchRows * Y.cols(), y->data(), Y.cols() * sizeof(netfloat_t));
 
+        ++batchRows;
         ++samplesProcessed;
 
+        if (batchRows == m_params.miniBatchSize || samplesProcessed >= m_params.batchSize) {
+          processMiniBatch();
+        }
+
         if (samplesProcessed >= m_params.batchSize) {
           break;
         }
@@ -238,23 +346,118 @@ void CpuNeuralNetImpl::train(LabelledDataSet& trainingData) {
       samples = pendingSamples.get();
     }
 
+    if (batchRows > 0) {
+      processMiniBatch();
+    }
+
+    // Pruning after every epoch lets the remaining weights adjust in the epochs that follow
+    for (auto& layer : m_layers) {
+      layer->prune();
+    }
+
     cost /= samplesProcessed;
     m_eventSystem.raise(EEpochCompleted{epoch, m_params.epochs, cost});
 
     trainingData.seekToBeginning();
   }
 
+  for (auto& layer : m_layers) {
+    layer->finishTraining();
+  }
+
   m_isTrained = true;
 }
 
 Vector CpuNeuralNetImpl::evaluate(const Array3& x) const {
-  DataArray A;
+  Vector y(calcProduct(m_layers.back()->outputSize()));
+  evaluateInto(x, y);
+
+  return y;
+}
+
+// Activations ping-pong between the two halves of an arena that's allocated once per thread, and
+// the output layer writes straight into y
+void CpuNeuralNetImpl::evaluateInto(const Array3& x, Vector& y) const {
+  ASSERT_MSG(y.size() == calcProduct(m_layers.back()->outputSize()),
+    "Output vector has wrong size");
+
+  thread_local std::vector<netfloat_t> arena;
+  if (arena.size() < 2 * m_maxActivationSize) {
+    arena.resize(2 * m_maxActivationSize);
+  }
+
+  netfloat_t* buffers[] = { arena.data(), arena.data() + m_maxActivationSize };
+  const netfloat_t* A = x.data();
+
+  for (size_t i = 0; i + 1 < m_layers.size(); ++i) {
+    netfloat_t* Z = buffers[i % 2];
+    m_layers[i]->evalForwardInto(A, Z);
+    A = Z;
+  }
+
+  m_layers.back()->evalForwardInto(A, y.data());
+}
+
+// As evaluateInto, but a batch at a time, so that dense layers multiply whole matrices
+Matrix CpuNeuralNetImpl::evaluateBatch(const Matrix& X) const {
+  ASSERT_MSG(X.cols() == calcProduct(m_inputShape), "Expected samples of size "
+    << calcProduct(m_inputShape) << ", got " << X.cols());
+
+  thread_local Matrix buffers[2];
+  const Matrix* A = &X;
+
+  for (size_t i = 0; i + 1 < m_layers.size(); ++i) {
+    Matrix& Z = buffers[i % 2];
+    size_t size = calcProduct(m_layers[i]->outputSize());
+    if (Z.cols() != size || Z.rows() != X.rows()) {
+      Z = Matrix(size, X.rows());
+    }
 
-  for (size_t i = 0; i < m_layers.size(); ++i) {
-    A = m_layers[i]->evalForward(i == 0 ? x.storage() : A);
+    m_layers[i]->evalForwardBatch(*A, Z);
+    A = &Z;
   }
 
-  return Vector(A);
+  Matrix Y(calcProduct(m_layers.back()->outputSize()), X.rows());
+  m_layers.back()->evalForwardBatch(*A, Y);
+
+  return Y;
+}
+
+void CpuNeuralNetImpl::quantize(LabelledDataSet& data, size_t maxSamples) {
+  ASSERT_MSG(m_isTrained, "Neural net is not trained");
+
+  // Each layer is calibrated on the float32 activations of the layers before it
+  size_t samplesProcessed = 0;
+  DataArray input(calcProduct(m_inputShape), false);
+  std::vector<Sample> samples = data.loadSamples();
+  while (samples.size() > 0 && samplesProcessed < maxSamples) {
+    for (const auto& sample : samples) {
+      if (samplesProcessed == maxSamples) {
+        break;
+      }
+
+      sample.copyTo(input.data());
+
+      DataArray A;
+      for (size_t i = 0; i < m_layers.size(); ++i) {
+        const DataArray& x = i == 0 ? input : A;
+        m_layers[i]->calibrate(x);
+        A = m_layers[i]->evalForward(x);
+      }
+
+      ++samplesProcessed;
+    }
+
+    samples = data.loadSamples();
+  }
+
+  data.seekToBeginning();
+
+  ASSERT_MSG(samplesProcessed > 0, "No samples to calibrate quantization with");
+
+  for (auto& layer : m_layers) {
+    layer->quantize();
+  }
 }
 
 }
@@ -1,44 +1,95 @@
 #include "richard/cpu/dense_layer.hpp"
 #include "richard/utils.hpp"
 #include "richard/config.hpp"
+#include "richard/neural_net.hpp"
+#include <algorithm>
 
 namespace richard {
 namespace cpu {
+namespace {
+
+// Mini-batches with no more than this fraction of non-zero inputs take the sparse path. The
+// sparse products cost about the same as the dense ones at around half density, but keeping
+// W^T up to date adds to that.
+const netfloat_t SPARSE_INPUT_DENSITY = 0.3f;
+
+bool isSparse(const Matrix& inputs) {
+  size_t nonZeros = 0;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    nonZeros += inputs.data()[i] != 0.f;
+  }
+  return nonZeros <= SPARSE_INPUT_DENSITY * inputs.size();
+}
+
+}
 
 DenseLayer::DenseLayer(const Config& config, size_t inputSize) {
   initialize(config, inputSize);
 
-  m_W.randomize(0.1f);
+  m_W.randomize(0.1f, m_random);
+  m_inferenceW.update(m_W);
 }
 
 DenseLayer::DenseLayer(const Config& config, std::istream& stream, size_t inputSize) {
   initialize(config, inputSize);
 
   stream.read(reinterpret_cast<char*>(m_B.data()), m_B.size() * sizeof(netfloat_t));
-  stream.read(reinterpret_cast<char*>(m_W.data()), m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+
+  // Pruned layers are stored in sparse form
+  if (m_pruning.enabled()) {
+    m_W = SparseMatrix(stream, m_W.cols(), m_W.rows()).toDense();
+    m_inferenceW.sparsify(m_W);
+  }
+  else {
+    stream.read(reinterpret_cast<char*>(m_W.data()),
+      m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+    m_inferenceW.update(m_W);
+  }
 }
 
 void DenseLayer::initialize(const Config& config, size_t inputSize) {
-  m_activationFn = sigmoid;
-  m_activationFnPrime = sigmoidPrime;
+  m_activation = Activation(Activation::Type::sigmoid);
+
+  if (config.contains("inferencePrecision")) {
+    m_inferenceW = InferenceWeights(parsePrecision(config.getString("inferencePrecision")));
+  }
+
+  if (config.contains("pruning")) {
+    m_pruning = Pruning(config.getObject("pruning"));
+  }
 
   size_t size = config.getNumber<size_t>("size");
   m_learnRate = config.getNumber<netfloat_t>("learnRate");
   m_learnRateDecay = config.getNumber<netfloat_t>("learnRateDecay");
   m_dropoutRate = config.getNumber<netfloat_t>("dropoutRate");
+  m_random = layerRandom(config);
 
   m_B = Vector(size);
   m_W = Matrix(inputSize, size);
+  m_Z = Vector(size);
+  m_A = Vector(size);
+  m_delta = Vector(size);
 
   m_inputDelta = Vector(inputSize);
   m_deltaB = Vector(size);
   m_deltaW = Matrix(inputSize, size);
+
+  m_sparseBatch = false;
+  m_sparseInputsSeen = false;
+  m_WtCurrent = false;
+  m_denseDeltas = false;
 }
 
 void DenseLayer::writeToStream(std::ostream& stream) const {
   stream.write(reinterpret_cast<const char*>(m_B.data()), m_B.size() * sizeof(netfloat_t));
-  stream.write(reinterpret_cast<const char*>(m_W.data()),
-    m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+
+  if (m_pruning.enabled()) {
+    SparseMatrix(m_W).writeToStream(stream);
+  }
+  else {
+    stream.write(reinterpret_cast<const char*>(m_W.data()),
+      m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+  }
 }
 
 Size3 DenseLayer::outputSize() const {
@@ -53,56 +104,272 @@ const DataArray& DenseLayer::inputDelta() const {
   return m_inputDelta.storage();
 }
 
-DataArray DenseLayer::evalForward(const DataArray& inputs) const {
-  ConstVectorPtr pX = Vector::createShallow(inputs);
-  const Vector& x = *pX;
+void DenseLayer::evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const {
+  ConstVectorView x = Vector::createShallow(inputs, m_W.cols());
+  VectorView y = Vector::createShallow(outputs, m_B.size());
+
+  m_inferenceW.evaluate(m_W, *x, m_B, *y, m_activation);
+}
 
-  Vector y = (m_W * x + m_B).computeTransform(m_activationFn);
+void DenseLayer::evalForwardBatch(const Matrix& inputs, Matrix& outputs) const {
+  DBG_ASSERT(inputs.cols() == m_W.cols());
 
-  return y.storage();
+  m_inferenceW.evaluateBatch(m_W, inputs, m_B, outputs, m_activation);
 }
 
 void DenseLayer::trainForward(const DataArray& inputs) {
-  auto shouldDrop = [this]() {
-    return rand() / (RAND_MAX + 1.0) < m_dropoutRate;
-  };
-
-  ConstVectorPtr pX = Vector::createShallow(inputs);
+  ConstVectorView pX = Vector::createShallow(inputs);
   const Vector& x = *pX;
 
-  m_Z = m_W * x + m_B;
-  m_A = m_Z.computeTransform(m_activationFn);
+  gemv(m_W, x, m_B, m_Z, m_A, [this](const netfloat_t* Z, netfloat_t* A, size_t n) {
+    m_activation.apply(Z, A, n);
+  });
 
-  for (size_t a = 0; a < m_A.size(); ++a) {
-    if (shouldDrop()) {
-      m_A[a] = 0.0;
-    }
-  }
+  m_random.dropout(m_A.data(), m_dropoutRate, m_A.size());
 }
 
 void DenseLayer::updateDeltas(const DataArray& inputs, const DataArray& outputDelta) {
-  ConstVectorPtr pDeltaA = Vector::createShallow(outputDelta);
+  ConstVectorView pDeltaA = Vector::createShallow(outputDelta);
   const Vector& deltaA = *pDeltaA;
 
-  Vector delta = deltaA.hadamard(m_Z.computeTransform(m_activationFnPrime));
-  m_inputDelta = m_W.transposeMultiply(delta);
+  m_activation.applyPrime(m_Z.data(), m_delta.data(), m_delta.size());
+  for (size_t i = 0; i < m_delta.size(); ++i) {
+    m_delta[i] *= deltaA[i];
+  }
+
+  transposeMultiply(m_W, m_delta, m_inputDelta);
 
-  m_deltaW += outerProduct(delta, inputs);
-  m_deltaB += delta;
+  ConstVectorView pX = Vector::createShallow(inputs);
+  ger(1.f, m_delta, *pX, m_deltaW);
+  axpy(1.f, m_delta, m_deltaB);
+  m_denseDeltas = true;
+}
+
+void DenseLayer::resizeBatch(size_t batchSize) {
+  if (m_batchZ.rows() != batchSize) {
+    m_batchZ = Matrix(m_W.rows(), batchSize);
+    m_batchA = Matrix(m_W.rows(), batchSize);
+    m_batchDelta = Matrix(m_W.rows(), batchSize);
+    m_batchInputDelta = Matrix(m_W.cols(), batchSize);
+  }
+}
+
+const Matrix& DenseLayer::batchActivations() const {
+  return m_batchA;
+}
+
+const Matrix& DenseLayer::batchInputDelta() const {
+  return m_batchInputDelta;
+}
+
+void DenseLayer::trainForwardBatch(const Matrix& inputs) {
+  DBG_ASSERT(inputs.cols() == m_W.cols());
+
+  resizeBatch(inputs.rows());
+
+  m_sparseBatch = false;
+  if (isSparse(inputs)) {
+    m_sparseInputsSeen = true;
+
+    // W^T is brought up to date at the next update, so the first sparse batch goes the dense way
+    if (m_WtCurrent) {
+      m_sparseInputs = SparseMatrix(inputs);
+      m_sparseBatch = true;
+    }
+  }
+
+  if (m_sparseBatch) {
+    multiply(m_sparseInputs, m_Wt, m_batchZ);
+  }
+  else {
+    multiplyTranspose(inputs, m_W, m_batchZ);
+  }
+  for (size_t i = 0; i < m_batchZ.rows(); ++i) {
+    *m_batchZ.slice(i) += m_B;
+  }
+
+  m_activation.apply(m_batchZ.data(), m_batchA.data(), m_batchZ.size());
+
+  m_random.dropout(m_batchA.data(), m_dropoutRate, m_batchA.size());
+}
+
+void DenseLayer::updateDeltasBatch(const Matrix& inputs, const Matrix& outputDelta) {
+  DBG_ASSERT(inputs.rows() == m_batchZ.rows());
+
+  Matrix& delta = m_batchDelta;
+  m_activation.applyPrime(m_batchZ.data(), delta.data(), delta.size());
+  for (size_t i = 0; i < delta.size(); ++i) {
+    delta.data()[i] *= outputDelta.data()[i];
+  }
+  multiply(delta, m_W, m_batchInputDelta);
+
+  if (m_sparseBatch) {
+    transposeMultiply(m_sparseInputs, delta, m_deltaWt, true);
+    for (size_t k = 0; k < m_sparseInputs.nonZeros(); ++k) {
+      markSparseColumn(m_sparseInputs.columns()[k]);
+    }
+  }
+  else {
+    transposeMultiply(delta, inputs, m_deltaW, true);
+    m_denseDeltas = true;
+  }
+
+  for (size_t i = 0; i < delta.rows(); ++i) {
+    m_deltaB += *delta.slice(i);
+  }
+}
+
+void DenseLayer::allocateSparseDeltas() {
+  if (m_deltaWt.size() != m_W.size()) {
+    m_deltaWt = Matrix(m_W.rows(), m_W.cols());
+    m_isSparseColumn = std::vector<uint8_t>(m_W.cols(), 0);
+  }
+}
+
+void DenseLayer::markSparseColumn(uint32_t column) {
+  if (!m_isSparseColumn[column]) {
+    m_isSparseColumn[column] = 1;
+    m_sparseColumns.push_back(column);
+  }
+}
+
+void DenseLayer::copyParams(const Layer& source) {
+  const DenseLayer& src = dynamic_cast<const DenseLayer&>(source);
+
+  m_W = src.m_W;
+  m_B = src.m_B;
+  m_inferenceW.invalidate();
+
+  m_WtCurrent = src.m_WtCurrent;
+  if (m_WtCurrent) {
+    m_Wt = src.m_Wt;
+    allocateSparseDeltas();
+  }
+}
+
+void DenseLayer::mergeDeltas(Layer& source) {
+  DenseLayer& src = dynamic_cast<DenseLayer&>(source);
+
+  if (src.m_denseDeltas) {
+    m_deltaW += src.m_deltaW;
+    src.m_deltaW.zero();
+    m_denseDeltas = true;
+  }
+
+  m_deltaB += src.m_deltaB;
+  src.m_deltaB.zero();
+
+  const size_t rows = m_W.rows();
+  for (uint32_t c : src.m_sparseColumns) {
+    netfloat_t* D = src.m_deltaWt.data() + c * rows;
+    simd::kernels().axpy(1.f, D, m_deltaWt.data() + c * rows, rows);
+    std::fill(D, D + rows, 0.f);
+
+    markSparseColumn(c);
+    src.m_isSparseColumn[c] = 0;
+  }
+
+  m_sparseInputsSeen = m_sparseInputsSeen || src.m_sparseInputsSeen;
+
+  src.m_sparseInputsSeen = false;
+  src.m_denseDeltas = false;
+  src.m_sparseColumns.clear();
+}
+
+void DenseLayer::calibrate(const DataArray& inputs) {
+  m_inferenceW.calibrate(inputs);
+}
+
+void DenseLayer::quantize() {
+  m_inferenceW.quantize(m_W);
+}
+
+void DenseLayer::finishTraining() {
+  m_inferenceW.refresh(m_W);
+}
+
+void DenseLayer::prune() {
+  if (m_pruning.enabled()) {
+    m_pruning.apply(m_W);
+    m_inferenceW.sparsify(m_W);
+    m_WtCurrent = false;
+  }
 }
 
 void DenseLayer::updateParams(size_t epoch) {
   netfloat_t learnRate = m_learnRate * static_cast<netfloat_t>(pow(m_learnRateDecay, epoch));
 
-  m_W -= m_deltaW * learnRate;
-  m_B -= m_deltaB * learnRate;
+  const auto& kernels = simd::kernels();
+  const size_t rows = m_W.rows();
+  const size_t cols = m_W.cols();
+
+  if (m_denseDeltas) {
+    axpy(-learnRate, m_deltaW, m_W);
+    m_deltaW.zero();
+  }
+
+  // The deltas from sparse batches are held transposed, and only for the inputs that were
+  // non-zero. Unless there were dense deltas too, they're applied to W^T and the changed rows
+  // copied back into W.
+  // Writing a column of W is a strided pass, so when most have changed it's quicker to transpose
+  // the whole of W^T
+  bool copyAll = !m_denseDeltas && m_sparseColumns.size() > cols / 4;
+
+  for (uint32_t c : m_sparseColumns) {
+    netfloat_t* D = m_deltaWt.data() + c * rows;
 
+    if (m_denseDeltas) {
+      for (size_t j = 0; j < rows; ++j) {
+        m_W.data()[j * cols + c] -= learnRate * D[j];
+      }
+    }
+    else {
+      netfloat_t* Wt = m_Wt.data() + c * rows;
+      kernels.axpy(-learnRate, D, Wt, rows);
+      if (!copyAll) {
+        for (size_t j = 0; j < rows; ++j) {
+          m_W.data()[j * cols + c] = Wt[j];
+        }
+      }
+    }
+
+    std::fill(D, D + rows, 0.f);
+    m_isSparseColumn[c] = 0;
+  }
+
+  if (copyAll) {
+    transpose(m_Wt, m_W);
+  }
+
+  axpy(-learnRate, m_deltaB, m_B);
   m_deltaB.zero();
-  m_deltaW.zero();
+
+  m_inferenceW.invalidate();
+
+  // W^T is only kept for as long as sparse batches keep arriving
+  if (m_sparseInputsSeen) {
+    if (!m_WtCurrent || m_denseDeltas) {
+      if (m_Wt.size() != m_W.size()) {
+        m_Wt = Matrix(rows, cols);
+      }
+      transpose(m_W, m_Wt);
+      allocateSparseDeltas();
+      m_WtCurrent = true;
+    }
+  }
+  else {
+    m_WtCurrent = false;
+  }
+
+  m_sparseColumns.clear();
+  m_sparseInputsSeen = false;
+  m_denseDeltas = false;
 }
 
 void DenseLayer::test_setWeights(const DataArray& W) {
   m_W = Matrix(W, m_W.cols(), m_W.rows());
+  m_inferenceW.update(m_W);
+  m_WtCurrent = false;
 }
 
 void DenseLayer::test_setBiases(const DataArray& B) {
@@ -126,8 +393,7 @@ const Vector& DenseLayer::test_B() const {
 }
 
 void DenseLayer::test_setActivationFn(ActivationFn f, ActivationFn fPrime) {
-  m_activationFn = f;
-  m_activationFnPrime = fPrime;
+  m_activation = Activation(f, fPrime);
 }
 
 }
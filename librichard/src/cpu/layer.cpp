@@ -0,0 +1,188 @@
+#include "richard/cpu/layer.hpp"
+#include "richard/config.hpp"
+#include "richard/exception.hpp"
+#include "richard/utils.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace richard {
+namespace cpu {
+namespace {
+
+// Below this many samples, a dense layer evaluates a batch one sample at a time, as the matrix
+// product kernels don't fill their vector registers on narrower matrices
+const size_t MIN_GEMM_BATCH = 32;
+
+}
+
+DataArray Layer::evalForward(const DataArray& inputs) const {
+  DataArray outputs(calcProduct(outputSize()));
+  evalForwardInto(inputs.data(), outputs.data());
+  return outputs;
+}
+
+void Layer::evalForwardBatch(const Matrix& inputs, Matrix& outputs) const {
+  DBG_ASSERT(outputs.rows() == inputs.rows());
+  DBG_ASSERT(outputs.cols() == calcProduct(outputSize()));
+
+  for (size_t i = 0; i < inputs.rows(); ++i) {
+    evalForwardInto(inputs.data() + i * inputs.cols(), outputs.data() + i * outputs.cols());
+  }
+}
+
+Pruning::Pruning()
+  : m_enabled(false)
+  , m_threshold(0.f)
+  , m_sparsity(0.f) {}
+
+Pruning::Pruning(const Config& config)
+  : Pruning() {
+
+  m_enabled = true;
+
+  if (config.contains("threshold")) {
+    m_threshold = config.getNumber<netfloat_t>("threshold");
+  }
+  else if (config.contains("sparsity")) {
+    m_sparsity = config.getNumber<netfloat_t>("sparsity");
+
+    if (m_sparsity < 0.f || m_sparsity > 1.f) {
+      EXCEPTION("Pruning sparsity must be between 0 and 1, got " << m_sparsity);
+    }
+  }
+  else {
+    EXCEPTION("Pruning config must contain a threshold or a sparsity");
+  }
+}
+
+void Pruning::apply(Matrix& W) const {
+  if (!m_enabled) {
+    return;
+  }
+
+  pruneBelow(W, m_sparsity > 0.f ? magnitudeQuantile(W, m_sparsity) : m_threshold);
+}
+
+InferenceWeights::InferenceWeights(Precision precision)
+  : m_precision(precision)
+  , m_quantized(false)
+  , m_inputRange(0.f)
+  , m_sparse(false)
+  , m_current(true) {}
+
+void InferenceWeights::update(const Matrix& W) {
+  m_current = true;
+
+  if (m_quantized) {
+    m_int8.quantize(W, m_inputRange);
+    return;
+  }
+  if (m_sparse) {
+    m_sparseW = SparseMatrix(W);
+    return;
+  }
+
+  switch (m_precision) {
+    case Precision::float32: break;
+    case Precision::float16: m_float16.pack(W); break;
+    case Precision::bfloat16: m_bfloat16.pack(W); break;
+  }
+}
+
+void InferenceWeights::invalidate() {
+  // At float32, W itself is evaluated, so there's no copy to go out of date
+  m_current = !m_quantized && !m_sparse && m_precision == Precision::float32;
+}
+
+void InferenceWeights::refresh(const Matrix& W) {
+  if (!m_current) {
+    update(W);
+  }
+}
+
+void InferenceWeights::evaluate(const Matrix& W, const Vector& x, const Vector& b, Vector& y,
+  const Activation& activation) const {
+
+  ASSERT_MSG(m_current, "Inference weights are out of date");
+
+  auto f = [&activation](const netfloat_t* Z, netfloat_t* A, size_t n) {
+    activation.apply(Z, A, n);
+  };
+
+  if (m_quantized) {
+    gemv(m_int8, x, b, y, y, f);
+    return;
+  }
+  if (m_sparse) {
+    gemv(m_sparseW, x, b, y, y, f);
+    return;
+  }
+
+  switch (m_precision) {
+    case Precision::float32: gemv(W, x, b, y, y, f); break;
+    case Precision::float16: gemv(m_float16, x, b, y, y, f); break;
+    case Precision::bfloat16: gemv(m_bfloat16, x, b, y, y, f); break;
+  }
+}
+
+void InferenceWeights::evaluateBatch(const Matrix& W, const Matrix& X, const Vector& b,
+  Matrix& Y, const Activation& activation) const {
+
+  DBG_ASSERT(Y.rows() == X.rows());
+  ASSERT_MSG(m_current, "Inference weights are out of date");
+
+  bool rowByRow = m_quantized || m_sparse || m_precision != Precision::float32;
+  if (rowByRow || X.rows() < MIN_GEMM_BATCH) {
+    for (size_t i = 0; i < X.rows(); ++i) {
+      VectorView y = Y.slice(i);
+      evaluate(W, *X.slice(i), b, *y, activation);
+    }
+    return;
+  }
+
+  // Working on the transposes, Y^T = WX^T, means transposing only the activations rather than
+  // the much larger W
+  thread_local std::vector<netfloat_t> buffer;
+  buffer.resize(std::max(buffer.size(), X.size() + Y.size()));
+
+  MatrixView Xt = Matrix::createShallow(buffer.data(), X.rows(), X.cols());
+  MatrixView Yt = Matrix::createShallow(buffer.data() + X.size(), Y.rows(), Y.cols());
+
+  transpose(X, *Xt);
+  multiply(W, *Xt, *Yt);
+  for (size_t i = 0; i < Yt->rows(); ++i) {
+    *Yt->slice(i) += b[i];
+  }
+
+  activation.apply(Yt->data(), Yt->data(), Yt->size());
+  transpose(*Yt, Y);
+}
+
+void InferenceWeights::calibrate(const DataArray& inputs) {
+  m_inputRange = std::max(m_inputRange, maxMagnitude(inputs));
+}
+
+void InferenceWeights::quantize(const Matrix& W) {
+  m_quantized = true;
+  m_float16 = PackedMatrix<float16_t>();
+  m_bfloat16 = PackedMatrix<bfloat16_t>();
+  m_int8.quantize(W, m_inputRange);
+  m_sparse = false;
+  m_sparseW = SparseMatrix();
+  m_current = true;
+}
+
+void InferenceWeights::sparsify(const Matrix& W) {
+  if (m_quantized) {
+    return;
+  }
+
+  m_sparse = true;
+  m_float16 = PackedMatrix<float16_t>();
+  m_bfloat16 = PackedMatrix<bfloat16_t>();
+  m_sparseW = SparseMatrix(W);
+  m_current = true;
+}
+
+}
+}
@@ -42,9 +42,11 @@ const DataArray& MaxPoolingLayer::inputDelta() const {
 }
 
 void MaxPoolingLayer::trainForward(const DataArray& inputs) {
-  ConstArray3Ptr pImage = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
-  const Array3& image = *pImage;
+  ConstArray3View pImage = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
+  forwardPass(*pImage, m_Z, m_mask);
+}
 
+void MaxPoolingLayer::forwardPass(const Array3& image, Array3& Z, Array3& mask) const {
   size_t outputW = m_inputW / m_regionW;
   size_t outputH = m_inputH / m_regionH;
 
@@ -67,25 +69,26 @@ void MaxPoolingLayer::trainForward(const DataArray& inputs) {
               largestInputY = imgY;
             }
 
-            m_mask.set(imgX, imgY, z, 0.0);
+            mask.set(imgX, imgY, z, 0.0);
           }
         }
 
-        m_mask.set(largestInputX, largestInputY, z, 1.0);
-        m_Z.set(x, y, z, largest);
+        mask.set(largestInputX, largestInputY, z, 1.0);
+        Z.set(x, y, z, largest);
       }
     }
   }
 }
 
-DataArray MaxPoolingLayer::evalForward(const DataArray& inputs) const {
-  ConstArray3Ptr pImage = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
+void MaxPoolingLayer::evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const {
+  ConstArray3View pImage = Array3::createShallow(inputs, m_inputW, m_inputH, m_inputDepth);
   const Array3& image = *pImage;
 
   size_t outputW = m_inputW / m_regionW;
   size_t outputH = m_inputH / m_regionH;
 
-  Array3 Z(outputW, outputH, m_inputDepth);
+  Array3View pZ = Array3::createShallow(outputs, outputW, outputH, m_inputDepth);
+  Array3& Z = *pZ;
 
   for (size_t z = 0; z < m_inputDepth; ++z) {
     for (size_t y = 0; y < outputH; ++y) {
@@ -108,13 +111,15 @@ DataArray MaxPoolingLayer::evalForward(const DataArray& inputs) const {
       }
     }
   }
-
-  return Z.storage();
 }
 
 void MaxPoolingLayer::updateDeltas(const DataArray&, const DataArray& outputDelta) {
-  ConstArray3Ptr pDelta = Array3::createShallow(outputDelta, m_Z.W(), m_Z.H(), m_Z.D());
-  const Array3& delta = *pDelta;
+  ConstArray3View pDelta = Array3::createShallow(outputDelta, m_Z.W(), m_Z.H(), m_Z.D());
+  backpropagate(*pDelta, m_mask, m_inputDelta);
+}
+
+void MaxPoolingLayer::backpropagate(const Array3& delta, const Array3& mask,
+  Array3& inputDelta) const {
 
   size_t outputW = m_inputW / m_regionW;
   size_t outputH = m_inputH / m_regionH;
@@ -127,11 +132,11 @@ void MaxPoolingLayer::updateDeltas(const DataArray&, const DataArray& outputDelt
             size_t imgX = x * m_regionW + i;
             size_t imgY = y * m_regionH + j;
 
-            if (m_mask.at(imgX, imgY, z) != 0.0) {
-              m_inputDelta.set(imgX, imgY, z, delta.at(x, y, z));
+            if (mask.at(imgX, imgY, z) != 0.0) {
+              inputDelta.set(imgX, imgY, z, delta.at(x, y, z));
             }
             else {
-              m_inputDelta.set(imgX, imgY, z, 0.0);
+              inputDelta.set(imgX, imgY, z, 0.0);
             }
           }
         }
@@ -140,6 +145,52 @@ void MaxPoolingLayer::updateDeltas(const DataArray&, const DataArray& outputDelt
   }
 }
 
+const Matrix& MaxPoolingLayer::batchActivations() const {
+  return m_batchZ;
+}
+
+const Matrix& MaxPoolingLayer::batchInputDelta() const {
+  return m_batchInputDelta;
+}
+
+void MaxPoolingLayer::trainForwardBatch(const Matrix& inputs) {
+  DBG_ASSERT(inputs.cols() == m_inputW * m_inputH * m_inputDepth);
+
+  size_t batchSize = inputs.rows();
+
+  if (m_batchZ.rows() != batchSize) {
+    m_batchZ = Matrix(m_Z.size(), batchSize);
+    m_batchMask = Matrix(inputs.cols(), batchSize);
+    m_batchInputDelta = Matrix(inputs.cols(), batchSize);
+  }
+
+  for (size_t i = 0; i < batchSize; ++i) {
+    ConstArray3View pImage = Array3::createShallow(inputs.data() + i * inputs.cols(), m_inputW,
+      m_inputH, m_inputDepth);
+    Array3View pZ = Array3::createShallow(m_batchZ.data() + i * m_batchZ.cols(), m_Z.W(),
+      m_Z.H(), m_Z.D());
+    Array3View pMask = Array3::createShallow(m_batchMask.data() + i * m_batchMask.cols(),
+      m_inputW, m_inputH, m_inputDepth);
+
+    forwardPass(*pImage, *pZ, *pMask);
+  }
+}
+
+void MaxPoolingLayer::updateDeltasBatch(const Matrix&, const Matrix& outputDelta) {
+  DBG_ASSERT(outputDelta.rows() == m_batchZ.rows());
+
+  for (size_t i = 0; i < outputDelta.rows(); ++i) {
+    ConstArray3View pDelta = Array3::createShallow(outputDelta.data() + i * outputDelta.cols(),
+      m_Z.W(), m_Z.H(), m_Z.D());
+    ConstArray3View pMask = Array3::createShallow(m_batchMask.data() + i * m_batchMask.cols(),
+      m_inputW, m_inputH, m_inputDepth);
+    Array3View pInputDelta = Array3::createShallow(
+      m_batchInputDelta.data() + i * m_batchInputDelta.cols(), m_inputW, m_inputH, m_inputDepth);
+
+    backpropagate(*pDelta, *pMask, *pInputDelta);
+  }
+}
+
 void MaxPoolingLayer::test_setMask(const Array3& mask) {
   m_mask = mask;
 }
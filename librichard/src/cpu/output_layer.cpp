@@ -1,6 +1,7 @@
 #include "richard/cpu/output_layer.hpp"
 #include "richard/utils.hpp"
 #include "richard/config.hpp"
+#include "richard/neural_net.hpp"
 
 namespace richard {
 namespace cpu {
@@ -8,19 +9,38 @@ namespace cpu {
 OutputLayer::OutputLayer(const Config& config, size_t inputSize) {
   initialize(config, inputSize);
 
-  m_W.randomize(0.1f);
+  Random random = layerRandom(config);
+  m_W.randomize(0.1f, random);
+  m_inferenceW.update(m_W);
 }
 
 OutputLayer::OutputLayer(const Config& config, std::istream& stream, size_t inputSize) {
   initialize(config, inputSize);
 
   stream.read(reinterpret_cast<char*>(m_B.data()), m_B.size() * sizeof(netfloat_t));
-  stream.read(reinterpret_cast<char*>(m_W.data()), m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+
+  // Pruned layers are stored in sparse form
+  if (m_pruning.enabled()) {
+    m_W = SparseMatrix(stream, m_W.cols(), m_W.rows()).toDense();
+    m_inferenceW.sparsify(m_W);
+  }
+  else {
+    stream.read(reinterpret_cast<char*>(m_W.data()),
+      m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+    m_inferenceW.update(m_W);
+  }
 }
 
 void OutputLayer::initialize(const Config& config, size_t inputSize) {
-  m_activationFn = sigmoid;
-  m_activationFnPrime = sigmoidPrime;
+  m_activation = Activation(Activation::Type::sigmoid);
+
+  if (config.contains("inferencePrecision")) {
+    m_inferenceW = InferenceWeights(parsePrecision(config.getString("inferencePrecision")));
+  }
+
+  if (config.contains("pruning")) {
+    m_pruning = Pruning(config.getObject("pruning"));
+  }
 
   size_t size = config.getNumber<size_t>("size");
   m_learnRate = config.getNumber<netfloat_t>("learnRate");
@@ -28,6 +48,9 @@ void OutputLayer::initialize(const Config& config, size_t inputSize) {
 
   m_B = Vector(size);
   m_W = Matrix(inputSize, size);
+  m_Z = Vector(size);
+  m_A = Vector(size);
+  m_delta = Vector(size);
 
   m_inputDelta = Vector(inputSize);
   m_deltaB = Vector(size);
@@ -36,8 +59,14 @@ void OutputLayer::initialize(const Config& config, size_t inputSize) {
 
 void OutputLayer::writeToStream(std::ostream& stream) const {
   stream.write(reinterpret_cast<const char*>(m_B.data()), m_B.size() * sizeof(netfloat_t));
-  stream.write(reinterpret_cast<const char*>(m_W.data()),
-    m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+
+  if (m_pruning.enabled()) {
+    SparseMatrix(m_W).writeToStream(stream);
+  }
+  else {
+    stream.write(reinterpret_cast<const char*>(m_W.data()),
+      m_W.rows() * m_W.cols() * sizeof(netfloat_t));
+  }
 }
 
 const DataArray& OutputLayer::activations() const {
@@ -48,13 +77,17 @@ const DataArray& OutputLayer::inputDelta() const {
   return m_inputDelta.storage();
 }
 
-DataArray OutputLayer::evalForward(const DataArray& inputs) const {
-  ConstVectorPtr pX = Vector::createShallow(inputs);
-  const Vector& x = *pX;
+void OutputLayer::evalForwardInto(const netfloat_t* inputs, netfloat_t* outputs) const {
+  ConstVectorView x = Vector::createShallow(inputs, m_W.cols());
+  VectorView y = Vector::createShallow(outputs, m_B.size());
 
-  Vector y = (m_W * x + m_B).computeTransform(m_activationFn);
+  m_inferenceW.evaluate(m_W, *x, m_B, *y, m_activation);
+}
+
+void OutputLayer::evalForwardBatch(const Matrix& inputs, Matrix& outputs) const {
+  DBG_ASSERT(inputs.cols() == m_W.cols());
 
-  return y.storage();
+  m_inferenceW.evaluateBatch(m_W, inputs, m_B, outputs, m_activation);
 }
 
 Size3 OutputLayer::outputSize() const {
@@ -62,31 +95,123 @@ Size3 OutputLayer::outputSize() const {
 }
 
 void OutputLayer::trainForward(const DataArray& inputs) {
-  ConstVectorPtr pX = Vector::createShallow(inputs);
+  ConstVectorView pX = Vector::createShallow(inputs);
   const Vector& x = *pX;
 
-  m_Z = m_W * x + m_B;
-  m_A = m_Z.computeTransform(m_activationFn);
+  gemv(m_W, x, m_B, m_Z, m_A, [this](const netfloat_t* Z, netfloat_t* A, size_t n) {
+    m_activation.apply(Z, A, n);
+  });
 }
 
 void OutputLayer::updateDeltas(const DataArray& inputs, const DataArray& outputs) {
-  ConstVectorPtr pY = Vector::createShallow(outputs);
+  ConstVectorView pY = Vector::createShallow(outputs);
   const Vector& y = *pY;
 
-  Vector deltaC = quadraticCostDerivatives(m_A, y);
-  Vector delta = m_Z.computeTransform(m_activationFnPrime).hadamard(deltaC);
+  // Element-wise quadraticCostDerivatives
+  m_activation.applyPrime(m_Z.data(), m_delta.data(), m_delta.size());
+  for (size_t i = 0; i < m_delta.size(); ++i) {
+    m_delta[i] *= m_A[i] - y[i];
+  }
+
+  transposeMultiply(m_W, m_delta, m_inputDelta);
+
+  ConstVectorView pX = Vector::createShallow(inputs);
+  ger(1.f, m_delta, *pX, m_deltaW);
+  axpy(1.f, m_delta, m_deltaB);
+}
+
+void OutputLayer::resizeBatch(size_t batchSize) {
+  if (m_batchZ.rows() != batchSize) {
+    m_batchZ = Matrix(m_W.rows(), batchSize);
+    m_batchA = Matrix(m_W.rows(), batchSize);
+    m_batchDelta = Matrix(m_W.rows(), batchSize);
+    m_batchInputDelta = Matrix(m_W.cols(), batchSize);
+  }
+}
+
+const Matrix& OutputLayer::batchActivations() const {
+  return m_batchA;
+}
+
+const Matrix& OutputLayer::batchInputDelta() const {
+  return m_batchInputDelta;
+}
+
+void OutputLayer::trainForwardBatch(const Matrix& inputs) {
+  DBG_ASSERT(inputs.cols() == m_W.cols());
+
+  resizeBatch(inputs.rows());
+
+  multiplyTranspose(inputs, m_W, m_batchZ);
+  for (size_t i = 0; i < m_batchZ.rows(); ++i) {
+    *m_batchZ.slice(i) += m_B;
+  }
 
-  m_inputDelta = m_W.transposeMultiply(delta);
+  m_activation.apply(m_batchZ.data(), m_batchA.data(), m_batchZ.size());
+}
+
+void OutputLayer::updateDeltasBatch(const Matrix& inputs, const Matrix& outputs) {
+  DBG_ASSERT(inputs.rows() == m_batchZ.rows());
+  DBG_ASSERT(outputs.rows() == m_batchA.rows());
+
+  // Row-wise quadraticCostDerivatives
+  Matrix& delta = m_batchDelta;
+  m_activation.applyPrime(m_batchZ.data(), delta.data(), delta.size());
+  for (size_t i = 0; i < delta.size(); ++i) {
+    delta.data()[i] *= m_batchA.data()[i] - outputs.data()[i];
+  }
+
+  multiply(delta, m_W, m_batchInputDelta);
+
+  transposeMultiply(delta, inputs, m_deltaW, true);
+  for (size_t i = 0; i < delta.rows(); ++i) {
+    m_deltaB += *delta.slice(i);
+  }
+}
+
+void OutputLayer::copyParams(const Layer& source) {
+  const OutputLayer& src = dynamic_cast<const OutputLayer&>(source);
+
+  m_W = src.m_W;
+  m_B = src.m_B;
+  m_inferenceW.invalidate();
+}
+
+void OutputLayer::mergeDeltas(Layer& source) {
+  OutputLayer& src = dynamic_cast<OutputLayer&>(source);
+
+  m_deltaW += src.m_deltaW;
+  m_deltaB += src.m_deltaB;
+
+  src.m_deltaW.zero();
+  src.m_deltaB.zero();
+}
+
+void OutputLayer::calibrate(const DataArray& inputs) {
+  m_inferenceW.calibrate(inputs);
+}
+
+void OutputLayer::quantize() {
+  m_inferenceW.quantize(m_W);
+}
+
+void OutputLayer::finishTraining() {
+  m_inferenceW.refresh(m_W);
+}
 
-  m_deltaW += outerProduct(delta, inputs);
-  m_deltaB += delta;
+void OutputLayer::prune() {
+  if (m_pruning.enabled()) {
+    m_pruning.apply(m_W);
+    m_inferenceW.sparsify(m_W);
+  }
 }
 
 void OutputLayer::updateParams(size_t epoch) {
   netfloat_t learnRate = m_learnRate * static_cast<netfloat_t>(pow(m_learnRateDecay, epoch));
 
-  m_W -= m_deltaW * learnRate;
-  m_B -= m_deltaB * learnRate;
+  axpy(-learnRate, m_deltaW, m_W);
+  axpy(-learnRate, m_deltaB, m_B);
+  m_inferenceW.invalidate();
 
   m_deltaB.zero();
   m_deltaW.zero();
@@ -94,6 +219,7 @@ void OutputLayer::updateParams(size_t epoch) {
 
 void OutputLayer::test_setWeights(const DataArray& W) {
   m_W = Matrix(W, m_W.cols(), m_W.rows());
+  m_inferenceW.update(m_W);
 }
 
 void OutputLayer::test_setBiases(const DataArray& B) {
@@ -117,8 +243,7 @@ const Vector& OutputLayer::test_B() const {
 }
 
 void OutputLayer::test_setActivationFn(ActivationFn f, ActivationFn fPrime) {
-  m_activationFn = f;
-  m_activationFnPrime = fPrime;
+  m_activation = Activation(f, fPrime);
 }
 
 }
@@ -1,8 +1,99 @@
 #include "richard/csv_data_loader.hpp"
 #include "richard/exception.hpp"
-#include <sstream>
+#include <charconv>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#ifndef __cpp_lib_to_chars
+  #include <cstdlib>
+  #include <clocale>
+  #ifdef __APPLE__
+    #include <xlocale.h>
+  #endif
+#endif
 
 namespace richard {
+namespace {
+
+// The stream is read this much at a time
+const size_t BLOCK_SIZE = 1024 * 1024;
+
+// Each thread is given several runs of lines, so that a thread that lands on long lines doesn't
+// hold up the rest
+const size_t TASKS_PER_THREAD = 4;
+
+const char* skipSpaces(const char* p, const char* end) {
+  while (p < end && *p == ' ') {
+    ++p;
+  }
+  return p;
+}
+
+// Many data sets hold small non-negative integers, such as pixel values, which are quicker to
+// read directly. Returns nullptr for anything else, which is left to parseFloat.
+const char* parseInteger(const char* p, const char* end, netfloat_t& value) {
+  const size_t MAX_DIGITS = 7;
+
+  uint32_t x = 0;
+  const char* q = p;
+  while (q < end && q - p < static_cast<ptrdiff_t>(MAX_DIGITS) && *q >= '0' && *q <= '9') {
+    x = x * 10 + static_cast<uint32_t>(*q - '0');
+    ++q;
+  }
+
+  if (q == p || (q < end && *q != ',' && *q != ' ')) {
+    return nullptr;
+  }
+
+  value = static_cast<netfloat_t>(x);
+  return q;
+}
+
+// Returns the end of the value parsed, or nullptr on error
+const char* parseFloat(const char* p, const char* end, netfloat_t& value) {
+#ifdef __cpp_lib_to_chars
+  auto result = std::from_chars(p, end, value);
+  return result.ec == std::errc{} ? result.ptr : nullptr;
+#else
+  // Older standard libraries, such as libc++ before 17, lack floating-point std::from_chars.
+  // strtod needs a terminated string and reads the current locale's decimal point, so copy the
+  // value out and parse it in the C locale.
+  const size_t MAX_LENGTH = 63;
+
+  const char* valueEnd = p;
+  while (valueEnd < end && *valueEnd != ',' && *valueEnd != ' ') {
+    ++valueEnd;
+  }
+
+  size_t length = static_cast<size_t>(valueEnd - p);
+  if (length == 0 || length > MAX_LENGTH) {
+    return nullptr;
+  }
+
+  char text[MAX_LENGTH + 1];
+  memcpy(text, p, length);
+  text[length] = '\0';
+
+  char* parsedEnd = nullptr;
+#ifdef WIN32
+  static const _locale_t cLocale = _create_locale(LC_ALL, "C");
+  double x = _strtod_l(text, &parsedEnd, cLocale);
+#else
+  static const locale_t cLocale = newlocale(LC_ALL_MASK, "C", nullptr);
+  double x = strtod_l(text, &parsedEnd, cLocale);
+#endif
+
+  if (parsedEnd == text) {
+    return nullptr;
+  }
+
+  value = static_cast<netfloat_t>(x);
+  return p + (parsedEnd - text);
+#endif
+}
+
+}
 
 // Load training data from csv file
 //
@@ -14,49 +105,165 @@ namespace richard {
 // c,11.9,92.4
 // ...
 CsvDataLoader::CsvDataLoader(std::unique_ptr<std::istream> stream, size_t inputSize,
-  const NormalizationParams& normalization, size_t fetchSize)
+  const std::vector<std::string>& labels, const NormalizationParams& normalization,
+  size_t fetchSize, size_t numThreads)
   : DataLoader(fetchSize)
   , m_inputSize(inputSize)
   , m_normalization(normalization)
-  , m_stream(std::move(stream)) {}
+  , m_stream(std::move(stream))
+  , m_threadPool(numThreads)
+  , m_buffer(BLOCK_SIZE)
+  , m_begin(0)
+  , m_end(0) {
+
+  for (size_t i = 0; i < labels.size(); ++i) {
+    m_classIds.insert({ labels[i], static_cast<uint32_t>(i) });
+  }
+}
 
 void CsvDataLoader::seekToBeginning() {
+  m_stream->clear();
   m_stream->seekg(0);
+  m_begin = 0;
+  m_end = 0;
 }
 
-std::vector<Sample> CsvDataLoader::loadSamples() {
-  std::vector<Sample> samples;
+// Appends the next block of the stream. Returns false at the end of the stream.
+//
+// Text before m_begin has been parsed, so the first read of each fetch moves the remainder of the
+// last block to the front of the buffer. Later reads in the same fetch find m_begin at 0 and just
+// append, so the lines gathered so far are never moved.
+bool CsvDataLoader::readBlock() {
+  if (m_begin > 0) {
+    std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+    m_end -= m_begin;
+    m_begin = 0;
+  }
 
-  std::string line;
-  while (std::getline(*m_stream, line)) {
-    std::stringstream ss{line};
-    std::string label = "_";
-    Vector v(m_inputSize);
+  if (m_buffer.size() < m_end + BLOCK_SIZE) {
+    m_buffer.resize(m_end + BLOCK_SIZE);
+  }
 
-    for (size_t i = 0; ss.good(); ++i) {
-      if (i > m_inputSize) {
-        EXCEPTION("Input too large");
-      }
+  m_stream->read(m_buffer.data() + m_end, BLOCK_SIZE);
+  size_t bytesRead = static_cast<size_t>(m_stream->gcount());
+  m_end += bytesRead;
 
-      std::string token;
-      std::getline(ss, token, ',');
+  return bytesRead > 0;
+}
 
-      if (i == 0 && token.length() > 0) {
-        label = token;
+void CsvDataLoader::parseLine(const char* begin, const char* end, uint32_t& classId,
+  netfloat_t* values) const {
+
+  const char* comma = static_cast<const char*>(std::memchr(begin, ',', end - begin));
+  const char* labelEnd = comma != nullptr ? comma : end;
+
+  auto i = m_classIds.find(std::string_view(begin, labelEnd - begin));
+  if (i == m_classIds.end()) {
+    EXCEPTION("Unrecognised label '" << std::string(begin, labelEnd) << "'");
+  }
+  classId = i->second;
+
+  size_t n = 0;
+
+  // Every comma is followed by a value, so an empty field, trailing or not, fails to parse
+  const char* p = comma != nullptr ? comma + 1 : end;
+  bool more = comma != nullptr;
+  while (more) {
+    if (n == m_inputSize) {
+      EXCEPTION("Input too large");
+    }
+
+    p = skipSpaces(p, end);
+
+    netfloat_t value = 0.f;
+    const char* next = parseInteger(p, end, value);
+    if (next == nullptr) {
+      next = parseFloat(p, end, value);
+      if (next == nullptr) {
+        EXCEPTION("Error parsing value '" << std::string(p, std::find(p, end, ',')) << "'");
       }
-      else {
-        netfloat_t value = std::stof(token);
-        v[i - 1] = normalize(m_normalization, value);
+    }
+
+    values[n++] = normalize(m_normalization, value);
+
+    p = skipSpaces(next, end);
+    more = p < end;
+    if (more) {
+      if (*p != ',') {
+        EXCEPTION("Expected ',' after value, got '" << *p << "'");
       }
+      ++p;
     }
+  }
+}
 
-    Array3 asArr3(std::move(v.storage()), v.size(), 1, 1);
+std::vector<Sample> CsvDataLoader::loadSamples() {
+  // Offsets from m_begin of the start and end of each of the next fetchSize non-empty lines
+  std::vector<std::pair<size_t, size_t>> lines;
+
+  size_t pos = 0;
+  while (lines.size() < fetchSize()) {
+    const char* start = m_buffer.data() + m_begin + pos;
+    size_t remaining = m_end - m_begin - pos;
 
-    samples.emplace_back(label, asArr3);
+    const char* newline = static_cast<const char*>(std::memchr(start, '\n', remaining));
+    size_t lineEnd = 0;
+
+    if (newline != nullptr) {
+      lineEnd = newline - (m_buffer.data() + m_begin);
+    }
+    else if (readBlock()) {
+      continue;
+    }
+    else {
+      // The last line needn't end with a newline
+      if (remaining == 0) {
+        break;
+      }
+      lineEnd = pos + remaining;
+    }
 
-    if (samples.size() >= fetchSize()) {
-      break;
+    const char* text = m_buffer.data() + m_begin;
+    size_t end = lineEnd;
+    if (end > pos && text[end - 1] == '\r') {
+      --end;
     }
+    if (end > pos) {
+      lines.push_back({ pos, end });
+    }
+
+    pos = std::min(lineEnd + 1, m_end - m_begin);
+  }
+
+  std::vector<uint32_t> classIds(lines.size());
+  std::vector<Array3> values;
+  values.reserve(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    values.emplace_back(m_inputSize, 1, 1);
+  }
+
+  const char* text = m_buffer.data() + m_begin;
+
+  size_t numTasks = std::min(lines.size(), m_threadPool.numThreads() * TASKS_PER_THREAD);
+  if (numTasks > 0) {
+    size_t linesPerTask = (lines.size() + numTasks - 1) / numTasks;
+
+    m_threadPool.parallelFor(numTasks, [&](size_t task) {
+      size_t first = task * linesPerTask;
+      size_t last = std::min(first + linesPerTask, lines.size());
+
+      for (size_t i = first; i < last; ++i) {
+        parseLine(text + lines[i].first, text + lines[i].second, classIds[i], values[i].data());
+      }
+    });
+  }
+
+  m_begin += pos;
+
+  std::vector<Sample> samples;
+  samples.reserve(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    samples.emplace_back(classIds[i], std::move(values[i]));
   }
 
   return samples;
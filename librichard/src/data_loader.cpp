@@ -2,10 +2,62 @@
 #include "richard/utils.hpp"
 #include "richard/image_data_loader.hpp"
 #include "richard/csv_data_loader.hpp"
+#include "richard/binary_data_loader.hpp"
+#include "richard/exception.hpp"
+#include "richard/simd.hpp"
 #include "richard/file_system.hpp"
 
 namespace richard {
 
+Sample::Sample(uint32_t classId, Array3&& data)
+  : classId(classId)
+  , m_shape(data.shape())
+  , m_data(std::move(data))
+  , m_packed(nullptr) {}
+
+Sample::Sample(uint32_t classId, const Size3& shape, std::vector<uint8_t>&& bytes,
+  const NormalizationParams& normalization)
+  : classId(classId)
+  , m_shape(shape)
+  , m_bytes(std::move(bytes))
+  , m_packed(m_bytes.data())
+  , m_normalization(normalization) {
+
+  ASSERT_MSG(m_bytes.size() == calcProduct(m_shape), "Expected " << calcProduct(m_shape)
+    << " bytes for sample of shape " << m_shape << ", got " << m_bytes.size());
+}
+
+Sample::Sample(uint32_t classId, const Size3& shape, const uint8_t* bytes,
+  std::shared_ptr<const void> owner, const NormalizationParams& normalization)
+  : classId(classId)
+  , m_shape(shape)
+  , m_owner(std::move(owner))
+  , m_packed(bytes)
+  , m_normalization(normalization) {
+
+  ASSERT(m_packed != nullptr);
+}
+
+void Sample::copyTo(netfloat_t* R) const {
+  if (isPacked()) {
+    simd::kernels().normalizeUint8(m_packed, m_normalization.min, m_normalization.max, R,
+      size());
+  }
+  else {
+    std::copy(m_data.data(), m_data.data() + m_data.size(), R);
+  }
+}
+
+Array3 Sample::toArray3() const {
+  if (!isPacked()) {
+    return m_data;
+  }
+
+  Array3 data(m_shape[0], m_shape[1], m_shape[2]);
+  copyTo(data.data());
+  return data;
+}
+
 DataLoader::DataLoader(size_t fetchSize)
   : m_fetchSize(fetchSize) {}
 
@@ -13,6 +65,7 @@ const Config& DataLoader::exampleConfig() {
   static Config config = []() {
     Config c;
     c.setNumber("fetchSize", 500);
+    c.setNumber("threads", 1);
     return c;
   }();
   
@@ -31,8 +84,30 @@ DataLoaderPtr createDataLoader(FileSystem& fileSystem, const Config& config,
   else {
     auto stream = fileSystem.openFileForReading(samplesPath);
 
+    if (isBinaryDataSet(*stream)) {
+      stream.reset();
+
+      auto loader = std::make_unique<BinaryDataLoader>(fileSystem.mapFileForReading(samplesPath),
+        fetchSize);
+
+      ASSERT_MSG(loader->shape() == dataDetails.shape, "Data set has shape " << loader->shape()
+        << ", expected " << dataDetails.shape);
+      ASSERT_MSG(loader->labels() == dataDetails.classLabels,
+        "Data set class labels don't match config");
+      ASSERT_MSG(loader->normalization().min == dataDetails.normalization.min
+        && loader->normalization().max == dataDetails.normalization.max,
+        "Data set normalization doesn't match config");
+
+      return loader;
+    }
+
+    stream->clear();
+    stream->seekg(0);
+
+    size_t numThreads = config.contains("threads") ? config.getNumber<size_t>("threads") : 1;
+
     return std::make_unique<CsvDataLoader>(std::move(stream), calcProduct(dataDetails.shape),
-      dataDetails.normalization, fetchSize);
+      dataDetails.classLabels, dataDetails.normalization, fetchSize, numThreads);
   }
 }
 
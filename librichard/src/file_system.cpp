@@ -13,6 +13,7 @@ class FileSystemImpl : public FileSystem {
 
     std::string loadTextFile(const std::filesystem::path& path) override;
     std::vector<uint8_t> loadBinaryFile(const std::filesystem::path& path) override;
+    MappedFilePtr mapFileForReading(const std::filesystem::path& path) override;
 };
 
 std::unique_ptr<std::ostream> FileSystemImpl::openFileForWriting(const fs::path& path) {
@@ -46,6 +47,10 @@ std::vector<uint8_t> FileSystemImpl::loadBinaryFile(const fs::path& path) {
   return buffer;
 }
 
+MappedFilePtr FileSystemImpl::mapFileForReading(const fs::path& path) {
+  return mapFile(path);
+}
+
 FileSystemPtr createFileSystem() {
   return std::make_unique<FileSystemImpl>();
 }
@@ -4,6 +4,7 @@
 #include "richard/file_system.hpp"
 #include "richard/platform_paths.hpp"
 #include "richard/config.hpp"
+#include "richard/neural_net.hpp"
 
 namespace richard {
 namespace gpu {
@@ -47,6 +48,7 @@ void ConvolutionalLayer::initialize(const Config& config, const Size3& inputShap
   m_learnRate = config.getNumber<netfloat_t>("learnRate");
   m_learnRateDecay = config.getNumber<netfloat_t>("learnRateDecay");
   m_dropoutRate = config.getNumber<netfloat_t>("dropoutRate");
+  m_random = layerRandom(config);
   m_isFirstLayer = isFirstLayer;
   m_kernelData = Vector(m_kernelSize[0] * m_kernelSize[1] * m_inputDepth * m_depth);
   m_biasData = Vector(m_depth);
@@ -54,8 +56,8 @@ void ConvolutionalLayer::initialize(const Config& config, const Size3& inputShap
   Size3 kernelShape{ m_kernelSize[0], m_kernelSize[1], m_inputDepth };
   size_t kernelSize = calcProduct(kernelShape);
   for (size_t i = 0; i < m_depth; ++i) {
-    KernelPtr kernel = Kernel::createShallow(m_kernelData.data() + i * kernelSize, kernelShape);
-    kernel->randomize(0.1f);
+    KernelView kernel = Kernel::createShallow(m_kernelData.data() + i * kernelSize, kernelShape);
+    kernel->randomize(0.1f, m_random);
   }
 
   ASSERT_MSG(m_kernelSize[0] <= m_inputW,
@@ -120,7 +122,8 @@ void ConvolutionalLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
   SpecializationConstants constants{
     { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_kernelSize[0]) },
     { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_kernelSize[1]) },
-    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_inputDepth) }
+    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_inputDepth) },
+    { SpecializationConstant::Type::bool_type, m_isFirstLayer }
   };
 
   std::string shaderName = "convolutional_eval_forward.spv";
@@ -128,7 +131,8 @@ void ConvolutionalLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
 
   Size3 workSize{ outputSize()[0], outputSize()[1], m_depth };
 
-  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants, 0, workSize);
+  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants,
+    sizeof(uint32_t), workSize);
 }
 
 void ConvolutionalLayer::createTrainForwardShader(GpuBufferHandle statusBuffer,
@@ -264,12 +268,12 @@ Size3 ConvolutionalLayer::outputSize() const {
   };
 }
 
-void ConvolutionalLayer::evalForward() {
-  m_gpu.queueShader(m_evalForwardShader);
+void ConvolutionalLayer::evalForward(uint32_t sampleIndex) {
+  m_gpu.queueShader(m_evalForwardShader, &sampleIndex);
 }
 
 void ConvolutionalLayer::trainForward() {
-  uint32_t seed = static_cast<uint32_t>(rand());
+  uint32_t seed = m_random.next();
   m_gpu.queueShader(m_trainForwardShader, &seed);
 }
 
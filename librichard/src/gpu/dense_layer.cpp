@@ -3,6 +3,7 @@
 #include "richard/file_system.hpp"
 #include "richard/platform_paths.hpp"
 #include "richard/config.hpp"
+#include "richard/neural_net.hpp"
 
 namespace richard {
 namespace gpu {
@@ -36,11 +37,12 @@ void DenseLayer::initialize(const Config& config, size_t inputSize, bool isFirst
   m_learnRate = config.getNumber<netfloat_t>("learnRate");
   m_learnRateDecay = config.getNumber<netfloat_t>("learnRateDecay");
   m_dropoutRate = config.getNumber<netfloat_t>("dropoutRate");
+  m_random = layerRandom(config);
 
   m_B = Vector(m_size);
   m_W = Matrix(m_inputSize, m_size);
 
-  m_W.randomize(0.1f);
+  m_W.randomize(0.1f, m_random);
 }
 
 void DenseLayer::allocateGpuBuffers() {
@@ -92,7 +94,9 @@ void DenseLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
   };
 
   SpecializationConstants constants{
-    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_inputSize) }
+    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_inputSize) },
+    { SpecializationConstant::Type::bool_type, m_isFirstLayer },
+    { SpecializationConstant::Type::bool_type, false }
   };
 
   std::string shaderName = "dense_eval_forward.spv";
@@ -100,7 +104,8 @@ void DenseLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
 
   Size3 workSize{ m_size, 1, 1 };
 
-  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants, 0, workSize);
+  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants,
+    sizeof(uint32_t), workSize);
 }
 
 void DenseLayer::createTrainForwardShader(GpuBufferHandle statusBuffer,
@@ -213,12 +218,12 @@ Size3 DenseLayer::outputSize() const {
   return { m_size, 1, 1 };
 }
 
-void DenseLayer::evalForward() {
-  m_gpu.queueShader(m_evalForwardShader);
+void DenseLayer::evalForward(uint32_t sampleIndex) {
+  m_gpu.queueShader(m_evalForwardShader, &sampleIndex);
 }
 
 void DenseLayer::trainForward() {
-  uint32_t seed = static_cast<uint32_t>(rand());
+  uint32_t seed = m_random.next();
   m_gpu.queueShader(m_trainForwardShader, &seed);
 }
 
@@ -12,6 +12,7 @@
 #include "richard/file_system.hpp"
 #include "richard/platform_paths.hpp"
 #include <atomic>
+#include <algorithm>
 #include <future>
 #include <cstring>
 
@@ -44,7 +45,10 @@ class GpuNeuralNet : public NeuralNet {
     void writeToStream(std::ostream& stream) const override;
     void train(LabelledDataSet& data) override;
     Vector evaluate(const Array3& inputs) const override;
+    void evaluateInto(const Array3& inputs, Vector& outputs) const override;
+    Matrix evaluateBatch(const Matrix& inputs) const override;
     ModelDetails modelDetails() const override;
+    void quantize(LabelledDataSet& data, size_t maxSamples) override;
 
     void abort() override;
 
@@ -110,6 +114,7 @@ void GpuNeuralNet::initialize(const Size3& inputShape, const Config& config,
     auto layersConfig = config.getObjectArray("hiddenLayers");
 
     for (auto layerConfig : layersConfig) {
+      setLayerStream(layerConfig, m_params.seed, m_layers.size());
       m_layers.push_back(constructLayer(layerConfig, prevLayerSize, m_layers.empty(), stream));
       prevLayerSize = m_layers.back()->outputSize();
     }
@@ -117,6 +122,7 @@ void GpuNeuralNet::initialize(const Size3& inputShape, const Config& config,
 
   auto outLayerConfig = config.getObject("outputLayer");
   outLayerConfig.setString("type", "output");
+  setLayerStream(outLayerConfig, m_params.seed, m_layers.size());
   m_layers.push_back(constructLayer(outLayerConfig, prevLayerSize, false, stream));
 
   m_outputSize = m_layers.back()->outputSize()[0];
@@ -132,6 +138,10 @@ ModelDetails GpuNeuralNet::modelDetails() const {
   };
 }
 
+void GpuNeuralNet::quantize(LabelledDataSet&, size_t) {
+  EXCEPTION("Quantization is not supported with GPU acceleration");
+}
+
 void GpuNeuralNet::abort() {
   m_abort = true;
 }
@@ -157,14 +167,14 @@ LayerPtr GpuNeuralNet::constructLayer(const Config& config, const Size3& prevLay
   }
   else if (type == "maxPooling") {
     return std::make_unique<MaxPoolingLayer>(*m_gpu, m_fileSystem, m_platformPaths, config,
-      prevLayerSize);
+      prevLayerSize, isFirstLayer);
   }
   else if (type == "output") {
     return stream ?
       std::make_unique<OutputLayer>(*m_gpu, m_fileSystem, m_platformPaths, config, *stream,
-        calcProduct(prevLayerSize)) :
+        calcProduct(prevLayerSize), m_params.miniBatchSize) :
       std::make_unique<OutputLayer>(*m_gpu, m_fileSystem, m_platformPaths, config,
-        calcProduct(prevLayerSize));
+        calcProduct(prevLayerSize), m_params.miniBatchSize);
   }
   else {
     EXCEPTION("Don't know how to construct layer of type '" << type << "'");
@@ -258,10 +268,13 @@ void GpuNeuralNet::loadSampleBuffers(const LabelledDataSet& trainingData, const
 
   for (size_t i = 0; i < numSamples; ++i) {
     const Sample& sample = samples[i];
-    const Vector& y = trainingData.classOutputVector(sample.label);
+    ConstVectorView y = trainingData.classOutputVector(sample.classId);
 
-    memcpy(m_bufferX.data + i * xSize, sample.data.data(), xSize);
-    memcpy(m_bufferY.data + i * ySize, y.data(), ySize);
+    DBG_ASSERT(sample.size() * sizeof(netfloat_t) == xSize);
+
+    // Normalized straight into the mapped buffer
+    sample.copyTo(reinterpret_cast<netfloat_t*>(m_bufferX.data + i * xSize));
+    memcpy(m_bufferY.data + i * ySize, y->data(), ySize);
   }
 }
 
@@ -353,15 +366,39 @@ void GpuNeuralNet::train(LabelledDataSet& trainingData) {
 }
 
 Vector GpuNeuralNet::evaluate(const Array3& sample) const {
-  memcpy(m_bufferX.data, sample.data(), sample.size() * sizeof(netfloat_t));
+  ConstMatrixView X = Matrix::createShallow(sample.data(), sample.size(), 1);
+  return Vector(evaluateBatch(*X).storage());
+}
 
-  for (const LayerPtr& layer : m_layers) {
-    layer->evalForward();
-  }
+void GpuNeuralNet::evaluateInto(const Array3& sample, Vector& outputs) const {
+  outputs = evaluate(sample);
+}
+
+// The sample buffer holds a mini-batch, so samples are evaluated a mini-batch per submission
+Matrix GpuNeuralNet::evaluateBatch(const Matrix& X) const {
+  ASSERT_MSG(X.cols() == calcProduct(m_inputShape), "Expected samples of size "
+    << calcProduct(m_inputShape) << ", got " << X.cols());
+
+  Matrix Y(m_outputSize, X.rows());
 
-  m_gpu->flushQueue();
+  for (size_t first = 0; first < X.rows(); first += m_params.miniBatchSize) {
+    uint32_t n = static_cast<uint32_t>(std::min<size_t>(m_params.miniBatchSize,
+      X.rows() - first));
+
+    memcpy(m_bufferX.data, X.data() + first * X.cols(), n * X.cols() * sizeof(netfloat_t));
+
+    for (uint32_t s = 0; s < n; ++s) {
+      for (const LayerPtr& layer : m_layers) {
+        layer->evalForward(s);
+      }
+    }
+
+    m_gpu->flushQueue();
+
+    outputLayer().retrieveEvalOutputs(Y.data() + first * m_outputSize, n);
+  }
 
-  return outputLayer().activations();
+  return Y;
 }
 
 }
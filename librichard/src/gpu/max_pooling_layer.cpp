@@ -8,13 +8,15 @@ namespace richard {
 namespace gpu {
 
 MaxPoolingLayer::MaxPoolingLayer(Gpu& gpu, FileSystem& fileSystem,
-  const PlatformPaths& platformPaths, const Config& config, const Size3& inputShape)
+  const PlatformPaths& platformPaths, const Config& config, const Size3& inputShape,
+  bool isFirstLayer)
   : m_gpu(gpu)
   , m_fileSystem(fileSystem)
   , m_platformPaths(platformPaths)
   , m_inputW(inputShape[0])
   , m_inputH(inputShape[1])
-  , m_inputDepth(inputShape[2]) {
+  , m_inputDepth(inputShape[2])
+  , m_isFirstLayer(isFirstLayer) {
 
   auto regionSize = config.getNumberArray<size_t, 2>("regionSize");
   m_regionW = regionSize[0];
@@ -34,13 +36,13 @@ void MaxPoolingLayer::allocateGpuBuffers() {
   m_bufferMask = m_gpu.allocateBuffer(inputSize * sizeof(netfloat_t), GpuBufferFlags::large);
 }
 
-void MaxPoolingLayer::createGpuShaders(GpuBufferHandle inputBuffer, GpuBufferHandle,
+void MaxPoolingLayer::createGpuShaders(GpuBufferHandle inputBuffer, GpuBufferHandle statusBuffer,
   const Layer* nextLayer, GpuBufferHandle) {
 
   DBG_ASSERT(nextLayer != nullptr);
 
   createEvalForwardShader(inputBuffer);
-  createTrainForwardShader(inputBuffer);
+  createTrainForwardShader(statusBuffer, inputBuffer);
   createBackpropShader(nextLayer);
 }
 
@@ -52,7 +54,8 @@ void MaxPoolingLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
 
   SpecializationConstants constants{
     { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_regionW) },
-    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_regionH) }
+    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_regionH) },
+    { SpecializationConstant::Type::bool_type, m_isFirstLayer }
   };
 
   std::string shaderName = "max_pooling_eval_forward.spv";
@@ -60,11 +63,15 @@ void MaxPoolingLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
 
   Size3 workSize = outputSize();
 
-  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants, 0, workSize);
+  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants,
+    sizeof(uint32_t), workSize);
 }
 
-void MaxPoolingLayer::createTrainForwardShader(GpuBufferHandle inputBuffer) {
+void MaxPoolingLayer::createTrainForwardShader(GpuBufferHandle statusBuffer,
+  GpuBufferHandle inputBuffer) {
+
   GpuBufferBindings buffers{
+    { statusBuffer, BufferAccessMode::read },
     { inputBuffer, BufferAccessMode::read },
     { m_bufferZ.handle, BufferAccessMode::write },
     { m_bufferMask.handle, BufferAccessMode::write }
@@ -72,7 +79,8 @@ void MaxPoolingLayer::createTrainForwardShader(GpuBufferHandle inputBuffer) {
 
   SpecializationConstants constants{
     { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_regionW) },
-    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_regionH) }
+    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_regionH) },
+    { SpecializationConstant::Type::bool_type, m_isFirstLayer }
   };
 
   std::string shaderName = "max_pooling_train_forward.spv";
@@ -111,8 +119,8 @@ Size3 MaxPoolingLayer::outputSize() const {
   return { m_inputW / m_regionW, m_inputH / m_regionH, m_inputDepth };
 }
 
-void MaxPoolingLayer::evalForward() {
-  m_gpu.queueShader(m_evalForwardShader);
+void MaxPoolingLayer::evalForward(uint32_t sampleIndex) {
+  m_gpu.queueShader(m_evalForwardShader, &sampleIndex);
 }
 
 void MaxPoolingLayer::trainForward() {
@@ -3,36 +3,39 @@
 #include "richard/file_system.hpp"
 #include "richard/platform_paths.hpp"
 #include "richard/config.hpp"
+#include "richard/neural_net.hpp"
 #include <cstring>
 
 namespace richard {
 namespace gpu {
 
 OutputLayer::OutputLayer(Gpu& gpu, FileSystem& fileSystem, const PlatformPaths& platformPaths,
-  const Config& config, std::istream& stream, size_t inputSize)
+  const Config& config, std::istream& stream, size_t inputSize, size_t evalBatchSize)
   : m_gpu(gpu)
   , m_fileSystem(fileSystem)
   , m_platformPaths(platformPaths) {
 
-  initialize(config, inputSize);
+  initialize(config, inputSize, evalBatchSize);
 
   stream.read(reinterpret_cast<char*>(m_B.data()), m_size * sizeof(netfloat_t));
   stream.read(reinterpret_cast<char*>(m_W.data()), m_W.rows() * m_W.cols() * sizeof(netfloat_t));
 }
 
 OutputLayer::OutputLayer(Gpu& gpu, FileSystem& fileSystem, const PlatformPaths& platformPaths,
-  const Config& config, size_t inputSize)
+  const Config& config, size_t inputSize, size_t evalBatchSize)
   : m_gpu(gpu)
   , m_fileSystem(fileSystem)
   , m_platformPaths(platformPaths) {
 
-  initialize(config, inputSize);
+  initialize(config, inputSize, evalBatchSize);
 
-  m_W.randomize(0.1f);
+  Random random = layerRandom(config);
+  m_W.randomize(0.1f, random);
 }
 
-void OutputLayer::initialize(const Config& config, size_t inputSize) {
+void OutputLayer::initialize(const Config& config, size_t inputSize, size_t evalBatchSize) {
   m_inputSize = inputSize;
+  m_evalBatchSize = evalBatchSize;
 
   m_size = config.getNumber<size_t>("size");
   m_learnRate = config.getNumber<netfloat_t>("learnRate");
@@ -56,6 +59,8 @@ void OutputLayer::allocateGpuBuffers() {
   m_bufferW = m_gpu.allocateBuffer(m_inputSize * m_size * sizeof(netfloat_t), paramBuffersFlags);
   m_bufferZ = m_gpu.allocateBuffer(m_size * sizeof(netfloat_t), GpuBufferFlags::large);
   m_bufferA = m_gpu.allocateBuffer(m_size * sizeof(netfloat_t), activationsBufferFlags);
+  m_bufferEvalA = m_gpu.allocateBuffer(m_evalBatchSize * m_size * sizeof(netfloat_t),
+    activationsBufferFlags);
   m_bufferD = m_gpu.allocateBuffer(m_size * sizeof(netfloat_t), GpuBufferFlags::large);
   m_bufferInputDelta = m_gpu.allocateBuffer(m_inputSize * sizeof(netfloat_t),
     GpuBufferFlags::large);
@@ -89,11 +94,13 @@ void OutputLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
     { inputBuffer, BufferAccessMode::read },
     { m_bufferB.handle, BufferAccessMode::read },
     { m_bufferW.handle, BufferAccessMode::read },
-    { m_bufferA.handle, BufferAccessMode::write }
+    { m_bufferEvalA.handle, BufferAccessMode::write }
   };
 
   SpecializationConstants constants{
-    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_inputSize) }
+    { SpecializationConstant::Type::uint_type, static_cast<uint32_t>(m_inputSize) },
+    { SpecializationConstant::Type::bool_type, false },
+    { SpecializationConstant::Type::bool_type, true }
   };
 
   std::string shaderName = "dense_eval_forward.spv";
@@ -101,7 +108,8 @@ void OutputLayer::createEvalForwardShader(GpuBufferHandle inputBuffer) {
 
   Size3 workSize{ m_size, 1, 1 };
 
-  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants, 0, workSize);
+  m_evalForwardShader = m_gpu.addShader(shaderName, shaderCode, buffers, constants,
+    sizeof(uint32_t), workSize);
 }
 
 void OutputLayer::createTrainForwardShader(GpuBufferHandle inputBuffer) {
@@ -210,8 +218,14 @@ const Vector& OutputLayer::activations() const {
   return m_A;
 }
 
-void OutputLayer::evalForward() {
-  m_gpu.queueShader(m_evalForwardShader);
+void OutputLayer::retrieveEvalOutputs(netfloat_t* outputs, size_t numSamples) const {
+  DBG_ASSERT(numSamples <= m_evalBatchSize);
+  memcpy(outputs, m_bufferEvalA.data, numSamples * m_size * sizeof(netfloat_t));
+}
+
+void OutputLayer::evalForward(uint32_t sampleIndex) {
+  DBG_ASSERT(sampleIndex < m_evalBatchSize);
+  m_gpu.queueShader(m_evalForwardShader, &sampleIndex);
 }
 
 void OutputLayer::trainForward() {
@@ -5,6 +5,11 @@
 layout(constant_id = 3) const uint KERNEL_W = 1;
 layout(constant_id = 4) const uint KERNEL_H = 1;
 layout(constant_id = 5) const uint KERNEL_D = 1;
+layout(constant_id = 6) const bool IS_FIRST_LAYER = false;
+
+layout(push_constant) uniform PushConstants {
+  uint sampleIndex;
+} constants;
 
 layout(std140, binding = 0) readonly buffer ImageSsbo {
   vec4 Image[];
@@ -41,6 +46,8 @@ void main() {
   const uint imW = fmW + KERNEL_W - 1;
   const uint imH = fmH + KERNEL_H - 1;
 
+  const uint imageOffset = IS_FIRST_LAYER ? constants.sampleIndex * imW * imH * KERNEL_D : 0;
+
   float sum = 0.0;
   for (uint k = 0; k < KERNEL_D; ++k) {
     for (uint j = 0; j < KERNEL_H; ++j) {
@@ -49,7 +56,7 @@ void main() {
         const uint y = yIdx + j;
         const uint z = k;
 
-        const float pixel = readImage(z * imW * imH + y * imW + x);
+        const float pixel = readImage(imageOffset + z * imW * imH + y * imW + x);
 
         const float kernelPixel = readK(
           KERNEL_W * KERNEL_H * KERNEL_D * zIdx +
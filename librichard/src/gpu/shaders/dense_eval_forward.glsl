@@ -3,6 +3,12 @@
 #include "common/common.glsl"
 
 layout(constant_id = 3) const uint LAYER_NUM_INPUTS = 1;
+layout(constant_id = 4) const bool IS_FIRST_LAYER = false;
+layout(constant_id = 5) const bool IS_OUTPUT_LAYER = false;
+
+layout(push_constant) uniform PushConstants {
+  uint sampleIndex;
+} constants;
 
 layout(std140, binding = 0) readonly buffer XSsbo {
   vec4 X[];
@@ -30,13 +36,16 @@ FN_WRITE(A)
 
 void main() {
   const uint index = gl_GlobalInvocationID.x;
+  const uint layerSize = gl_WorkGroupSize.x * gl_NumWorkGroups.x;
+  const uint xOffset = IS_FIRST_LAYER ? constants.sampleIndex * LAYER_NUM_INPUTS : 0;
+  const uint aOffset = IS_OUTPUT_LAYER ? constants.sampleIndex * layerSize : 0;
 
   float weightedSum = 0.0;
   for (uint i = 0; i < LAYER_NUM_INPUTS; ++i) {
     float w = readW(index * LAYER_NUM_INPUTS + i);
-    float x = readX(i);
+    float x = readX(xOffset + i);
     weightedSum += w * x;
   }
   weightedSum += readB(index);
-  writeA(index, sigmoid(weightedSum));
+  writeA(aOffset + index, sigmoid(weightedSum));
 }
@@ -4,6 +4,11 @@
 
 layout(constant_id = 3) const uint REGION_W = 1;
 layout(constant_id = 4) const uint REGION_H = 1;
+layout(constant_id = 5) const bool IS_FIRST_LAYER = false;
+
+layout(push_constant) uniform PushConstants {
+  uint sampleIndex;
+} constants;
 
 layout(std140, binding = 0) readonly buffer XSsbo {
   vec4 X[];
@@ -27,6 +32,9 @@ void main() {
 
   const uint imgW = outW * REGION_W;
   const uint imgH = outH * REGION_H;
+  const uint imgD = gl_NumWorkGroups.z * gl_WorkGroupSize.z;
+
+  const uint xOffset = IS_FIRST_LAYER ? constants.sampleIndex * imgW * imgH * imgD : 0;
 
   float largest = FLOAT_LOWEST;
   uint largestX = 0;
@@ -38,7 +46,7 @@ void main() {
       const uint imgY = yIdx * REGION_H + j;
       const uint imgOffset = arrayIndex3d(imgW, imgH, imgX, imgY, zIdx);
 
-      const float px = readX(imgOffset);
+      const float px = readX(xOffset + imgOffset);
 
       if (px > largest) {
         largest = px;
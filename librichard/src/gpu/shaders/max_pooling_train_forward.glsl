@@ -4,20 +4,25 @@
 
 layout(constant_id = 3) const uint REGION_W = 1;
 layout(constant_id = 4) const uint REGION_H = 1;
+layout(constant_id = 5) const bool IS_FIRST_LAYER = false;
 
-layout(std140, binding = 0) readonly buffer XSsbo {
+layout(std140, binding = 0) readonly buffer StatusSsbo {
+  StatusBuffer Status;
+};
+
+layout(std140, binding = 1) readonly buffer XSsbo {
   vec4 X[];
 };
 
 FN_READ(X)
 
-layout(std140, binding = 1) writeonly buffer ZSsbo {
+layout(std140, binding = 2) writeonly buffer ZSsbo {
   vec4 Z[];
 };
 
 FN_WRITE(Z)
 
-layout(std140, binding = 2) writeonly buffer MaskSsbo {
+layout(std140, binding = 3) writeonly buffer MaskSsbo {
   vec4 Mask[];
 };
 
@@ -33,6 +38,9 @@ void main() {
 
   const uint imgW = outW * REGION_W;
   const uint imgH = outH * REGION_H;
+  const uint imgD = gl_NumWorkGroups.z * gl_WorkGroupSize.z;
+
+  const uint xOffset = IS_FIRST_LAYER ? Status.sampleIndex * imgW * imgH * imgD : 0;
 
   float largest = FLOAT_LOWEST;
   uint largestX = 0;
@@ -44,7 +52,7 @@ void main() {
       const uint imgY = yIdx * REGION_H + j;
       const uint imgOffset = arrayIndex3d(imgW, imgH, imgX, imgY, zIdx);
 
-      const float px = readX(imgOffset);
+      const float px = readX(xOffset + imgOffset);
 
       if (px > largest) {
         largest = px;
@@ -0,0 +1,20 @@
+#include "richard/half.hpp"
+#include "richard/exception.hpp"
+
+namespace richard {
+
+Precision parsePrecision(const std::string& name) {
+  if (name == "float32") {
+    return Precision::float32;
+  }
+  if (name == "float16") {
+    return Precision::float16;
+  }
+  if (name == "bfloat16") {
+    return Precision::bfloat16;
+  }
+
+  EXCEPTION("Unrecognised precision '" << name << "'");
+}
+
+}
@@ -18,11 +18,13 @@ ImageDataLoader::ImageDataLoader(const std::string& directoryPath,
     "'" << m_directoryPath << "' is not a directory");
 
   std::filesystem::path directory{directoryPath};
-  for (const std::string& label : labels) {
+  for (size_t i = 0; i < labels.size(); ++i) {
+    const std::string& label = labels[i];
     ASSERT_MSG(std::filesystem::is_directory(directory/label),
       "'" << directory/label << "' is not a directory");
 
-    m_iterators.emplace_back(label, std::filesystem::directory_iterator{directory/label});
+    m_iterators.emplace_back(label, static_cast<uint32_t>(i),
+      std::filesystem::directory_iterator{directory/label});
   }
 }
 
@@ -50,17 +52,19 @@ std::vector<Sample> ImageDataLoader::loadSamples() {
         size_t imgH = image.size()[1];
         size_t channels = image.size()[2];
 
-        Array3 v(imgW, imgH, channels);
+        // Pixels are kept as bytes, in the same order as the values of an Array3
+        std::vector<uint8_t> pixels(imgW * imgH * channels);
 
         for (size_t j = 0; j < imgH; ++j) {
           for (size_t i = 0; i < imgW; ++i) {
             for (size_t k = 0; k < channels; ++k) {
-              v.set(i, j, k, normalize(m_normalization, image[j][i][k]));
+              pixels[k * imgW * imgH + j * imgW + i] = image[j][i][k];
             }
           }
         }
 
-        samples.emplace_back(cursor.label, v);
+        samples.emplace_back(cursor.classId, Size3{ imgW, imgH, channels }, std::move(pixels),
+          m_normalization);
       }
 
       ++cursor.i;
@@ -8,13 +8,12 @@ namespace richard {
 
 LabelledDataSet::LabelledDataSet(DataLoaderPtr loader, const std::vector<std::string>& labels)
   : m_loader(std::move(loader))
-  , m_labels(labels) {
+  , m_labels(labels)
+  , m_classOutputVectors(labels.size(), labels.size()) {
 
+  m_classOutputVectors.zero();
   for (size_t i = 0; i < m_labels.size(); ++i) {
-    Vector v(m_labels.size());
-    v.zero();
-    v[i] = 1.0;
-    m_classOutputVectors.insert({m_labels[i], v});
+    m_classOutputVectors.set(i, i, 1.0);
   }
 }
 
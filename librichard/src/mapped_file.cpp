@@ -0,0 +1,153 @@
+#include "richard/mapped_file.hpp"
+#include "richard/exception.hpp"
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace richard {
+namespace {
+
+class MappedFileImpl : public MappedFile {
+  public:
+    explicit MappedFileImpl(const std::filesystem::path& path);
+
+    MappedFileImpl(const MappedFileImpl&) = delete;
+    MappedFileImpl& operator=(const MappedFileImpl&) = delete;
+
+    const uint8_t* data() const override;
+    size_t size() const override;
+
+    ~MappedFileImpl() override;
+
+  private:
+    void release();
+
+    const uint8_t* m_data;
+    size_t m_size;
+#ifdef WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+};
+
+const uint8_t* MappedFileImpl::data() const {
+  return m_data;
+}
+
+size_t MappedFileImpl::size() const {
+  return m_size;
+}
+
+#ifdef WIN32
+
+MappedFileImpl::MappedFileImpl(const std::filesystem::path& path)
+  : m_data(nullptr)
+  , m_size(0)
+  , m_file(INVALID_HANDLE_VALUE)
+  , m_mapping(nullptr) {
+
+  m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+    FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    EXCEPTION("Error opening file " << path);
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size)) {
+    release();
+    EXCEPTION("Error reading size of file " << path);
+  }
+  m_size = static_cast<size_t>(size.QuadPart);
+
+  if (m_size == 0) {
+    return;
+  }
+
+  m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr) {
+    release();
+    EXCEPTION("Error mapping file " << path);
+  }
+
+  m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    release();
+    EXCEPTION("Error mapping file " << path);
+  }
+}
+
+// The destructor doesn't run if the constructor throws, so the constructor calls this itself
+void MappedFileImpl::release() {
+  if (m_data != nullptr) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping != nullptr) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_file);
+  }
+}
+
+MappedFileImpl::~MappedFileImpl() {
+  release();
+}
+
+#else
+
+MappedFileImpl::MappedFileImpl(const std::filesystem::path& path)
+  : m_data(nullptr)
+  , m_size(0) {
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    EXCEPTION("Error opening file " << path);
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    EXCEPTION("Error reading size of file " << path);
+  }
+  m_size = static_cast<size_t>(info.st_size);
+
+  if (m_size > 0) {
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      EXCEPTION("Error mapping file " << path);
+    }
+
+    // Data sets are read front to back, so the OS can read well ahead
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const uint8_t*>(data);
+  }
+  else {
+    close(fd);
+  }
+}
+
+void MappedFileImpl::release() {
+  if (m_data != nullptr) {
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+  }
+}
+
+MappedFileImpl::~MappedFileImpl() {
+  release();
+}
+
+#endif
+
+}
+
+MappedFilePtr mapFile(const std::filesystem::path& path) {
+  return std::make_unique<MappedFileImpl>(path);
+}
+
+}
@@ -1,11 +1,16 @@
 #include "richard/math.hpp"
 #include "richard/exception.hpp"
 #include "richard/utils.hpp"
+#include "richard/simd.hpp"
 #include <ostream>
+#include <istream>
 #include <iomanip>
 #include <cstring>
-#include <random>
 #include <algorithm>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <limits>
 
 namespace richard {
 namespace {
@@ -60,50 +65,408 @@ size_t count(std::initializer_list<std::initializer_list<std::initializer_list<n
   return numElements;
 }
 
+// Blocks of B (depth x cols) are sized to stay resident in L2 while every tile of rows of A
+// streams past them
+const size_t GEMM_BLOCK_DEPTH = 128;
+const size_t GEMM_BLOCK_COLS = 256;
+
+// Keeps the slice of x used by a matrix-vector product resident in L1
+const size_t GEMV_BLOCK_COLS = 4096;
+
+// gemv applies its activation to runs of this many rows, which are long enough for the vector
+// kernels and short enough that Z is still in L1
+const size_t GEMV_ACTIVATION_ROWS = 64;
+static_assert(GEMV_ACTIVATION_ROWS % simd::TILE_ROWS == 0);
+
+// C[i * ldc + j] += sum_k A[i * rsA + k * csA] * B[k * ldb + j]
+void blockedMultiplyAccumulate(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t rows, size_t depth, size_t n) {
+
+  const simd::Kernels& kernels = simd::kernels();
+
+  for (size_t j = 0; j < n; j += GEMM_BLOCK_COLS) {
+    size_t blockCols = std::min(GEMM_BLOCK_COLS, n - j);
+
+    for (size_t k = 0; k < depth; k += GEMM_BLOCK_DEPTH) {
+      size_t blockDepth = std::min(GEMM_BLOCK_DEPTH, depth - k);
+
+      for (size_t i = 0; i < rows; i += simd::TILE_ROWS) {
+        size_t tileRows = std::min(simd::TILE_ROWS, rows - i);
+
+        kernels.multiplyAccumulate(A + i * rsA + k * csA, rsA, csA, B + k * ldb + j, ldb,
+          C + i * ldc + j, ldc, tileRows, blockDepth, blockCols);
+      }
+    }
+  }
+}
+
+// Writes the transpose of the rows x cols matrix A into T, a block at a time so that both
+// sides are accessed a cache line at a time
+void transposeInto(const netfloat_t* A, size_t cols, size_t rows, netfloat_t* T) {
+  const size_t BLOCK = 32;
+
+  for (size_t r0 = 0; r0 < rows; r0 += BLOCK) {
+    for (size_t c0 = 0; c0 < cols; c0 += BLOCK) {
+      size_t rEnd = std::min(r0 + BLOCK, rows);
+      size_t cEnd = std::min(c0 + BLOCK, cols);
+
+      for (size_t r = r0; r < rEnd; ++r) {
+        for (size_t c = c0; c < cEnd; ++c) {
+          T[c * rows + r] = A[r * cols + c];
+        }
+      }
+    }
+  }
+}
+
+using complex_t = std::complex<netfloat_t>;
+
+// Avoids the NaN/inf recovery that std::complex's operator* does when not built with
+// -ffast-math
+inline complex_t complexMultiply(complex_t a, complex_t b) {
+  return complex_t(a.real() * b.real() - a.imag() * b.imag(),
+    a.real() * b.imag() + a.imag() * b.real());
+}
+
+size_t nextPowerOfTwo(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+// Iterative radix-2 FFT of a fixed power-of-two length. The inverse transform is unscaled.
+class Fft {
+  public:
+    explicit Fft(size_t n)
+      : m_n(n)
+      , m_twiddles(n / 2)
+      , m_reversed(n) {
+
+      DBG_ASSERT(n > 0 && (n & (n - 1)) == 0);
+
+      const double pi = 3.14159265358979323846;
+      for (size_t i = 0; i < n / 2; ++i) {
+        double theta = -2.0 * pi * static_cast<double>(i) / static_cast<double>(n);
+        m_twiddles[i] = complex_t(static_cast<netfloat_t>(cos(theta)),
+          static_cast<netfloat_t>(sin(theta)));
+      }
+
+      size_t bits = 0;
+      while ((size_t(1) << bits) < n) {
+        ++bits;
+      }
+
+      for (size_t i = 0; i < n; ++i) {
+        size_t r = 0;
+        for (size_t b = 0; b < bits; ++b) {
+          r |= ((i >> b) & 1) << (bits - b - 1);
+        }
+        m_reversed[i] = r;
+      }
+    }
+
+    size_t size() const {
+      return m_n;
+    }
+
+    void transform(complex_t* x, bool inverse) const {
+      for (size_t i = 0; i < m_n; ++i) {
+        size_t j = m_reversed[i];
+        if (i < j) {
+          std::swap(x[i], x[j]);
+        }
+      }
+
+      for (size_t len = 2; len <= m_n; len <<= 1) {
+        size_t half = len / 2;
+        size_t step = m_n / len;
+
+        for (size_t i = 0; i < m_n; i += len) {
+          for (size_t k = 0; k < half; ++k) {
+            complex_t w = m_twiddles[k * step];
+            if (inverse) {
+              w = std::conj(w);
+            }
+
+            complex_t u = x[i + k];
+            complex_t v = complexMultiply(x[i + k + half], w);
+            x[i + k] = u + v;
+            x[i + k + half] = u - v;
+          }
+        }
+      }
+    }
+
+  private:
+    size_t m_n;
+    std::vector<complex_t> m_twiddles;
+    std::vector<size_t> m_reversed;
+};
+
+// 2D transform of a rowFft.size() x colFft.size() array. Columns from nonZeroCols onwards are
+// known to be zero, so their column transforms are skipped.
+void transform2d(complex_t* data, const Fft& rowFft, const Fft& colFft, size_t nonZeroCols,
+  bool inverse, std::vector<complex_t>& column) {
+
+  const size_t W = rowFft.size();
+  const size_t H = colFft.size();
+
+  column.resize(H);
+  for (size_t x = 0; x < nonZeroCols; ++x) {
+    for (size_t y = 0; y < H; ++y) {
+      column[y] = data[y * W + x];
+    }
+
+    colFft.transform(column.data(), inverse);
+
+    for (size_t y = 0; y < H; ++y) {
+      data[y * W + x] = column[y];
+    }
+  }
+
+  for (size_t y = 0; y < H; ++y) {
+    rowFft.transform(data + y * W, inverse);
+  }
+}
+
+// The image is zero padded to a power of two large enough that the circular correlation
+// computed in the frequency domain doesn't wrap into any output element
+void fftCrossCorrelation(const Array3& image, const Matrix& kernels, size_t kW, size_t kH,
+  Matrix& result, bool full, bool flipKernel) {
+
+  const size_t D = image.D();
+  const size_t imW = image.W();
+  const size_t imH = image.H();
+  const size_t numKernels = kernels.rows();
+
+  DBG_ASSERT(kernels.cols() == kW * kH * D);
+  DBG_ASSERT(full || (imW >= kW && imH >= kH));
+
+  const size_t outW = full ? imW + kW - 1 : imW - kW + 1;
+  const size_t outH = full ? imH + kH - 1 : imH - kH + 1;
+
+  DBG_ASSERT(result.rows() == numKernels);
+  DBG_ASSERT(result.cols() == outW * outH);
+
+  const size_t padW = nextPowerOfTwo(full ? outW : imW);
+  const size_t padH = nextPowerOfTwo(full ? outH : imH);
+  const size_t P = padW * padH;
+
+  Fft rowFft(padW);
+  Fft colFft(padH);
+
+  thread_local std::vector<complex_t> imageFreq;
+  thread_local std::vector<complex_t> kernelFreq;
+  thread_local std::vector<complex_t> acc;
+  thread_local std::vector<complex_t> column;
+
+  imageFreq.assign(D * P, complex_t(0, 0));
+  kernelFreq.resize(P);
+  acc.resize(P);
+
+  for (size_t d = 0; d < D; ++d) {
+    complex_t* channel = imageFreq.data() + d * P;
+    const netfloat_t* src = image.data() + d * imW * imH;
+
+    for (size_t y = 0; y < imH; ++y) {
+      for (size_t x = 0; x < imW; ++x) {
+        channel[y * padW + x] = complex_t(src[y * imW + x], 0);
+      }
+    }
+
+    transform2d(channel, rowFft, colFft, imW, false, column);
+  }
+
+  const netfloat_t scale = 1.f / static_cast<netfloat_t>(P);
+
+  for (size_t k = 0; k < numKernels; ++k) {
+    std::fill(acc.begin(), acc.end(), complex_t(0, 0));
+
+    for (size_t d = 0; d < D; ++d) {
+      const netfloat_t* g = kernels.data() + k * kernels.cols() + d * kW * kH;
+
+      std::fill(kernelFreq.begin(), kernelFreq.end(), complex_t(0, 0));
+      for (size_t j = 0; j < kH; ++j) {
+        for (size_t i = 0; i < kW; ++i) {
+          netfloat_t value = flipKernel ? g[(kH - j - 1) * kW + (kW - i - 1)] : g[j * kW + i];
+          kernelFreq[j * padW + i] = complex_t(value, 0);
+        }
+      }
+
+      transform2d(kernelFreq.data(), rowFft, colFft, kW, false, column);
+
+      // Correlation is multiplication by the conjugate of the kernel's spectrum
+      const complex_t* channel = imageFreq.data() + d * P;
+      for (size_t i = 0; i < P; ++i) {
+        acc[i] += complexMultiply(channel[i], std::conj(kernelFreq[i]));
+      }
+    }
+
+    transform2d(acc.data(), rowFft, colFft, padW, true, column);
+
+    // Output element x of a full correlation is at circular offset x - (kW - 1)
+    netfloat_t* featureMap = result.data() + k * result.cols();
+    for (size_t y = 0; y < outH; ++y) {
+      size_t srcY = full ? (y + padH - (kH - 1)) % padH : y;
+
+      for (size_t x = 0; x < outW; ++x) {
+        size_t srcX = full ? (x + padW - (kW - 1)) % padW : x;
+        featureMap[y * outW + x] = acc[srcY * padW + srcX].real() * scale;
+      }
+    }
+  }
+}
+
+void dotRows(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  simd::kernels().dotRows(A, lda, x, R, rows, n);
+}
+
+void dotRows(const float16_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  simd::kernels().dotRowsFloat16(A, lda, x, R, rows, n);
+}
+
+void dotRows(const bfloat16_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  simd::kernels().dotRowsBfloat16(A, lda, x, R, rows, n);
+}
+
+void packArray(const netfloat_t* A, float16_t* R, size_t n) {
+  simd::kernels().toFloat16(A, R, n);
+}
+
+void packArray(const netfloat_t* A, bfloat16_t* R, size_t n) {
+  simd::kernels().toBfloat16(A, R, n);
+}
+
+void unpackArray(const float16_t* A, netfloat_t* R, size_t n) {
+  simd::kernels().fromFloat16(A, R, n);
+}
+
+void unpackArray(const bfloat16_t* A, netfloat_t* R, size_t n) {
+  simd::kernels().fromBfloat16(A, R, n);
+}
+
+// sum_i A[i] * x[indices[i]]. Gathers are slow on many CPUs, so rather than vectorise this,
+// independent sums hide the latency of the indirect loads.
+netfloat_t dotSparse(const netfloat_t* A, const uint32_t* indices, const netfloat_t* x,
+  size_t n) {
+
+  netfloat_t s[4] = { 0.f, 0.f, 0.f, 0.f };
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (size_t j = 0; j < 4; ++j) {
+      s[j] += A[i + j] * x[indices[i + j]];
+    }
+  }
+  for (; i < n; ++i) {
+    s[0] += A[i] * x[indices[i]];
+  }
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+// The body of gemv, for A (cols x rows) in any of the storage formats
+template<typename T>
+void gemvRows(const T* A, size_t cols, size_t rows, const Vector& x, const Vector& b, Vector& Z,
+  Vector& Y, const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f) {
+
+  DBG_ASSERT(cols > 0);
+
+  netfloat_t tile[simd::TILE_ROWS];
+
+  for (size_t j = 0; j < cols; j += GEMV_BLOCK_COLS) {
+    size_t blockCols = std::min(GEMV_BLOCK_COLS, cols - j);
+    bool lastBlock = j + blockCols == cols;
+
+    for (size_t i = 0; i < rows; i += simd::TILE_ROWS) {
+      size_t tileRows = std::min(simd::TILE_ROWS, rows - i);
+
+      dotRows(A + i * cols + j, cols, x.data() + j, tile, tileRows, blockCols);
+
+      for (size_t r = 0; r < tileRows; ++r) {
+        Z[i + r] = (j == 0 ? b[i + r] : Z[i + r]) + tile[r];
+      }
+
+      size_t end = i + tileRows;
+      if (lastBlock && (end % GEMV_ACTIVATION_ROWS == 0 || end == rows)) {
+        size_t start = (end - 1) / GEMV_ACTIVATION_ROWS * GEMV_ACTIVATION_ROWS;
+        f(Z.data() + start, Y.data() + start, end - start);
+      }
+    }
+  }
+}
+
 }
 
 DataArray::DataArray()
   : m_data(nullptr)
   , m_size(0) {}
 
-DataArray::DataArray(size_t size)
-  : m_data(new netfloat_t[size])
+DataArray::DataArray(size_t size, bool zero)
+  : m_data(memory::allocate(size))
   , m_size(size) {
 
-  memset(m_data.get(), 0, m_size * sizeof(netfloat_t));
+  if (zero) {
+    memset(m_data, 0, m_size * sizeof(netfloat_t));
+  }
 }
 
 DataArray::DataArray(const DataArray& cpy)
-  : m_data(new netfloat_t[cpy.m_size])
+  : m_data(memory::allocate(cpy.m_size))
   , m_size(cpy.m_size) {
 
-  memcpy(m_data.get(), cpy.m_data.get(), m_size * sizeof(netfloat_t));
+  memcpy(m_data, cpy.m_data, m_size * sizeof(netfloat_t));
 }
 
 DataArray::DataArray(DataArray&& mv)
-  : m_data(std::move(mv.m_data))
+  : m_data(mv.m_data)
   , m_size(mv.m_size) {
 
+  mv.m_data = nullptr;
   mv.m_size = 0;
 }
 
 DataArray& DataArray::operator=(const DataArray& rhs) {
-  m_size = rhs.m_size;
-  m_data.reset(new netfloat_t[m_size]);
-  memcpy(m_data.get(), rhs.m_data.get(), m_size * sizeof(netfloat_t));
+  if (this == &rhs) {
+    return *this;
+  }
+
+  if (m_size != rhs.m_size) {
+    memory::release(m_data, m_size);
+    m_data = memory::allocate(rhs.m_size);
+    m_size = rhs.m_size;
+  }
+  memcpy(m_data, rhs.m_data, m_size * sizeof(netfloat_t));
 
   return *this;
 }
 
 DataArray& DataArray::operator=(DataArray&& rhs) {
+  if (this == &rhs) {
+    return *this;
+  }
+
+  memory::release(m_data, m_size);
+
+  m_data = rhs.m_data;
   m_size = rhs.m_size;
-  m_data = std::move(rhs.m_data);
 
+  rhs.m_data = nullptr;
   rhs.m_size = 0;
 
   return *this;
 }
 
+DataArray::~DataArray() {
+  memory::release(m_data, m_size);
+}
+
 DataArray DataArray::concat(const std::vector<std::reference_wrapper<DataArray>>& arrays) {
   size_t totalSize = 0;
   for (auto array : arrays) {
@@ -112,9 +475,9 @@ DataArray DataArray::concat(const std::vector<std::reference_wrapper<DataArray>>
 
   DataArray result(totalSize);
 
-  netfloat_t* ptr = result.m_data.get();
+  netfloat_t* ptr = result.m_data;
   for (auto array : arrays) {
-    memcpy(ptr, array.get().m_data.get(), array.get().size() * sizeof(netfloat_t));
+    memcpy(ptr, array.get().m_data, array.get().size() * sizeof(netfloat_t));
     ptr += array.get().size();
   }
 
@@ -136,7 +499,7 @@ Vector::Vector()
   , m_size(0) {}
 
 Vector::Vector(std::initializer_list<netfloat_t> data)
-  : m_storage(data.size())
+  : m_storage(data.size(), false)
   , m_data(m_storage.data())
   , m_size(data.size()) {
 
@@ -166,7 +529,7 @@ Vector::Vector(DataArray&& data)
   , m_size(m_storage.size()) {}
 
 Vector::Vector(const Vector& cpy)
-  : m_storage(cpy.m_size)
+  : m_storage(cpy.m_size, false)
   , m_data(m_storage.data())
   , m_size(cpy.m_size) {
 
@@ -177,7 +540,7 @@ Vector::Vector(Vector&& mv) {
   m_size = mv.m_size;
 
   if (mv.isShallow()) {
-    m_storage = DataArray(m_size);
+    m_storage = DataArray(m_size, false);
     m_data = m_storage.data();
     memcpy(m_data, mv.m_data, m_size * sizeof(netfloat_t));
   }
@@ -195,9 +558,12 @@ Vector& Vector::operator=(const Vector& rhs) {
     DBG_ASSERT(rhs.size() == m_size);
   }
   else {
+    // Reuse the existing allocation when the size hasn't changed
+    if (m_storage.size() != rhs.m_size) {
+      m_storage = DataArray(rhs.m_size, false);
+      m_data = m_storage.data();
+    }
     m_size = rhs.m_size;
-    m_storage = DataArray(m_size);
-    m_data = m_storage.data();
   }
 
   memcpy(m_data, rhs.m_data, m_size * sizeof(netfloat_t));
@@ -233,12 +599,7 @@ netfloat_t Vector::magnitude() const {
 }
 
 netfloat_t Vector::squareMagnitude() const {
-  netfloat_t sqSum = 0.0;
-  for (size_t i = 0; i < m_size; ++i) {
-    netfloat_t x = m_data[i];
-    sqSum += x * x;
-  }
-  return sqSum;
+  return simd::kernels().dot(m_data, m_data, m_size);
 }
 
 void Vector::zero() {
@@ -246,175 +607,84 @@ void Vector::zero() {
 }
 
 void Vector::fill(netfloat_t x) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] = x;
-  }
+  simd::kernels().fill(m_data, x, m_size);
 }
 
-Vector& Vector::randomize(netfloat_t standardDeviation) {
-  static std::mt19937 gen(0);
-  std::normal_distribution<netfloat_t> dist(0.0, standardDeviation);
-
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] = dist(gen);
-  }
-  
+Vector& Vector::randomize(netfloat_t standardDeviation, Random& random) {
+  random.normal(m_data, standardDeviation, m_size);
   return *this;
 }
 
 void Vector::normalize() {
-  netfloat_t mag = magnitude();
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] = m_data[i] / mag;
-  }
+  simd::kernels().divideScalar(m_data, magnitude(), m_data, m_size);
 }
 
 netfloat_t Vector::dot(const Vector& rhs) const {
   DBG_ASSERT(rhs.m_size == m_size);
 
-  netfloat_t x = 0.0;
-  for (size_t i = 0; i < m_size; ++i) {
-    x += m_data[i] * rhs[i];
-  }
-  return x;
+  return simd::kernels().dot(m_data, rhs.m_data, m_size);
 }
 
 Vector Vector::hadamard(const Vector& rhs) const {
   DBG_ASSERT(rhs.m_size == m_size);
 
-  Vector v(m_size);
-  for (size_t i = 0; i < m_size; ++i) {
-    v[i] = m_data[i] * rhs[i];
-  }
-  return v;
-}
-
-Vector Vector::operator+(const Vector& rhs) const {
-  DBG_ASSERT(rhs.m_size == m_size);
-
-  Vector v(m_size);
-  for (size_t i = 0; i < m_size; ++i) {
-    v[i] = m_data[i] + rhs[i];
-  }
+  Vector v(DataArray(m_size, false));
+  simd::kernels().multiply(m_data, rhs.m_data, v.m_data, m_size);
   return v;
 }
 
-Vector Vector::operator-(const Vector& rhs) const {
+Vector& Vector::operator+=(const Vector& rhs) {
   DBG_ASSERT(rhs.m_size == m_size);
 
-  Vector v(m_size);
-  for (size_t i = 0; i < m_size; ++i) {
-    v[i] = m_data[i] - rhs[i];
-  }
-  return v;
-}
-
-Vector Vector::operator*(netfloat_t s) const {
-  Vector v(m_size);
-  for (size_t i = 0; i < m_size; ++i) {
-    v[i] = m_data[i] * s;
-  }
-  return v;
-}
-
-Vector Vector::operator+(netfloat_t s) const {
-  Vector v(m_size);
-  for (size_t i = 0; i < m_size; ++i) {
-    v[i] = m_data[i] + s;
-  }
-  return v;
-}
-
-Vector Vector::operator-(netfloat_t s) const {
-  Vector v(m_size);
-  for (size_t i = 0; i < m_size; ++i) {
-    v[i] = m_data[i] - s;
-  }
-  return v;
-}
-
-Vector& Vector::operator+=(const Vector& rhs) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] += rhs.m_data[i];
-  }
+  simd::kernels().add(m_data, rhs.m_data, m_data, m_size);
   return *this;
 }
 
 Vector& Vector::operator-=(const Vector& rhs) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] -= rhs.m_data[i];
-  }
+  DBG_ASSERT(rhs.m_size == m_size);
+
+  simd::kernels().subtract(m_data, rhs.m_data, m_data, m_size);
   return *this;
 }
 
 Vector& Vector::operator+=(netfloat_t x) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] += x;
-  }
+  simd::kernels().addScalar(m_data, x, m_data, m_size);
   return *this;
 }
 
 Vector& Vector::operator-=(netfloat_t x) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] -= x;
-  }
+  simd::kernels().addScalar(m_data, -x, m_data, m_size);
   return *this;
 }
 
 Vector& Vector::operator*=(netfloat_t x) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] *= x;
-  }
+  simd::kernels().multiplyScalar(m_data, x, m_data, m_size);
   return *this;
 }
 
 Vector& Vector::operator/=(netfloat_t x) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] /= x;
-  }
+  simd::kernels().divideScalar(m_data, x, m_data, m_size);
   return *this;
 }
 
 netfloat_t Vector::sum() const {
-  netfloat_t s = 0.0;
-
-  for (size_t i = 0; i < m_size; ++i) {
-    s += m_data[i];
-  }
-
-  return s;
-}
-
-Vector Vector::computeTransform(const std::function<netfloat_t(netfloat_t)>& f) const {
-  Vector v(m_size);
-
-  for (size_t i = 0; i < m_size; ++i) {
-    v.m_data[i] = f(m_data[i]);
-  }
-
-  return v;
-}
-
-void Vector::transformInPlace(const std::function<netfloat_t(netfloat_t)>& f) {
-  for (size_t i = 0; i < m_size; ++i) {
-    m_data[i] = f(m_data[i]);
-  }
+  return simd::kernels().sum(m_data, m_size);
 }
 
-VectorPtr Vector::createShallow(DataArray& data) {
-  return VectorPtr(new Vector(data.data(), data.size()));
+VectorView Vector::createShallow(DataArray& data) {
+  return VectorView(data.data(), data.size());
 }
 
-ConstVectorPtr Vector::createShallow(const DataArray& data) {
-  return ConstVectorPtr(new Vector(const_cast<netfloat_t*>(data.data()), data.size()));
+ConstVectorView Vector::createShallow(const DataArray& data) {
+  return ConstVectorView(const_cast<netfloat_t*>(data.data()), data.size());
 }
 
-VectorPtr Vector::createShallow(netfloat_t* data, size_t size) {
-  return VectorPtr(new Vector(data, size));
+VectorView Vector::createShallow(netfloat_t* data, size_t size) {
+  return VectorView(data, size);
 }
 
-ConstVectorPtr Vector::createShallow(const netfloat_t* data, size_t size) {
-  return ConstVectorPtr(new Vector(const_cast<netfloat_t*>(data), size));
+ConstVectorView Vector::createShallow(const netfloat_t* data, size_t size) {
+  return ConstVectorView(const_cast<netfloat_t*>(data), size);
 }
 
 std::ostream& operator<<(std::ostream& os, const Vector& v) {
@@ -479,7 +749,7 @@ Matrix::Matrix(DataArray&& data, size_t cols, size_t rows)
 }
 
 Matrix::Matrix(const Matrix& cpy)
-  : m_storage(cpy.size())
+  : m_storage(cpy.size(), false)
   , m_data(m_storage.data())
   , m_rows(cpy.m_rows)
   , m_cols(cpy.m_cols) {
@@ -492,7 +762,7 @@ Matrix::Matrix(Matrix&& mv) {
   m_rows = mv.m_rows;
 
   if (mv.isShallow()) {
-    m_storage = DataArray(m_cols * m_rows);
+    m_storage = DataArray(m_cols * m_rows, false);
     m_data = m_storage.data();
     memcpy(m_data, mv.m_data, m_cols * m_rows * sizeof(netfloat_t));
   }
@@ -511,10 +781,13 @@ Matrix& Matrix::operator=(const Matrix& rhs) {
     DBG_ASSERT(rhs.m_cols == m_cols && rhs.m_rows == m_rows);
   }
   else {
+    // Reuse the existing allocation when the number of elements hasn't changed
+    if (m_storage.size() != rhs.m_cols * rhs.m_rows) {
+      m_storage = DataArray(rhs.m_cols * rhs.m_rows, false);
+      m_data = m_storage.data();
+    }
     m_cols = rhs.m_cols;
     m_rows = rhs.m_rows;
-    m_storage = DataArray(m_cols * m_rows);
-    m_data = m_storage.data();
   }
 
   memcpy(m_data, rhs.m_data, m_cols * m_rows * sizeof(netfloat_t));
@@ -540,138 +813,48 @@ Matrix& Matrix::operator=(Matrix&& rhs) {
 }
 
 Vector Matrix::operator*(const Vector& rhs) const {
-  DBG_ASSERT(rhs.size() == m_cols);
-
   Vector v(m_rows);
-  for (size_t r = 0; r < m_rows; ++r) {
-    netfloat_t sum = 0.0;
-    for (size_t c = 0; c < m_cols; ++c) {
-      sum += at(c, r) * rhs[c];
-    }
-    v[r] = sum;
-  }
+  multiply(*this, rhs, v, true);
   return v;
 }
 
-Matrix Matrix::operator+(const Matrix& rhs) const {
-  DBG_ASSERT(rhs.m_cols == m_cols);
-  DBG_ASSERT(rhs.m_rows == m_rows);
-
-  Matrix m(m_cols, m_rows);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m.m_data[i] = m_data[i] + rhs.m_data[i];
-  }
-
-  return m;
-}
-
-Matrix Matrix::operator-(const Matrix& rhs) const {
-  DBG_ASSERT(rhs.m_cols == m_cols);
-  DBG_ASSERT(rhs.m_rows == m_rows);
-
-  Matrix m(m_cols, m_rows);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m.m_data[i] = m_data[i] - rhs.m_data[i];
-  }
-
-  return m;
-}
-
-Matrix Matrix::operator+(netfloat_t x) const {
-  Matrix m(m_cols, m_rows);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m.m_data[i] = m_data[i] + x;
-  }
-
-  return m;
-}
-
-Matrix Matrix::operator-(netfloat_t x) const {
-  Matrix m(m_cols, m_rows);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m.m_data[i] = m_data[i] - x;
-  }
-
-  return m;
-}
-
-Matrix Matrix::operator*(netfloat_t x) const {
-  Matrix m(m_cols, m_rows);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m.m_data[i] = m_data[i] * x;
-  }
-
-  return m;
-}
-
-Matrix Matrix::operator/(netfloat_t x) const {
-  Matrix m(m_cols, m_rows);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m.m_data[i] = m_data[i] / x;
-  }
-
-  return m;
-}
-
 Matrix& Matrix::operator+=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] += x;
-  }
+  simd::kernels().addScalar(m_data, x, m_data, size());
   return *this;
 }
 
 Matrix& Matrix::operator-=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] -= x;
-  }
+  simd::kernels().addScalar(m_data, -x, m_data, size());
   return *this;
 }
 
 Matrix& Matrix::operator*=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] *= x;
-  }
+  simd::kernels().multiplyScalar(m_data, x, m_data, size());
   return *this;
 }
 
 Matrix& Matrix::operator/=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] /= x;
-  }
+  simd::kernels().divideScalar(m_data, x, m_data, size());
   return *this;
 }
 
 Matrix& Matrix::operator+=(const Matrix& rhs) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] += rhs.m_data[i];
-  }
+  DBG_ASSERT(rhs.size() == size());
+
+  simd::kernels().add(m_data, rhs.m_data, m_data, size());
   return *this;
 }
 
 Matrix& Matrix::operator-=(const Matrix& rhs) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] -= rhs.m_data[i];
-  }
+  DBG_ASSERT(rhs.size() == size());
+
+  simd::kernels().subtract(m_data, rhs.m_data, m_data, size());
   return *this;
 }
 
 Vector Matrix::transposeMultiply(const Vector& rhs) const {
-  DBG_ASSERT(rhs.size() == m_rows);
-
   Vector v(m_cols);
-  for (size_t c = 0; c < m_cols; ++c) {
-    netfloat_t sum = 0.0;
-    for (size_t r = 0; r < m_rows; ++r) {
-      sum += at(c, r) * rhs[r];
-    }
-    v[c] = sum;
-  }
+  richard::transposeMultiply(*this, rhs, v, true);
   return v;
 }
 
@@ -679,10 +862,8 @@ Matrix Matrix::hadamard(const Matrix& rhs) const {
   DBG_ASSERT(rhs.m_cols == m_cols);
   DBG_ASSERT(rhs.m_rows == m_rows);
 
-  Matrix m(m_cols, m_rows);
-  for (size_t i = 0; i < size(); ++i) {
-    m.m_data[i] = m_data[i] * rhs.m_data[i];
-  }
+  Matrix m(DataArray(size(), false), m_cols, m_rows);
+  simd::kernels().multiply(m_data, rhs.m_data, m.m_data, size());
   return m;
 }
 
@@ -691,39 +872,21 @@ void Matrix::zero() {
 }
 
 void Matrix::fill(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] = x;
-  }
+  simd::kernels().fill(m_data, x, size());
 }
 
-Matrix& Matrix::randomize(netfloat_t standardDeviation) {
-  static std::mt19937 gen(0);
-  std::normal_distribution<netfloat_t> dist(0.0, standardDeviation);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] = dist(gen);
-  }
-  
+Matrix& Matrix::randomize(netfloat_t standardDeviation, Random& random) {
+  random.normal(m_data, standardDeviation, size());
   return *this;
 }
 
 netfloat_t Matrix::sum() const {
-  netfloat_t s = 0.0;
-
-  for (size_t i = 0; i < size(); ++i) {
-    s += m_data[i];
-  }
-
-  return s;
+  return simd::kernels().sum(m_data, size());
 }
 
 Matrix Matrix::transpose() const {
   Matrix m(m_rows, m_cols);
-  for (size_t c = 0; c < m_cols; ++c) {
-    for (size_t r = 0; r < m_rows; ++r) {
-      m.set(r, c, at(c, r));
-    }
-  }
+  transposeInto(m_data, m_cols, m_rows, m.data());
   return m;
 }
 
@@ -735,22 +898,22 @@ bool Matrix::operator==(const Matrix& rhs) const {
   return arraysEqual(m_data, rhs.m_data, size());
 }
 
-MatrixPtr Matrix::createShallow(DataArray& data, size_t cols, size_t rows) {
+MatrixView Matrix::createShallow(DataArray& data, size_t cols, size_t rows) {
   DBG_ASSERT(data.size() == cols * rows);
-  return MatrixPtr(new Matrix(data.data(), cols, rows));
+  return MatrixView(data.data(), cols, rows);
 }
 
-ConstMatrixPtr Matrix::createShallow(const DataArray& data, size_t cols, size_t rows) {
+ConstMatrixView Matrix::createShallow(const DataArray& data, size_t cols, size_t rows) {
   DBG_ASSERT(data.size() == cols * rows);
-  return ConstMatrixPtr(new Matrix(const_cast<netfloat_t*>(data.data()), cols, rows));
+  return ConstMatrixView(const_cast<netfloat_t*>(data.data()), cols, rows);
 }
 
-MatrixPtr Matrix::createShallow(netfloat_t* data, size_t cols, size_t rows) {
-  return MatrixPtr(new Matrix(data, cols, rows));
+MatrixView Matrix::createShallow(netfloat_t* data, size_t cols, size_t rows) {
+  return MatrixView(data, cols, rows);
 }
 
-ConstMatrixPtr Matrix::createShallow(const netfloat_t* data, size_t cols, size_t rows) {
-  return ConstMatrixPtr(new Matrix(const_cast<netfloat_t*>(data), cols, rows));
+ConstMatrixView Matrix::createShallow(const netfloat_t* data, size_t cols, size_t rows) {
+  return ConstMatrixView(const_cast<netfloat_t*>(data), cols, rows);
 }
 
 std::ostream& operator<<(std::ostream& os, const Matrix& m) {
@@ -870,7 +1033,7 @@ Kernel::Kernel(netfloat_t* data, size_t W, size_t H, size_t D)
   , m_W(W) {}
 
 Kernel::Kernel(const Kernel& cpy)
-  : m_storage(cpy.size())
+  : m_storage(cpy.size(), false)
   , m_data(m_storage.data())
   , m_D(cpy.m_D)
   , m_H(cpy.m_H)
@@ -885,7 +1048,7 @@ Kernel::Kernel(Kernel&& mv) {
   m_D = mv.m_D;
 
   if (mv.isShallow()) {
-    m_storage = DataArray(m_W * m_H * m_D);
+    m_storage = DataArray(m_W * m_H * m_D, false);
     m_data = m_storage.data();
     memcpy(m_data, mv.m_data, m_W * m_H * m_D * sizeof(netfloat_t));
   }
@@ -913,11 +1076,14 @@ Kernel& Kernel::operator=(const Kernel& rhs) {
     DBG_ASSERT(rhs.m_W == m_W && rhs.m_H == m_H && rhs.m_D == m_D);
   }
   else {
+    // Reuse the existing allocation when the number of elements hasn't changed
+    if (m_storage.size() != rhs.m_W * rhs.m_H * rhs.m_D) {
+      m_storage = DataArray(rhs.m_W * rhs.m_H * rhs.m_D, false);
+      m_data = m_storage.data();
+    }
     m_W = rhs.m_W;
     m_H = rhs.m_H;
     m_D = rhs.m_D;
-    m_storage = DataArray(m_W * m_H * m_D);
-    m_data = m_storage.data();
   }
 
   memcpy(m_data, rhs.m_data, m_W * m_H * m_D * sizeof(netfloat_t));
@@ -949,154 +1115,74 @@ void Kernel::zero() {
 }
 
 void Kernel::fill(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] = x;
-  }
+  simd::kernels().fill(m_data, x, size());
 }
 
-Kernel& Kernel::randomize(netfloat_t standardDeviation) {
-  static std::mt19937 gen(0);
-  std::normal_distribution<netfloat_t> dist(0.0, standardDeviation);
-
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] = dist(gen);
-  }
-
+Kernel& Kernel::randomize(netfloat_t standardDeviation, Random& random) {
+  random.normal(m_data, standardDeviation, size());
   return *this;
 }
 
-Kernel Kernel::operator+(const Kernel& rhs) const {
-  Kernel K(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    K.m_data[i] = m_data[i] + rhs.m_data[i];
-  }
-  return K;
-}
-
-Kernel Kernel::operator-(const Kernel& rhs) const {
-  Kernel K(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    K.m_data[i] = m_data[i] - rhs.m_data[i];
-  }
-  return K;
-}
-
-Kernel Kernel::operator+(netfloat_t x) const {
-  Kernel K(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    K.m_data[i] = m_data[i] + x;
-  }
-  return K;
-}
-
-Kernel Kernel::operator-(netfloat_t x) const {
-  Kernel K(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    K.m_data[i] = m_data[i] - x;
-  }
-  return K;
-}
-
-Kernel Kernel::operator*(netfloat_t x) const {
-  Kernel K(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    K.m_data[i] = m_data[i] * x;
-  }
-  return K;
-}
-
-Kernel Kernel::operator/(netfloat_t x) const {
-  Kernel K(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    K.m_data[i] = m_data[i] / x;
-  }
-  return K;
-}
-
 Kernel Kernel::hadamard(const Kernel& rhs) const {
   DBG_ASSERT(rhs.m_W == m_W);
   DBG_ASSERT(rhs.m_H == m_H);
   DBG_ASSERT(rhs.m_D == m_D);
 
-  Kernel k(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    k.m_data[i] = m_data[i] * rhs.m_data[i];
-  }
+  Kernel k(DataArray(size(), false), m_W, m_H, m_D);
+  simd::kernels().multiply(m_data, rhs.m_data, k.m_data, size());
   return k;
 }
 
 Kernel& Kernel::operator+=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] += x;
-  }
+  simd::kernels().addScalar(m_data, x, m_data, size());
   return *this;
 }
 
 Kernel& Kernel::operator-=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] -= x;
-  }
+  simd::kernels().addScalar(m_data, -x, m_data, size());
   return *this;
 }
 
 Kernel& Kernel::operator*=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] *= x;
-  }
+  simd::kernels().multiplyScalar(m_data, x, m_data, size());
   return *this;
 }
 
 Kernel& Kernel::operator/=(netfloat_t x) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] /= x;
-  }
+  simd::kernels().divideScalar(m_data, x, m_data, size());
   return *this;
 }
 
 Kernel& Kernel::operator+=(const Kernel& rhs) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] += rhs.m_data[i];
-  }
-  return *this;
-}
+  DBG_ASSERT(rhs.size() == size());
 
-Kernel& Kernel::operator-=(const Kernel& rhs) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] -= rhs.m_data[i];
-  }
+  simd::kernels().add(m_data, rhs.m_data, m_data, size());
   return *this;
 }
 
-Kernel Kernel::computeTransform(const std::function<netfloat_t(netfloat_t)>& f) const {
-  Kernel K(m_W, m_H, m_D);
-  for (size_t i = 0; i < size(); ++i) {
-    K.m_data[i] = f(m_data[i]);
-  }
-  return K;
-}
+Kernel& Kernel::operator-=(const Kernel& rhs) {
+  DBG_ASSERT(rhs.size() == size());
 
-void Kernel::transformInPlace(const std::function<netfloat_t(netfloat_t)>& f) {
-  for (size_t i = 0; i < size(); ++i) {
-    m_data[i] = f(m_data[i]);
-  }
+  simd::kernels().subtract(m_data, rhs.m_data, m_data, size());
+  return *this;
 }
 
-KernelPtr Kernel::createShallow(DataArray& data, size_t W, size_t H, size_t D) {
+KernelView Kernel::createShallow(DataArray& data, size_t W, size_t H, size_t D) {
   DBG_ASSERT(data.size() == W * H * D);
-  return std::unique_ptr<Kernel>(new Kernel(data.data(), W, H, D));
+  return KernelView(data.data(), W, H, D);
 }
 
-ConstKernelPtr Kernel::createShallow(const DataArray& data, size_t W, size_t H, size_t D) {
+ConstKernelView Kernel::createShallow(const DataArray& data, size_t W, size_t H, size_t D) {
   DBG_ASSERT(data.size() == W * H * D);
-  return std::unique_ptr<const Kernel>(new Kernel(const_cast<netfloat_t*>(data.data()), W, H, D));
+  return ConstKernelView(const_cast<netfloat_t*>(data.data()), W, H, D);
 }
 
-KernelPtr Kernel::createShallow(netfloat_t* data, size_t W, size_t H, size_t D) {
-  return std::unique_ptr<Kernel>(new Kernel(data, W, H, D));
+KernelView Kernel::createShallow(netfloat_t* data, size_t W, size_t H, size_t D) {
+  return KernelView(data, W, H, D);
 }
 
-ConstKernelPtr Kernel::createShallow(const netfloat_t* data, size_t W, size_t H, size_t D) {
-  return std::unique_ptr<const Kernel>(new Kernel(const_cast<netfloat_t*>(data), W, H, D));
+ConstKernelView Kernel::createShallow(const netfloat_t* data, size_t W, size_t H, size_t D) {
+  return ConstKernelView(const_cast<netfloat_t*>(data), W, H, D);
 }
 
 void computeCrossCorrelation(const Array3& image, const Kernel& kernel, Array2& result,
@@ -1176,18 +1262,846 @@ void computeFullCrossCorrelation(const Array3& image, const Kernel& kernel, Arra
   }
 }
 
+namespace {
+
+// Lowers one image into result, whose rows are rowStride apart
+void lowerImage(const netfloat_t* image, size_t imW, size_t imH, size_t imD, size_t kW,
+  size_t kH, netfloat_t* result, size_t rowStride) {
+
+  const size_t fmW = imW - kW + 1;
+  const size_t fmH = imH - kH + 1;
+
+  for (size_t k = 0; k < imD; ++k) {
+    for (size_t j = 0; j < kH; ++j) {
+      for (size_t i = 0; i < kW; ++i) {
+        netfloat_t* dst = result + ((k * kH + j) * kW + i) * rowStride;
+
+        for (size_t y = 0; y < fmH; ++y) {
+          const netfloat_t* src = image + (k * imH + y + j) * imW + i;
+          memcpy(dst, src, fmW * sizeof(netfloat_t));
+          dst += fmW;
+        }
+      }
+    }
+  }
+}
+
+// The adjoint of lowerImage
+void raiseImage(const netfloat_t* cols, size_t rowStride, size_t kW, size_t kH, size_t imW,
+  size_t imH, size_t imD, netfloat_t* image) {
+
+  const size_t fmW = imW - kW + 1;
+  const size_t fmH = imH - kH + 1;
+
+  const simd::Kernels& kernels = simd::kernels();
+
+  for (size_t k = 0; k < imD; ++k) {
+    for (size_t j = 0; j < kH; ++j) {
+      for (size_t i = 0; i < kW; ++i) {
+        const netfloat_t* src = cols + ((k * kH + j) * kW + i) * rowStride;
+
+        for (size_t y = 0; y < fmH; ++y) {
+          netfloat_t* dst = image + (k * imH + y + j) * imW + i;
+          kernels.add(dst, src, dst, fmW);
+          src += fmW;
+        }
+      }
+    }
+  }
+}
+
+}
+
+void im2col(const Array3& image, size_t kW, size_t kH, Matrix& result) {
+  DBG_ASSERT(image.W() >= kW);
+  DBG_ASSERT(image.H() >= kH);
+
+  const size_t fmW = image.W() - kW + 1;
+  const size_t fmH = image.H() - kH + 1;
+
+  DBG_ASSERT(result.rows() == image.D() * kH * kW);
+  DBG_ASSERT(result.cols() == fmW * fmH);
+
+  lowerImage(image.data(), image.W(), image.H(), image.D(), kW, kH, result.data(),
+    result.cols());
+}
+
+void col2im(const Matrix& cols, size_t kW, size_t kH, Array3& image) {
+  const size_t fmW = image.W() - kW + 1;
+  const size_t fmH = image.H() - kH + 1;
+
+  DBG_ASSERT(cols.rows() == image.D() * kH * kW);
+  DBG_ASSERT(cols.cols() == fmW * fmH);
+
+  raiseImage(cols.data(), cols.cols(), kW, kH, image.W(), image.H(), image.D(), image.data());
+}
+
+void im2col(const Matrix& images, const Size3& shape, size_t kW, size_t kH, Matrix& result) {
+  const size_t imW = shape[0];
+  const size_t imH = shape[1];
+  const size_t imD = shape[2];
+
+  DBG_ASSERT(imW >= kW);
+  DBG_ASSERT(imH >= kH);
+  DBG_ASSERT(images.cols() == imW * imH * imD);
+
+  const size_t fmSize = (imW - kW + 1) * (imH - kH + 1);
+
+  DBG_ASSERT(result.rows() == imD * kH * kW);
+  DBG_ASSERT(result.cols() == fmSize * images.rows());
+
+  for (size_t b = 0; b < images.rows(); ++b) {
+    lowerImage(images.data() + b * images.cols(), imW, imH, imD, kW, kH,
+      result.data() + b * fmSize, result.cols());
+  }
+}
+
+void col2im(const Matrix& cols, size_t kW, size_t kH, const Size3& shape, Matrix& images) {
+  const size_t imW = shape[0];
+  const size_t imH = shape[1];
+  const size_t imD = shape[2];
+
+  DBG_ASSERT(images.cols() == imW * imH * imD);
+
+  const size_t fmSize = (imW - kW + 1) * (imH - kH + 1);
+
+  DBG_ASSERT(cols.rows() == imD * kH * kW);
+  DBG_ASSERT(cols.cols() == fmSize * images.rows());
+
+  for (size_t b = 0; b < images.rows(); ++b) {
+    raiseImage(cols.data() + b * fmSize, cols.cols(), kW, kH, imW, imH, imD,
+      images.data() + b * images.cols());
+  }
+}
+
+// The transform matrices are
+//
+//   B^T = [ 1  0 -1  0 ]    G = [ 1    0    0   ]    A^T = [ 1  1  1  0 ]
+//         [ 0  1  1  0 ]        [ 1/2  1/2  1/2 ]          [ 0  1 -1 -1 ]
+//         [ 0 -1  1  0 ]        [ 1/2 -1/2  1/2 ]
+//         [ 0  1  0 -1 ]        [ 0    0    1   ]
+//
+// The 4 x 4 elementwise product of the transformed tiles is done as 16 independent matrix
+// products, each over the input channels, so the filters are applied together.
+void computeWinogradCrossCorrelation(const Array3& image, const Matrix& kernels, Matrix& result) {
+  const size_t D = image.D();
+  const size_t imW = image.W();
+  const size_t imH = image.H();
+  const size_t F = kernels.rows();
+
+  DBG_ASSERT(kernels.cols() == 9 * D);
+  DBG_ASSERT(imW >= 3 && imH >= 3);
+
+  const size_t fmW = imW - 2;
+  const size_t fmH = imH - 2;
+
+  DBG_ASSERT(result.rows() == F);
+  DBG_ASSERT(result.cols() == fmW * fmH);
+
+  const size_t tilesX = (fmW + 1) / 2;
+  const size_t tilesY = (fmH + 1) / 2;
+  const size_t T = tilesX * tilesY;
+
+  thread_local std::vector<netfloat_t> U;
+  thread_local std::vector<netfloat_t> V;
+  thread_local std::vector<netfloat_t> M;
+  U.resize(16 * F * D);
+  V.resize(16 * D * T);
+  M.resize(16 * F * T);
+
+  // Filter transform, G g G^T
+  for (size_t f = 0; f < F; ++f) {
+    for (size_t d = 0; d < D; ++d) {
+      const netfloat_t* g = kernels.data() + f * kernels.cols() + d * 9;
+
+      netfloat_t Gg[4][3];
+      for (size_t c = 0; c < 3; ++c) {
+        Gg[0][c] = g[c];
+        Gg[1][c] = 0.5f * (g[c] + g[3 + c] + g[6 + c]);
+        Gg[2][c] = 0.5f * (g[c] - g[3 + c] + g[6 + c]);
+        Gg[3][c] = g[6 + c];
+      }
+
+      for (size_t r = 0; r < 4; ++r) {
+        netfloat_t u[4] = {
+          Gg[r][0],
+          0.5f * (Gg[r][0] + Gg[r][1] + Gg[r][2]),
+          0.5f * (Gg[r][0] - Gg[r][1] + Gg[r][2]),
+          Gg[r][2]
+        };
+
+        for (size_t c = 0; c < 4; ++c) {
+          U[((r * 4 + c) * F + f) * D + d] = u[c];
+        }
+      }
+    }
+  }
+
+  // Input transform, B^T d B, over overlapping 4 x 4 tiles with a stride of 2. Tiles that
+  // overhang the image are zero padded.
+  for (size_t d = 0; d < D; ++d) {
+    const netfloat_t* channel = image.data() + d * imW * imH;
+
+    for (size_t ty = 0; ty < tilesY; ++ty) {
+      for (size_t tx = 0; tx < tilesX; ++tx) {
+        netfloat_t patch[4][4];
+        for (size_t r = 0; r < 4; ++r) {
+          for (size_t c = 0; c < 4; ++c) {
+            size_t y = ty * 2 + r;
+            size_t x = tx * 2 + c;
+            patch[r][c] = (y < imH && x < imW) ? channel[y * imW + x] : 0.f;
+          }
+        }
+
+        netfloat_t tmp[4][4];
+        for (size_t c = 0; c < 4; ++c) {
+          tmp[0][c] = patch[0][c] - patch[2][c];
+          tmp[1][c] = patch[1][c] + patch[2][c];
+          tmp[2][c] = patch[2][c] - patch[1][c];
+          tmp[3][c] = patch[1][c] - patch[3][c];
+        }
+
+        size_t t = ty * tilesX + tx;
+        for (size_t r = 0; r < 4; ++r) {
+          netfloat_t v[4] = {
+            tmp[r][0] - tmp[r][2],
+            tmp[r][1] + tmp[r][2],
+            tmp[r][2] - tmp[r][1],
+            tmp[r][1] - tmp[r][3]
+          };
+
+          for (size_t c = 0; c < 4; ++c) {
+            V[((r * 4 + c) * D + d) * T + t] = v[c];
+          }
+        }
+      }
+    }
+  }
+
+  for (size_t xi = 0; xi < 16; ++xi) {
+    ConstMatrixView pU = Matrix::createShallow(U.data() + xi * F * D, D, F);
+    ConstMatrixView pV = Matrix::createShallow(V.data() + xi * D * T, T, D);
+    MatrixView pM = Matrix::createShallow(M.data() + xi * F * T, T, F);
+
+    multiply(*pU, *pV, *pM);
+  }
+
+  // Output transform, A^T m A
+  for (size_t f = 0; f < F; ++f) {
+    netfloat_t* featureMap = result.data() + f * result.cols();
+
+    for (size_t ty = 0; ty < tilesY; ++ty) {
+      for (size_t tx = 0; tx < tilesX; ++tx) {
+        size_t t = ty * tilesX + tx;
+
+        netfloat_t m[4][4];
+        for (size_t xi = 0; xi < 16; ++xi) {
+          m[xi / 4][xi % 4] = M[(xi * F + f) * T + t];
+        }
+
+        netfloat_t a[2][4];
+        for (size_t c = 0; c < 4; ++c) {
+          a[0][c] = m[0][c] + m[1][c] + m[2][c];
+          a[1][c] = m[1][c] - m[2][c] - m[3][c];
+        }
+
+        for (size_t r = 0; r < 2; ++r) {
+          size_t y = ty * 2 + r;
+          if (y >= fmH) {
+            break;
+          }
+
+          netfloat_t out[2] = {
+            a[r][0] + a[r][1] + a[r][2],
+            a[r][1] - a[r][2] - a[r][3]
+          };
+
+          for (size_t c = 0; c < 2; ++c) {
+            size_t x = tx * 2 + c;
+            if (x < fmW) {
+              featureMap[y * fmW + x] = out[c];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void computeFftCrossCorrelation(const Array3& image, const Matrix& kernels, size_t kW,
+  size_t kH, Matrix& result, bool flipKernel) {
+
+  fftCrossCorrelation(image, kernels, kW, kH, result, false, flipKernel);
+}
+
+void computeFftFullCrossCorrelation(const Array3& image, const Matrix& kernels, size_t kW,
+  size_t kH, Matrix& result, bool flipKernel) {
+
+  fftCrossCorrelation(image, kernels, kW, kH, result, true, flipKernel);
+}
+
+void computeFftCrossCorrelation(const Array3& image, const Kernel& kernel, Array2& result,
+  bool flipKernel) {
+
+  ConstMatrixView pKernels = Matrix::createShallow(kernel.data(), kernel.size(), 1);
+  MatrixView pResult = Matrix::createShallow(result.data(), result.size(), 1);
+
+  fftCrossCorrelation(image, *pKernels, kernel.W(), kernel.H(), *pResult, false, flipKernel);
+}
+
+void computeFftFullCrossCorrelation(const Array3& image, const Kernel& kernel, Array2& result,
+  bool flipKernel) {
+
+  ConstMatrixView pKernels = Matrix::createShallow(kernel.data(), kernel.size(), 1);
+  MatrixView pResult = Matrix::createShallow(result.data(), result.size(), 1);
+
+  fftCrossCorrelation(image, *pKernels, kernel.W(), kernel.H(), *pResult, true, flipKernel);
+}
+
+// The direct cost counts multiply-adds, which the GEMM engine runs many to a vector
+// instruction. The FFT is scalar, so each of its butterfly operations is weighted accordingly.
+bool fftCorrelationIsCheaper(size_t imW, size_t imH, size_t imD, size_t kW, size_t kH,
+  size_t numKernels, bool full) {
+
+  const double FFT_OP_COST = 8.0;
+
+  size_t outW = full ? imW + kW - 1 : imW - kW + 1;
+  size_t outH = full ? imH + kH - 1 : imH - kH + 1;
+
+  double P = static_cast<double>(nextPowerOfTwo(full ? outW : imW) *
+    nextPowerOfTwo(full ? outH : imH));
+
+  double direct = static_cast<double>(numKernels * imD * outW * outH * kW * kH);
+
+  double transforms = static_cast<double>(imD + numKernels * imD + numKernels);
+  double fft = FFT_OP_COST * (transforms * P * log2(P) + 4.0 * numKernels * imD * P);
+
+  return fft < direct;
+}
+
 Matrix outerProduct(const Vector& A, const Vector& B) {
   Matrix M(B.size(), A.size());
+  outerProduct(A, B, M, true);
+  return M;
+}
+
+void outerProduct(const Vector& A, const Vector& B, Matrix& result, bool accumulate) {
+  DBG_ASSERT(result.rows() == A.size());
+  DBG_ASSERT(result.cols() == B.size());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  blockedMultiplyAccumulate(A.data(), 1, 0, B.data(), B.size(), result.data(), result.cols(),
+    A.size(), 1, B.size());
+}
+
+void multiply(const Matrix& A, const Vector& x, Vector& result, bool accumulate) {
+  DBG_ASSERT(x.size() == A.cols());
+  DBG_ASSERT(result.size() == A.rows());
+  DBG_ASSERT(result.data() != x.data());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  const simd::Kernels& kernels = simd::kernels();
+  const size_t cols = A.cols();
+  const size_t rows = A.rows();
+  netfloat_t tile[simd::TILE_ROWS];
+
+  for (size_t j = 0; j < cols; j += GEMV_BLOCK_COLS) {
+    size_t blockCols = std::min(GEMV_BLOCK_COLS, cols - j);
+
+    for (size_t i = 0; i < rows; i += simd::TILE_ROWS) {
+      size_t tileRows = std::min(simd::TILE_ROWS, rows - i);
 
-  for (size_t j = 0; j < A.size(); ++j) {
-    for (size_t i = 0; i < B.size(); ++i) {
-      M.set(i, j, A[j] * B[i]);
+      kernels.dotRows(A.data() + i * cols + j, cols, x.data() + j, tile, tileRows, blockCols);
+
+      for (size_t r = 0; r < tileRows; ++r) {
+        result[i + r] += tile[r];
+      }
+    }
+  }
+}
+
+void gemv(const Matrix& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f) {
+
+  DBG_ASSERT(x.size() == A.cols());
+  DBG_ASSERT(b.size() == A.rows());
+  DBG_ASSERT(Z.size() == A.rows());
+  DBG_ASSERT(Y.size() == A.rows());
+
+  gemvRows(A.data(), A.cols(), A.rows(), x, b, Z, Y, f);
+}
+
+template<typename S>
+void gemv(const PackedMatrix<S>& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f) {
+
+  DBG_ASSERT(x.size() == A.cols());
+  DBG_ASSERT(b.size() == A.rows());
+  DBG_ASSERT(Z.size() == A.rows());
+  DBG_ASSERT(Y.size() == A.rows());
+
+  gemvRows(A.data(), A.cols(), A.rows(), x, b, Z, Y, f);
+}
+
+template void gemv(const PackedMatrix<float16_t>&, const Vector&, const Vector&, Vector&,
+  Vector&, const std::function<void(const netfloat_t*, netfloat_t*, size_t)>&);
+template void gemv(const PackedMatrix<bfloat16_t>&, const Vector&, const Vector&, Vector&,
+  Vector&, const std::function<void(const netfloat_t*, netfloat_t*, size_t)>&);
+
+template<typename S>
+PackedMatrix<S>::PackedMatrix()
+  : m_cols(0)
+  , m_rows(0) {}
+
+template<typename S>
+PackedMatrix<S>::PackedMatrix(const Matrix& M)
+  : PackedMatrix() {
+
+  pack(M);
+}
+
+template<typename S>
+void PackedMatrix<S>::pack(const Matrix& M) {
+  m_data.resize(M.size());
+  m_cols = M.cols();
+  m_rows = M.rows();
+
+  packArray(M.data(), m_data.data(), m_data.size());
+}
+
+template<typename S>
+Matrix PackedMatrix<S>::unpack() const {
+  Matrix M(DataArray(m_data.size(), false), m_cols, m_rows);
+  unpackArray(m_data.data(), M.data(), m_data.size());
+  return M;
+}
+
+template class PackedMatrix<float16_t>;
+template class PackedMatrix<bfloat16_t>;
+
+QuantizedMatrix::QuantizedMatrix()
+  : m_inputScale(1.f)
+  , m_cols(0)
+  , m_rows(0) {}
+
+QuantizedMatrix::QuantizedMatrix(const Matrix& M, netfloat_t inputRange)
+  : QuantizedMatrix() {
+
+  quantize(M, inputRange);
+}
+
+void QuantizedMatrix::quantize(const Matrix& M, netfloat_t inputRange) {
+  m_data.resize(M.size());
+  m_scales.resize(M.rows());
+  m_cols = M.cols();
+  m_rows = M.rows();
+  m_inputScale = inputRange > 0.f ? inputRange / 127.f : 1.f;
+
+  for (size_t i = 0; i < m_rows; ++i) {
+    const netfloat_t* row = M.data() + i * m_cols;
+
+    netfloat_t largest = 0.f;
+    for (size_t j = 0; j < m_cols; ++j) {
+      largest = std::max(largest, std::fabs(row[j]));
+    }
+
+    m_scales[i] = largest > 0.f ? largest / 127.f : 1.f;
+    simd::kernels().toInt8(row, m_data.data() + i * m_cols, 1.f / m_scales[i], m_cols);
+  }
+}
+
+Matrix QuantizedMatrix::dequantize() const {
+  Matrix M(m_cols, m_rows);
+  for (size_t i = 0; i < m_rows; ++i) {
+    for (size_t j = 0; j < m_cols; ++j) {
+      M.data()[i * m_cols + j] = m_scales[i] * m_data[i * m_cols + j];
+    }
+  }
+  return M;
+}
+
+void QuantizedMatrix::quantizeInputs(const netfloat_t* x, int8_t* R, size_t n) const {
+  simd::kernels().toInt8(x, R, 1.f / m_inputScale, n);
+}
+
+netfloat_t maxMagnitude(const DataArray& A) {
+  netfloat_t largest = 0.f;
+  for (size_t i = 0; i < A.size(); ++i) {
+    largest = std::max(largest, std::fabs(A[i]));
+  }
+  return largest;
+}
+
+void gemv(const QuantizedMatrix& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f) {
+
+  DBG_ASSERT(x.size() == A.cols());
+  DBG_ASSERT(b.size() == A.rows());
+  DBG_ASSERT(Z.size() == A.rows());
+  DBG_ASSERT(Y.size() == A.rows());
+
+  const size_t cols = A.cols();
+  const size_t rows = A.rows();
+
+  // A row of int8 weights is a quarter the size of a float row, so the quantized x stays in
+  // cache without blocking the columns
+  thread_local std::vector<int8_t> xq;
+  xq.resize(cols);
+  A.quantizeInputs(x.data(), xq.data(), cols);
+
+  int32_t tile[simd::TILE_ROWS];
+
+  for (size_t i = 0; i < rows; i += simd::TILE_ROWS) {
+    size_t tileRows = std::min(simd::TILE_ROWS, rows - i);
+
+    simd::kernels().dotRowsInt8(A.data() + i * cols, cols, xq.data(), tile, tileRows, cols);
+
+    for (size_t r = 0; r < tileRows; ++r) {
+      Z[i + r] = b[i + r] + A.scales()[i + r] * A.inputScale() * tile[r];
+    }
+
+    size_t end = i + tileRows;
+    if (end % GEMV_ACTIVATION_ROWS == 0 || end == rows) {
+      size_t start = (end - 1) / GEMV_ACTIVATION_ROWS * GEMV_ACTIVATION_ROWS;
+      f(Z.data() + start, Y.data() + start, end - start);
+    }
+  }
+}
+
+SparseMatrix::SparseMatrix()
+  : m_rowStarts(1, 0)
+  , m_cols(0)
+  , m_rows(0) {}
+
+SparseMatrix::SparseMatrix(const Matrix& M)
+  : m_cols(M.cols())
+  , m_rows(M.rows()) {
+
+  m_rowStarts.reserve(m_rows + 1);
+  m_rowStarts.push_back(0);
+
+  for (size_t i = 0; i < m_rows; ++i) {
+    const netfloat_t* row = M.data() + i * m_cols;
+    for (size_t j = 0; j < m_cols; ++j) {
+      if (row[j] != 0.f) {
+        m_values.push_back(row[j]);
+        m_columns.push_back(static_cast<uint32_t>(j));
+      }
+    }
+    m_rowStarts.push_back(static_cast<uint32_t>(m_values.size()));
+  }
+}
+
+SparseMatrix::SparseMatrix(std::istream& stream, size_t cols, size_t rows)
+  : m_rowStarts(rows + 1)
+  , m_cols(cols)
+  , m_rows(rows) {
+
+  stream.read(reinterpret_cast<char*>(m_rowStarts.data()), m_rowStarts.size() * sizeof(uint32_t));
+
+  size_t nonZeros = m_rowStarts.back();
+  if (!stream || m_rowStarts[0] != 0 || nonZeros > cols * rows
+    || !std::is_sorted(m_rowStarts.begin(), m_rowStarts.end())) {
+
+    EXCEPTION("Error reading sparse matrix; row offsets are invalid");
+  }
+
+  m_columns.resize(nonZeros);
+  m_values.resize(nonZeros);
+  stream.read(reinterpret_cast<char*>(m_columns.data()), nonZeros * sizeof(uint32_t));
+  stream.read(reinterpret_cast<char*>(m_values.data()), nonZeros * sizeof(netfloat_t));
+
+  if (!stream) {
+    EXCEPTION("Error reading sparse matrix; unexpected end of stream");
+  }
+  for (uint32_t column : m_columns) {
+    if (column >= cols) {
+      EXCEPTION("Error reading sparse matrix; column " << column << " out of range");
     }
   }
+}
+
+void SparseMatrix::writeToStream(std::ostream& stream) const {
+  stream.write(reinterpret_cast<const char*>(m_rowStarts.data()),
+    m_rowStarts.size() * sizeof(uint32_t));
+  stream.write(reinterpret_cast<const char*>(m_columns.data()),
+    m_columns.size() * sizeof(uint32_t));
+  stream.write(reinterpret_cast<const char*>(m_values.data()),
+    m_values.size() * sizeof(netfloat_t));
+}
 
+Matrix SparseMatrix::toDense() const {
+  Matrix M(m_cols, m_rows);
+  for (size_t i = 0; i < m_rows; ++i) {
+    for (size_t k = m_rowStarts[i]; k < m_rowStarts[i + 1]; ++k) {
+      M.data()[i * m_cols + m_columns[k]] = m_values[k];
+    }
+  }
   return M;
 }
 
+void gemv(const SparseMatrix& A, const Vector& x, const Vector& b, Vector& Z, Vector& Y,
+  const std::function<void(const netfloat_t*, netfloat_t*, size_t)>& f) {
+
+  DBG_ASSERT(x.size() == A.cols());
+  DBG_ASSERT(b.size() == A.rows());
+  DBG_ASSERT(Z.size() == A.rows());
+  DBG_ASSERT(Y.size() == A.rows());
+
+  const uint32_t* rowStarts = A.rowStarts();
+  const size_t rows = A.rows();
+
+  for (size_t i = 0; i < rows; ++i) {
+    size_t k = rowStarts[i];
+    size_t n = rowStarts[i + 1] - k;
+
+    Z[i] = b[i] + dotSparse(A.values() + k, A.columns() + k, x.data(), n);
+
+    size_t end = i + 1;
+    if (end % GEMV_ACTIVATION_ROWS == 0 || end == rows) {
+      size_t start = (end - 1) / GEMV_ACTIVATION_ROWS * GEMV_ACTIVATION_ROWS;
+      f(Z.data() + start, Y.data() + start, end - start);
+    }
+  }
+}
+
+void multiply(const SparseMatrix& A, const Matrix& B, Matrix& result, bool accumulate) {
+  DBG_ASSERT(A.cols() == B.rows());
+  DBG_ASSERT(result.rows() == A.rows());
+  DBG_ASSERT(result.cols() == B.cols());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  const auto& kernels = simd::kernels();
+  const uint32_t* rowStarts = A.rowStarts();
+  const size_t n = B.cols();
+
+  for (size_t i = 0; i < A.rows(); ++i) {
+    netfloat_t* R = result.data() + i * n;
+    for (size_t k = rowStarts[i]; k < rowStarts[i + 1]; ++k) {
+      kernels.axpy(A.values()[k], B.data() + A.columns()[k] * n, R, n);
+    }
+  }
+}
+
+void transposeMultiply(const SparseMatrix& A, const Matrix& B, Matrix& result, bool accumulate) {
+  DBG_ASSERT(A.rows() == B.rows());
+  DBG_ASSERT(result.rows() == A.cols());
+  DBG_ASSERT(result.cols() == B.cols());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  const auto& kernels = simd::kernels();
+  const uint32_t* rowStarts = A.rowStarts();
+  const size_t n = B.cols();
+
+  for (size_t i = 0; i < A.rows(); ++i) {
+    const netfloat_t* Brow = B.data() + i * n;
+    for (size_t k = rowStarts[i]; k < rowStarts[i + 1]; ++k) {
+      kernels.axpy(A.values()[k], Brow, result.data() + A.columns()[k] * n, n);
+    }
+  }
+}
+
+void pruneBelow(Matrix& M, netfloat_t threshold) {
+  netfloat_t* data = M.data();
+  for (size_t i = 0; i < M.size(); ++i) {
+    if (std::fabs(data[i]) < threshold) {
+      data[i] = 0.f;
+    }
+  }
+}
+
+netfloat_t magnitudeQuantile(const Matrix& M, netfloat_t fraction) {
+  DBG_ASSERT(fraction >= 0.f && fraction <= 1.f);
+
+  size_t k = static_cast<size_t>(fraction * M.size());
+  if (k == 0) {
+    return 0.f;
+  }
+  if (k >= M.size()) {
+    return std::numeric_limits<netfloat_t>::infinity();
+  }
+
+  std::vector<netfloat_t> magnitudes(M.size());
+  for (size_t i = 0; i < M.size(); ++i) {
+    magnitudes[i] = std::fabs(M.data()[i]);
+  }
+
+  std::nth_element(magnitudes.begin(), magnitudes.begin() + k, magnitudes.end());
+  return magnitudes[k];
+}
+
+void computeQuantizedCrossCorrelation(const Array3& image, const QuantizedMatrix& kernels,
+  size_t kW, size_t kH, Matrix& result) {
+
+  const size_t imW = image.W();
+  const size_t imH = image.H();
+  const size_t imD = image.D();
+
+  DBG_ASSERT(imW >= kW);
+  DBG_ASSERT(imH >= kH);
+
+  const size_t fmW = imW - kW + 1;
+  const size_t fmH = imH - kH + 1;
+  const size_t kernelSize = kW * kH * imD;
+  const size_t numKernels = kernels.rows();
+
+  DBG_ASSERT(kernels.cols() == kernelSize);
+  DBG_ASSERT(result.cols() == fmW * fmH);
+  DBG_ASSERT(result.rows() == numKernels);
+
+  const size_t numPositions = fmW * fmH;
+  const size_t groups = (kernelSize + 3) / 4;
+  const size_t ldb = 4 * numPositions;
+
+  // Rows are copied eight bytes at a time, which is far cheaper than a memcpy call per row. A
+  // copy may run up to seven bytes past the end of a row, either into the next row, which is
+  // written afterwards, or into the padding at the end of each buffer.
+  const size_t CHUNK = 8;
+  const size_t chunks = (fmW + CHUNK - 1) / CHUNK;
+
+  thread_local std::vector<int8_t> imageq;
+  thread_local std::vector<int8_t> columns;
+  thread_local std::vector<int8_t> lowered;
+  imageq.resize(image.size() + CHUNK);
+  columns.resize(groups * 4 * numPositions + CHUNK);
+  lowered.resize(groups * ldb);
+
+  kernels.quantizeInputs(image.data(), imageq.data(), image.size());
+
+  // Lower the quantized image as im2col does. Row (z * kH + j) * kW + i is kernel element
+  // (i, j, z) against each output position in turn.
+  for (size_t z = 0; z < imD; ++z) {
+    for (size_t j = 0; j < kH; ++j) {
+      for (size_t i = 0; i < kW; ++i) {
+        int8_t* dst = columns.data() + ((z * kH + j) * kW + i) * numPositions;
+
+        for (size_t y = 0; y < fmH; ++y) {
+          const int8_t* src = imageq.data() + (z * imH + y + j) * imW + i;
+          for (size_t c = 0; c < chunks; ++c) {
+            memcpy(dst + y * fmW + c * CHUNK, src + c * CHUNK, CHUNK);
+          }
+        }
+      }
+    }
+  }
+  std::fill(columns.begin() + kernelSize * numPositions, columns.end(), 0);
+
+  // Then pack the rows four to a word for multiplyInt8
+  for (size_t g = 0; g < groups; ++g) {
+    const int8_t* src = columns.data() + 4 * g * numPositions;
+    int8_t* dst = lowered.data() + g * ldb;
+
+    for (size_t p = 0; p < numPositions; ++p) {
+      dst[4 * p] = src[p];
+      dst[4 * p + 1] = src[numPositions + p];
+      dst[4 * p + 2] = src[2 * numPositions + p];
+      dst[4 * p + 3] = src[3 * numPositions + p];
+    }
+  }
+
+  thread_local std::vector<int32_t> tile;
+  tile.resize(simd::TILE_ROWS * numPositions);
+
+  for (size_t i = 0; i < numKernels; i += simd::TILE_ROWS) {
+    size_t tileRows = std::min(simd::TILE_ROWS, numKernels - i);
+
+    simd::kernels().multiplyInt8(kernels.data() + i * kernelSize, kernelSize, lowered.data(),
+      ldb, tile.data(), numPositions, tileRows, kernelSize, numPositions);
+
+    for (size_t r = 0; r < tileRows; ++r) {
+      netfloat_t scale = kernels.scales()[i + r] * kernels.inputScale();
+      netfloat_t* dst = result.data() + (i + r) * result.cols();
+      const int32_t* src = tile.data() + r * numPositions;
+
+      for (size_t p = 0; p < numPositions; ++p) {
+        dst[p] = scale * src[p];
+      }
+    }
+  }
+}
+
+void transposeMultiply(const Matrix& A, const Vector& x, Vector& result, bool accumulate) {
+  DBG_ASSERT(x.size() == A.rows());
+  DBG_ASSERT(result.size() == A.cols());
+  DBG_ASSERT(result.data() != x.data());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  // Treat x as a single row, so A is streamed a row at a time rather than down its columns
+  blockedMultiplyAccumulate(x.data(), 0, 1, A.data(), A.cols(), result.data(), A.cols(), 1,
+    A.rows(), A.cols());
+}
+
+void multiply(const Matrix& A, const Matrix& B, Matrix& result, bool accumulate) {
+  DBG_ASSERT(A.cols() == B.rows());
+  DBG_ASSERT(result.rows() == A.rows());
+  DBG_ASSERT(result.cols() == B.cols());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  blockedMultiplyAccumulate(A.data(), A.cols(), 1, B.data(), B.cols(), result.data(),
+    result.cols(), A.rows(), A.cols(), B.cols());
+}
+
+void transposeMultiply(const Matrix& A, const Matrix& B, Matrix& result, bool accumulate) {
+  DBG_ASSERT(A.rows() == B.rows());
+  DBG_ASSERT(result.rows() == A.cols());
+  DBG_ASSERT(result.cols() == B.cols());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  blockedMultiplyAccumulate(A.data(), 1, A.cols(), B.data(), B.cols(), result.data(),
+    result.cols(), A.cols(), A.rows(), B.cols());
+}
+
+void multiplyTranspose(const Matrix& A, const Matrix& B, Matrix& result, bool accumulate) {
+  DBG_ASSERT(A.cols() == B.cols());
+  DBG_ASSERT(result.rows() == A.rows());
+  DBG_ASSERT(result.cols() == B.rows());
+
+  if (!accumulate) {
+    result.zero();
+  }
+
+  // A single row or column has the same layout as its transpose
+  const netfloat_t* Bt = B.data();
+
+  thread_local std::vector<netfloat_t> packed;
+  if (B.rows() > 1 && B.cols() > 1) {
+    packed.resize(B.size());
+    transposeInto(B.data(), B.cols(), B.rows(), packed.data());
+    Bt = packed.data();
+  }
+
+  blockedMultiplyAccumulate(A.data(), A.cols(), 1, Bt, B.rows(), result.data(), result.cols(),
+    A.rows(), A.cols(), B.rows());
+}
+
+void transpose(const Matrix& A, Matrix& result) {
+  DBG_ASSERT(result.rows() == A.cols());
+  DBG_ASSERT(result.cols() == A.rows());
+
+  transposeInto(A.data(), A.cols(), A.rows(), result.data());
+}
+
 std::ostream& operator<<(std::ostream& os, const Kernel& k) {
   os << "[" << std::endl;
 
@@ -1211,4 +2125,30 @@ std::ostream& operator<<(std::ostream& os, const Kernel& k) {
   return os;
 }
 
+void axpy(netfloat_t a, const Vector& X, Vector& Y) {
+  DBG_ASSERT(X.size() == Y.size());
+  simd::kernels().axpy(a, X.data(), Y.data(), X.size());
+}
+
+void axpy(netfloat_t a, const Matrix& X, Matrix& Y) {
+  DBG_ASSERT(X.size() == Y.size());
+  simd::kernels().axpy(a, X.data(), Y.data(), X.size());
+}
+
+void axpy(netfloat_t a, const Kernel& X, Kernel& Y) {
+  DBG_ASSERT(X.size() == Y.size());
+  simd::kernels().axpy(a, X.data(), Y.data(), X.size());
+}
+
+void ger(netfloat_t a, const Vector& x, const Vector& y, Matrix& A) {
+  DBG_ASSERT(A.rows() == x.size());
+  DBG_ASSERT(A.cols() == y.size());
+
+  const simd::Kernels& kernels = simd::kernels();
+
+  for (size_t i = 0; i < A.rows(); ++i) {
+    kernels.axpy(a * x[i], y.data(), A.data() + i * A.cols(), A.cols());
+  }
+}
+
 }
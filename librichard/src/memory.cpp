@@ -0,0 +1,165 @@
+#include "richard/memory.hpp"
+#include <array>
+#include <new>
+
+namespace richard {
+namespace memory {
+namespace {
+
+// Size classes run from 64 bytes to 64 MB. Larger buffers bypass the free lists.
+const size_t MIN_CLASS_BYTES = 64;
+const size_t NUM_CLASSES = 21;
+const size_t MAX_CLASS_BYTES = MIN_CLASS_BYTES << (NUM_CLASSES - 1);
+
+// Beyond this, released buffers go back to the system rather than being cached
+const size_t MAX_CACHED_BYTES = 256 * 1024 * 1024;
+
+static_assert(MIN_CLASS_BYTES % ALIGNMENT == 0);
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+size_t sizeClass(size_t bytes) {
+  size_t c = 0;
+  while ((MIN_CLASS_BYTES << c) < bytes) {
+    ++c;
+  }
+  return c;
+}
+
+void* systemAllocate(size_t bytes) {
+  return ::operator new(bytes, std::align_val_t(ALIGNMENT));
+}
+
+void systemFree(void* ptr) {
+  ::operator delete(ptr, std::align_val_t(ALIGNMENT));
+}
+
+class ThreadCache {
+  public:
+    ThreadCache()
+      : m_cachedBytes(0)
+      , m_systemAllocations(0) {
+
+      m_freeLists.fill(nullptr);
+    }
+
+    void* allocate(size_t bytes) {
+      if (bytes > MAX_CLASS_BYTES) {
+        ++m_systemAllocations;
+        return systemAllocate((bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+      }
+
+      size_t c = sizeClass(bytes);
+      FreeBlock* block = m_freeLists[c];
+
+      if (block != nullptr) {
+        m_freeLists[c] = block->next;
+        m_cachedBytes -= MIN_CLASS_BYTES << c;
+        return block;
+      }
+
+      ++m_systemAllocations;
+      return systemAllocate(MIN_CLASS_BYTES << c);
+    }
+
+    void release(void* ptr, size_t bytes) {
+      if (bytes > MAX_CLASS_BYTES) {
+        systemFree(ptr);
+        return;
+      }
+
+      size_t c = sizeClass(bytes);
+      size_t classBytes = MIN_CLASS_BYTES << c;
+
+      if (m_cachedBytes + classBytes > MAX_CACHED_BYTES) {
+        systemFree(ptr);
+        return;
+      }
+
+      FreeBlock* block = static_cast<FreeBlock*>(ptr);
+      block->next = m_freeLists[c];
+      m_freeLists[c] = block;
+      m_cachedBytes += classBytes;
+    }
+
+    void trim() {
+      for (FreeBlock*& head : m_freeLists) {
+        while (head != nullptr) {
+          FreeBlock* next = head->next;
+          systemFree(head);
+          head = next;
+        }
+      }
+      m_cachedBytes = 0;
+    }
+
+    PoolStats stats() const {
+      return PoolStats{ m_cachedBytes, m_systemAllocations };
+    }
+
+    ~ThreadCache();
+
+  private:
+    std::array<FreeBlock*, NUM_CLASSES> m_freeLists;
+    size_t m_cachedBytes;
+    size_t m_systemAllocations;
+};
+
+// Tensors with static or thread storage duration may be released after the cache has been
+// destroyed, in which case they go straight back to the system
+thread_local bool cacheDestroyed = false;
+thread_local ThreadCache cache;
+
+ThreadCache::~ThreadCache() {
+  trim();
+  cacheDestroyed = true;
+}
+
+}
+
+netfloat_t* allocate(size_t n) {
+  if (n == 0) {
+    return nullptr;
+  }
+
+  size_t bytes = n * sizeof(netfloat_t);
+
+  if (cacheDestroyed) {
+    return static_cast<netfloat_t*>(systemAllocate((bytes + ALIGNMENT - 1) / ALIGNMENT
+      * ALIGNMENT));
+  }
+
+  return static_cast<netfloat_t*>(cache.allocate(bytes));
+}
+
+void release(netfloat_t* ptr, size_t n) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  if (cacheDestroyed) {
+    systemFree(ptr);
+    return;
+  }
+
+  cache.release(ptr, n * sizeof(netfloat_t));
+}
+
+void trim() {
+  if (!cacheDestroyed) {
+    cache.trim();
+  }
+}
+
+PoolStats poolStats() {
+  if (cacheDestroyed) {
+    return PoolStats{ 0, 0 };
+  }
+
+  return cache.stats();
+}
+
+}
+}
@@ -11,12 +11,16 @@ const hashedString_t ESampleProcessed::name = hashString("sampleProcessed");
 Hyperparams::Hyperparams()
   : epochs(0)
   , batchSize(1000)
-  , miniBatchSize(16) {}
+  , miniBatchSize(16)
+  , threads(1)
+  , seed(0) {}
 
 Hyperparams::Hyperparams(const Config& config) {
   epochs = config.getNumber<uint32_t>("epochs");
   batchSize = config.getNumber<uint32_t>("batchSize");
   miniBatchSize = config.getNumber<uint32_t>("miniBatchSize");
+  threads = config.contains("threads") ? config.getNumber<uint32_t>("threads") : 1;
+  seed = config.contains("seed") ? config.getNumber<uint64_t>("seed") : 0;
 }
 
 const Config& Hyperparams::exampleConfig() {
@@ -25,12 +29,26 @@ const Config& Hyperparams::exampleConfig() {
     c.setNumber("epochs", 10);
     c.setNumber("batchSize", 1000);
     c.setNumber("miniBatchSize", 16);
+    c.setNumber("threads", 1);
     return c;
   }();
 
   return config;
 }
 
+void setLayerStream(Config& layerConfig, uint64_t seed, uint64_t stream) {
+  layerConfig.setNumber("seed", seed);
+  layerConfig.setNumber("stream", stream);
+}
+
+Random layerRandom(const Config& layerConfig) {
+  uint64_t seed = layerConfig.contains("seed") ? layerConfig.getNumber<uint64_t>("seed") : 0;
+  uint64_t stream = layerConfig.contains("stream") ?
+    layerConfig.getNumber<uint64_t>("stream") : 0;
+
+  return Random(seed, stream);
+}
+
 const Config& NeuralNet::exampleConfig() {
   static Config config = []() {
     Config layer1;
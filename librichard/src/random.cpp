@@ -0,0 +1,116 @@
+#include "richard/random.hpp"
+#include "richard/simd.hpp"
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+namespace richard {
+namespace {
+
+// Values are generated a chunk at a time into a buffer on the stack
+const size_t CHUNK = 256;
+
+// The top 24 bits as a float in [0, 1)
+inline netfloat_t toUniform(uint32_t x) {
+  return static_cast<netfloat_t>(x >> 8) * (1.f / 16777216.f);
+}
+
+}
+
+Random::Random(uint64_t seed, uint64_t stream)
+  : m_key{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) }
+  , m_stream(stream)
+  , m_counter(0) {}
+
+uint32_t Random::next() {
+  uint32_t x;
+  generate(&x, 1);
+  return x;
+}
+
+void Random::generate(uint32_t* R, size_t n) {
+  const auto& kernels = simd::kernels();
+
+  size_t blocks = n / 4;
+  kernels.philox(m_key, m_stream, m_counter, R, blocks);
+  m_counter += blocks;
+
+  if (n % 4 != 0) {
+    uint32_t block[4];
+    kernels.philox(m_key, m_stream, m_counter, block, 1);
+    std::copy(block, block + n % 4, R + 4 * blocks);
+    ++m_counter;
+  }
+}
+
+void Random::uniform(netfloat_t* R, size_t n) {
+  uint32_t bits[CHUNK];
+
+  for (size_t i = 0; i < n; i += CHUNK) {
+    size_t m = std::min(CHUNK, n - i);
+    generate(bits, m);
+
+    for (size_t j = 0; j < m; ++j) {
+      R[i + j] = toUniform(bits[j]);
+    }
+  }
+}
+
+// Box-Muller, one pair of outputs per pair of uniforms
+void Random::normal(netfloat_t* R, netfloat_t standardDeviation, size_t n) {
+  const netfloat_t twoPi = 6.283185307f;
+  uint32_t bits[CHUNK];
+
+  for (size_t i = 0; i < n; i += CHUNK) {
+    size_t m = std::min(CHUNK, n - i);
+    generate(bits, CHUNK);
+
+    for (size_t j = 0; j < m; j += 2) {
+      // Shifted into (0, 1] so the log is finite
+      netfloat_t u = toUniform(bits[j]) + 1.f / 16777216.f;
+      netfloat_t v = toUniform(bits[j + 1]);
+
+      netfloat_t r = standardDeviation * std::sqrt(-2.f * std::log(u));
+      R[i + j] = r * std::cos(twoPi * v);
+      if (j + 1 < m) {
+        R[i + j + 1] = r * std::sin(twoPi * v);
+      }
+    }
+  }
+}
+
+void Random::dropout(netfloat_t* A, netfloat_t rate, size_t n) {
+  if (rate <= 0.f) {
+    return;
+  }
+  if (rate >= 1.f) {
+    std::fill(A, A + n, 0.f);
+    return;
+  }
+
+  const uint32_t threshold = static_cast<uint32_t>(static_cast<double>(rate) * 4294967296.0);
+  uint32_t bits[CHUNK];
+
+  for (size_t i = 0; i < n; i += CHUNK) {
+    size_t m = std::min(CHUNK, n - i);
+    generate(bits, m);
+
+    // Masking the bits rather than branching, as the branch would be unpredictable
+    netfloat_t* X = A + i;
+    for (size_t j = 0; j < m; ++j) {
+      uint32_t x;
+      memcpy(&x, X + j, sizeof(x));
+      x &= 0u - static_cast<uint32_t>(bits[j] >= threshold);
+      memcpy(X + j, &x, sizeof(x));
+    }
+  }
+}
+
+Random& defaultRandom() {
+  static std::atomic<uint64_t> nextStream{0};
+  thread_local Random random(0, nextStream++);
+  return random;
+}
+
+}
@@ -0,0 +1,2245 @@
+#include "richard/simd.hpp"
+#include "richard/exception.hpp"
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define RICHARD_SIMD_X86
+  // GCC 12's AVX-512 headers seed some intrinsics with _mm512_undefined_ps(), which trips
+  // -Wuninitialized once inlined (GCC bug 105593).
+  #if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wuninitialized"
+    #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  #endif
+  #include <immintrin.h>
+  #if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic pop
+  #endif
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define RICHARD_SIMD_NEON
+  #include <arm_neon.h>
+#endif
+
+// Allows kernels for instruction sets beyond the compiler's baseline to live in this translation
+// unit. MSVC doesn't need (or support) per-function targets.
+#if defined(__GNUC__) || defined(__clang__)
+  #define RICHARD_TARGET(isa) __attribute__((target(isa)))
+#else
+  #define RICHARD_TARGET(isa)
+#endif
+
+namespace richard {
+namespace simd {
+namespace {
+
+static_assert(std::is_same_v<netfloat_t, float>, "SIMD kernels assume 32-bit netfloat_t");
+
+// Constants for the vectorised exp. Arguments are clamped to the range where the result is a
+// finite, normal float.
+[[maybe_unused]] const float EXP_HI = 88.3762626647949f;
+[[maybe_unused]] const float EXP_LO = -88.3762626647949f;
+[[maybe_unused]] const float LOG2E = 1.44269504088896341f;
+[[maybe_unused]] const float LN2_HI = 0.693359375f;
+[[maybe_unused]] const float LN2_LO = -2.12194440e-4f;
+[[maybe_unused]] const float EXP_P[] = {
+  1.9875691500e-4f,
+  1.3981999507e-3f,
+  8.3334519073e-3f,
+  4.1665795894e-2f,
+  1.6666665459e-1f,
+  5.0000001201e-1f
+};
+
+// Philox4x32-10 multipliers and key increments
+const uint32_t PHILOX_M0 = 0xD2511F53;
+const uint32_t PHILOX_M1 = 0xCD9E8D57;
+const uint32_t PHILOX_W0 = 0x9E3779B9;
+const uint32_t PHILOX_W1 = 0xBB67AE85;
+const int PHILOX_ROUNDS = 10;
+
+namespace scalar {
+
+void add(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] + B[i];
+  }
+}
+
+void subtract(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] - B[i];
+  }
+}
+
+void multiply(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] * B[i];
+  }
+}
+
+void addScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] + x;
+  }
+}
+
+void multiplyScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] * x;
+  }
+}
+
+void divideScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] / x;
+  }
+}
+
+void axpy(netfloat_t a, const netfloat_t* X, netfloat_t* Y, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    Y[i] += a * X[i];
+  }
+}
+
+void fill(netfloat_t* R, netfloat_t x, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = x;
+  }
+}
+
+netfloat_t sum(const netfloat_t* A, size_t n) {
+  netfloat_t s = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    s += A[i];
+  }
+  return s;
+}
+
+netfloat_t dot(const netfloat_t* A, const netfloat_t* B, size_t n) {
+  netfloat_t s = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    s += A[i] * B[i];
+  }
+  return s;
+}
+
+void multiplyAccumulate(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t rows, size_t depth, size_t n) {
+
+  for (size_t i = 0; i < rows; ++i) {
+    netfloat_t* c = C + i * ldc;
+    for (size_t k = 0; k < depth; ++k) {
+      netfloat_t a = A[i * rsA + k * csA];
+      const netfloat_t* b = B + k * ldb;
+      for (size_t j = 0; j < n; ++j) {
+        c[j] += a * b[j];
+      }
+    }
+  }
+}
+
+void dotRows(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  for (size_t i = 0; i < rows; ++i) {
+    R[i] = dot(A + i * lda, x, n);
+  }
+}
+
+void sigmoid(const netfloat_t* A, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = 1.f / (1.f + std::exp(-A[i]));
+  }
+}
+
+void sigmoidPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    netfloat_t s = 1.f / (1.f + std::exp(-A[i]));
+    R[i] = s * (1.f - s);
+  }
+}
+
+void relu(const netfloat_t* A, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] < 0.f ? 0.f : A[i];
+  }
+}
+
+void reluPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = A[i] < 0.f ? 0.f : 1.f;
+  }
+}
+
+template<typename S>
+void convertTo(const netfloat_t* A, S* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = fromNetfloat<S>(A[i]);
+  }
+}
+
+template<typename S>
+void convertFrom(const S* A, netfloat_t* R, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = toNetfloat(A[i]);
+  }
+}
+
+template<typename S>
+netfloat_t dotPacked(const S* A, const netfloat_t* x, size_t n) {
+  netfloat_t sum = 0.f;
+  for (size_t i = 0; i < n; ++i) {
+    sum += toNetfloat(A[i]) * x[i];
+  }
+  return sum;
+}
+
+template<typename S>
+void dotRowsPacked(const S* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  for (size_t i = 0; i < rows; ++i) {
+    R[i] = dotPacked(A + i * lda, x, n);
+  }
+}
+
+void toInt8(const netfloat_t* A, int8_t* R, netfloat_t scale, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = static_cast<int8_t>(std::nearbyint(std::clamp(A[i] * scale, -127.f, 127.f)));
+  }
+}
+
+void normalizeUint8(const uint8_t* A, netfloat_t min, netfloat_t max, netfloat_t* R,
+  size_t n) {
+
+  const netfloat_t range = max - min;
+  for (size_t i = 0; i < n; ++i) {
+    R[i] = (static_cast<netfloat_t>(A[i]) - min) / range;
+  }
+}
+
+int32_t dotInt8(const int8_t* A, const int8_t* x, size_t n) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += static_cast<int32_t>(A[i]) * x[i];
+  }
+  return sum;
+}
+
+void dotRowsInt8(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t rows,
+  size_t n) {
+
+  for (size_t i = 0; i < rows; ++i) {
+    R[i] = dotInt8(A + i * lda, x, n);
+  }
+}
+
+// Packs rows of A four elements to a word, as multiplyInt8 packs B, so that word g of row i is
+// R[g * rows + i], with zeros beyond depth. The vector kernels broadcast these words.
+void packInt8Quads(const int8_t* A, size_t lda, size_t rows, size_t depth,
+  std::vector<int32_t>& R) {
+
+  const size_t groups = (depth + 3) / 4;
+  R.assign(groups * rows, 0);
+
+  // Whole words are copied at a fixed size, so they compile to plain loads
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t g = 0; g < depth / 4; ++g) {
+      memcpy(R.data() + g * rows + i, A + i * lda + 4 * g, 4);
+    }
+    if (depth % 4 != 0) {
+      memcpy(R.data() + (groups - 1) * rows + i, A + i * lda + depth - depth % 4, depth % 4);
+    }
+  }
+}
+
+void multiplyInt8(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t rows, size_t depth, size_t n) {
+
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      int32_t sum = 0;
+      for (size_t k = 0; k < depth; ++k) {
+        sum += static_cast<int32_t>(A[i * lda + k]) * B[(k / 4) * ldb + 4 * j + k % 4];
+      }
+      R[i * ldr + j] = sum;
+    }
+  }
+}
+
+void philox(const uint32_t* key, uint64_t stream, uint64_t counter, uint32_t* R,
+  size_t blocks) {
+
+  for (size_t i = 0; i < blocks; ++i) {
+    uint32_t c0 = static_cast<uint32_t>(counter + i);
+    uint32_t c1 = static_cast<uint32_t>((counter + i) >> 32);
+    uint32_t c2 = static_cast<uint32_t>(stream);
+    uint32_t c3 = static_cast<uint32_t>(stream >> 32);
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+
+    for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+      uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0;
+      uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2;
+
+      c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      c1 = static_cast<uint32_t>(p1);
+      c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c3 = static_cast<uint32_t>(p0);
+
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    R[4 * i] = c0;
+    R[4 * i + 1] = c1;
+    R[4 * i + 2] = c2;
+    R[4 * i + 3] = c3;
+  }
+}
+
+const Kernels kernels{
+  InstructionSet::scalar,
+  add,
+  subtract,
+  multiply,
+  addScalar,
+  multiplyScalar,
+  divideScalar,
+  axpy,
+  fill,
+  sum,
+  dot,
+  multiplyAccumulate,
+  dotRows,
+  sigmoid,
+  sigmoidPrime,
+  relu,
+  reluPrime,
+  convertTo<float16_t>,
+  convertFrom<float16_t>,
+  convertTo<bfloat16_t>,
+  convertFrom<bfloat16_t>,
+  dotRowsPacked<float16_t>,
+  dotRowsPacked<bfloat16_t>,
+  toInt8,
+  dotRowsInt8,
+  multiplyInt8,
+  normalizeUint8,
+  philox
+};
+
+}
+
+#ifdef RICHARD_SIMD_X86
+
+namespace avx2 {
+
+const size_t N = 8;
+
+RICHARD_TARGET("avx2,fma")
+void add(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, _mm256_add_ps(_mm256_loadu_ps(A + i), _mm256_loadu_ps(B + i)));
+  }
+  scalar::add(A + i, B + i, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void subtract(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, _mm256_sub_ps(_mm256_loadu_ps(A + i), _mm256_loadu_ps(B + i)));
+  }
+  scalar::subtract(A + i, B + i, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void multiply(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, _mm256_mul_ps(_mm256_loadu_ps(A + i), _mm256_loadu_ps(B + i)));
+  }
+  scalar::multiply(A + i, B + i, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void addScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  __m256 X = _mm256_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, _mm256_add_ps(_mm256_loadu_ps(A + i), X));
+  }
+  scalar::addScalar(A + i, x, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void multiplyScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  __m256 X = _mm256_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, _mm256_mul_ps(_mm256_loadu_ps(A + i), X));
+  }
+  scalar::multiplyScalar(A + i, x, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void divideScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  __m256 X = _mm256_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, _mm256_div_ps(_mm256_loadu_ps(A + i), X));
+  }
+  scalar::divideScalar(A + i, x, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void axpy(netfloat_t a, const netfloat_t* X, netfloat_t* Y, size_t n) {
+  __m256 A = _mm256_set1_ps(a);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(Y + i, _mm256_fmadd_ps(A, _mm256_loadu_ps(X + i), _mm256_loadu_ps(Y + i)));
+  }
+  scalar::axpy(a, X + i, Y + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void fill(netfloat_t* R, netfloat_t x, size_t n) {
+  __m256 X = _mm256_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, X);
+  }
+  scalar::fill(R + i, x, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+netfloat_t horizontalSum(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+RICHARD_TARGET("avx2,fma")
+netfloat_t sum(const netfloat_t* A, size_t n) {
+  __m256 s0 = _mm256_setzero_ps();
+  __m256 s1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    s0 = _mm256_add_ps(s0, _mm256_loadu_ps(A + i));
+    s1 = _mm256_add_ps(s1, _mm256_loadu_ps(A + i + N));
+  }
+  for (; i + N <= n; i += N) {
+    s0 = _mm256_add_ps(s0, _mm256_loadu_ps(A + i));
+  }
+  return horizontalSum(_mm256_add_ps(s0, s1)) + scalar::sum(A + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+netfloat_t dot(const netfloat_t* A, const netfloat_t* B, size_t n) {
+  __m256 s0 = _mm256_setzero_ps();
+  __m256 s1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(A + i), _mm256_loadu_ps(B + i), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(A + i + N), _mm256_loadu_ps(B + i + N), s1);
+  }
+  for (; i + N <= n; i += N) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(A + i), _mm256_loadu_ps(B + i), s0);
+  }
+  return horizontalSum(_mm256_add_ps(s0, s1)) + scalar::dot(A + i, B + i, n - i);
+}
+
+template<size_t ROWS>
+RICHARD_TARGET("avx2,fma")
+void multiplyAccumulateTile(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t depth, size_t n) {
+
+  size_t j = 0;
+  for (; j + 2 * N <= n; j += 2 * N) {
+    __m256 c0[ROWS];
+    __m256 c1[ROWS];
+    for (size_t i = 0; i < ROWS; ++i) {
+      c0[i] = _mm256_loadu_ps(C + i * ldc + j);
+      c1[i] = _mm256_loadu_ps(C + i * ldc + j + N);
+    }
+    for (size_t k = 0; k < depth; ++k) {
+      __m256 b0 = _mm256_loadu_ps(B + k * ldb + j);
+      __m256 b1 = _mm256_loadu_ps(B + k * ldb + j + N);
+      for (size_t i = 0; i < ROWS; ++i) {
+        __m256 a = _mm256_set1_ps(A[i * rsA + k * csA]);
+        c0[i] = _mm256_fmadd_ps(a, b0, c0[i]);
+        c1[i] = _mm256_fmadd_ps(a, b1, c1[i]);
+      }
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      _mm256_storeu_ps(C + i * ldc + j, c0[i]);
+      _mm256_storeu_ps(C + i * ldc + j + N, c1[i]);
+    }
+  }
+  for (; j + N <= n; j += N) {
+    __m256 c[ROWS];
+    for (size_t i = 0; i < ROWS; ++i) {
+      c[i] = _mm256_loadu_ps(C + i * ldc + j);
+    }
+    for (size_t k = 0; k < depth; ++k) {
+      __m256 b = _mm256_loadu_ps(B + k * ldb + j);
+      for (size_t i = 0; i < ROWS; ++i) {
+        c[i] = _mm256_fmadd_ps(_mm256_set1_ps(A[i * rsA + k * csA]), b, c[i]);
+      }
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      _mm256_storeu_ps(C + i * ldc + j, c[i]);
+    }
+  }
+  if (j < n) {
+    scalar::multiplyAccumulate(A, rsA, csA, B + j, ldb, C + j, ldc, ROWS, depth, n - j);
+  }
+}
+
+RICHARD_TARGET("avx2,fma")
+void multiplyAccumulate(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t rows, size_t depth, size_t n) {
+
+  switch (rows) {
+    case 1: multiplyAccumulateTile<1>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 2: multiplyAccumulateTile<2>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 3: multiplyAccumulateTile<3>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 4: multiplyAccumulateTile<4>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    default: scalar::multiplyAccumulate(A, rsA, csA, B, ldb, C, ldc, rows, depth, n); break;
+  }
+}
+
+template<size_t ROWS>
+RICHARD_TARGET("avx2,fma")
+void dotRowsTile(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t n) {
+  __m256 s[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    s[i] = _mm256_setzero_ps();
+  }
+  size_t j = 0;
+  for (; j + N <= n; j += N) {
+    __m256 X = _mm256_loadu_ps(x + j);
+    for (size_t i = 0; i < ROWS; ++i) {
+      s[i] = _mm256_fmadd_ps(_mm256_loadu_ps(A + i * lda + j), X, s[i]);
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    R[i] = horizontalSum(s[i]) + scalar::dot(A + i * lda + j, x + j, n - j);
+  }
+}
+
+RICHARD_TARGET("avx2,fma")
+void dotRows(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  switch (rows) {
+    case 1: dotRowsTile<1>(A, lda, x, R, n); break;
+    case 2: dotRowsTile<2>(A, lda, x, R, n); break;
+    case 3: dotRowsTile<3>(A, lda, x, R, n); break;
+    case 4: dotRowsTile<4>(A, lda, x, R, n); break;
+    default: scalar::dotRows(A, lda, x, R, rows, n); break;
+  }
+}
+
+// Cephes-style exp: the argument is reduced to r = x - n ln(2), e^r comes from a degree 5
+// polynomial, and 2^n is assembled directly in the exponent bits. Relative error is within a
+// few ulp over the clamped range.
+RICHARD_TARGET("avx2,fma")
+__m256 exp(__m256 x) {
+  x = _mm256_min_ps(x, _mm256_set1_ps(EXP_HI));
+  x = _mm256_max_ps(x, _mm256_set1_ps(EXP_LO));
+
+  __m256 fx = _mm256_fmadd_ps(x, _mm256_set1_ps(LOG2E), _mm256_set1_ps(0.5f));
+  fx = _mm256_floor_ps(fx);
+
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(LN2_HI), x);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(LN2_LO), x);
+
+  __m256 y = _mm256_set1_ps(EXP_P[0]);
+  for (size_t k = 1; k < 6; ++k) {
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P[k]));
+  }
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.f)));
+
+  __m256i e = _mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127));
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+}
+
+RICHARD_TARGET("avx2,fma")
+__m256 sigmoid(__m256 x) {
+  __m256 one = _mm256_set1_ps(1.f);
+  __m256 negX = _mm256_sub_ps(_mm256_setzero_ps(), x);
+  return _mm256_div_ps(one, _mm256_add_ps(one, exp(negX)));
+}
+
+RICHARD_TARGET("avx2,fma")
+void sigmoid(const netfloat_t* A, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, sigmoid(_mm256_loadu_ps(A + i)));
+  }
+  scalar::sigmoid(A + i, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void sigmoidPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  __m256 one = _mm256_set1_ps(1.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    __m256 s = sigmoid(_mm256_loadu_ps(A + i));
+    _mm256_storeu_ps(R + i, _mm256_mul_ps(s, _mm256_sub_ps(one, s)));
+  }
+  scalar::sigmoidPrime(A + i, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void relu(const netfloat_t* A, netfloat_t* R, size_t n) {
+  __m256 zero = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, _mm256_max_ps(_mm256_loadu_ps(A + i), zero));
+  }
+  scalar::relu(A + i, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void reluPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  __m256 zero = _mm256_setzero_ps();
+  __m256 one = _mm256_set1_ps(1.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    __m256 negative = _mm256_cmp_ps(_mm256_loadu_ps(A + i), zero, _CMP_LT_OQ);
+    _mm256_storeu_ps(R + i, _mm256_blendv_ps(one, zero, negative));
+  }
+  scalar::reluPrime(A + i, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma,f16c")
+__m256 load8(const float16_t* A) {
+  return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(A)));
+}
+
+RICHARD_TARGET("avx2,fma,f16c")
+__m256 load8(const bfloat16_t* A) {
+  __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(A)));
+  return _mm256_castsi256_ps(_mm256_slli_epi32(x, 16));
+}
+
+RICHARD_TARGET("avx2,fma,f16c")
+void store8(float16_t* R, __m256 x) {
+  __m128i h = _mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(R), h);
+}
+
+RICHARD_TARGET("avx2,fma,f16c")
+void store8(bfloat16_t* R, __m256 x) {
+  __m256i u = _mm256_castps_si256(x);
+  __m256i odd = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+  __m256i rounded = _mm256_add_epi32(u, _mm256_add_epi32(odd, _mm256_set1_epi32(0x7fff)));
+  __m256i quietNan = _mm256_or_si256(u, _mm256_set1_epi32(0x00400000));
+  __m256 isNan = _mm256_cmp_ps(x, x, _CMP_UNORD_Q);
+  __m256i b = _mm256_srli_epi32(_mm256_blendv_epi8(rounded, quietNan,
+    _mm256_castps_si256(isNan)), 16);
+
+  // Pack within each 128-bit lane, then gather the two low halves
+  __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(b, b), 0x08);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(R), _mm256_castsi256_si128(packed));
+}
+
+template<typename S>
+RICHARD_TARGET("avx2,fma,f16c")
+void convertTo(const netfloat_t* A, S* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    store8(R + i, _mm256_loadu_ps(A + i));
+  }
+  scalar::convertTo(A + i, R + i, n - i);
+}
+
+template<typename S>
+RICHARD_TARGET("avx2,fma,f16c")
+void convertFrom(const S* A, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm256_storeu_ps(R + i, load8(A + i));
+  }
+  scalar::convertFrom(A + i, R + i, n - i);
+}
+
+template<size_t ROWS, typename S>
+RICHARD_TARGET("avx2,fma,f16c")
+void dotRowsPackedTile(const S* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t n) {
+  __m256 s[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    s[i] = _mm256_setzero_ps();
+  }
+  size_t j = 0;
+  for (; j + N <= n; j += N) {
+    __m256 X = _mm256_loadu_ps(x + j);
+    for (size_t i = 0; i < ROWS; ++i) {
+      s[i] = _mm256_fmadd_ps(load8(A + i * lda + j), X, s[i]);
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    R[i] = horizontalSum(s[i]) + scalar::dotPacked(A + i * lda + j, x + j, n - j);
+  }
+}
+
+template<typename S>
+RICHARD_TARGET("avx2,fma,f16c")
+void dotRowsPacked(const S* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  switch (rows) {
+    case 1: dotRowsPackedTile<1>(A, lda, x, R, n); break;
+    case 2: dotRowsPackedTile<2>(A, lda, x, R, n); break;
+    case 3: dotRowsPackedTile<3>(A, lda, x, R, n); break;
+    case 4: dotRowsPackedTile<4>(A, lda, x, R, n); break;
+    default: scalar::dotRowsPacked(A, lda, x, R, rows, n); break;
+  }
+}
+
+RICHARD_TARGET("avx2,fma")
+void toInt8(const netfloat_t* A, int8_t* R, netfloat_t scale, size_t n) {
+  const __m256 s = _mm256_set1_ps(scale);
+  const __m256 lo = _mm256_set1_ps(-127.f);
+  const __m256 hi = _mm256_set1_ps(127.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(A + i), s), lo), hi);
+    __m256i q = _mm256_cvtps_epi32(x);
+    __m128i q16 = _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(R + i), _mm_packs_epi16(q16, q16));
+  }
+  scalar::toInt8(A + i, R + i, scale, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+void normalizeUint8(const uint8_t* A, netfloat_t min, netfloat_t max, netfloat_t* R,
+  size_t n) {
+
+  const __m256 lo = _mm256_set1_ps(min);
+  const __m256 range = _mm256_set1_ps(max - min);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    __m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(A + i));
+    __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(a));
+    _mm256_storeu_ps(R + i, _mm256_div_ps(_mm256_sub_ps(x, lo), range));
+  }
+  scalar::normalizeUint8(A + i, min, max, R + i, n - i);
+}
+
+RICHARD_TARGET("avx2,fma")
+int32_t horizontalSum(__m256i x) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+}
+
+// maddubs multiplies unsigned by signed bytes, so x's sign is moved onto A. With both operands
+// in [-127, 127], the pairwise sums of products can't saturate 16 bits.
+template<size_t ROWS>
+RICHARD_TARGET("avx2,fma")
+void dotRowsInt8Tile(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t n) {
+  const size_t B = 32;
+  const __m256i ones = _mm256_set1_epi16(1);
+
+  __m256i s[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    s[i] = _mm256_setzero_si256();
+  }
+  size_t j = 0;
+  for (; j + B <= n; j += B) {
+    __m256i X = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + j));
+    __m256i absX = _mm256_abs_epi8(X);
+    for (size_t i = 0; i < ROWS; ++i) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(A + i * lda + j));
+      __m256i pairs = _mm256_maddubs_epi16(absX, _mm256_sign_epi8(a, X));
+      s[i] = _mm256_add_epi32(s[i], _mm256_madd_epi16(pairs, ones));
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    R[i] = horizontalSum(s[i]) + scalar::dotInt8(A + i * lda + j, x + j, n - j);
+  }
+}
+
+RICHARD_TARGET("avx2,fma")
+void dotRowsInt8(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t rows,
+  size_t n) {
+
+  switch (rows) {
+    case 1: dotRowsInt8Tile<1>(A, lda, x, R, n); break;
+    case 2: dotRowsInt8Tile<2>(A, lda, x, R, n); break;
+    case 3: dotRowsInt8Tile<3>(A, lda, x, R, n); break;
+    case 4: dotRowsInt8Tile<4>(A, lda, x, R, n); break;
+    default: scalar::dotRowsInt8(A, lda, x, R, rows, n); break;
+  }
+}
+
+// Each 32-bit lane of a vector of B holds four consecutive elements of one column, so maddubs
+// followed by madd sums them into that column's lane, with no horizontal sums. The four
+// matching elements of a row of A are broadcast to every lane.
+template<size_t ROWS>
+RICHARD_TARGET("avx2,fma")
+void multiplyInt8Tile(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t depth, size_t n) {
+
+  const size_t N = 8;
+  const size_t groups = (depth + 3) / 4;
+  const __m256i ones = _mm256_set1_epi16(1);
+
+  thread_local std::vector<int32_t> quads;
+  scalar::packInt8Quads(A, lda, ROWS, depth, quads);
+
+  size_t j = 0;
+  for (; j + N <= n; j += N) {
+    __m256i s[ROWS];
+    for (size_t i = 0; i < ROWS; ++i) {
+      s[i] = _mm256_setzero_si256();
+    }
+    for (size_t g = 0; g < groups; ++g) {
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(B + g * ldb + 4 * j));
+      __m256i absB = _mm256_abs_epi8(b);
+      for (size_t i = 0; i < ROWS; ++i) {
+        __m256i a = _mm256_set1_epi32(quads[g * ROWS + i]);
+        __m256i pairs = _mm256_maddubs_epi16(absB, _mm256_sign_epi8(a, b));
+        s[i] = _mm256_add_epi32(s[i], _mm256_madd_epi16(pairs, ones));
+      }
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(R + i * ldr + j), s[i]);
+    }
+  }
+  scalar::multiplyInt8(A, lda, B + 4 * j, ldb, R + j, ldr, ROWS, depth, n - j);
+}
+
+RICHARD_TARGET("avx2,fma")
+void multiplyInt8(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t rows, size_t depth, size_t n) {
+
+  switch (rows) {
+    case 1: multiplyInt8Tile<1>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 2: multiplyInt8Tile<2>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 3: multiplyInt8Tile<3>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 4: multiplyInt8Tile<4>(A, lda, B, ldb, R, ldr, depth, n); break;
+    default: scalar::multiplyInt8(A, lda, B, ldb, R, ldr, rows, depth, n); break;
+  }
+}
+
+// The 32-bit halves of the products of each lane of c with m
+RICHARD_TARGET("avx2,fma")
+void mulhilo(__m256i c, __m256i m, __m256i& hi, __m256i& lo) {
+  __m256i even = _mm256_mul_epu32(c, m);
+  __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(c, 32), m);
+
+  hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+  lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+
+// Eight blocks at a time, one per lane
+RICHARD_TARGET("avx2,fma")
+void philox(const uint32_t* key, uint64_t stream, uint64_t counter, uint32_t* R,
+  size_t blocks) {
+
+  const __m256i m0 = _mm256_set1_epi32(static_cast<int>(PHILOX_M0));
+  const __m256i m1 = _mm256_set1_epi32(static_cast<int>(PHILOX_M1));
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  size_t i = 0;
+  for (; i + N <= blocks; i += N) {
+    uint64_t first = counter + i;
+
+    // Lanes whose low word wraps carry into the high word
+    __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)), lane);
+    __m256i carry = _mm256_cmpgt_epi32(_mm256_xor_si256(lane, _mm256_set1_epi32(INT32_MIN)),
+      _mm256_xor_si256(c0, _mm256_set1_epi32(INT32_MIN)));
+    __m256i c1 = _mm256_sub_epi32(_mm256_set1_epi32(static_cast<int>(first >> 32)), carry);
+    __m256i c2 = _mm256_set1_epi32(static_cast<int>(stream));
+    __m256i c3 = _mm256_set1_epi32(static_cast<int>(stream >> 32));
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+
+    for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+      __m256i hi0, lo0, hi1, lo1;
+      mulhilo(c0, m0, hi0, lo0);
+      mulhilo(c2, m1, hi1, lo1);
+
+      c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(static_cast<int>(k0)));
+      c1 = lo1;
+      c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(static_cast<int>(k1)));
+      c3 = lo0;
+
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    // Transpose so that each block's four words are contiguous
+    __m256i t0 = _mm256_unpacklo_epi32(c0, c1);
+    __m256i t1 = _mm256_unpackhi_epi32(c0, c1);
+    __m256i t2 = _mm256_unpacklo_epi32(c2, c3);
+    __m256i t3 = _mm256_unpackhi_epi32(c2, c3);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+
+    __m256i* out = reinterpret_cast<__m256i*>(R + 4 * i);
+    _mm256_storeu_si256(out, _mm256_permute2x128_si256(u0, u1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(u2, u3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(u0, u1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(u2, u3, 0x31));
+  }
+  scalar::philox(key, stream, counter + i, R + 4 * i, blocks - i);
+}
+
+const Kernels kernels{
+  InstructionSet::avx2,
+  add,
+  subtract,
+  multiply,
+  addScalar,
+  multiplyScalar,
+  divideScalar,
+  axpy,
+  fill,
+  sum,
+  dot,
+  multiplyAccumulate,
+  dotRows,
+  sigmoid,
+  sigmoidPrime,
+  relu,
+  reluPrime,
+  convertTo<float16_t>,
+  convertFrom<float16_t>,
+  convertTo<bfloat16_t>,
+  convertFrom<bfloat16_t>,
+  dotRowsPacked<float16_t>,
+  dotRowsPacked<bfloat16_t>,
+  toInt8,
+  dotRowsInt8,
+  multiplyInt8,
+  normalizeUint8,
+  philox
+};
+
+}
+
+// Whether the AVX-512 int8 dot product instructions are available, in addition to AVX-512F
+bool cpuSupportsVnni();
+
+// AVX-512 handles the tail of each array with a masked load/store rather than falling back to
+// scalar code.
+namespace avx512 {
+
+const size_t N = 16;
+
+RICHARD_TARGET("avx512f")
+__mmask16 tailMask(size_t remaining) {
+  return static_cast<__mmask16>((1u << remaining) - 1u);
+}
+
+RICHARD_TARGET("avx512f")
+netfloat_t horizontalSum(__m512 v) {
+  alignas(64) netfloat_t lanes[N];
+  _mm512_store_ps(lanes, v);
+  return scalar::sum(lanes, N);
+}
+
+RICHARD_TARGET("avx512f")
+void add(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, _mm512_add_ps(_mm512_loadu_ps(A + i), _mm512_loadu_ps(B + i)));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(R + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, A + i),
+      _mm512_maskz_loadu_ps(m, B + i)));
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void subtract(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, _mm512_sub_ps(_mm512_loadu_ps(A + i), _mm512_loadu_ps(B + i)));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(R + i, m, _mm512_sub_ps(_mm512_maskz_loadu_ps(m, A + i),
+      _mm512_maskz_loadu_ps(m, B + i)));
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void multiply(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, _mm512_mul_ps(_mm512_loadu_ps(A + i), _mm512_loadu_ps(B + i)));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(R + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, A + i),
+      _mm512_maskz_loadu_ps(m, B + i)));
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void addScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  __m512 X = _mm512_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, _mm512_add_ps(_mm512_loadu_ps(A + i), X));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(R + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, A + i), X));
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void multiplyScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  __m512 X = _mm512_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, _mm512_mul_ps(_mm512_loadu_ps(A + i), X));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(R + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, A + i), X));
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void divideScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  __m512 X = _mm512_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, _mm512_div_ps(_mm512_loadu_ps(A + i), X));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(R + i, m, _mm512_div_ps(_mm512_maskz_loadu_ps(m, A + i), X));
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void axpy(netfloat_t a, const netfloat_t* X, netfloat_t* Y, size_t n) {
+  __m512 A = _mm512_set1_ps(a);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(Y + i, _mm512_fmadd_ps(A, _mm512_loadu_ps(X + i), _mm512_loadu_ps(Y + i)));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(Y + i, m, _mm512_fmadd_ps(A, _mm512_maskz_loadu_ps(m, X + i),
+      _mm512_maskz_loadu_ps(m, Y + i)));
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void fill(netfloat_t* R, netfloat_t x, size_t n) {
+  __m512 X = _mm512_set1_ps(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, X);
+  }
+  if (i < n) {
+    _mm512_mask_storeu_ps(R + i, tailMask(n - i), X);
+  }
+}
+
+RICHARD_TARGET("avx512f")
+netfloat_t sum(const netfloat_t* A, size_t n) {
+  __m512 s0 = _mm512_setzero_ps();
+  __m512 s1 = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    s0 = _mm512_add_ps(s0, _mm512_loadu_ps(A + i));
+    s1 = _mm512_add_ps(s1, _mm512_loadu_ps(A + i + N));
+  }
+  for (; i + N <= n; i += N) {
+    s0 = _mm512_add_ps(s0, _mm512_loadu_ps(A + i));
+  }
+  if (i < n) {
+    s1 = _mm512_add_ps(s1, _mm512_maskz_loadu_ps(tailMask(n - i), A + i));
+  }
+  return horizontalSum(_mm512_add_ps(s0, s1));
+}
+
+RICHARD_TARGET("avx512f")
+netfloat_t dot(const netfloat_t* A, const netfloat_t* B, size_t n) {
+  __m512 s0 = _mm512_setzero_ps();
+  __m512 s1 = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(A + i), _mm512_loadu_ps(B + i), s0);
+    s1 = _mm512_fmadd_ps(_mm512_loadu_ps(A + i + N), _mm512_loadu_ps(B + i + N), s1);
+  }
+  for (; i + N <= n; i += N) {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(A + i), _mm512_loadu_ps(B + i), s0);
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, A + i), _mm512_maskz_loadu_ps(m, B + i), s1);
+  }
+  return horizontalSum(_mm512_add_ps(s0, s1));
+}
+
+template<size_t ROWS>
+RICHARD_TARGET("avx512f")
+void multiplyAccumulateTile(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t depth, size_t n) {
+
+  size_t j = 0;
+  for (; j + 2 * N <= n; j += 2 * N) {
+    __m512 c0[ROWS];
+    __m512 c1[ROWS];
+    for (size_t i = 0; i < ROWS; ++i) {
+      c0[i] = _mm512_loadu_ps(C + i * ldc + j);
+      c1[i] = _mm512_loadu_ps(C + i * ldc + j + N);
+    }
+    for (size_t k = 0; k < depth; ++k) {
+      __m512 b0 = _mm512_loadu_ps(B + k * ldb + j);
+      __m512 b1 = _mm512_loadu_ps(B + k * ldb + j + N);
+      for (size_t i = 0; i < ROWS; ++i) {
+        __m512 a = _mm512_set1_ps(A[i * rsA + k * csA]);
+        c0[i] = _mm512_fmadd_ps(a, b0, c0[i]);
+        c1[i] = _mm512_fmadd_ps(a, b1, c1[i]);
+      }
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      _mm512_storeu_ps(C + i * ldc + j, c0[i]);
+      _mm512_storeu_ps(C + i * ldc + j + N, c1[i]);
+    }
+  }
+  for (; j < n; j += N) {
+    __mmask16 m = tailMask(std::min(N, n - j));
+    __m512 c[ROWS];
+    for (size_t i = 0; i < ROWS; ++i) {
+      c[i] = _mm512_maskz_loadu_ps(m, C + i * ldc + j);
+    }
+    for (size_t k = 0; k < depth; ++k) {
+      __m512 b = _mm512_maskz_loadu_ps(m, B + k * ldb + j);
+      for (size_t i = 0; i < ROWS; ++i) {
+        c[i] = _mm512_fmadd_ps(_mm512_set1_ps(A[i * rsA + k * csA]), b, c[i]);
+      }
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      _mm512_mask_storeu_ps(C + i * ldc + j, m, c[i]);
+    }
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void multiplyAccumulate(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t rows, size_t depth, size_t n) {
+
+  switch (rows) {
+    case 1: multiplyAccumulateTile<1>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 2: multiplyAccumulateTile<2>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 3: multiplyAccumulateTile<3>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 4: multiplyAccumulateTile<4>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    default: scalar::multiplyAccumulate(A, rsA, csA, B, ldb, C, ldc, rows, depth, n); break;
+  }
+}
+
+template<size_t ROWS>
+RICHARD_TARGET("avx512f")
+void dotRowsTile(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t n) {
+  __m512 s[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    s[i] = _mm512_setzero_ps();
+  }
+  size_t j = 0;
+  for (; j + N <= n; j += N) {
+    __m512 X = _mm512_loadu_ps(x + j);
+    for (size_t i = 0; i < ROWS; ++i) {
+      s[i] = _mm512_fmadd_ps(_mm512_loadu_ps(A + i * lda + j), X, s[i]);
+    }
+  }
+  if (j < n) {
+    __mmask16 m = tailMask(n - j);
+    __m512 X = _mm512_maskz_loadu_ps(m, x + j);
+    for (size_t i = 0; i < ROWS; ++i) {
+      s[i] = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, A + i * lda + j), X, s[i]);
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    R[i] = horizontalSum(s[i]);
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void dotRows(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  switch (rows) {
+    case 1: dotRowsTile<1>(A, lda, x, R, n); break;
+    case 2: dotRowsTile<2>(A, lda, x, R, n); break;
+    case 3: dotRowsTile<3>(A, lda, x, R, n); break;
+    case 4: dotRowsTile<4>(A, lda, x, R, n); break;
+    default: scalar::dotRows(A, lda, x, R, rows, n); break;
+  }
+}
+
+RICHARD_TARGET("avx512f")
+__m512 exp(__m512 x) {
+  x = _mm512_min_ps(x, _mm512_set1_ps(EXP_HI));
+  x = _mm512_max_ps(x, _mm512_set1_ps(EXP_LO));
+
+  __m512 fx = _mm512_fmadd_ps(x, _mm512_set1_ps(LOG2E), _mm512_set1_ps(0.5f));
+  fx = _mm512_roundscale_ps(fx, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+
+  x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(LN2_HI), x);
+  x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(LN2_LO), x);
+
+  __m512 y = _mm512_set1_ps(EXP_P[0]);
+  for (size_t k = 1; k < 6; ++k) {
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P[k]));
+  }
+  y = _mm512_fmadd_ps(y, _mm512_mul_ps(x, x), _mm512_add_ps(x, _mm512_set1_ps(1.f)));
+
+  __m512i e = _mm512_add_epi32(_mm512_cvttps_epi32(fx), _mm512_set1_epi32(127));
+  return _mm512_mul_ps(y, _mm512_castsi512_ps(_mm512_slli_epi32(e, 23)));
+}
+
+RICHARD_TARGET("avx512f")
+__m512 sigmoid(__m512 x) {
+  __m512 one = _mm512_set1_ps(1.f);
+  __m512 negX = _mm512_sub_ps(_mm512_setzero_ps(), x);
+  return _mm512_div_ps(one, _mm512_add_ps(one, exp(negX)));
+}
+
+RICHARD_TARGET("avx512f")
+__m512 sigmoidPrime(__m512 x) {
+  __m512 s = sigmoid(x);
+  return _mm512_mul_ps(s, _mm512_sub_ps(_mm512_set1_ps(1.f), s));
+}
+
+RICHARD_TARGET("avx512f")
+__m512 relu(__m512 x) {
+  return _mm512_max_ps(x, _mm512_setzero_ps());
+}
+
+RICHARD_TARGET("avx512f")
+__m512 reluPrime(__m512 x) {
+  __mmask16 negative = _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LT_OQ);
+  return _mm512_mask_blend_ps(negative, _mm512_set1_ps(1.f), _mm512_setzero_ps());
+}
+
+template<__m512 (*F)(__m512)>
+RICHARD_TARGET("avx512f")
+void mapArray(const netfloat_t* A, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, F(_mm512_loadu_ps(A + i)));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(R + i, m, F(_mm512_maskz_loadu_ps(m, A + i)));
+  }
+}
+
+void sigmoid(const netfloat_t* A, netfloat_t* R, size_t n) {
+  mapArray<sigmoid>(A, R, n);
+}
+
+void sigmoidPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  mapArray<sigmoidPrime>(A, R, n);
+}
+
+void relu(const netfloat_t* A, netfloat_t* R, size_t n) {
+  mapArray<relu>(A, R, n);
+}
+
+void reluPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  mapArray<reluPrime>(A, R, n);
+}
+
+RICHARD_TARGET("avx512f")
+__m512 load16(const float16_t* A) {
+  return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(A)));
+}
+
+RICHARD_TARGET("avx512f")
+__m512 load16(const bfloat16_t* A) {
+  __m512i x = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(A)));
+  return _mm512_castsi512_ps(_mm512_slli_epi32(x, 16));
+}
+
+RICHARD_TARGET("avx512f")
+void store16(float16_t* R, __m512 x) {
+  __m256i h = _mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(R), h);
+}
+
+RICHARD_TARGET("avx512f")
+void store16(bfloat16_t* R, __m512 x) {
+  __m512i u = _mm512_castps_si512(x);
+  __m512i odd = _mm512_and_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(1));
+  __m512i rounded = _mm512_add_epi32(u, _mm512_add_epi32(odd, _mm512_set1_epi32(0x7fff)));
+  __m512i quietNan = _mm512_or_si512(u, _mm512_set1_epi32(0x00400000));
+  __mmask16 isNan = _mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q);
+  __m512i b = _mm512_srli_epi32(_mm512_mask_blend_epi32(isNan, rounded, quietNan), 16);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(R), _mm512_cvtepi32_epi16(b));
+}
+
+// 16-bit masked loads and stores need AVX-512BW, so these kernels finish with scalar code
+// instead
+template<typename S>
+RICHARD_TARGET("avx512f")
+void convertTo(const netfloat_t* A, S* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    store16(R + i, _mm512_loadu_ps(A + i));
+  }
+  scalar::convertTo(A + i, R + i, n - i);
+}
+
+template<typename S>
+RICHARD_TARGET("avx512f")
+void convertFrom(const S* A, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    _mm512_storeu_ps(R + i, load16(A + i));
+  }
+  scalar::convertFrom(A + i, R + i, n - i);
+}
+
+template<size_t ROWS, typename S>
+RICHARD_TARGET("avx512f")
+void dotRowsPackedTile(const S* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t n) {
+  __m512 s[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    s[i] = _mm512_setzero_ps();
+  }
+  size_t j = 0;
+  for (; j + N <= n; j += N) {
+    __m512 X = _mm512_loadu_ps(x + j);
+    for (size_t i = 0; i < ROWS; ++i) {
+      s[i] = _mm512_fmadd_ps(load16(A + i * lda + j), X, s[i]);
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    R[i] = horizontalSum(s[i]) + scalar::dotPacked(A + i * lda + j, x + j, n - j);
+  }
+}
+
+template<typename S>
+RICHARD_TARGET("avx512f")
+void dotRowsPacked(const S* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  switch (rows) {
+    case 1: dotRowsPackedTile<1>(A, lda, x, R, n); break;
+    case 2: dotRowsPackedTile<2>(A, lda, x, R, n); break;
+    case 3: dotRowsPackedTile<3>(A, lda, x, R, n); break;
+    case 4: dotRowsPackedTile<4>(A, lda, x, R, n); break;
+    default: scalar::dotRowsPacked(A, lda, x, R, rows, n); break;
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void toInt8(const netfloat_t* A, int8_t* R, netfloat_t scale, size_t n) {
+  const __m512 s = _mm512_set1_ps(scale);
+  const __m512 lo = _mm512_set1_ps(-127.f);
+  const __m512 hi = _mm512_set1_ps(127.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    __m512 x = _mm512_mul_ps(_mm512_loadu_ps(A + i), s);
+    __m512i q = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(x, lo), hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(R + i), _mm512_cvtsepi32_epi8(q));
+  }
+  if (i < n) {
+    __mmask16 m = tailMask(n - i);
+    __m512 x = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, A + i), s);
+    __m512i q = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(x, lo), hi));
+    _mm512_mask_cvtsepi32_storeu_epi8(R + i, m, q);
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void normalizeUint8(const uint8_t* A, netfloat_t min, netfloat_t max, netfloat_t* R,
+  size_t n) {
+
+  const __m512 lo = _mm512_set1_ps(min);
+  const __m512 range = _mm512_set1_ps(max - min);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(A + i));
+    __m512 x = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(a));
+    _mm512_storeu_ps(R + i, _mm512_div_ps(_mm512_sub_ps(x, lo), range));
+  }
+  if (i < n) {
+    // Masked byte loads need AVX-512BW, so the tail is staged through a buffer
+    alignas(16) uint8_t tail[N] = {};
+    std::copy(A + i, A + n, tail);
+    __m512 x = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_load_si128(
+      reinterpret_cast<const __m128i*>(tail))));
+    _mm512_mask_storeu_ps(R + i, tailMask(n - i), _mm512_div_ps(_mm512_sub_ps(x, lo), range));
+  }
+}
+
+// VNNI multiplies unsigned by signed bytes, so x's sign is moved onto A
+template<size_t ROWS>
+RICHARD_TARGET("avx512f,avx512bw,avx512vnni")
+void dotRowsInt8TileVnni(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t n) {
+  const size_t B = 64;
+  const __m512i zero = _mm512_setzero_si512();
+
+  __m512i s[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    s[i] = _mm512_setzero_si512();
+  }
+  for (size_t j = 0; j < n; j += B) {
+    __mmask64 mask = n - j >= B ? ~__mmask64(0) : (__mmask64(1) << (n - j)) - 1;
+    __m512i X = _mm512_maskz_loadu_epi8(mask, x + j);
+    __m512i absX = _mm512_abs_epi8(X);
+    __mmask64 negX = _mm512_movepi8_mask(X);
+    for (size_t i = 0; i < ROWS; ++i) {
+      __m512i a = _mm512_maskz_loadu_epi8(mask, A + i * lda + j);
+      s[i] = _mm512_dpbusd_epi32(s[i], absX, _mm512_mask_sub_epi8(a, negX, zero, a));
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    R[i] = _mm512_reduce_add_epi32(s[i]);
+  }
+}
+
+RICHARD_TARGET("avx512f,avx512bw,avx512vnni")
+void dotRowsInt8Vnni(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t rows,
+  size_t n) {
+
+  switch (rows) {
+    case 1: dotRowsInt8TileVnni<1>(A, lda, x, R, n); break;
+    case 2: dotRowsInt8TileVnni<2>(A, lda, x, R, n); break;
+    case 3: dotRowsInt8TileVnni<3>(A, lda, x, R, n); break;
+    case 4: dotRowsInt8TileVnni<4>(A, lda, x, R, n); break;
+    default: scalar::dotRowsInt8(A, lda, x, R, rows, n); break;
+  }
+}
+
+// Integer dot products aren't part of AVX-512F, so fall back to the AVX2 kernel without VNNI
+void dotRowsInt8(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t rows,
+  size_t n) {
+
+  static const bool vnni = cpuSupportsVnni();
+
+  if (vnni) {
+    dotRowsInt8Vnni(A, lda, x, R, rows, n);
+  }
+  else {
+    avx2::dotRowsInt8(A, lda, x, R, rows, n);
+  }
+}
+
+// VNNI sums each lane's four products directly, but takes one operand unsigned. Rather than
+// moving signs as dotRowsInt8 does, B is offset by 128 and 128 times the sum of each row of A is
+// taken off again, which costs one xor per vector of B, shared by every row.
+template<size_t ROWS, size_t VECTORS>
+RICHARD_TARGET("avx512f,avx512bw,avx512vnni")
+void multiplyInt8BlockVnni(const int32_t* quads, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t depth, const int32_t* offsets) {
+
+  const size_t N = 16;
+  const size_t groups = (depth + 3) / 4;
+  const __m512i flip = _mm512_set1_epi8(-128);
+
+  __m512i s[ROWS][VECTORS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    for (size_t v = 0; v < VECTORS; ++v) {
+      s[i][v] = _mm512_set1_epi32(-offsets[i]);
+    }
+  }
+  for (size_t g = 0; g < groups; ++g) {
+    __m512i b[VECTORS];
+    for (size_t v = 0; v < VECTORS; ++v) {
+      b[v] = _mm512_xor_si512(_mm512_loadu_si512(B + g * ldb + 4 * v * N), flip);
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      __m512i a = _mm512_set1_epi32(quads[g * ROWS + i]);
+      for (size_t v = 0; v < VECTORS; ++v) {
+        s[i][v] = _mm512_dpbusd_epi32(s[i][v], b[v], a);
+      }
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    for (size_t v = 0; v < VECTORS; ++v) {
+      _mm512_storeu_si512(R + i * ldr + v * N, s[i][v]);
+    }
+  }
+}
+
+template<size_t ROWS>
+RICHARD_TARGET("avx512f,avx512bw,avx512vnni")
+void multiplyInt8TileVnni(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t depth, size_t n) {
+
+  const size_t N = 16;
+
+  int32_t offsets[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    int32_t sum = 0;
+    for (size_t k = 0; k < depth; ++k) {
+      sum += A[i * lda + k];
+    }
+    offsets[i] = 128 * sum;
+  }
+
+  thread_local std::vector<int32_t> quads;
+  scalar::packInt8Quads(A, lda, ROWS, depth, quads);
+
+  // Two vectors of B at a time keep enough sums in flight to hide the latency of vpdpbusd
+  size_t j = 0;
+  for (; j + 2 * N <= n; j += 2 * N) {
+    multiplyInt8BlockVnni<ROWS, 2>(quads.data(), B + 4 * j, ldb, R + j, ldr, depth, offsets);
+  }
+  for (; j + N <= n; j += N) {
+    multiplyInt8BlockVnni<ROWS, 1>(quads.data(), B + 4 * j, ldb, R + j, ldr, depth, offsets);
+  }
+  scalar::multiplyInt8(A, lda, B + 4 * j, ldb, R + j, ldr, ROWS, depth, n - j);
+}
+
+RICHARD_TARGET("avx512f,avx512bw,avx512vnni")
+void multiplyInt8Vnni(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t rows, size_t depth, size_t n) {
+
+  switch (rows) {
+    case 1: multiplyInt8TileVnni<1>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 2: multiplyInt8TileVnni<2>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 3: multiplyInt8TileVnni<3>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 4: multiplyInt8TileVnni<4>(A, lda, B, ldb, R, ldr, depth, n); break;
+    default: scalar::multiplyInt8(A, lda, B, ldb, R, ldr, rows, depth, n); break;
+  }
+}
+
+void multiplyInt8(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t rows, size_t depth, size_t n) {
+
+  static const bool vnni = cpuSupportsVnni();
+
+  if (vnni) {
+    multiplyInt8Vnni(A, lda, B, ldb, R, ldr, rows, depth, n);
+  }
+  else {
+    avx2::multiplyInt8(A, lda, B, ldb, R, ldr, rows, depth, n);
+  }
+}
+
+RICHARD_TARGET("avx512f")
+void mulhilo(__m512i c, __m512i m, __m512i& hi, __m512i& lo) {
+  __m512i even = _mm512_mul_epu32(c, m);
+  __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(c, 32), m);
+
+  hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+  lo = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32));
+}
+
+// Sixteen blocks at a time, one per lane
+RICHARD_TARGET("avx512f")
+void philox(const uint32_t* key, uint64_t stream, uint64_t counter, uint32_t* R,
+  size_t blocks) {
+
+  const __m512i m0 = _mm512_set1_epi32(static_cast<int>(PHILOX_M0));
+  const __m512i m1 = _mm512_set1_epi32(static_cast<int>(PHILOX_M1));
+  const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+  size_t i = 0;
+  for (; i + N <= blocks; i += N) {
+    uint64_t first = counter + i;
+
+    __m512i c0 = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(first)), lane);
+    __mmask16 carry = _mm512_cmplt_epu32_mask(c0, lane);
+    __m512i c1 = _mm512_mask_add_epi32(_mm512_set1_epi32(static_cast<int>(first >> 32)), carry,
+      _mm512_set1_epi32(static_cast<int>(first >> 32)), _mm512_set1_epi32(1));
+    __m512i c2 = _mm512_set1_epi32(static_cast<int>(stream));
+    __m512i c3 = _mm512_set1_epi32(static_cast<int>(stream >> 32));
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+
+    for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+      __m512i hi0, lo0, hi1, lo1;
+      mulhilo(c0, m0, hi0, lo0);
+      mulhilo(c2, m1, hi1, lo1);
+
+      c0 = _mm512_xor_si512(_mm512_xor_si512(hi1, c1), _mm512_set1_epi32(static_cast<int>(k0)));
+      c1 = lo1;
+      c2 = _mm512_xor_si512(_mm512_xor_si512(hi0, c3), _mm512_set1_epi32(static_cast<int>(k1)));
+      c3 = lo0;
+
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    // Within each 128-bit lane, u0 to u3 hold one block each. The lanes are then gathered so that
+    // the blocks are in order.
+    __m512i t0 = _mm512_unpacklo_epi32(c0, c1);
+    __m512i t1 = _mm512_unpackhi_epi32(c0, c1);
+    __m512i t2 = _mm512_unpacklo_epi32(c2, c3);
+    __m512i t3 = _mm512_unpackhi_epi32(c2, c3);
+    __m512i u0 = _mm512_unpacklo_epi64(t0, t2);
+    __m512i u1 = _mm512_unpackhi_epi64(t0, t2);
+    __m512i u2 = _mm512_unpacklo_epi64(t1, t3);
+    __m512i u3 = _mm512_unpackhi_epi64(t1, t3);
+
+    __m512i a = _mm512_shuffle_i32x4(u0, u1, 0x44);
+    __m512i b = _mm512_shuffle_i32x4(u2, u3, 0x44);
+    __m512i c = _mm512_shuffle_i32x4(u0, u1, 0xEE);
+    __m512i d = _mm512_shuffle_i32x4(u2, u3, 0xEE);
+
+    uint32_t* out = R + 4 * i;
+    _mm512_storeu_si512(out, _mm512_shuffle_i32x4(a, b, 0x88));
+    _mm512_storeu_si512(out + 16, _mm512_shuffle_i32x4(a, b, 0xDD));
+    _mm512_storeu_si512(out + 32, _mm512_shuffle_i32x4(c, d, 0x88));
+    _mm512_storeu_si512(out + 48, _mm512_shuffle_i32x4(c, d, 0xDD));
+  }
+  avx2::philox(key, stream, counter + i, R + 4 * i, blocks - i);
+}
+
+const Kernels kernels{
+  InstructionSet::avx512,
+  add,
+  subtract,
+  multiply,
+  addScalar,
+  multiplyScalar,
+  divideScalar,
+  axpy,
+  fill,
+  sum,
+  dot,
+  multiplyAccumulate,
+  dotRows,
+  sigmoid,
+  sigmoidPrime,
+  relu,
+  reluPrime,
+  convertTo<float16_t>,
+  convertFrom<float16_t>,
+  convertTo<bfloat16_t>,
+  convertFrom<bfloat16_t>,
+  dotRowsPacked<float16_t>,
+  dotRowsPacked<bfloat16_t>,
+  toInt8,
+  dotRowsInt8,
+  multiplyInt8,
+  normalizeUint8,
+  philox
+};
+
+}
+
+#ifdef _MSC_VER
+
+bool cpuSupports(InstructionSet instructionSet) {
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool fma = (info[2] & (1 << 12)) != 0;
+  bool f16c = (info[2] & (1 << 29)) != 0;
+  if (!osxsave) {
+    return false;
+  }
+
+  unsigned long long xcr0 = _xgetbv(0);
+  bool osAvx = (xcr0 & 0x6) == 0x6;
+  bool osAvx512 = (xcr0 & 0xe6) == 0xe6;
+
+  __cpuidex(info, 7, 0);
+  bool avx2 = (info[1] & (1 << 5)) != 0;
+  bool avx512f = (info[1] & (1 << 16)) != 0;
+
+  switch (instructionSet) {
+    case InstructionSet::avx2: return osAvx && avx2 && fma && f16c;
+    // Some avx512 kernels call into the avx2 ones, which need fma and f16c
+    case InstructionSet::avx512: return osAvx && avx2 && fma && f16c && osAvx512 && avx512f;
+    default: return false;
+  }
+}
+
+bool cpuSupportsVnni() {
+  int info[4];
+  __cpuidex(info, 7, 0);
+  bool avx512bw = (info[1] & (1 << 30)) != 0;
+  bool avx512vnni = (info[2] & (1 << 11)) != 0;
+
+  return cpuSupports(InstructionSet::avx512) && avx512bw && avx512vnni;
+}
+
+#else
+
+bool cpuSupports(InstructionSet instructionSet) {
+  __builtin_cpu_init();
+
+  switch (instructionSet) {
+    case InstructionSet::avx2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+        && __builtin_cpu_supports("f16c");
+    case InstructionSet::avx512:
+      // Some avx512 kernels call into the avx2 ones, which need fma and f16c
+      return cpuSupports(InstructionSet::avx2) && __builtin_cpu_supports("avx512f");
+    default:
+      return false;
+  }
+}
+
+bool cpuSupportsVnni() {
+  return cpuSupports(InstructionSet::avx512) && __builtin_cpu_supports("avx512bw")
+    && __builtin_cpu_supports("avx512vnni");
+}
+
+#endif
+
+#endif
+
+#ifdef RICHARD_SIMD_NEON
+
+namespace neon {
+
+const size_t N = 4;
+
+void add(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, vaddq_f32(vld1q_f32(A + i), vld1q_f32(B + i)));
+  }
+  scalar::add(A + i, B + i, R + i, n - i);
+}
+
+void subtract(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, vsubq_f32(vld1q_f32(A + i), vld1q_f32(B + i)));
+  }
+  scalar::subtract(A + i, B + i, R + i, n - i);
+}
+
+void multiply(const netfloat_t* A, const netfloat_t* B, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, vmulq_f32(vld1q_f32(A + i), vld1q_f32(B + i)));
+  }
+  scalar::multiply(A + i, B + i, R + i, n - i);
+}
+
+void addScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  float32x4_t X = vdupq_n_f32(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, vaddq_f32(vld1q_f32(A + i), X));
+  }
+  scalar::addScalar(A + i, x, R + i, n - i);
+}
+
+void multiplyScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  float32x4_t X = vdupq_n_f32(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, vmulq_f32(vld1q_f32(A + i), X));
+  }
+  scalar::multiplyScalar(A + i, x, R + i, n - i);
+}
+
+void divideScalar(const netfloat_t* A, netfloat_t x, netfloat_t* R, size_t n) {
+  float32x4_t X = vdupq_n_f32(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, vdivq_f32(vld1q_f32(A + i), X));
+  }
+  scalar::divideScalar(A + i, x, R + i, n - i);
+}
+
+void axpy(netfloat_t a, const netfloat_t* X, netfloat_t* Y, size_t n) {
+  float32x4_t A = vdupq_n_f32(a);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(Y + i, vfmaq_f32(vld1q_f32(Y + i), A, vld1q_f32(X + i)));
+  }
+  scalar::axpy(a, X + i, Y + i, n - i);
+}
+
+void fill(netfloat_t* R, netfloat_t x, size_t n) {
+  float32x4_t X = vdupq_n_f32(x);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, X);
+  }
+  scalar::fill(R + i, x, n - i);
+}
+
+netfloat_t sum(const netfloat_t* A, size_t n) {
+  float32x4_t s0 = vdupq_n_f32(0.f);
+  float32x4_t s1 = vdupq_n_f32(0.f);
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    s0 = vaddq_f32(s0, vld1q_f32(A + i));
+    s1 = vaddq_f32(s1, vld1q_f32(A + i + N));
+  }
+  for (; i + N <= n; i += N) {
+    s0 = vaddq_f32(s0, vld1q_f32(A + i));
+  }
+  return vaddvq_f32(vaddq_f32(s0, s1)) + scalar::sum(A + i, n - i);
+}
+
+netfloat_t dot(const netfloat_t* A, const netfloat_t* B, size_t n) {
+  float32x4_t s0 = vdupq_n_f32(0.f);
+  float32x4_t s1 = vdupq_n_f32(0.f);
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    s0 = vfmaq_f32(s0, vld1q_f32(A + i), vld1q_f32(B + i));
+    s1 = vfmaq_f32(s1, vld1q_f32(A + i + N), vld1q_f32(B + i + N));
+  }
+  for (; i + N <= n; i += N) {
+    s0 = vfmaq_f32(s0, vld1q_f32(A + i), vld1q_f32(B + i));
+  }
+  return vaddvq_f32(vaddq_f32(s0, s1)) + scalar::dot(A + i, B + i, n - i);
+}
+
+template<size_t ROWS>
+void multiplyAccumulateTile(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t depth, size_t n) {
+
+  size_t j = 0;
+  for (; j + 2 * N <= n; j += 2 * N) {
+    float32x4_t c0[ROWS];
+    float32x4_t c1[ROWS];
+    for (size_t i = 0; i < ROWS; ++i) {
+      c0[i] = vld1q_f32(C + i * ldc + j);
+      c1[i] = vld1q_f32(C + i * ldc + j + N);
+    }
+    for (size_t k = 0; k < depth; ++k) {
+      float32x4_t b0 = vld1q_f32(B + k * ldb + j);
+      float32x4_t b1 = vld1q_f32(B + k * ldb + j + N);
+      for (size_t i = 0; i < ROWS; ++i) {
+        netfloat_t a = A[i * rsA + k * csA];
+        c0[i] = vfmaq_n_f32(c0[i], b0, a);
+        c1[i] = vfmaq_n_f32(c1[i], b1, a);
+      }
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      vst1q_f32(C + i * ldc + j, c0[i]);
+      vst1q_f32(C + i * ldc + j + N, c1[i]);
+    }
+  }
+  if (j < n) {
+    scalar::multiplyAccumulate(A, rsA, csA, B + j, ldb, C + j, ldc, ROWS, depth, n - j);
+  }
+}
+
+void multiplyAccumulate(const netfloat_t* A, size_t rsA, size_t csA, const netfloat_t* B,
+  size_t ldb, netfloat_t* C, size_t ldc, size_t rows, size_t depth, size_t n) {
+
+  switch (rows) {
+    case 1: multiplyAccumulateTile<1>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 2: multiplyAccumulateTile<2>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 3: multiplyAccumulateTile<3>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    case 4: multiplyAccumulateTile<4>(A, rsA, csA, B, ldb, C, ldc, depth, n); break;
+    default: scalar::multiplyAccumulate(A, rsA, csA, B, ldb, C, ldc, rows, depth, n); break;
+  }
+}
+
+void dotRows(const netfloat_t* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  for (size_t i = 0; i < rows; ++i) {
+    R[i] = dot(A + i * lda, x, n);
+  }
+}
+
+float32x4_t exp(float32x4_t x) {
+  x = vminq_f32(x, vdupq_n_f32(EXP_HI));
+  x = vmaxq_f32(x, vdupq_n_f32(EXP_LO));
+
+  float32x4_t fx = vfmaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(LOG2E));
+  fx = vrndmq_f32(fx);
+
+  x = vfmsq_f32(x, fx, vdupq_n_f32(LN2_HI));
+  x = vfmsq_f32(x, fx, vdupq_n_f32(LN2_LO));
+
+  float32x4_t y = vdupq_n_f32(EXP_P[0]);
+  for (size_t k = 1; k < 6; ++k) {
+    y = vfmaq_f32(vdupq_n_f32(EXP_P[k]), y, x);
+  }
+  y = vfmaq_f32(vaddq_f32(x, vdupq_n_f32(1.f)), y, vmulq_f32(x, x));
+
+  int32x4_t e = vaddq_s32(vcvtq_s32_f32(fx), vdupq_n_s32(127));
+  return vmulq_f32(y, vreinterpretq_f32_s32(vshlq_n_s32(e, 23)));
+}
+
+float32x4_t sigmoid(float32x4_t x) {
+  float32x4_t one = vdupq_n_f32(1.f);
+  return vdivq_f32(one, vaddq_f32(one, exp(vnegq_f32(x))));
+}
+
+void sigmoid(const netfloat_t* A, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, sigmoid(vld1q_f32(A + i)));
+  }
+  scalar::sigmoid(A + i, R + i, n - i);
+}
+
+void sigmoidPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  float32x4_t one = vdupq_n_f32(1.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    float32x4_t s = sigmoid(vld1q_f32(A + i));
+    vst1q_f32(R + i, vmulq_f32(s, vsubq_f32(one, s)));
+  }
+  scalar::sigmoidPrime(A + i, R + i, n - i);
+}
+
+void relu(const netfloat_t* A, netfloat_t* R, size_t n) {
+  float32x4_t zero = vdupq_n_f32(0.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, vmaxq_f32(vld1q_f32(A + i), zero));
+  }
+  scalar::relu(A + i, R + i, n - i);
+}
+
+void reluPrime(const netfloat_t* A, netfloat_t* R, size_t n) {
+  float32x4_t zero = vdupq_n_f32(0.f);
+  float32x4_t one = vdupq_n_f32(1.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    uint32x4_t negative = vcltq_f32(vld1q_f32(A + i), zero);
+    vst1q_f32(R + i, vbslq_f32(negative, zero, one));
+  }
+  scalar::reluPrime(A + i, R + i, n - i);
+}
+
+float32x4_t load4(const float16_t* A) {
+  return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(reinterpret_cast<const uint16_t*>(A))));
+}
+
+float32x4_t load4(const bfloat16_t* A) {
+  return vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(reinterpret_cast<const uint16_t*>(A)), 16));
+}
+
+void store4(float16_t* R, float32x4_t x) {
+  vst1_u16(reinterpret_cast<uint16_t*>(R), vreinterpret_u16_f16(vcvt_f16_f32(x)));
+}
+
+void store4(bfloat16_t* R, float32x4_t x) {
+  uint32x4_t u = vreinterpretq_u32_f32(x);
+  uint32x4_t odd = vandq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(1));
+  uint32x4_t rounded = vaddq_u32(u, vaddq_u32(odd, vdupq_n_u32(0x7fff)));
+  uint32x4_t quietNan = vorrq_u32(u, vdupq_n_u32(0x00400000));
+  uint32x4_t b = vbslq_u32(vceqq_f32(x, x), rounded, quietNan);
+  vst1_u16(reinterpret_cast<uint16_t*>(R), vshrn_n_u32(b, 16));
+}
+
+template<typename S>
+void convertTo(const netfloat_t* A, S* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    store4(R + i, vld1q_f32(A + i));
+  }
+  scalar::convertTo(A + i, R + i, n - i);
+}
+
+template<typename S>
+void convertFrom(const S* A, netfloat_t* R, size_t n) {
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    vst1q_f32(R + i, load4(A + i));
+  }
+  scalar::convertFrom(A + i, R + i, n - i);
+}
+
+template<typename S>
+netfloat_t dotPacked(const S* A, const netfloat_t* x, size_t n) {
+  float32x4_t s = vdupq_n_f32(0.f);
+  size_t i = 0;
+  for (; i + N <= n; i += N) {
+    s = vfmaq_f32(s, load4(A + i), vld1q_f32(x + i));
+  }
+  return vaddvq_f32(s) + scalar::dotPacked(A + i, x + i, n - i);
+}
+
+template<typename S>
+void dotRowsPacked(const S* A, size_t lda, const netfloat_t* x, netfloat_t* R, size_t rows,
+  size_t n) {
+
+  for (size_t i = 0; i < rows; ++i) {
+    R[i] = dotPacked(A + i * lda, x, n);
+  }
+}
+
+void toInt8(const netfloat_t* A, int8_t* R, netfloat_t scale, size_t n) {
+  const float32x4_t s = vdupq_n_f32(scale);
+  const float32x4_t lo = vdupq_n_f32(-127.f);
+  const float32x4_t hi = vdupq_n_f32(127.f);
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    float32x4_t x0 = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(A + i), s), lo), hi);
+    float32x4_t x1 = vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(A + i + N), s), lo), hi);
+    int16x8_t q = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(x0)), vqmovn_s32(vcvtnq_s32_f32(x1)));
+    vst1_s8(R + i, vqmovn_s16(q));
+  }
+  scalar::toInt8(A + i, R + i, scale, n - i);
+}
+
+void normalizeUint8(const uint8_t* A, netfloat_t min, netfloat_t max, netfloat_t* R,
+  size_t n) {
+
+  const float32x4_t lo = vdupq_n_f32(min);
+  const float32x4_t range = vdupq_n_f32(max - min);
+  size_t i = 0;
+  for (; i + 2 * N <= n; i += 2 * N) {
+    uint16x8_t a = vmovl_u8(vld1_u8(A + i));
+    float32x4_t x0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(a)));
+    float32x4_t x1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(a)));
+    vst1q_f32(R + i, vdivq_f32(vsubq_f32(x0, lo), range));
+    vst1q_f32(R + i + N, vdivq_f32(vsubq_f32(x1, lo), range));
+  }
+  scalar::normalizeUint8(A + i, min, max, R + i, n - i);
+}
+
+// Without the dot product extension, pairs of products are summed in 16 bits, which can't
+// saturate with both operands in [-127, 127]
+template<size_t ROWS>
+void dotRowsInt8Tile(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t n) {
+  const size_t B = 16;
+
+  int32x4_t s[ROWS];
+  for (size_t i = 0; i < ROWS; ++i) {
+    s[i] = vdupq_n_s32(0);
+  }
+  size_t j = 0;
+  for (; j + B <= n; j += B) {
+    int8x16_t X = vld1q_s8(x + j);
+    for (size_t i = 0; i < ROWS; ++i) {
+      int8x16_t a = vld1q_s8(A + i * lda + j);
+#ifdef __ARM_FEATURE_DOTPROD
+      s[i] = vdotq_s32(s[i], a, X);
+#else
+      int16x8_t pairs = vmull_s8(vget_low_s8(a), vget_low_s8(X));
+      pairs = vmlal_s8(pairs, vget_high_s8(a), vget_high_s8(X));
+      s[i] = vpadalq_s16(s[i], pairs);
+#endif
+    }
+  }
+  for (size_t i = 0; i < ROWS; ++i) {
+    R[i] = vaddvq_s32(s[i]) + scalar::dotInt8(A + i * lda + j, x + j, n - j);
+  }
+}
+
+void dotRowsInt8(const int8_t* A, size_t lda, const int8_t* x, int32_t* R, size_t rows,
+  size_t n) {
+
+  switch (rows) {
+    case 1: dotRowsInt8Tile<1>(A, lda, x, R, n); break;
+    case 2: dotRowsInt8Tile<2>(A, lda, x, R, n); break;
+    case 3: dotRowsInt8Tile<3>(A, lda, x, R, n); break;
+    case 4: dotRowsInt8Tile<4>(A, lda, x, R, n); break;
+    default: scalar::dotRowsInt8(A, lda, x, R, rows, n); break;
+  }
+}
+
+// sdot sums the four products in each 32-bit lane, which is how B is packed. Without it, the
+// products of two columns are widened and summed pairwise twice.
+template<size_t ROWS>
+void multiplyInt8Tile(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t depth, size_t n) {
+
+  const size_t N = 4;
+  const size_t groups = (depth + 3) / 4;
+
+  thread_local std::vector<int32_t> quads;
+  scalar::packInt8Quads(A, lda, ROWS, depth, quads);
+
+  size_t j = 0;
+  for (; j + N <= n; j += N) {
+    int32x4_t s[ROWS];
+    for (size_t i = 0; i < ROWS; ++i) {
+      s[i] = vdupq_n_s32(0);
+    }
+    for (size_t g = 0; g < groups; ++g) {
+      int8x16_t b = vld1q_s8(B + g * ldb + 4 * j);
+      for (size_t i = 0; i < ROWS; ++i) {
+        int8x16_t a = vreinterpretq_s8_s32(vdupq_n_s32(quads[g * ROWS + i]));
+#ifdef __ARM_FEATURE_DOTPROD
+        s[i] = vdotq_s32(s[i], a, b);
+#else
+        int16x8_t lo = vmull_s8(vget_low_s8(a), vget_low_s8(b));
+        int16x8_t hi = vmull_s8(vget_high_s8(a), vget_high_s8(b));
+        s[i] = vaddq_s32(s[i], vpaddq_s32(vpaddlq_s16(lo), vpaddlq_s16(hi)));
+#endif
+      }
+    }
+    for (size_t i = 0; i < ROWS; ++i) {
+      vst1q_s32(R + i * ldr + j, s[i]);
+    }
+  }
+  scalar::multiplyInt8(A, lda, B + 4 * j, ldb, R + j, ldr, ROWS, depth, n - j);
+}
+
+void multiplyInt8(const int8_t* A, size_t lda, const int8_t* B, size_t ldb, int32_t* R,
+  size_t ldr, size_t rows, size_t depth, size_t n) {
+
+  switch (rows) {
+    case 1: multiplyInt8Tile<1>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 2: multiplyInt8Tile<2>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 3: multiplyInt8Tile<3>(A, lda, B, ldb, R, ldr, depth, n); break;
+    case 4: multiplyInt8Tile<4>(A, lda, B, ldb, R, ldr, depth, n); break;
+    default: scalar::multiplyInt8(A, lda, B, ldb, R, ldr, rows, depth, n); break;
+  }
+}
+
+void mulhilo(uint32x4_t c, uint32_t m, uint32x4_t& hi, uint32x4_t& lo) {
+  uint32x4_t low = vreinterpretq_u32_u64(vmull_n_u32(vget_low_u32(c), m));
+  uint32x4_t high = vreinterpretq_u32_u64(vmull_high_n_u32(c, m));
+
+  hi = vuzp2q_u32(low, high);
+  lo = vuzp1q_u32(low, high);
+}
+
+// Four blocks at a time, one per lane
+void philox(const uint32_t* key, uint64_t stream, uint64_t counter, uint32_t* R,
+  size_t blocks) {
+
+  const uint32_t laneInit[] = { 0, 1, 2, 3 };
+  const uint32x4_t lane = vld1q_u32(laneInit);
+
+  size_t i = 0;
+  for (; i + 4 <= blocks; i += 4) {
+    uint64_t first = counter + i;
+
+    uint32x4_t c0 = vaddq_u32(vdupq_n_u32(static_cast<uint32_t>(first)), lane);
+    // All ones where the low word wrapped
+    uint32x4_t carry = vcltq_u32(c0, lane);
+    uint32x4_t c1 = vsubq_u32(vdupq_n_u32(static_cast<uint32_t>(first >> 32)), carry);
+    uint32x4_t c2 = vdupq_n_u32(static_cast<uint32_t>(stream));
+    uint32x4_t c3 = vdupq_n_u32(static_cast<uint32_t>(stream >> 32));
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+
+    for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+      uint32x4_t hi0, lo0, hi1, lo1;
+      mulhilo(c0, PHILOX_M0, hi0, lo0);
+      mulhilo(c2, PHILOX_M1, hi1, lo1);
+
+      c0 = veorq_u32(veorq_u32(hi1, c1), vdupq_n_u32(k0));
+      c1 = lo1;
+      c2 = veorq_u32(veorq_u32(hi0, c3), vdupq_n_u32(k1));
+      c3 = lo0;
+
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    // Interleaving stores each block's four words together
+    uint32x4x4_t words = {{ c0, c1, c2, c3 }};
+    vst4q_u32(R + 4 * i, words);
+  }
+  scalar::philox(key, stream, counter + i, R + 4 * i, blocks - i);
+}
+
+const Kernels kernels{
+  InstructionSet::neon,
+  add,
+  subtract,
+  multiply,
+  addScalar,
+  multiplyScalar,
+  divideScalar,
+  axpy,
+  fill,
+  sum,
+  dot,
+  multiplyAccumulate,
+  dotRows,
+  sigmoid,
+  sigmoidPrime,
+  relu,
+  reluPrime,
+  convertTo<float16_t>,
+  convertFrom<float16_t>,
+  convertTo<bfloat16_t>,
+  convertFrom<bfloat16_t>,
+  dotRowsPacked<float16_t>,
+  dotRowsPacked<bfloat16_t>,
+  toInt8,
+  dotRowsInt8,
+  multiplyInt8,
+  normalizeUint8,
+  philox
+};
+
+}
+
+#endif
+
+}
+
+InstructionSet detectInstructionSet() {
+#if defined(RICHARD_SIMD_X86)
+  if (cpuSupports(InstructionSet::avx512)) {
+    return InstructionSet::avx512;
+  }
+  if (cpuSupports(InstructionSet::avx2)) {
+    return InstructionSet::avx2;
+  }
+#elif defined(RICHARD_SIMD_NEON)
+  // NEON is mandatory on AArch64
+  return InstructionSet::neon;
+#endif
+  return InstructionSet::scalar;
+}
+
+const Kernels& kernels() {
+  static const Kernels& selected = *kernels(detectInstructionSet());
+  return selected;
+}
+
+const Kernels* kernels(InstructionSet instructionSet) {
+  switch (instructionSet) {
+    case InstructionSet::scalar:
+      return &scalar::kernels;
+#ifdef RICHARD_SIMD_X86
+    case InstructionSet::avx2:
+      return cpuSupports(InstructionSet::avx2) ? &avx2::kernels : nullptr;
+    case InstructionSet::avx512:
+      return cpuSupports(InstructionSet::avx512) ? &avx512::kernels : nullptr;
+#endif
+#ifdef RICHARD_SIMD_NEON
+    case InstructionSet::neon:
+      return &neon::kernels;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+std::string instructionSetName(InstructionSet instructionSet) {
+  switch (instructionSet) {
+    case InstructionSet::scalar: return "scalar";
+    case InstructionSet::avx2: return "avx2";
+    case InstructionSet::avx512: return "avx512";
+    case InstructionSet::neon: return "neon";
+    default: EXCEPTION("Unknown instruction set");
+  }
+}
+
+}
+}
@@ -0,0 +1,118 @@
+#include "richard/thread_pool.hpp"
+#include <algorithm>
+
+namespace richard {
+
+ThreadPool::ThreadPool(size_t numThreads)
+  : m_fn(nullptr)
+  , m_numTasks(0)
+  , m_nextTask(0)
+  , m_generation(0)
+  , m_busyWorkers(0)
+  , m_stop(false) {
+
+  if (numThreads == 0) {
+    numThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  for (size_t i = 1; i < numThreads; ++i) {
+    m_workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+size_t ThreadPool::numThreads() const {
+  return m_workers.size() + 1;
+}
+
+void ThreadPool::runTasks() {
+  while (true) {
+    size_t i = m_nextTask++;
+    if (i >= m_numTasks) {
+      break;
+    }
+
+    try {
+      (*m_fn)(i);
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_exception) {
+        m_exception = std::current_exception();
+      }
+    }
+  }
+}
+
+void ThreadPool::workerLoop() {
+  size_t generation = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobReady.wait(lock, [&]() { return m_stop || m_generation != generation; });
+
+      if (m_stop) {
+        return;
+      }
+
+      generation = m_generation;
+    }
+
+    runTasks();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_busyWorkers;
+    }
+    m_jobDone.notify_one();
+  }
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+  if (m_workers.empty() || n <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fn = &fn;
+    m_numTasks = n;
+    m_nextTask = 0;
+    m_exception = nullptr;
+    m_busyWorkers = m_workers.size();
+    ++m_generation;
+  }
+  m_jobReady.notify_all();
+
+  runTasks();
+
+  std::exception_ptr exception;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobDone.wait(lock, [this]() { return m_busyWorkers == 0; });
+
+    m_fn = nullptr;
+    exception = m_exception;
+  }
+
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_jobReady.notify_all();
+
+  for (auto& worker : m_workers) {
+    worker.join();
+  }
+}
+
+}
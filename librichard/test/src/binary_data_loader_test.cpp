@@ -0,0 +1,209 @@
+#include "mock_file_system.hpp"
+#include "mock_data_loader.hpp"
+#include <richard/binary_data_loader.hpp>
+#include <richard/csv_data_loader.hpp>
+#include <richard/utils.hpp>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <fstream>
+
+using namespace richard;
+using testing::Return;
+using testing::ByMove;
+
+class BinaryDataLoaderTest : public testing::Test {
+  public:
+    virtual void SetUp() override {
+      m_path = std::filesystem::temp_directory_path() / "richard_binary_data_loader_test.bin";
+    }
+
+    virtual void TearDown() override {
+      std::filesystem::remove(m_path);
+    }
+
+    std::filesystem::path m_path;
+};
+
+namespace {
+
+DataDetails testDataDetails() {
+  DataDetails details{DataDetails::exampleConfig()};
+  details.classLabels = { "cat", "dog", "fish" };
+  details.shape = { 5, 4, 2 };
+  return details;
+}
+
+std::unique_ptr<CsvDataLoader> csvLoader(const std::string& text, const DataDetails& details,
+  size_t fetchSize) {
+
+  return std::make_unique<CsvDataLoader>(std::make_unique<std::stringstream>(text),
+    calcProduct(details.shape), details.classLabels, details.normalization, fetchSize);
+}
+
+std::vector<Sample> loadAll(DataLoader& loader) {
+  std::vector<Sample> all;
+
+  std::vector<Sample> samples = loader.loadSamples();
+  while (samples.size() > 0) {
+    EXPECT_LE(samples.size(), loader.fetchSize());
+    all.insert(all.end(), std::make_move_iterator(samples.begin()),
+      std::make_move_iterator(samples.end()));
+    samples = loader.loadSamples();
+  }
+
+  return all;
+}
+
+void assertSamplesEqual(const std::vector<Sample>& A, const std::vector<Sample>& B) {
+  ASSERT_EQ(A.size(), B.size());
+
+  for (size_t i = 0; i < A.size(); ++i) {
+    ASSERT_EQ(A[i].classId, B[i].classId);
+    ASSERT_EQ(A[i].size(), B[i].size());
+
+    Array3 X = A[i].toArray3();
+    Array3 Y = B[i].toArray3();
+    for (size_t j = 0; j < X.size(); ++j) {
+      ASSERT_EQ(X.data()[j], Y.data()[j]);
+    }
+  }
+}
+
+}
+
+TEST_F(BinaryDataLoaderTest, roundTripsUint8Samples) {
+  DataDetails details = testDataDetails();
+  const std::string labels[] = { "cat", "dog", "fish" };
+
+  std::stringstream csv;
+  for (size_t i = 0; i < 23; ++i) {
+    csv << labels[i % 3];
+    for (size_t j = 0; j < calcProduct(details.shape); ++j) {
+      csv << "," << (i * 31 + j * 7) % 256;
+    }
+    csv << "\n";
+  }
+
+  {
+    auto source = csvLoader(csv.str(), details, 10);
+    std::ofstream stream(m_path, std::ios::binary);
+    writeBinaryDataSet(*source, details, stream);
+  }
+
+  MockFileSystem fileSystem;
+  EXPECT_CALL(fileSystem, openFileForReading(std::filesystem::path(m_path.string())))
+    .WillOnce(Return(ByMove(std::make_unique<std::ifstream>(m_path, std::ios::binary))));
+  EXPECT_CALL(fileSystem, mapFileForReading(std::filesystem::path(m_path.string())))
+    .WillOnce(Return(ByMove(mapFile(m_path))));
+
+  Config config = DataLoader::exampleConfig();
+  config.setNumber("fetchSize", 7);
+
+  DataLoaderPtr loader = createDataLoader(fileSystem, config, m_path.string(), details);
+  ASSERT_NE(dynamic_cast<BinaryDataLoader*>(loader.get()), nullptr);
+
+  std::vector<Sample> expected = loadAll(*csvLoader(csv.str(), details, 10));
+
+  std::vector<Sample> samples = loadAll(*loader);
+  ASSERT_TRUE(samples[0].isPacked());
+  ASSERT_EQ(samples[0].shape(), details.shape);
+
+  assertSamplesEqual(samples, expected);
+
+  loader->seekToBeginning();
+  assertSamplesEqual(loadAll(*loader), expected);
+
+  // Packed samples refer into the mapped file, which they keep open after the loader is gone
+  loader->seekToBeginning();
+  std::vector<Sample> outliving = loadAll(*loader);
+  loader.reset();
+  assertSamplesEqual(outliving, expected);
+}
+
+TEST_F(BinaryDataLoaderTest, roundTripsFloatSamples) {
+  DataDetails details = testDataDetails();
+
+  std::stringstream csv;
+  for (size_t i = 0; i < 5; ++i) {
+    csv << (i % 2 == 0 ? "fish" : "cat");
+    for (size_t j = 0; j < calcProduct(details.shape); ++j) {
+      csv << "," << static_cast<float>(i * 40 + j) * 0.37f - 3.f;
+    }
+    csv << "\n";
+  }
+
+  {
+    auto source = csvLoader(csv.str(), details, 2);
+    std::ofstream stream(m_path, std::ios::binary);
+    writeBinaryDataSet(*source, details, stream);
+  }
+
+  {
+    std::ifstream stream(m_path, std::ios::binary);
+    ASSERT_TRUE(isBinaryDataSet(stream));
+  }
+
+  BinaryDataLoader loader(mapFile(m_path), 3);
+
+  ASSERT_EQ(loader.numSamples(), 5);
+  ASSERT_EQ(loader.shape(), details.shape);
+  ASSERT_EQ(loader.labels(), details.classLabels);
+
+  std::vector<Sample> samples = loadAll(loader);
+  ASSERT_FALSE(samples[0].isPacked());
+  ASSERT_EQ(samples[0].shape(), details.shape);
+
+  assertSamplesEqual(samples, loadAll(*csvLoader(csv.str(), details, 2)));
+}
+
+TEST_F(BinaryDataLoaderTest, roundTripsSamplesWithShortRecords) {
+  DataDetails details = testDataDetails();
+  details.classLabels = { "a", "b" };
+  details.shape = { 2, 1, 1 };
+
+  // Records are 8 bytes, shorter than the padding before the first of them
+  std::string csv = "a,1,2\nb,3,4\na,255,0\n";
+
+  {
+    auto source = csvLoader(csv, details, 10);
+    std::ofstream stream(m_path, std::ios::binary);
+    writeBinaryDataSet(*source, details, stream);
+  }
+
+  // A 64 byte header, two 5 byte labels, padding to 128 bytes, then the records
+  ASSERT_EQ(std::filesystem::file_size(m_path), 128 + 3 * 8);
+
+  std::ifstream stream(m_path, std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(stream)),
+    std::istreambuf_iterator<char>());
+  for (size_t i = 64 + 2 * 5; i < 128; ++i) {
+    ASSERT_EQ(bytes[i], 0);
+  }
+
+  BinaryDataLoader loader(mapFile(m_path), 2);
+  ASSERT_EQ(loader.numSamples(), 3);
+
+  assertSamplesEqual(loadAll(loader), loadAll(*csvLoader(csv, details, 10)));
+}
+
+TEST_F(BinaryDataLoaderTest, rejectsOutOfRangeClassIds) {
+  DataDetails details = testDataDetails();
+
+  // Yields a single sample per pass
+  size_t fetches = 0;
+  testing::NiceMock<MockDataLoader> source;
+  ON_CALL(source, seekToBeginning()).WillByDefault([&]() { fetches = 0; });
+  ON_CALL(source, loadSamples()).WillByDefault([&]() {
+    std::vector<Sample> samples;
+    if (fetches++ == 0) {
+      samples.emplace_back(7, Array3(5, 4, 2));
+    }
+    return samples;
+  });
+
+  std::stringstream stream;
+  ASSERT_THROW(writeBinaryDataSet(source, details, stream), Exception);
+
+  std::stringstream text("1,2,3");
+  ASSERT_FALSE(isBinaryDataSet(text));
+}
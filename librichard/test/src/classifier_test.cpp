@@ -1,11 +1,14 @@
 #include "mock_file_system.hpp"
 #include "mock_logger.hpp"
 #include "mock_platform_paths.hpp"
+#include "mock_data_loader.hpp"
+#include "mock_labelled_data_set.hpp"
 #include <richard/config.hpp>
 #include <richard/classifier.hpp>
 #include <richard/data_details.hpp>
 #include <richard/event_system.hpp>
 #include <gtest/gtest.h>
+#include <sstream>
 
 using namespace richard;
 using testing::NiceMock;
@@ -27,3 +30,99 @@ TEST_F(ClassifierTest, exampleConfig) {
   Classifier classifier{dataDetails, config, *eventSystem, *fileSystem, *platformPaths, logger,
     true};
 }
+
+TEST_F(ClassifierTest, multiThreadedTestMatchesSingleThreaded) {
+  const std::string networkString =     ""
+  "{                                    "
+  "  \"hyperparams\": {                 "
+  "      \"epochs\": 1,                 "
+  "      \"batchSize\": 10,             "
+  "      \"miniBatchSize\": 2           "
+  "  },                                 "
+  "  \"hiddenLayers\": [                "
+  "      {                              "
+  "          \"type\": \"dense\",       "
+  "          \"size\": 5,               "
+  "          \"learnRate\": 0.1,        "
+  "          \"learnRateDecay\": 1.0,   "
+  "          \"dropoutRate\": 0.0       "
+  "      }                              "
+  "  ],                                 "
+  "  \"outputLayer\": {                 "
+  "      \"size\": 2,                   "
+  "      \"learnRate\": 0.1,            "
+  "      \"learnRateDecay\": 1.0        "
+  "  }                                  "
+  "}                                    ";
+
+  auto eventSystem = createEventSystem();
+  NiceMock<MockFileSystem> fileSystem;
+  NiceMock<MockPlatformPaths> platformPaths;
+  NiceMock<MockLogger> logger;
+
+  DataDetails dataDetails{DataDetails::exampleConfig()};
+  dataDetails.shape = { 4, 1, 1 };
+  dataDetails.classLabels = { "a", "b" };
+
+  const size_t numSamples = 23;
+
+  auto loadSamples = [&]() {
+    std::vector<Sample> samples;
+    for (size_t i = 0; i < numSamples; ++i) {
+      netfloat_t x = static_cast<netfloat_t>(i) / numSamples;
+      samples.emplace_back(i % 2 == 0 ? 0 : 1, Array3({{{ x, 1.f - x, x * x, 0.5f }}}));
+    }
+    return samples;
+  };
+
+  auto createDataSet = [&]() {
+    auto dataSet = std::make_unique<NiceMock<MockLabelledDataSet>>(
+      std::make_unique<MockDataLoader>(), dataDetails.classLabels);
+
+    EXPECT_CALL(*dataSet, loadSamples)
+      .WillOnce(loadSamples)
+      .WillRepeatedly([]() { return std::vector<Sample>{}; });
+
+    return dataSet;
+  };
+
+  auto createConfig = [&](size_t threads) {
+    Config config;
+    config.setObject("network", Config::fromJson(networkString));
+    config.setNumber("testBatchSize", 3);
+    config.setNumber("testThreads", threads);
+    return config;
+  };
+
+  std::stringstream stream;
+  {
+    Classifier classifier(dataDetails, createConfig(1), *eventSystem, fileSystem, platformPaths,
+      logger, false);
+
+    auto trainingData = createDataSet();
+    classifier.train(*trainingData);
+    classifier.writeToStream(stream);
+  }
+
+  std::string params = stream.str();
+
+  std::stringstream stream1(params);
+  Classifier classifier1(dataDetails, createConfig(1), stream1, *eventSystem, fileSystem,
+    platformPaths, logger, false);
+
+  std::stringstream stream4(params);
+  Classifier classifier4(dataDetails, createConfig(4), stream4, *eventSystem, fileSystem,
+    platformPaths, logger, false);
+
+  auto testData1 = createDataSet();
+  Classifier::Results results1 = classifier1.test(*testData1);
+
+  auto testData4 = createDataSet();
+  Classifier::Results results4 = classifier4.test(*testData4);
+
+  ASSERT_EQ(results1.guesses.size(), numSamples);
+  ASSERT_EQ(results4.guesses, results1.guesses);
+  ASSERT_EQ(results4.good, results1.good);
+  ASSERT_EQ(results4.bad, results1.bad);
+  ASSERT_FLOAT_EQ(results4.cost, results1.cost);
+}
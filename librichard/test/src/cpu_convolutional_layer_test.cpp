@@ -218,3 +218,318 @@ TEST_F(CpuConvolutionalLayerTest, updateDelta_inputDepth1_depth2) {
   // TODO
 }
 
+
+TEST_F(CpuConvolutionalLayerTest, batchMatchesSingleSamples) {
+  Config config;
+  config.setNumber("depth", 2);
+  config.setNumberArray<size_t>("kernelSize", { 2, 2 });
+  config.setNumber("learnRate", 1.0);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  ConvolutionalLayer::Filter filter0;
+  filter0.K = Kernel({{
+    { 5, 3 },
+    { 1, 2 }
+  }});
+  filter0.b = 7;
+
+  ConvolutionalLayer::Filter filter1;
+  filter1.K = Kernel({{
+    { 8, 4 },
+    { 5, 3 }
+  }});
+  filter1.b = -40;
+
+  ConvolutionalLayer single(config, { 3, 3, 1 });
+  single.test_setFilters({ filter0, filter1 });
+
+  ConvolutionalLayer batched(config, { 3, 3, 1 });
+  batched.test_setFilters({ filter0, filter1 });
+
+  Matrix X({
+    { 0, 1, 2, 5, 6, 7, 8, 7, 6 },
+    { 3, 1, 4, 1, 5, 9, 2, 6, 5 }
+  });
+
+  Matrix dA({
+    { 1, 2, 3, 4, 5, 6, 7, 8 },
+    { 8, 7, 6, 5, 4, 3, 2, 1 }
+  });
+
+  batched.trainForwardBatch(X);
+  batched.updateDeltasBatch(X, dA);
+
+  for (size_t i = 0; i < X.rows(); ++i) {
+    Vector x(*X.slice(i));
+    Vector d(*dA.slice(i));
+
+    single.trainForward(x.storage());
+    single.updateDeltas(x.storage(), d.storage());
+
+    ASSERT_EQ(Vector(single.activations()), *batched.batchActivations().slice(i));
+    ASSERT_EQ(Vector(single.inputDelta()), *batched.batchInputDelta().slice(i));
+  }
+
+  auto singleDeltas = single.test_filterDeltas();
+  auto batchedDeltas = batched.test_filterDeltas();
+
+  for (size_t i = 0; i < singleDeltas.size(); ++i) {
+    ASSERT_EQ(singleDeltas[i].K, batchedDeltas[i].K);
+    ASSERT_EQ(singleDeltas[i].b, batchedDeltas[i].b);
+  }
+}
+
+TEST_F(CpuConvolutionalLayerTest, batchMatchesSingleSamples_3x3Kernel) {
+  Config config;
+  config.setNumber("depth", 2);
+  config.setNumberArray<size_t>("kernelSize", { 3, 3 });
+  config.setNumber("learnRate", 1.0);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  // Small integers keep every path exact, whatever order it sums in
+  std::vector<ConvolutionalLayer::Filter> filters(2);
+  for (size_t f = 0; f < filters.size(); ++f) {
+    filters[f].K = Kernel(3, 3, 2);
+    for (size_t i = 0; i < filters[f].K.size(); ++i) {
+      filters[f].K.data()[i] = static_cast<netfloat_t>((i * 7 + f * 3) % 5) - 2.f;
+    }
+    filters[f].b = static_cast<netfloat_t>(f) + 1.f;
+  }
+
+  ConvolutionalLayer single(config, { 4, 5, 2 });
+  single.test_setFilters(filters);
+
+  ConvolutionalLayer batched(config, { 4, 5, 2 });
+  batched.test_setFilters(filters);
+
+  Matrix X(4 * 5 * 2, 3);
+  for (size_t i = 0; i < X.size(); ++i) {
+    X.data()[i] = static_cast<netfloat_t>((i * 5) % 9);
+  }
+
+  Matrix dA(2 * 3 * 2, 3);
+  for (size_t i = 0; i < dA.size(); ++i) {
+    dA.data()[i] = static_cast<netfloat_t>((i * 3) % 7) - 3.f;
+  }
+
+  batched.trainForwardBatch(X);
+  batched.updateDeltasBatch(X, dA);
+
+  for (size_t i = 0; i < X.rows(); ++i) {
+    Vector x(*X.slice(i));
+    Vector d(*dA.slice(i));
+
+    single.trainForward(x.storage());
+    single.updateDeltas(x.storage(), d.storage());
+
+    ASSERT_EQ(Vector(single.activations()), *batched.batchActivations().slice(i));
+    ASSERT_EQ(Vector(single.inputDelta()), *batched.batchInputDelta().slice(i));
+  }
+
+  auto singleDeltas = single.test_filterDeltas();
+  auto batchedDeltas = batched.test_filterDeltas();
+
+  for (size_t i = 0; i < singleDeltas.size(); ++i) {
+    ASSERT_EQ(singleDeltas[i].K, batchedDeltas[i].K);
+    ASSERT_EQ(singleDeltas[i].b, batchedDeltas[i].b);
+  }
+}
+
+TEST_F(CpuConvolutionalLayerTest, updateDelta_matchesDirectConvolution) {
+  Config config;
+  config.setNumber("depth", 2);
+  config.setNumberArray<size_t>("kernelSize", { 2, 3 });
+  config.setNumber("learnRate", 1.0);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  ConvolutionalLayer layer(config, { 4, 5, 2 });
+
+  std::vector<ConvolutionalLayer::Filter> filters(2);
+  for (auto& filter : filters) {
+    filter.K = Kernel(2, 3, 2);
+    filter.K.randomize(1.f);
+    filter.b = 1.f;
+  }
+  layer.test_setFilters(filters);
+
+  // The biases keep every Z positive, so reluPrime is 1 throughout
+  Array3 inputs(4, 5, 2);
+  inputs.fill(0.5f);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    inputs.data()[i] += 0.01f * static_cast<netfloat_t>(i % 7);
+  }
+  for (auto& filter : filters) {
+    filter.K.transformInPlace([](netfloat_t x) { return std::abs(x) * 0.1f; });
+  }
+  layer.test_setFilters(filters);
+
+  Array3 deltaA(3, 3, 2);
+  deltaA.randomize(1.f);
+
+  layer.trainForward(inputs.storage());
+  layer.updateDeltas(inputs.storage(), deltaA.storage());
+
+  Array3 expectedInputDelta(4, 5, 2);
+  Array2 dInputDelta(4, 5);
+  Array2 dDeltaK(2, 3);
+
+  auto deltas = layer.test_filterDeltas();
+
+  for (size_t slice = 0; slice < filters.size(); ++slice) {
+    ConstArray2View delta = deltaA.slice(slice);
+
+    for (size_t z = 0; z < 2; ++z) {
+      computeFullConvolution(*filters[slice].K.slice(z), *delta, dInputDelta);
+      *expectedInputDelta.slice(z) += dInputDelta;
+
+      computeCrossCorrelation(*inputs.slice(z), *delta, dDeltaK);
+      ConstArray2View deltaK = deltas[slice].K.slice(z);
+
+      for (size_t i = 0; i < dDeltaK.size(); ++i) {
+        ASSERT_NEAR(deltaK->data()[i], dDeltaK.data()[i], 0.0001f);
+      }
+    }
+
+    ASSERT_NEAR(deltas[slice].b, delta->sum(), 0.0001f);
+  }
+
+  Array3 inputDelta(layer.inputDelta(), 4, 5, 2);
+  for (size_t i = 0; i < inputDelta.size(); ++i) {
+    ASSERT_NEAR(inputDelta.data()[i], expectedInputDelta.data()[i], 0.0001f);
+  }
+}
+
+TEST_F(CpuConvolutionalLayerTest, forwardPass_3x3KernelsMatchDirectCorrelation) {
+  Config config;
+  config.setNumber("depth", 3);
+  config.setNumberArray<size_t>("kernelSize", { 3, 3 });
+  config.setNumber("learnRate", 1.0);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  ConvolutionalLayer layer(config, { 7, 6, 2 });
+
+  std::vector<ConvolutionalLayer::Filter> filters(3);
+  for (auto& filter : filters) {
+    filter.K = Kernel(3, 3, 2);
+    filter.K.randomize(1.f);
+    filter.b = 0.5f;
+  }
+  layer.test_setFilters(filters);
+
+  Array3 inputs(7, 6, 2);
+  inputs.randomize(1.f);
+
+  layer.trainForward(inputs.storage());
+
+  Array3 A(layer.activations(), 5, 4, 3);
+  Array3 evalA(layer.evalForward(inputs.storage()), 5, 4, 3);
+
+  for (size_t slice = 0; slice < filters.size(); ++slice) {
+    Array2 expected(5, 4);
+    computeCrossCorrelation(inputs, filters[slice].K, expected);
+    expected += filters[slice].b;
+    expected = expected.computeTransform(relu);
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_NEAR(A.slice(slice)->data()[i], expected.data()[i], 0.0001f);
+      ASSERT_NEAR(evalA.slice(slice)->data()[i], expected.data()[i], 0.0001f);
+    }
+  }
+}
+
+TEST_F(CpuConvolutionalLayerTest, evalForwardQuantized) {
+  Config config;
+  config.setNumber("depth", 3);
+  config.setNumberArray<size_t>("kernelSize", { 3, 2 });
+  config.setNumber("learnRate", 1.0);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  ConvolutionalLayer layer(config, { 7, 6, 2 });
+
+  std::vector<ConvolutionalLayer::Filter> filters(3);
+  for (auto& filter : filters) {
+    filter.K = Kernel(3, 2, 2);
+    filter.K.randomize(1.f);
+    filter.b = 0.5f;
+  }
+  layer.test_setFilters(filters);
+
+  Array3 inputs(7, 6, 2);
+  inputs.randomize(1.f);
+
+  Array3 expected(layer.evalForward(inputs.storage()), 5, 5, 3);
+
+  layer.calibrate(inputs.storage());
+  layer.quantize();
+
+  Array3 A(layer.evalForward(inputs.storage()), 5, 5, 3);
+
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_NEAR(A.data()[i], expected.data()[i], 0.1f);
+  }
+}
+
+TEST_F(CpuConvolutionalLayerTest, largeKernelsMatchDirectConvolution) {
+  const size_t W = 128;
+  const size_t H = 128;
+  const size_t k = 31;
+  const size_t fmW = W - k + 1;
+  const size_t fmH = H - k + 1;
+
+  // Large enough for the layer to take the frequency-domain path both ways
+  ASSERT_TRUE(fftCorrelationIsCheaper(W, H, 1, k, k, 2, false));
+  ASSERT_TRUE(fftCorrelationIsCheaper(fmW, fmH, 2, k, k, 1, true));
+
+  Config config;
+  config.setNumber("depth", 2);
+  config.setNumberArray<size_t>("kernelSize", { k, k });
+  config.setNumber("learnRate", 1.0);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  ConvolutionalLayer layer(config, { W, H, 1 });
+
+  std::vector<ConvolutionalLayer::Filter> filters(2);
+  for (auto& filter : filters) {
+    filter.K = Kernel(k, k, 1);
+    filter.K.randomize(0.1f);
+    filter.b = 0.f;
+  }
+  layer.test_setFilters(filters);
+
+  Array3 inputs(W, H, 1);
+  inputs.randomize(1.f);
+
+  Array3 deltaA(fmW, fmH, 2);
+  deltaA.randomize(1.f);
+
+  layer.trainForward(inputs.storage());
+  layer.updateDeltas(inputs.storage(), deltaA.storage());
+
+  Array3 A(layer.activations(), fmW, fmH, 2);
+  Array3 inputDelta(layer.inputDelta(), W, H, 1);
+  Array2 expectedInputDelta(W, H);
+
+  for (size_t slice = 0; slice < filters.size(); ++slice) {
+    Array2 Z(fmW, fmH);
+    computeCrossCorrelation(inputs, filters[slice].K, Z);
+
+    Array2 delta = deltaA.slice(slice)->hadamard(Z.computeTransform(reluPrime));
+    Array2 dInputDelta(W, H);
+    computeFullConvolution(*filters[slice].K.slice(0), delta, dInputDelta);
+    expectedInputDelta += dInputDelta;
+
+    for (size_t i = 0; i < Z.size(); ++i) {
+      ASSERT_NEAR(A.slice(slice)->data()[i], relu(Z.data()[i]), 0.001f);
+    }
+  }
+
+  for (size_t i = 0; i < expectedInputDelta.size(); ++i) {
+    ASSERT_NEAR(inputDelta.data()[i], expectedInputDelta.data()[i], 0.001f);
+  }
+}
@@ -2,6 +2,7 @@
 #include <richard/config.hpp>
 #include <richard/cpu/dense_layer.hpp>
 #include <gtest/gtest.h>
+#include <sstream>
 
 using namespace richard;
 using namespace richard::cpu;
@@ -45,6 +46,167 @@ TEST_F(CpuDenseLayerTest, evalForward) {
   ASSERT_EQ(Y, Vector({ (3*2+4*1+2*3+5)*2, (3*1+4*4+2*2+7)*2 }));
 }
 
+TEST_F(CpuDenseLayerTest, evalForwardAtReducedPrecision) {
+  Matrix W({
+    { 0.25f, -1.5f, 3.f },
+    { 1.f, 0.125f, -2.f }
+  });
+
+  Vector B({ 0.5f, -0.75f });
+  Vector X({ 0.3f, 0.4f, 0.2f });
+
+  Vector expected;
+  for (const char* precision : { "float32", "float16", "bfloat16" }) {
+    Config config;
+    config.setNumber("size", 2);
+    config.setNumber("learnRate", 0.5);
+    config.setNumber("learnRateDecay", 1.0);
+    config.setNumber("dropoutRate", 0.0);
+    config.setString("inferencePrecision", precision);
+
+    DenseLayer layer(config, 3);
+    layer.test_setWeights(W.storage());
+    layer.test_setBiases(B.storage());
+
+    Vector Y(layer.evalForward(X.storage()));
+
+    // Every weight is exactly representable in each format
+    if (expected.size() == 0) {
+      expected = Y;
+    }
+    for (size_t i = 0; i < Y.size(); ++i) {
+      ASSERT_NEAR(Y[i], expected[i], 1e-6f) << precision;
+    }
+  }
+}
+
+TEST_F(CpuDenseLayerTest, evalForwardAfterUpdateRequiresFinishTraining) {
+  Config config;
+  config.setNumber("size", 2);
+  config.setNumber("learnRate", 0.5);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+  config.setString("inferencePrecision", "float16");
+
+  Matrix W({
+    { 0.25f, -1.5f, 3.f },
+    { 1.f, 0.125f, -2.f }
+  });
+
+  Vector B({ 0.5f, -0.75f });
+  Vector X({ 0.5f, 0.25f, 1.f });
+  Vector dA({ 1.f, -1.f });
+
+  DenseLayer layer(config, 3);
+  layer.test_setWeights(W.storage());
+  layer.test_setBiases(B.storage());
+
+  Vector before(layer.evalForward(X.storage()));
+
+  layer.trainForward(X.storage());
+  layer.updateDeltas(X.storage(), dA.storage());
+  layer.updateParams(0);
+
+  // The packed float16 weights still hold W from before the update
+  ASSERT_THROW(layer.evalForward(X.storage()), Exception);
+
+  layer.finishTraining();
+
+  Vector after(layer.evalForward(X.storage()));
+  ASSERT_NE(after, before);
+}
+
+TEST_F(CpuDenseLayerTest, evalForwardQuantized) {
+  Config config;
+  config.setNumber("size", 2);
+  config.setNumber("learnRate", 0.5);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  Matrix W({
+    { 0.25f, -1.5f, 3.f },
+    { 1.f, 0.125f, -2.f }
+  });
+
+  Vector B({ 0.5f, -0.75f });
+  Vector X({ 0.3f, 0.4f, 0.2f });
+
+  DenseLayer layer(config, 3);
+  layer.test_setWeights(W.storage());
+  layer.test_setBiases(B.storage());
+
+  Vector expected(layer.evalForward(X.storage()));
+
+  layer.calibrate(X.storage());
+  layer.quantize();
+
+  Vector Y(layer.evalForward(X.storage()));
+
+  ASSERT_EQ(Y.size(), expected.size());
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(Y[i], expected[i], 0.01f);
+  }
+
+  // The float32 weights used in training are untouched
+  ASSERT_EQ(layer.test_W(), W);
+}
+
+TEST_F(CpuDenseLayerTest, pruneStoresSparseWeights) {
+  Config pruning;
+  pruning.setNumber("sparsity", 0.5);
+
+  Config config;
+  config.setNumber("size", 2);
+  config.setNumber("learnRate", 0.5);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+  config.setObject("pruning", pruning);
+
+  Matrix W({
+    { 0.25f, -1.5f, 3.f },
+    { 1.f, 0.125f, -2.f }
+  });
+
+  Vector B({ 0.5f, -0.75f });
+  Vector X({ 0.3f, 0.4f, 0.2f });
+
+  DenseLayer layer(config, 3);
+  layer.test_setWeights(W.storage());
+  layer.test_setBiases(B.storage());
+  layer.prune();
+
+  Matrix pruned({
+    { 0.f, -1.5f, 3.f },
+    { 0.f, 0.f, -2.f }
+  });
+
+  ASSERT_EQ(layer.test_W(), pruned);
+
+  Vector expected(2);
+  gemv(pruned, X, B, expected, expected, [](const netfloat_t* Z, netfloat_t* A, size_t n) {
+    Sigmoid::apply(Z, A, n);
+  });
+
+  Vector Y(layer.evalForward(X.storage()));
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(Y[i], expected[i], 1e-6f);
+  }
+
+  std::stringstream stream;
+  layer.writeToStream(stream);
+
+  // Biases, row offsets, then a column index and value per remaining weight
+  ASSERT_EQ(stream.str().size(), 2 * sizeof(netfloat_t) + 3 * sizeof(uint32_t) + 3 * 8);
+
+  DenseLayer loaded(config, stream, 3);
+  ASSERT_EQ(loaded.test_W(), pruned);
+
+  Vector loadedY(loaded.evalForward(X.storage()));
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(loadedY[i], expected[i], 1e-6f);
+  }
+}
+
 TEST_F(CpuDenseLayerTest, trainForward) {
   Config config;
   config.setNumber("size", 2);
@@ -76,7 +238,7 @@ TEST_F(CpuDenseLayerTest, trainForward) {
   
   layer.trainForward(X.storage());
 
-  ConstVectorPtr pA = Vector::createShallow(layer.activations());
+  ConstVectorView pA = Vector::createShallow(layer.activations());
   const Vector& A = *pA;
 
   Vector expectedZ({ 3*2+4*1+2*3+5, 3*1+4*4+2*2+7 });
@@ -124,7 +286,137 @@ TEST_F(CpuDenseLayerTest, updateDelta) {
 
   layer.updateDeltas(X.storage(), dA.storage());
 
-  ConstVectorPtr dInputs = Vector::createShallow(layer.inputDelta());
+  ConstVectorView dInputs = Vector::createShallow(layer.inputDelta());
 
   ASSERT_EQ(*dInputs, expectedDeltaInputs);
 }
+
+TEST_F(CpuDenseLayerTest, batchMatchesSingleSamples) {
+  Config config;
+  config.setNumber("size", 2);
+  config.setNumber("learnRate", 0.5);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  Matrix W({
+    { 0.2f, 0.1f, 0.3f },
+    { 0.1f, 0.4f, 0.2f }
+  });
+
+  Vector B({ 0.5f, 0.7f });
+
+  DenseLayer single(config, 3);
+  single.test_setWeights(W.storage());
+  single.test_setBiases(B.storage());
+
+  DenseLayer batched(config, 3);
+  batched.test_setWeights(W.storage());
+  batched.test_setBiases(B.storage());
+
+  Matrix X({
+    { 3, 4, 2 },
+    { 1, 0, 5 },
+    { 2, 2, 7 }
+  });
+
+  Matrix dA({
+    { 2, 3 },
+    { 1, 4 },
+    { 5, 1 }
+  });
+
+  batched.trainForwardBatch(X);
+  batched.updateDeltasBatch(X, dA);
+
+  for (size_t i = 0; i < X.rows(); ++i) {
+    Vector x(*X.slice(i));
+    Vector d(*dA.slice(i));
+
+    single.trainForward(x.storage());
+    single.updateDeltas(x.storage(), d.storage());
+
+    ConstVectorView A = Vector::createShallow(single.activations());
+    ConstVectorView dX = Vector::createShallow(single.inputDelta());
+
+    for (size_t j = 0; j < A->size(); ++j) {
+      ASSERT_FLOAT_EQ((*A)[j], batched.batchActivations().at(j, i));
+    }
+    for (size_t j = 0; j < dX->size(); ++j) {
+      ASSERT_FLOAT_EQ((*dX)[j], batched.batchInputDelta().at(j, i));
+    }
+  }
+
+  for (size_t j = 0; j < W.rows(); ++j) {
+    ASSERT_FLOAT_EQ(single.test_deltaB()[j], batched.test_deltaB()[j]);
+    for (size_t i = 0; i < W.cols(); ++i) {
+      ASSERT_FLOAT_EQ(single.test_deltaW().at(i, j), batched.test_deltaW().at(i, j));
+    }
+  }
+}
+
+TEST_F(CpuDenseLayerTest, sparseBatchesMatchSingleSamples) {
+  Config config;
+  config.setNumber("size", 3);
+  config.setNumber("learnRate", 0.5);
+  config.setNumber("learnRateDecay", 1.0);
+  config.setNumber("dropoutRate", 0.0);
+
+  Matrix W(8, 3);
+  W.randomize(1.f);
+  Vector B(3);
+  B.randomize(1.f);
+
+  DenseLayer single(config, 8);
+  single.test_setWeights(W.storage());
+  single.test_setBiases(B.storage());
+
+  DenseLayer batched(config, 8);
+  batched.test_setWeights(W.storage());
+  batched.test_setBiases(B.storage());
+
+  Matrix sparseX({
+    { 0, 0, 0.5f, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0.25f },
+    { 0, 0.75f, 0, 0, 0, 0, 0, 0 }
+  });
+
+  Matrix denseX(8, 3);
+  denseX.randomize(1.f);
+
+  Matrix dA({
+    { 2, 3, -1 },
+    { 1, -4, 2 },
+    { 5, 1, 3 }
+  });
+
+  // The first batch takes the dense path, and the W^T used by the sparse path has to be kept in
+  // step with W through sparse and dense updates
+  std::vector<const Matrix*> batches{ &sparseX, &sparseX, &denseX, &sparseX, &sparseX };
+
+  for (const Matrix* pX : batches) {
+    const Matrix& X = *pX;
+
+    batched.trainForwardBatch(X);
+    batched.updateDeltasBatch(X, dA);
+
+    for (size_t i = 0; i < X.rows(); ++i) {
+      Vector x(*X.slice(i));
+      Vector d(*dA.slice(i));
+
+      single.trainForward(x.storage());
+      single.updateDeltas(x.storage(), d.storage());
+
+      ConstVectorView A = Vector::createShallow(single.activations());
+      for (size_t j = 0; j < A->size(); ++j) {
+        ASSERT_NEAR((*A)[j], batched.batchActivations().at(j, i), 1e-6f);
+      }
+    }
+
+    single.updateParams(0);
+    batched.updateParams(0);
+
+    for (size_t i = 0; i < W.size(); ++i) {
+      ASSERT_NEAR(single.test_W().data()[i], batched.test_W().data()[i], 1e-5f);
+    }
+  }
+}
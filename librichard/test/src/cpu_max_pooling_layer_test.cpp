@@ -234,7 +234,7 @@ TEST_F(CpuMaxPoolingLayerTest, updateDeltas_depth1) {
 
   const DataArray& paddedDelta = layer.inputDelta();
 
-  ConstArray3Ptr pPadded = Array3::createShallow(paddedDelta, 4, 4, 1);
+  ConstArray3View pPadded = Array3::createShallow(paddedDelta, 4, 4, 1);
 
   ASSERT_EQ(*pPadded, Array3({{
     { 0, 0, 0, 8 },
@@ -283,7 +283,7 @@ TEST_F(CpuMaxPoolingLayerTest, updateDeltas_depth2) {
 
   const DataArray& paddedDelta = layer.inputDelta();
 
-  ConstArray3Ptr pPadded = Array3::createShallow(paddedDelta, 4, 4, 2);
+  ConstArray3View pPadded = Array3::createShallow(paddedDelta, 4, 4, 2);
 
   ASSERT_EQ(*pPadded, Array3({
     {
@@ -5,6 +5,7 @@
 #include <richard/cpu/output_layer.hpp>
 #include <richard/cpu/convolutional_layer.hpp>
 #include <richard/event_system.hpp>
+#include <richard/utils.hpp>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
@@ -56,13 +57,17 @@ TEST_F(CpuNeuralNetTest, evaluate) {
   Config config = Config::fromJson(configString);
   CpuNeuralNetPtr net = createNeuralNet(inputShape, config, *eventSystem);
 
-  std::vector<Sample> samples{Sample{"a", Array3({{{ 0.5f, 0.3f, 0.7f }}})}};
+  auto loadSamples = []() {
+    std::vector<Sample> samples;
+    samples.emplace_back(0, Array3({{{ 0.5f, 0.3f, 0.7f }}}));
+    return samples;
+  };
 
   DataLoaderPtr dataLoader = std::make_unique<MockDataLoader>();
   testing::NiceMock<MockLabelledDataSet> dataSet(std::move(dataLoader),
     std::vector<std::string>({ "a", "b" }));
 
-  ON_CALL(dataSet, loadSamples).WillByDefault(testing::Return(samples));
+  ON_CALL(dataSet, loadSamples).WillByDefault(loadSamples);
 
   Matrix W0({
     { 0.2f, 0.3f, 0.4f },
@@ -167,16 +172,20 @@ TEST_F(CpuNeuralNetTest, evaluateTrivialConvVsFullyConnected) {
   CpuNeuralNetPtr denseNet = createNeuralNet(inputShape, Config::fromJson(denseNetConfigString),
     *eventSystem);
 
-  std::vector<Sample> samples{Sample{"a", Array3{{
-    { 0.5f, 0.4f },
-    { 0.7f, 0.6f },
-   }}}};
+  auto loadSamples = []() {
+    std::vector<Sample> samples;
+    samples.emplace_back(0, Array3{{
+      { 0.5f, 0.4f },
+      { 0.7f, 0.6f },
+     }});
+    return samples;
+  };
 
   DataLoaderPtr dataLoader = std::make_unique<MockDataLoader>();
   testing::NiceMock<MockLabelledDataSet> dataSet(std::move(dataLoader),
     std::vector<std::string>({ "a", "b" }));
 
-  ON_CALL(dataSet, loadSamples).WillByDefault(testing::Return(samples));
+  ON_CALL(dataSet, loadSamples).WillByDefault(loadSamples);
 
   ConvolutionalLayer::Filter filter;
   filter.K = Kernel({
@@ -251,19 +260,23 @@ TEST_F(CpuNeuralNetTest, evaluateConv) {
   Config config = Config::fromJson(configString);
   CpuNeuralNetPtr net = createNeuralNet(inputShape, config, *eventSystem);
 
-  std::vector<Sample> samples{Sample{"a", Array3{{
-    { 0.5f, 0.4f, 0.3f, 0.9f, 0.8f },
-    { 0.7f, 0.6f, 0.9f, 0.2f, 0.5f },
-    { 0.5f, 0.5f, 0.1f, 0.6f, 0.3f },
-    { 0.4f, 0.1f, 0.8f, 0.2f, 0.7f },
-    { 0.2f, 0.3f, 0.7f, 0.1f, 0.4f }
-   }}}};
+  auto loadSamples = []() {
+    std::vector<Sample> samples;
+    samples.emplace_back(0, Array3{{
+      { 0.5f, 0.4f, 0.3f, 0.9f, 0.8f },
+      { 0.7f, 0.6f, 0.9f, 0.2f, 0.5f },
+      { 0.5f, 0.5f, 0.1f, 0.6f, 0.3f },
+      { 0.4f, 0.1f, 0.8f, 0.2f, 0.7f },
+      { 0.2f, 0.3f, 0.7f, 0.1f, 0.4f }
+     }});
+    return samples;
+  };
 
   DataLoaderPtr dataLoader = std::make_unique<MockDataLoader>();
   testing::NiceMock<MockLabelledDataSet> dataSet(std::move(dataLoader),
     std::vector<std::string>({ "a", "b" }));
 
-  ON_CALL(dataSet, loadSamples).WillByDefault(testing::Return(samples));
+  ON_CALL(dataSet, loadSamples).WillByDefault(loadSamples);
 
   ConvolutionalLayer::Filter filter0;
   filter0.K = Kernel({
@@ -298,3 +311,216 @@ TEST_F(CpuNeuralNetTest, evaluateConv) {
   // TODO: Add some assertions
 }
 
+TEST_F(CpuNeuralNetTest, evaluateIntoMatchesLayerByLayerEvaluation) {
+  const std::string configString =       ""
+  "{                                      "
+  "  \"hyperparams\": {                   "
+  "      \"epochs\": 1,                   "
+  "      \"batchSize\": 1,                "
+  "      \"miniBatchSize\": 1             "
+  "  },                                   "
+  "  \"hiddenLayers\": [                  "
+  "      {                                "
+  "          \"type\": \"convolutional\", "
+  "          \"depth\": 3,                "
+  "          \"kernelSize\": [3, 3],      "
+  "          \"learnRate\": 0.1,          "
+  "          \"learnRateDecay\": 1.0,     "
+  "          \"dropoutRate\": 0.0         "
+  "      },                               "
+  "      {                                "
+  "          \"type\": \"maxPooling\",    "
+  "          \"regionSize\": [2, 2]       "
+  "      },                               "
+  "      {                                "
+  "          \"type\": \"dense\",         "
+  "          \"size\": 7,                 "
+  "          \"learnRate\": 0.1,          "
+  "          \"learnRateDecay\": 1.0,     "
+  "          \"dropoutRate\": 0.0         "
+  "      }                                "
+  "  ],                                   "
+  "  \"outputLayer\": {                   "
+  "      \"size\": 4,                     "
+  "      \"learnRate\": 0.1,              "
+  "      \"learnRateDecay\": 1.0          "
+  "  }                                    "
+  "}                                      ";
+
+  Size3 inputShape({ 10, 10, 1 });
+
+  auto eventSystem = createEventSystem();
+
+  Config config = Config::fromJson(configString);
+  CpuNeuralNetPtr net = createNeuralNet(inputShape, config, *eventSystem);
+
+  Array3 X(10, 10, 1);
+  for (size_t i = 0; i < X.size(); ++i) {
+    X.data()[i] = static_cast<netfloat_t>(i % 7) / 7.f;
+  }
+
+  DataArray A = X.storage();
+  for (size_t i = 0; i < 4; ++i) {
+    A = net->test_getLayer(i).evalForward(A);
+  }
+
+  Vector y(4);
+  net->evaluateInto(X, y);
+  ASSERT_EQ(y, Vector(A));
+
+  // Buffers are reused between calls
+  net->evaluateInto(X, y);
+  ASSERT_EQ(y, Vector(A));
+  ASSERT_EQ(net->evaluate(X), Vector(A));
+
+  Vector wrongSize(3);
+  ASSERT_ANY_THROW(net->evaluateInto(X, wrongSize));
+}
+
+TEST_F(CpuNeuralNetTest, evaluateBatchMatchesEvaluate) {
+  const std::string configString =       ""
+  "{                                      "
+  "  \"hyperparams\": {                   "
+  "      \"epochs\": 1,                   "
+  "      \"batchSize\": 1,                "
+  "      \"miniBatchSize\": 1             "
+  "  },                                   "
+  "  \"hiddenLayers\": [                  "
+  "      {                                "
+  "          \"type\": \"convolutional\", "
+  "          \"depth\": 2,                "
+  "          \"kernelSize\": [3, 3],      "
+  "          \"learnRate\": 0.1,          "
+  "          \"learnRateDecay\": 1.0,     "
+  "          \"dropoutRate\": 0.0         "
+  "      },                               "
+  "      {                                "
+  "          \"type\": \"maxPooling\",    "
+  "          \"regionSize\": [2, 2]       "
+  "      },                               "
+  "      {                                "
+  "          \"type\": \"dense\",         "
+  "          \"size\": 9,                 "
+  "          \"learnRate\": 0.1,          "
+  "          \"learnRateDecay\": 1.0,     "
+  "          \"dropoutRate\": 0.0         "
+  "      }                                "
+  "  ],                                   "
+  "  \"outputLayer\": {                   "
+  "      \"size\": 3,                     "
+  "      \"learnRate\": 0.1,              "
+  "      \"learnRateDecay\": 1.0          "
+  "  }                                    "
+  "}                                      ";
+
+  Size3 inputShape({ 8, 8, 1 });
+
+  auto eventSystem = createEventSystem();
+
+  Config config = Config::fromJson(configString);
+  CpuNeuralNetPtr net = createNeuralNet(inputShape, config, *eventSystem);
+
+  // Enough samples for dense layers to multiply the whole batch at once
+  const size_t numSamples = 40;
+  Matrix X(64, numSamples);
+  for (size_t i = 0; i < X.size(); ++i) {
+    X.data()[i] = static_cast<netfloat_t>((i * 7) % 11) / 11.f;
+  }
+
+  Matrix Y = net->evaluateBatch(X);
+  ASSERT_EQ(Y.cols(), 3);
+  ASSERT_EQ(Y.rows(), numSamples);
+
+  for (size_t i = 0; i < numSamples; ++i) {
+    Array3 x(8, 8, 1);
+    std::copy(X.data() + i * 64, X.data() + (i + 1) * 64, x.data());
+
+    Vector y = net->evaluate(x);
+    for (size_t j = 0; j < y.size(); ++j) {
+      ASSERT_NEAR(Y.at(j, i), y[j], 1e-5f);
+    }
+  }
+}
+
+
+TEST_F(CpuNeuralNetTest, multiThreadedTrainingMatchesSingleThreaded) {
+  auto configString = [](int threads) {
+    return STR(""
+    "{                                    "
+    "  \"hyperparams\": {                 "
+    "      \"epochs\": 2,                 "
+    "      \"batchSize\": 6,              "
+    "      \"miniBatchSize\": 3,          "
+    "      \"threads\": " << threads << "  "
+    "  },                                 "
+    "  \"hiddenLayers\": [                "
+    "      {                              "
+    "          \"type\": \"dense\",       "
+    "          \"size\": 4,               "
+    "          \"learnRate\": 0.1,        "
+    "          \"learnRateDecay\": 1.0,   "
+    "          \"dropoutRate\": 0.0       "
+    "      }                              "
+    "  ],                                 "
+    "  \"outputLayer\": {                 "
+    "      \"size\": 2,                   "
+    "      \"learnRate\": 0.1,            "
+    "      \"learnRateDecay\": 1.0        "
+    "  }                                  "
+    "}                                    ");
+  };
+
+  Size3 inputShape({ 3, 1, 1 });
+
+  auto eventSystem = createEventSystem();
+
+  auto loadSamples = []() {
+    std::vector<Sample> samples;
+    samples.emplace_back(0, Array3({{{ 0.5f, 0.3f, 0.7f }}}));
+    samples.emplace_back(1, Array3({{{ 0.1f, 0.9f, 0.2f }}}));
+    samples.emplace_back(0, Array3({{{ 0.8f, 0.4f, 0.6f }}}));
+    samples.emplace_back(1, Array3({{{ 0.3f, 0.2f, 0.1f }}}));
+    return samples;
+  };
+
+  DataLoaderPtr dataLoader = std::make_unique<MockDataLoader>();
+  testing::NiceMock<MockLabelledDataSet> dataSet(std::move(dataLoader),
+    std::vector<std::string>({ "a", "b" }));
+
+  ON_CALL(dataSet, loadSamples).WillByDefault(loadSamples);
+
+  Matrix W0({
+    { 0.2f, 0.3f, 0.4f },
+    { 0.5f, 0.4f, 0.3f },
+    { 0.6f, 0.7f, 0.1f },
+    { 0.2f, 0.9f, 0.8f }
+  });
+
+  Matrix W1({
+    { 0.1f, 0.4f, 0.5f, 0.2f },
+    { 0.9f, 0.8f, 0.6f, 0.1f }
+  });
+
+  std::vector<CpuNeuralNetPtr> nets;
+  for (int threads : { 1, 3 }) {
+    nets.push_back(createNeuralNet(inputShape, Config::fromJson(configString(threads)),
+      *eventSystem));
+
+    dynamic_cast<DenseLayer&>(nets.back()->test_getLayer(0)).test_setWeights(W0.storage());
+    dynamic_cast<OutputLayer&>(nets.back()->test_getLayer(1)).test_setWeights(W1.storage());
+
+    nets.back()->train(dataSet);
+  }
+
+  const Matrix& expected = dynamic_cast<DenseLayer&>(nets[0]->test_getLayer(0)).test_W();
+  const Matrix& actual = dynamic_cast<DenseLayer&>(nets[1]->test_getLayer(0)).test_W();
+
+  for (size_t j = 0; j < expected.rows(); ++j) {
+    for (size_t i = 0; i < expected.cols(); ++i) {
+      ASSERT_NEAR(expected.at(i, j), actual.at(i, j), 0.0001f);
+    }
+  }
+
+  // Training has had an effect
+  ASSERT_NE(actual, W0);
+}
@@ -1,5 +1,6 @@
 #include <richard/csv_data_loader.hpp>
 #include <gtest/gtest.h>
+#include <sstream>
 
 using namespace richard;
 
@@ -16,13 +17,106 @@ TEST_F(CsvDataLoaderTest, loadSamples) {
   normalization.min = 0;
   normalization.max = 255;
 
-  CsvDataLoader loader(std::move(ss), 3, normalization, 1000);
+  CsvDataLoader loader(std::move(ss), 3, { "0", "1" }, normalization, 1000);
   std::vector<Sample> samples = loader.loadSamples();
 
   ASSERT_EQ(samples.size(), 1);
+  ASSERT_EQ(samples[0].classId, 1);
 
-  VectorPtr pX = Vector::createShallow(samples[0].data.storage());
+  Array3 X = samples[0].toArray3();
+  VectorView pX = Vector::createShallow(X.storage());
 
   ASSERT_EQ(*pX, Vector({ 0.f, 1.f, 128.f / 255.f }));
 }
 
+TEST_F(CsvDataLoaderTest, loadSamplesAcrossBlocksAndThreads) {
+  const size_t numSamples = 3000;
+  const size_t inputSize = 100;
+
+  // Over a megabyte, so lines straddle the blocks the file is read in
+  std::stringstream csv;
+  for (size_t i = 0; i < numSamples; ++i) {
+    csv << (i % 3 == 0 ? "cat" : "dog");
+    for (size_t j = 0; j < inputSize; ++j) {
+      csv << "," << (i * 7 + j * 13) % 256;
+    }
+    csv << (i % 2 == 0 ? "\n" : "\r\n");
+  }
+  std::string text = csv.str();
+  text.pop_back();
+
+  NormalizationParams normalization;
+  normalization.min = 0;
+  normalization.max = 255;
+
+  CsvDataLoader loader(std::make_unique<std::stringstream>(text), inputSize, { "cat", "dog" },
+    normalization, 700, 4);
+
+  for (size_t pass = 0; pass < 2; ++pass) {
+    size_t total = 0;
+    std::vector<Sample> samples = loader.loadSamples();
+
+    while (samples.size() > 0) {
+      ASSERT_LE(samples.size(), 700);
+
+      for (const auto& sample : samples) {
+        size_t i = total++;
+        ASSERT_EQ(sample.classId, i % 3 == 0 ? 0 : 1);
+        ASSERT_EQ(sample.size(), inputSize);
+
+        Array3 X = sample.toArray3();
+        for (size_t j = 0; j < inputSize; ++j) {
+          ASSERT_FLOAT_EQ(X.data()[j], ((i * 7 + j * 13) % 256) / 255.f);
+        }
+      }
+
+      samples = loader.loadSamples();
+    }
+
+    ASSERT_EQ(total, numSamples);
+    loader.seekToBeginning();
+  }
+}
+
+TEST_F(CsvDataLoaderTest, loadSamplesRejectsBadValues) {
+  NormalizationParams normalization;
+  normalization.min = 0;
+  normalization.max = 1;
+
+  CsvDataLoader badValue(std::make_unique<std::stringstream>("a,0.5,x,1\n"), 3, { "a" },
+    normalization, 10);
+  ASSERT_ANY_THROW(badValue.loadSamples());
+
+  CsvDataLoader tooLarge(std::make_unique<std::stringstream>("a,0.5,1,1,1\n"), 3, { "a" },
+    normalization, 10);
+  ASSERT_ANY_THROW(tooLarge.loadSamples());
+
+  CsvDataLoader badLabel(std::make_unique<std::stringstream>("b,0.5,1,1\n"), 3, { "a" },
+    normalization, 10);
+  ASSERT_ANY_THROW(badLabel.loadSamples());
+
+  CsvDataLoader trailingComma(std::make_unique<std::stringstream>("a,0.5,1,\n"), 3, { "a" },
+    normalization, 10);
+  ASSERT_ANY_THROW(trailingComma.loadSamples());
+
+  CsvDataLoader emptyField(std::make_unique<std::stringstream>("a,0.5,,1\n"), 3, { "a" },
+    normalization, 10);
+  ASSERT_ANY_THROW(emptyField.loadSamples());
+}
+
+TEST_F(CsvDataLoaderTest, loadSamplesParsesDecimals) {
+  NormalizationParams normalization;
+  normalization.min = 0;
+  normalization.max = 1;
+
+  CsvDataLoader loader(std::make_unique<std::stringstream>("a,0.5, 2e-1 ,-1.25,12\n"), 4,
+    { "a" }, normalization, 10);
+  std::vector<Sample> samples = loader.loadSamples();
+
+  ASSERT_EQ(samples.size(), 1);
+  ASSERT_EQ(samples[0].classId, 0);
+
+  Array3 X = samples[0].toArray3();
+  VectorView pX = Vector::createShallow(X.storage());
+  ASSERT_EQ(*pX, Vector({ 0.5f, 0.2f, -1.25f, 12.f }));
+}
@@ -279,7 +279,7 @@ TEST_F(GpuConvolutionalLayerTest, backprop) {
     expectedDeltaB);
 
   for (size_t d = 0; d < expectedDeltaK.size(); ++d) {
-    ConstKernelPtr pDeltaK = Kernel::createShallow(deltaKData.data() + d * kernelSize, 2, 2, 2);
+    ConstKernelView pDeltaK = Kernel::createShallow(deltaKData.data() + d * kernelSize, 2, 2, 2);
     const Kernel& deltaK = *pDeltaK;
 
     for (size_t k = 0; k < deltaK.D(); ++k) {
@@ -392,9 +392,9 @@ TEST_F(GpuConvolutionalLayerTest, updateParams) {
   layer.retrieveBuffers();
 
   const DataArray& actualK = layer.test_kernels();
-  ConstKernelPtr pActualK1 = Kernel::createShallow(actualK.data(), K1.shape());
+  ConstKernelView pActualK1 = Kernel::createShallow(actualK.data(), K1.shape());
   const Kernel& actualK1 = *pActualK1;
-  ConstKernelPtr pActualK2 = Kernel::createShallow(actualK.data() + K1.size(), K2.shape());
+  ConstKernelView pActualK2 = Kernel::createShallow(actualK.data() + K1.size(), K2.shape());
   const Kernel& actualK2 = *pActualK2;
   const Vector& actualB = layer.test_biases();
 
@@ -80,7 +80,7 @@ TEST_F(GpuMaxPoolingLayerTest, trainForward) {
   FileSystemPtr fileSystem = createFileSystem();
   PlatformPathsPtr platformPaths = createPlatformPaths();
 
-  gpu::MaxPoolingLayer layer(*gpu, *fileSystem, *platformPaths, config, { 4, 4, 2 });
+  gpu::MaxPoolingLayer layer(*gpu, *fileSystem, *platformPaths, config, { 4, 4, 2 }, true);
 
   testing::NiceMock<MockGpuLayer> nextLayer;
   ON_CALL(nextLayer, deltaBuffer).WillByDefault(testing::Return(0));
@@ -122,6 +122,76 @@ TEST_F(GpuMaxPoolingLayerTest, trainForward) {
   }
 }
 
+TEST_F(GpuMaxPoolingLayerTest, evalForwardReadsSampleAtIndex) {
+  testing::NiceMock<MockLogger> logger;
+  GpuPtr gpu = gpu::createGpu(logger);
+
+  GpuBufferFlags statusBufferFlags = GpuBufferFlags::frequentHostAccess
+                                   | GpuBufferFlags::hostReadAccess
+                                   | GpuBufferFlags::hostWriteAccess;
+  GpuBuffer statusBuffer = gpu->allocateBuffer(sizeof(StatusBuffer), statusBufferFlags);
+
+  Array3 inputs({
+    {
+      { 6.f, 0.f, 1.f, 2.f },
+      { 5.f, 5.f, 6.f, 7.f },
+      { 3.f, 8.f, 7.f, 6.f },
+      { 2.f, 6.f, 3.f, 1.f }
+    }, {
+      { 9.f, 5.f, 4.f, 3.f },
+      { 7.f, 2.f, 1.f, 0.f },
+      { 1.f, 2.f, 3.f, 4.f },
+      { 2.f, 8.f, 4.f, 6.f }
+    }
+  });
+
+  // As the first layer, the layer reads from a buffer of samples. Sample 0 is larger everywhere,
+  // so evaluating sample 1 only gives the right answer if the sample index is used.
+  Array3 samples(4, 4, 4);
+  samples.fill(100.f);
+  std::copy(inputs.data(), inputs.data() + inputs.size(), samples.data() + inputs.size());
+
+  GpuBufferFlags inputBufferFlags = GpuBufferFlags::large
+                                  | GpuBufferFlags::hostWriteAccess;
+
+  GpuBuffer inputBuffer = gpu->allocateBuffer(samples.size() * sizeof(netfloat_t),
+    inputBufferFlags);
+
+  gpu->submitBufferData(inputBuffer.handle, samples.data());
+
+  Config config;
+  config.setNumberArray<size_t>("regionSize", { 2, 2 });
+
+  FileSystemPtr fileSystem = createFileSystem();
+  PlatformPathsPtr platformPaths = createPlatformPaths();
+
+  gpu::MaxPoolingLayer layer(*gpu, *fileSystem, *platformPaths, config, { 4, 4, 2 }, true);
+
+  testing::NiceMock<MockGpuLayer> nextLayer;
+  ON_CALL(nextLayer, deltaBuffer).WillByDefault(testing::Return(0));
+
+  layer.allocateGpuBuffers();
+  layer.createGpuShaders(inputBuffer.handle, statusBuffer.handle, &nextLayer, 0);
+
+  layer.evalForward(1);
+  gpu->flushQueue();
+
+  Array3 A(2, 2, 2);
+  gpu->retrieveBuffer(layer.outputBuffer(), A.data());
+
+  Array3 expectedA;
+  Array3 expectedMask;
+  cpuMaxPoolingLayerTrainForward(config, inputs, expectedA, expectedMask);
+
+  for (size_t k = 0; k < A.D(); ++k) {
+    for (size_t j = 0; j < A.H(); ++j) {
+      for (size_t i = 0; i < A.W(); ++i) {
+        EXPECT_NEAR(A.at(i, j, k), expectedA.at(i, j, k), FLOAT_TOLERANCE);
+      }
+    }
+  }
+}
+
 void cpuMaxPoolingLayerBackprop(const Config& config, const Array3& mask,
   const Array3& outputDelta, Array3& inputDelta) {
 
@@ -172,7 +242,7 @@ TEST_F(GpuMaxPoolingLayerTest, backprop) {
   FileSystemPtr fileSystem = createFileSystem();
   PlatformPathsPtr platformPaths = createPlatformPaths();
 
-  gpu::MaxPoolingLayer layer(*gpu, *fileSystem, *platformPaths, config, { 4, 4, 2 });
+  gpu::MaxPoolingLayer layer(*gpu, *fileSystem, *platformPaths, config, { 4, 4, 2 }, true);
 
   testing::NiceMock<MockGpuLayer> nextLayer;
   ON_CALL(nextLayer, inputDeltaBuffer).WillByDefault(testing::Return(deltaABuffer.handle));
@@ -395,7 +395,8 @@ TEST_F(GpuNeuralNetTest, simpleConvNetwork) {
 
   gpu::ConvolutionalLayer layer1(*gpu, *fileSystem, *platformPaths, layer1Config, { 3, 3, 2 },
     true);
-  gpu::MaxPoolingLayer layer2(*gpu, *fileSystem, *platformPaths, layer2Config, { 2, 2, 2 });
+  gpu::MaxPoolingLayer layer2(*gpu, *fileSystem, *platformPaths, layer2Config, { 2, 2, 2 },
+    false);
   gpu::OutputLayer layer3(*gpu, *fileSystem, *platformPaths, layer3Config, 2);
 
   cpu::ConvolutionalLayer::Filter filter0;
@@ -523,7 +524,7 @@ TEST_F(GpuNeuralNetTest, simpleConvNetwork) {
   EXPECT_NEAR(actualCost, expectedCost, FLOAT_TOLERANCE);
 
   for (size_t d = 0; d < expectedK.size(); ++d) {
-    ConstKernelPtr pK = Kernel::createShallow(actualK.data() + d * kernelSize, 2, 2, 2);
+    ConstKernelView pK = Kernel::createShallow(actualK.data() + d * kernelSize, 2, 2, 2);
     const Kernel& K = *pK;
 
     for (size_t k = 0; k < K.D(); ++k) {
@@ -1,4 +1,7 @@
 #include <richard/math.hpp>
+#include <cstring>
+#include <sstream>
+#include <limits>
 #include <gtest/gtest.h>
 
 using namespace richard;
@@ -29,7 +32,7 @@ TEST_F(MathTest, arrayCopyConstructor) {
 
 TEST_F(MathTest, arrayCopyConstructorRhsShallow) {
   Array a({ 1, 2, 3, 4, 5 });
-  ConstArrayPtr b = a.subvector(1, 3);
+  ConstArrayView b = a.subvector(1, 3);
 
   Array c(*b);
 
@@ -46,7 +49,7 @@ TEST_F(MathTest, arrayMoveConstuctor) {
 
 TEST_F(MathTest, arrayMoveConstructorRhsShallow) {
   Array a({ 1, 2, 3, 4, 5 });
-  ArrayPtr pB = a.subvector(1, 3);
+  ArrayView pB = a.subvector(1, 3);
   Array& b = *pB;
 
   // b isn't moved because it's shallow
@@ -69,7 +72,7 @@ TEST_F(MathTest, arrayAssignment) {
 
 TEST_F(MathTest, arrayAssignmentRhsShallow) {
   Array b({ 1, 2, 3, 4 });
-  ConstArrayPtr c = b.subvector(0, 4);
+  ConstArrayView c = b.subvector(0, 4);
 
   Array a(1);
   a = *c;
@@ -83,7 +86,7 @@ TEST_F(MathTest, arrayAssignmentRhsShallowMismatchedSizes) {
 
 TEST_F(MathTest, arrayAssignmentRhsShallowRValue) {
   Array b({ 1, 2, 3, 4 });
-  ArrayPtr c = b.subvector(0, 4);
+  ArrayView c = b.subvector(0, 4);
 
   Array a(1);
   // When RHS is shallow, this should perform a copy, not a move, even when RHS is an r-value
@@ -100,7 +103,7 @@ TEST_F(MathTest, arrayAssignmentRhsShallowRValue) {
 
 TEST_F(MathTest, arrayAssignmentLhsShallow) {
   Array a({ 1, 2, 3, 4, 5 });
-  ArrayPtr pB = a.subvector(1, 3);
+  ArrayView pB = a.subvector(1, 3);
   Array& b = *pB;
 
   Array c({ 9, 9, 9 });
@@ -117,7 +120,7 @@ TEST_F(MathTest, arrayAssignmentLhsShallowMismatchedSizes) {
 
 TEST_F(MathTest, arrayAssignmentLhsShallowRhsRValue) {
   Array a({ 1, 2, 3, 4, 5 });
-  ArrayPtr pB = a.subvector(1, 3);
+  ArrayView pB = a.subvector(1, 3);
   Array& b = *pB;
 
   Array c({ 9, 9, 9 });
@@ -173,7 +176,7 @@ TEST_F(MathTest, array2CopyConstructor) {
 
 TEST_F(MathTest, array2CopyConstructorRhsShallow) {
   Vector a({ 1, 2, 3, 4 });
-  Array2Ptr b = Array2::createShallow(a.storage(), 2, 2);
+  Array2View b = Array2::createShallow(a.storage(), 2, 2);
 
   Array2 c(*b);
 
@@ -201,7 +204,7 @@ TEST_F(MathTest, array2MoveConstuctor) {
 
 TEST_F(MathTest, array2MoveConstructorRhsShallow) {
   Vector a({ 1, 2, 3, 4 });
-  Array2Ptr pB = Array2::createShallow(a.storage(), 2, 2);
+  Array2View pB = Array2::createShallow(a.storage(), 2, 2);
   Array2& b = *pB;
 
   Array2 c(std::move(b));
@@ -245,7 +248,7 @@ TEST_F(MathTest, array2AssignmentRhsShallow) {
       { 7, 8 }
     }
   });
-  ConstArray2Ptr c = b.slice(1);
+  ConstArray2View c = b.slice(1);
 
   Array2 a(1, 1);
   a = *c;
@@ -271,7 +274,7 @@ TEST_F(MathTest, array2AssignmentRhsShallowRValue) {
       { 7, 8 }
     }
   });
-  ConstArray2Ptr c = b.slice(1);
+  ConstArray2View c = b.slice(1);
 
   Array2 a(1, 1);
   // When RHS is shallow, this should perform a copy, not a move, even when RHS is an r-value
@@ -312,7 +315,7 @@ TEST_F(MathTest, array2AssignmentLhsShallow) {
       { 7, 8 }
     }
   });
-  Array2Ptr pB = a.slice(1);
+  Array2View pB = a.slice(1);
   Array2& b = *pB;
 
   Array2 c({
@@ -356,7 +359,7 @@ TEST_F(MathTest, array2AssignmentLhsShallowRhsRValue) {
       { 7, 8 }
     }
   });
-  Array2Ptr pB = a.slice(1);
+  Array2View pB = a.slice(1);
   Array2& b = *pB;
 
   Array2 c({
@@ -473,7 +476,7 @@ TEST_F(MathTest, array3CopyConstructor) {
 
 TEST_F(MathTest, array3CopyConstructorRhsShallow) {
   Vector a({ 1, 2, 3, 4, 5, 6, 7, 8 });
-  Array3Ptr b = Array3::createShallow(a.storage(), 2, 2, 2);
+  Array3View b = Array3::createShallow(a.storage(), 2, 2, 2);
 
   Array3 c(*b);
 
@@ -519,7 +522,7 @@ TEST_F(MathTest, array3MoveConstuctor) {
 
 TEST_F(MathTest, array3MoveConstructorRhsShallow) {
   Vector a({ 1, 2, 3, 4, 5, 6, 7, 8 });
-  Array3Ptr pB = Array3::createShallow(a.storage(), 2, 2, 2);
+  Array3View pB = Array3::createShallow(a.storage(), 2, 2, 2);
   Array3& b = *pB;
 
   Array3 c(std::move(b));
@@ -579,7 +582,7 @@ TEST_F(MathTest, array3Assignment) {
 TEST_F(MathTest, array3AssignmentRhsShallow) {
   Vector v({ 1, 2, 3, 4, 5, 6, 7, 8 });  
   
-  ConstArray3Ptr c = Array3::createShallow(v.storage(), 2, 2, 2);
+  ConstArray3View c = Array3::createShallow(v.storage(), 2, 2, 2);
 
   Array3 a(1, 1, 1);
   a = *c;
@@ -602,7 +605,7 @@ TEST_F(MathTest, array3AssignmentRhsShallowMismatchedSizes) {
 
 TEST_F(MathTest, array3AssignmentRhsShallowRValue) {
   Vector b({ 1, 2, 3, 4, 5, 6, 7, 8 });
-  ConstArray3Ptr c = Array3::createShallow(b.storage(), 2, 2, 2);
+  ConstArray3View c = Array3::createShallow(b.storage(), 2, 2, 2);
 
   Array3 a(1, 1, 1);
   // When RHS is shallow, this should perform a copy, not a move, even when RHS is an r-value
@@ -637,7 +640,7 @@ TEST_F(MathTest, array3AssignmentRhsShallowRValue) {
 
 TEST_F(MathTest, array3AssignmentLhsShallow) {
   Vector a({ 1, 2, 3, 4, 5, 6, 7, 8 });
-  Array3Ptr pB = Array3::createShallow(a.storage(), 2, 2, 2);
+  Array3View pB = Array3::createShallow(a.storage(), 2, 2, 2);
   Array3& b = *pB;
 
   Array3 c({
@@ -662,7 +665,7 @@ TEST_F(MathTest, array3AssignmentLhsShallowMismatchedSizes) {
 
 TEST_F(MathTest, array3AssignmentLhsShallowRhsRValue) {
   Vector a({ 1, 2, 3, 4, 5, 6, 7, 8 });
-  Array3Ptr pB = Array3::createShallow(a.storage(), 2, 2, 2);
+  Array3View pB = Array3::createShallow(a.storage(), 2, 2, 2);
   Array3& b = *pB;
 
   Array3 c({
@@ -755,7 +758,7 @@ TEST_F(MathTest, array3ElementAccess) {
 
 TEST_F(MathTest, array2AsArray) {
   auto foo = [](const DataArray& data) {
-    ConstArrayPtr arrPtr = Array::createShallow(data);
+    ConstArrayView arrPtr = Array::createShallow(data);
     const Array& arr = *arrPtr;
 
     ASSERT_EQ(arr, Array({ 1, 2, 3, 4, 5, 6 }));
@@ -771,7 +774,7 @@ TEST_F(MathTest, array2AsArray) {
 
 TEST_F(MathTest, arrayAsArray2) {
   auto foo = [](const DataArray& data, size_t w, size_t h) {
-    ConstArray2Ptr arr2Ptr = Array2::createShallow(data, w, h);
+    ConstArray2View arr2Ptr = Array2::createShallow(data, w, h);
     const Array2& arr2 = *arr2Ptr;
 
     ASSERT_EQ(arr2, Array2({
@@ -803,6 +806,72 @@ TEST_F(MathTest, vectorMinusEqualsVectorMultiply) {
   ASSERT_EQ(a, Vector({ -5, -6, -7 }));
 }
 
+TEST_F(MathTest, expressionMayReadItsDestination) {
+  // Longer than one evaluation block
+  const size_t n = 1000;
+
+  Vector a(n);
+  Vector b(n);
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = static_cast<netfloat_t>(i);
+    b[i] = static_cast<netfloat_t>(2 * i);
+  }
+
+  a = (b - a) + a * 2.f;
+
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_EQ(a[i], static_cast<netfloat_t>(3 * i));
+  }
+}
+
+TEST_F(MathTest, expressionOwnsTemporaryOperands) {
+  Vector a({ 1, 2, 3 });
+
+  auto expr = a + Vector({ 4, 5, 6 }) * 2.f;
+
+  ASSERT_EQ(Vector(expr), Vector({ 9, 12, 15 }));
+}
+
+TEST_F(MathTest, matrixMinusEqualsExpression) {
+  Matrix W({
+    { 1, 2, 3 },
+    { 4, 5, 6 }
+  });
+  Matrix deltaW({
+    { 2, 2, 2 },
+    { 4, 4, 4 }
+  });
+
+  W -= deltaW * 0.5f;
+
+  ASSERT_EQ(W, Matrix({
+    { 0, 1, 2 },
+    { 2, 3, 4 }
+  }));
+}
+
+TEST_F(MathTest, kernelExpressionKeepsShape) {
+  Kernel A(3, 2, 4);
+  A.fill(1.f);
+  Kernel B(3, 2, 4);
+  B.fill(2.f);
+
+  Kernel C = (A + B) / 3.f;
+
+  ASSERT_EQ(C.shape(), A.shape());
+  for (size_t i = 0; i < C.size(); ++i) {
+    ASSERT_EQ(C.data()[i], 1.f);
+  }
+}
+
+TEST_F(MathTest, reductionsOfExpressions) {
+  Vector expected({ 1, 2, 3 });
+  Vector actual({ 2, 4, 6 });
+
+  ASSERT_EQ((expected - actual).squareMagnitude(), 14.f);
+  ASSERT_EQ((expected + actual).sum(), 18.f);
+}
+
 TEST_F(MathTest, constSliceArray2) {
   const Array2 arr2({
     { 1, 2, 3 },
@@ -810,12 +879,28 @@ TEST_F(MathTest, constSliceArray2) {
     { 7, 8, 9 }
   });
 
-  ConstArrayPtr slicePtr = arr2.slice(1);
+  ConstArrayView slicePtr = arr2.slice(1);
   const Array& slice = *slicePtr;
 
   ASSERT_EQ(slice, Array({ 4, 5, 6 }));
 }
 
+TEST_F(MathTest, viewsPassStraightToMathRoutines) {
+  Array3 arr3(2, 2, 3);
+  arr3.fill(1);
+
+  Array2View slice = arr3.slice(1);
+  ConstArray2View constSlice = arr3.slice(1);
+  slice->fill(2);
+
+  Vector x({ 1, 1 });
+  Vector result(2);
+  multiply(constSlice, x, result);
+
+  ASSERT_EQ(result, Vector({ 4, 4 }));
+  ASSERT_EQ(arr3.slice(0)->sum() + arr3.slice(2)->sum(), 8);
+}
+
 TEST_F(MathTest, sliceArray2Modify) {
   Array2 arr2({
     { 1, 2, 3 },
@@ -823,7 +908,7 @@ TEST_F(MathTest, sliceArray2Modify) {
     { 7, 8, 9 }
   });
 
-  ArrayPtr slicePtr = arr2.slice(1);
+  ArrayView slicePtr = arr2.slice(1);
   Array& slice = *slicePtr;
 
   slice[0] = 11;
@@ -1018,3 +1103,553 @@ TEST_F(MathTest, fullConvolutionIsCommutative) {
 
   ASSERT_EQ(convResult1, convResult2);
 }
+
+TEST_F(MathTest, matrixVectorMultiply) {
+  Matrix M({
+    { 1, 2, 3 },
+    { 4, 5, 6 }
+  });
+  Vector x({ 1, 0, 2 });
+
+  ASSERT_EQ(M * x, Vector({ 7, 16 }));
+  ASSERT_EQ(M.transposeMultiply(Vector({ 1, 2 })), Vector({ 9, 12, 15 }));
+}
+
+TEST_F(MathTest, outerProductAccumulate) {
+  Vector a({ 1, 2 });
+  Vector b({ 3, 4, 5 });
+  Matrix M(3, 2);
+  M.fill(1);
+
+  outerProduct(a, b, M, true);
+
+  ASSERT_EQ(M, Matrix({
+    { 4, 5, 6 },
+    { 7, 9, 11 }
+  }));
+}
+
+TEST_F(MathTest, packedGemvMatchesFloatGemv) {
+  Matrix A(4099, 9);
+  A.randomize(1.f);
+  Vector x(4099);
+  x.randomize(1.f);
+  Vector b(9);
+  b.randomize(1.f);
+
+  auto identity = [](const netfloat_t* Z, netfloat_t* R, size_t n) {
+    std::copy(Z, Z + n, R);
+  };
+
+  PackedMatrix<float16_t> F16(A);
+  PackedMatrix<bfloat16_t> Bf16(A);
+
+  // Products with the unpacked matrices are exact to within summation order
+  Vector expectedF16(9);
+  gemv(F16.unpack(), x, b, expectedF16, expectedF16, identity);
+  Vector expectedBf16(9);
+  gemv(Bf16.unpack(), x, b, expectedBf16, expectedBf16, identity);
+
+  Vector Z(9);
+  Vector Y(9);
+
+  gemv(F16, x, b, Z, Y, identity);
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(Y[i], expectedF16[i], 0.001f);
+  }
+
+  gemv(Bf16, x, b, Z, Y, identity);
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(Y[i], expectedBf16[i], 0.001f);
+  }
+
+  Vector exact(9);
+  gemv(A, x, b, exact, exact, identity);
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(expectedF16[i], exact[i], 0.1f);
+    ASSERT_NEAR(expectedBf16[i], exact[i], 1.f);
+  }
+}
+
+// Sizes span more than one cache block and leave remainders in every dimension
+TEST_F(MathTest, quantizedGemvMatchesDequantizedGemv) {
+  Matrix A(4099, 9);
+  A.randomize(1.f);
+  Vector x(4099);
+  x.randomize(1.f);
+  Vector b(9);
+  b.randomize(1.f);
+
+  auto identity = [](const netfloat_t* Z, netfloat_t* R, size_t n) {
+    std::copy(Z, Z + n, R);
+  };
+
+  QuantizedMatrix Q(A, maxMagnitude(x.storage()));
+
+  std::vector<int8_t> xq(x.size());
+  Q.quantizeInputs(x.data(), xq.data(), x.size());
+  Vector xDequantized(x.size());
+  for (size_t i = 0; i < x.size(); ++i) {
+    xDequantized[i] = Q.inputScale() * xq[i];
+  }
+
+  // The int8 product is exact, so matches the float product of the dequantized values to
+  // within rounding
+  Vector expected(9);
+  gemv(Q.dequantize(), xDequantized, b, expected, expected, identity);
+
+  Vector Z(9);
+  Vector Y(9);
+  gemv(Q, x, b, Z, Y, identity);
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(Y[i], expected[i], 0.001f);
+  }
+
+  // Each product carries an error of up to half a quantization step in both operands
+  Vector exact(9);
+  gemv(A, x, b, exact, exact, identity);
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(Y[i], exact[i], 3.f);
+  }
+}
+
+TEST_F(MathTest, quantizedCrossCorrelationMatchesIm2col) {
+  const size_t imW = 9;
+  const size_t imH = 7;
+  const size_t D = 3;
+  const size_t kW = 3;
+  const size_t kH = 2;
+  const size_t F = 5;
+  const size_t fmW = imW - kW + 1;
+  const size_t fmH = imH - kH + 1;
+
+  Array3 image(imW, imH, D);
+  image.randomize(1.f);
+
+  Matrix kernels(kW * kH * D, F);
+  kernels.randomize(1.f);
+
+  QuantizedMatrix Q(kernels, maxMagnitude(image.storage()));
+
+  std::vector<int8_t> imageq(image.size());
+  Q.quantizeInputs(image.data(), imageq.data(), image.size());
+  Array3 imageDequantized(imW, imH, D);
+  for (size_t i = 0; i < image.size(); ++i) {
+    imageDequantized.data()[i] = Q.inputScale() * imageq[i];
+  }
+
+  Matrix cols(fmW * fmH, kW * kH * D);
+  im2col(imageDequantized, kW, kH, cols);
+  Matrix expected(fmW * fmH, F);
+  multiply(Q.dequantize(), cols, expected);
+
+  Matrix result(fmW * fmH, F);
+  computeQuantizedCrossCorrelation(image, Q, kW, kH, result);
+
+  for (size_t f = 0; f < F; ++f) {
+    for (size_t i = 0; i < fmW * fmH; ++i) {
+      ASSERT_NEAR(result.at(i, f), expected.at(i, f), 0.0001f) << "f = " << f;
+    }
+  }
+}
+
+TEST_F(MathTest, pruneToTargetSparsity) {
+  Matrix M(40, 25);
+  M.randomize(1.f);
+
+  netfloat_t threshold = magnitudeQuantile(M, 0.9f);
+  pruneBelow(M, threshold);
+
+  size_t zeros = 0;
+  for (size_t i = 0; i < M.size(); ++i) {
+    if (M.data()[i] == 0.f) {
+      ++zeros;
+    }
+    else {
+      ASSERT_GE(std::fabs(M.data()[i]), threshold);
+    }
+  }
+  ASSERT_EQ(zeros, 900);
+
+  ASSERT_EQ(magnitudeQuantile(M, 0.f), 0.f);
+  ASSERT_EQ(magnitudeQuantile(M, 1.f), std::numeric_limits<netfloat_t>::infinity());
+}
+
+TEST_F(MathTest, sparseGemvMatchesDenseGemv) {
+  Matrix A(517, 70);
+  A.randomize(1.f);
+  pruneBelow(A, magnitudeQuantile(A, 0.8f));
+
+  // Include an empty row
+  memset(A.data() + 3 * A.cols(), 0, A.cols() * sizeof(netfloat_t));
+
+  Vector x(517);
+  x.randomize(1.f);
+  Vector b(70);
+  b.randomize(1.f);
+
+  auto identity = [](const netfloat_t* Z, netfloat_t* R, size_t n) {
+    std::copy(Z, Z + n, R);
+  };
+
+  size_t nonZeros = std::count_if(A.data(), A.data() + A.size(), [](netfloat_t a) {
+    return a != 0.f;
+  });
+
+  SparseMatrix S(A);
+  ASSERT_EQ(S.nonZeros(), nonZeros);
+  ASSERT_EQ(S.rowStarts()[4], S.rowStarts()[3]);
+  ASSERT_EQ(S.toDense(), A);
+
+  Vector expected(70);
+  gemv(A, x, b, expected, expected, identity);
+
+  Vector Z(70);
+  Vector Y(70);
+  gemv(S, x, b, Z, Y, identity);
+  for (size_t i = 0; i < Y.size(); ++i) {
+    ASSERT_NEAR(Y[i], expected[i], 0.001f);
+  }
+
+  std::stringstream stream;
+  S.writeToStream(stream);
+  ASSERT_EQ(stream.str().size(), 71 * sizeof(uint32_t) + S.nonZeros() * 8);
+
+  SparseMatrix loaded(stream, 517, 70);
+  ASSERT_EQ(loaded.toDense(), A);
+}
+
+TEST_F(MathTest, sparseProductsMatchDenseProducts) {
+  Matrix X(300, 9);
+  X.randomize(1.f);
+  pruneBelow(X, magnitudeQuantile(X, 0.8f));
+
+  Matrix B(37, 300);
+  B.randomize(1.f);
+  Matrix D(37, 9);
+  D.randomize(1.f);
+
+  SparseMatrix S(X);
+
+  Matrix expected(37, 9);
+  multiply(X, B, expected);
+  Matrix R(37, 9);
+  R.fill(1.f);
+  multiply(S, B, R);
+  for (size_t i = 0; i < R.size(); ++i) {
+    ASSERT_NEAR(R.data()[i], expected.data()[i], 0.001f);
+  }
+
+  Matrix expectedT(37, 300);
+  expectedT.fill(1.f);
+  transposeMultiply(X, D, expectedT, true);
+  Matrix RT(37, 300);
+  RT.fill(1.f);
+  transposeMultiply(S, D, RT, true);
+  for (size_t i = 0; i < RT.size(); ++i) {
+    ASSERT_NEAR(RT.data()[i], expectedT.data()[i], 0.001f);
+  }
+}
+
+TEST_F(MathTest, fusedPrimitivesMatchUnfused) {
+  // More columns than one GEMV block, and rows that end part way through a run of activations
+  Matrix A(4099, 131);
+  A.randomize(1.f);
+  Vector x(4099);
+  x.randomize(1.f);
+  Vector b(131);
+  b.randomize(1.f);
+  Vector y(131);
+  y.randomize(1.f);
+
+  Vector expectedZ(131);
+  multiply(A, x, expectedZ);
+  expectedZ += b;
+
+  auto leaky = [](netfloat_t z) { return z > 0.f ? z : 0.1f * z; };
+  auto f = [&](const netfloat_t* Z, netfloat_t* R, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      R[i] = leaky(Z[i]);
+    }
+  };
+
+  Vector Z(131);
+  Vector Y(131);
+  gemv(A, x, b, Z, Y, f);
+
+  for (size_t i = 0; i < Z.size(); ++i) {
+    ASSERT_NEAR(Z[i], expectedZ[i], 0.001f);
+    ASSERT_NEAR(Y[i], leaky(expectedZ[i]), 0.001f);
+  }
+
+  Vector inPlace(131);
+  gemv(A, x, b, inPlace, inPlace, f);
+  ASSERT_EQ(inPlace, Y);
+
+  Matrix expectedA(A);
+  outerProduct(y, x, expectedA, true);
+  ger(1.f, y, x, A);
+
+  for (size_t i = 0; i < A.size(); ++i) {
+    ASSERT_NEAR(A.data()[i], expectedA.data()[i], 0.0001f);
+  }
+
+  Matrix expectedW = A - expectedA * 0.5f;
+  axpy(-0.5f, expectedA, A);
+
+  for (size_t i = 0; i < A.size(); ++i) {
+    ASSERT_NEAR(A.data()[i], expectedW.data()[i], 0.0001f);
+  }
+}
+
+TEST_F(MathTest, blockedProductsMatchNaive) {
+  const netfloat_t tolerance = 0.001f;
+  const size_t M = 67;
+  const size_t K = 301;
+  const size_t N = 261;
+
+  Matrix A(K, M);
+  Matrix B(N, K);
+  Matrix Bt(K, N);
+  A.randomize(1.f);
+  B.randomize(1.f);
+  Bt.randomize(1.f);
+
+  Matrix expectedAB(N, M);
+  Matrix expectedABt(N, M);
+  for (size_t i = 0; i < M; ++i) {
+    for (size_t j = 0; j < N; ++j) {
+      netfloat_t ab = 0.0;
+      netfloat_t abt = 0.0;
+      for (size_t k = 0; k < K; ++k) {
+        ab += A.at(k, i) * B.at(j, k);
+        abt += A.at(k, i) * Bt.at(k, j);
+      }
+      expectedAB.set(j, i, ab);
+      expectedABt.set(j, i, abt);
+    }
+  }
+
+  Matrix AB(N, M);
+  multiply(A, B, AB);
+  Matrix ABt(N, M);
+  multiplyTranspose(A, Bt, ABt);
+
+  // (A^T)^T B = AB
+  Matrix At = A.transpose();
+  Matrix AtTB(N, M);
+  transposeMultiply(At, B, AtTB);
+
+  for (size_t i = 0; i < M; ++i) {
+    for (size_t j = 0; j < N; ++j) {
+      ASSERT_NEAR(AB.at(j, i), expectedAB.at(j, i), tolerance);
+      ASSERT_NEAR(AtTB.at(j, i), expectedAB.at(j, i), tolerance);
+      ASSERT_NEAR(ABt.at(j, i), expectedABt.at(j, i), tolerance);
+    }
+  }
+
+  Vector x(K);
+  x.randomize(1.f);
+  Vector y(M);
+  y.randomize(1.f);
+
+  Vector Ax(M);
+  multiply(A, x, Ax);
+  Vector Aty(K);
+  transposeMultiply(A, y, Aty);
+
+  for (size_t i = 0; i < M; ++i) {
+    netfloat_t sum = 0.0;
+    for (size_t k = 0; k < K; ++k) {
+      sum += A.at(k, i) * x[k];
+    }
+    ASSERT_NEAR(Ax[i], sum, tolerance);
+  }
+
+  for (size_t k = 0; k < K; ++k) {
+    netfloat_t sum = 0.0;
+    for (size_t i = 0; i < M; ++i) {
+      sum += A.at(k, i) * y[i];
+    }
+    ASSERT_NEAR(Aty[k], sum, tolerance);
+  }
+}
+
+TEST_F(MathTest, im2colProductMatchesCrossCorrelation) {
+  Array3 image(6, 5, 3);
+  image.randomize(1.f);
+
+  Kernel K0(3, 2, 3);
+  K0.randomize(1.f);
+  Kernel K1(3, 2, 3);
+  K1.randomize(1.f);
+
+  Matrix W(K0.size(), 2);
+  memcpy(W.data(), K0.data(), K0.size() * sizeof(netfloat_t));
+  memcpy(W.data() + K0.size(), K1.data(), K1.size() * sizeof(netfloat_t));
+
+  Matrix cols(4 * 4, K0.size());
+  im2col(image, 3, 2, cols);
+
+  Matrix Z(4 * 4, 2);
+  multiply(W, cols, Z);
+
+  Array2 expected0(4, 4);
+  computeCrossCorrelation(image, K0, expected0);
+  Array2 expected1(4, 4);
+  computeCrossCorrelation(image, K1, expected1);
+
+  for (size_t i = 0; i < 16; ++i) {
+    ASSERT_NEAR(Z.at(i, 0), expected0.data()[i], 0.0001f);
+    ASSERT_NEAR(Z.at(i, 1), expected1.data()[i], 0.0001f);
+  }
+}
+
+TEST_F(MathTest, batchedIm2colMatchesEachImage) {
+  Matrix images(5 * 4 * 2, 3);
+  images.randomize(1.f);
+
+  Matrix cols(3 * 3 * 3, 3 * 2 * 2);
+  im2col(images, { 5, 4, 2 }, 3, 2, cols);
+
+  for (size_t b = 0; b < images.rows(); ++b) {
+    ConstArray3View image = Array3::createShallow(images.data() + b * images.cols(), 5, 4, 2);
+
+    Matrix expected(3 * 3, 3 * 2 * 2);
+    im2col(*image, 3, 2, expected);
+
+    for (size_t r = 0; r < expected.rows(); ++r) {
+      for (size_t c = 0; c < expected.cols(); ++c) {
+        ASSERT_EQ(cols.at(b * 9 + c, r), expected.at(c, r));
+      }
+    }
+  }
+
+  Matrix raised(5 * 4 * 2, 3);
+  col2im(cols, 3, 2, { 5, 4, 2 }, raised);
+
+  for (size_t b = 0; b < images.rows(); ++b) {
+    Matrix expectedCols(3 * 3, 3 * 2 * 2);
+    ConstArray3View image = Array3::createShallow(images.data() + b * images.cols(), 5, 4, 2);
+    im2col(*image, 3, 2, expectedCols);
+
+    Array3 expected(5, 4, 2);
+    col2im(expectedCols, 3, 2, expected);
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(raised.at(i, b), expected.data()[i]);
+    }
+  }
+}
+
+TEST_F(MathTest, col2imIsAdjointOfIm2col) {
+  Array3 image(5, 4, 2);
+  image.randomize(1.f);
+
+  Matrix cols(3 * 3, 2 * 2 * 3);
+  cols.randomize(1.f);
+
+  Matrix lowered(3 * 3, 2 * 2 * 3);
+  im2col(image, 3, 2, lowered);
+
+  Array3 raised(5, 4, 2);
+  col2im(cols, 3, 2, raised);
+
+  // <im2col(x), c> = <x, col2im(c)>
+  netfloat_t lhs = 0.0;
+  for (size_t i = 0; i < cols.size(); ++i) {
+    lhs += lowered.data()[i] * cols.data()[i];
+  }
+
+  netfloat_t rhs = 0.0;
+  for (size_t i = 0; i < image.size(); ++i) {
+    rhs += image.data()[i] * raised.data()[i];
+  }
+
+  ASSERT_NEAR(lhs, rhs, 0.0001f);
+}
+
+TEST_F(MathTest, winogradMatchesCrossCorrelation) {
+  // Even and odd sized feature maps
+  for (size_t imW : { 6, 7 }) {
+    for (size_t imH : { 3, 8, 9 }) {
+      const size_t D = 3;
+      const size_t F = 5;
+
+      Array3 image(imW, imH, D);
+      image.randomize(1.f);
+
+      Matrix kernels(9 * D, F);
+      kernels.randomize(1.f);
+
+      Matrix result((imW - 2) * (imH - 2), F);
+      computeWinogradCrossCorrelation(image, kernels, result);
+
+      for (size_t f = 0; f < F; ++f) {
+        ConstKernelView K = Kernel::createShallow(kernels.data() + f * 9 * D, 3, 3, D);
+        Array2 expected(imW - 2, imH - 2);
+        computeCrossCorrelation(image, *K, expected);
+
+        for (size_t i = 0; i < expected.size(); ++i) {
+          ASSERT_NEAR(result.at(i, f), expected.data()[i], 0.0001f)
+            << "imW = " << imW << ", imH = " << imH << ", f = " << f;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(MathTest, fftCorrelationMatchesDirect) {
+  // Non power-of-two sizes, so the padding is exercised
+  Array3 image(13, 10, 2);
+  image.randomize(1.f);
+
+  Kernel kernel(5, 4, 2);
+  kernel.randomize(1.f);
+
+  for (bool flip : { false, true }) {
+    Array2 expected(9, 7);
+    Array2 actual(9, 7);
+    computeCrossCorrelation(image, kernel, expected, flip);
+    computeFftCrossCorrelation(image, kernel, actual, flip);
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_NEAR(actual.data()[i], expected.data()[i], 0.0001f) << "flip = " << flip;
+    }
+
+    Array2 expectedFull(17, 13);
+    Array2 actualFull(17, 13);
+    computeFullCrossCorrelation(image, kernel, expectedFull, flip);
+    computeFftFullCrossCorrelation(image, kernel, actualFull, flip);
+
+    for (size_t i = 0; i < expectedFull.size(); ++i) {
+      ASSERT_NEAR(actualFull.data()[i], expectedFull.data()[i], 0.0001f) << "flip = " << flip;
+    }
+  }
+}
+
+TEST_F(MathTest, fftCorrelationOfKernelStack) {
+  Array3 image(12, 9, 3);
+  image.randomize(1.f);
+
+  Matrix kernels(4 * 3 * 3, 5);
+  kernels.randomize(1.f);
+
+  Matrix result(9 * 7, 5);
+  computeFftCrossCorrelation(image, kernels, 4, 3, result);
+
+  for (size_t k = 0; k < kernels.rows(); ++k) {
+    ConstKernelView K = Kernel::createShallow(kernels.data() + k * kernels.cols(), 4, 3, 3);
+    Array2 expected(9, 7);
+    computeCrossCorrelation(image, *K, expected);
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_NEAR(result.at(i, k), expected.data()[i], 0.0001f) << "k = " << k;
+    }
+  }
+}
+
+TEST_F(MathTest, fftCorrelationIsCheaperForLargeKernels) {
+  ASSERT_FALSE(fftCorrelationIsCheaper(28, 28, 1, 5, 5, 8, false));
+  ASSERT_TRUE(fftCorrelationIsCheaper(128, 128, 1, 31, 31, 2, false));
+}
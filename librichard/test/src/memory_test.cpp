@@ -0,0 +1,80 @@
+#include <richard/memory.hpp>
+#include <richard/math.hpp>
+#include <richard/thread_pool.hpp>
+#include <gtest/gtest.h>
+#include <cstdint>
+
+using namespace richard;
+
+class MemoryTest : public testing::Test {
+  public:
+    virtual void SetUp() override {}
+    virtual void TearDown() override {}
+};
+
+TEST_F(MemoryTest, buffersAreAligned) {
+  for (size_t n : { 1, 3, 16, 17, 1000, 20000000 }) {
+    netfloat_t* p = memory::allocate(n);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(p) % memory::ALIGNMENT, 0) << "n = " << n;
+
+    p[0] = 1.f;
+    p[n - 1] = 2.f;
+
+    memory::release(p, n);
+  }
+
+  ASSERT_EQ(memory::allocate(0), nullptr);
+  memory::release(nullptr, 0);
+}
+
+TEST_F(MemoryTest, releasedBuffersAreReused) {
+  memory::trim();
+
+  netfloat_t* p = memory::allocate(100);
+  memory::release(p, 100);
+
+  // Anything in the same size class gets the same buffer back
+  netfloat_t* q = memory::allocate(120);
+  ASSERT_EQ(p, q);
+  memory::release(q, 120);
+
+  ASSERT_GT(memory::poolStats().cachedBytes, 0);
+  memory::trim();
+  ASSERT_EQ(memory::poolStats().cachedBytes, 0);
+}
+
+TEST_F(MemoryTest, steadyStateTemporariesDontReachTheSystem) {
+  Vector a(1000);
+  a.randomize(1.f);
+  Vector b(1000);
+  b.randomize(1.f);
+
+  // Warm up the free lists
+  Vector c = a.hadamard(b) + a;
+  c = a.hadamard(b) + a;
+
+  size_t allocations = memory::poolStats().systemAllocations;
+
+  for (size_t i = 0; i < 100; ++i) {
+    c = a.hadamard(b) + a;
+  }
+
+  ASSERT_EQ(memory::poolStats().systemAllocations, allocations);
+}
+
+TEST_F(MemoryTest, buffersMayBeReleasedOnAnotherThread) {
+  ThreadPool pool(4);
+
+  std::vector<DataArray> arrays;
+  for (size_t i = 0; i < 64; ++i) {
+    arrays.emplace_back(100 + i);
+  }
+
+  pool.parallelFor(arrays.size(), [&](size_t i) {
+    arrays[i] = DataArray();
+  });
+
+  for (const DataArray& array : arrays) {
+    ASSERT_EQ(array.size(), 0);
+  }
+}
@@ -12,10 +12,22 @@ class MockCpuLayer : public cpu::Layer {
     MOCK_METHOD(const DataArray&, activations, (), (const, override));
     MOCK_METHOD(const DataArray&, inputDelta, (), (const, override));
     MOCK_METHOD(void, trainForward, (const DataArray& inputs), (override));
-    MOCK_METHOD(DataArray, evalForward, (const DataArray& inputs), (const, override));
+    MOCK_METHOD(void, evalForwardInto, (const netfloat_t* inputs, netfloat_t* outputs),
+      (const, override));
     MOCK_METHOD(void, updateDeltas, (const DataArray& inputs, const DataArray& outputDelta),
       (override));
     MOCK_METHOD(void, updateParams, (size_t epoch), (override));
     MOCK_METHOD(void, writeToStream, (std::ostream& stream), (const, override));
+    MOCK_METHOD(const Matrix&, batchActivations, (), (const, override));
+    MOCK_METHOD(const Matrix&, batchInputDelta, (), (const, override));
+    MOCK_METHOD(void, trainForwardBatch, (const Matrix& inputs), (override));
+    MOCK_METHOD(void, updateDeltasBatch, (const Matrix& inputs, const Matrix& outputDelta),
+      (override));
+    MOCK_METHOD(void, copyParams, (const Layer& source), (override));
+    MOCK_METHOD(void, mergeDeltas, (Layer& source), (override));
+    MOCK_METHOD(void, calibrate, (const DataArray& inputs), (override));
+    MOCK_METHOD(void, quantize, (), (override));
+    MOCK_METHOD(void, prune, (), (override));
+    MOCK_METHOD(void, finishTraining, (), (override));
 };
 
@@ -13,4 +13,5 @@ class MockFileSystem : public FileSystem {
       (override));
     MOCK_METHOD(std::string, loadTextFile, (const std::filesystem::path&), (override));
     MOCK_METHOD(std::vector<uint8_t>, loadBinaryFile, (const std::filesystem::path&), (override));
+    MOCK_METHOD(MappedFilePtr, mapFileForReading, (const std::filesystem::path&), (override));
 };
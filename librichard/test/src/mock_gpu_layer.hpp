@@ -19,7 +19,7 @@ class MockGpuLayer : public gpu::Layer {
     MOCK_METHOD(GpuBufferHandle, inputDeltaBuffer, (), (const, override));
     MOCK_METHOD(void, retrieveBuffers, (), (override));
     MOCK_METHOD(Size3, outputSize, (), (const, override));
-    MOCK_METHOD(void, evalForward, (), (override));
+    MOCK_METHOD(void, evalForward, (uint32_t sampleIndex), (override));
     MOCK_METHOD(void, trainForward, (), (override));
     MOCK_METHOD(void, backprop, (), (override));
     MOCK_METHOD(void, updateParams, (), (override));
@@ -0,0 +1,88 @@
+#include <richard/random.hpp>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+using namespace richard;
+
+class RandomTest : public testing::Test {
+  public:
+    virtual void SetUp() override {}
+    virtual void TearDown() override {}
+};
+
+TEST_F(RandomTest, matchesPhiloxKnownAnswers) {
+  // From the known answer tests distributed with Random123
+  Random zero(0, 0);
+  std::vector<uint32_t> R(4);
+  zero.generate(R.data(), R.size());
+
+  ASSERT_EQ(R[0], 0x6627e8d5u);
+  ASSERT_EQ(R[1], 0xe169c58du);
+  ASSERT_EQ(R[2], 0xbc57ac4cu);
+  ASSERT_EQ(R[3], 0x9b00dbd8u);
+}
+
+TEST_F(RandomTest, bulkGenerationMatchesSingleBlocks) {
+  Random bulk(1234, 5);
+  std::vector<uint32_t> R(203);
+  bulk.generate(R.data(), R.size());
+
+  Random single(1234, 5);
+  for (size_t i = 0; i < R.size(); i += 4) {
+    uint32_t block[4];
+    single.generate(block, 4);
+
+    for (size_t j = i; j < std::min(i + 4, R.size()); ++j) {
+      ASSERT_EQ(R[j], block[j - i]);
+    }
+  }
+
+  // Streams are independent
+  Random other(1234, 6);
+  std::vector<uint32_t> S(203);
+  other.generate(S.data(), S.size());
+  ASSERT_NE(R, S);
+}
+
+TEST_F(RandomTest, dropoutZeroesAtTheGivenRate) {
+  Random random(7, 0);
+
+  std::vector<netfloat_t> A(100000, 1.f);
+  random.dropout(A.data(), 0.3f, A.size());
+
+  size_t zeros = 0;
+  for (netfloat_t a : A) {
+    ASSERT_TRUE(a == 0.f || a == 1.f);
+    zeros += a == 0.f;
+  }
+
+  ASSERT_NEAR(static_cast<double>(zeros) / A.size(), 0.3, 0.01);
+
+  std::vector<netfloat_t> B(100, 1.f);
+  random.dropout(B.data(), 0.f, B.size());
+  ASSERT_EQ(B, std::vector<netfloat_t>(100, 1.f));
+  random.dropout(B.data(), 1.f, B.size());
+  ASSERT_EQ(B, std::vector<netfloat_t>(100, 0.f));
+}
+
+TEST_F(RandomTest, normalHasTheGivenMoments) {
+  Random random(11, 3);
+
+  std::vector<netfloat_t> R(100001);
+  random.normal(R.data(), 2.f, R.size());
+
+  double sum = 0.0;
+  double sumSquares = 0.0;
+  for (netfloat_t x : R) {
+    ASSERT_TRUE(std::isfinite(x));
+    sum += x;
+    sumSquares += x * x;
+  }
+
+  double mean = sum / R.size();
+  double variance = sumSquares / R.size() - mean * mean;
+
+  ASSERT_NEAR(mean, 0.0, 0.03);
+  ASSERT_NEAR(std::sqrt(variance), 2.0, 0.03);
+}
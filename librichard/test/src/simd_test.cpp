@@ -0,0 +1,430 @@
+#include <richard/simd.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+using namespace richard;
+using namespace richard::simd;
+
+const netfloat_t FLOAT_TOLERANCE = 0.0001f;
+
+class SimdTest : public testing::Test {
+  public:
+    virtual void SetUp() override {
+      std::mt19937 gen(0);
+      std::uniform_real_distribution<netfloat_t> dist(-1.f, 1.f);
+
+      // Odd length, so every implementation exercises its remainder handling
+      A.resize(1027);
+      B.resize(1027);
+      for (size_t i = 0; i < A.size(); ++i) {
+        A[i] = dist(gen);
+        B[i] = dist(gen);
+      }
+
+      for (auto instructionSet : { InstructionSet::avx2, InstructionSet::avx512,
+        InstructionSet::neon }) {
+
+        const Kernels* k = kernels(instructionSet);
+        if (k != nullptr) {
+          available.push_back(k);
+        }
+      }
+    }
+
+    virtual void TearDown() override {}
+
+    std::vector<netfloat_t> A;
+    std::vector<netfloat_t> B;
+    std::vector<const Kernels*> available;
+};
+
+TEST_F(SimdTest, scalarKernelsAlwaysAvailable) {
+  const Kernels* k = kernels(InstructionSet::scalar);
+
+  ASSERT_NE(k, nullptr);
+  ASSERT_EQ(k->instructionSet, InstructionSet::scalar);
+}
+
+TEST_F(SimdTest, detectedKernelsAreAvailable) {
+  ASSERT_NE(kernels(detectInstructionSet()), nullptr);
+  ASSERT_EQ(kernels().instructionSet, detectInstructionSet());
+}
+
+TEST_F(SimdTest, elementWiseKernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  for (const Kernels* k : available) {
+    for (size_t n : { 0, 1, 7, 8, 15, 16, 17, 33, 1027 }) {
+      std::vector<netfloat_t> expected(n);
+      std::vector<netfloat_t> actual(n);
+
+      scalar.add(A.data(), B.data(), expected.data(), n);
+      k->add(A.data(), B.data(), actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet) << ", n = " << n;
+
+      scalar.subtract(A.data(), B.data(), expected.data(), n);
+      k->subtract(A.data(), B.data(), actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet) << ", n = " << n;
+
+      scalar.multiply(A.data(), B.data(), expected.data(), n);
+      k->multiply(A.data(), B.data(), actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet) << ", n = " << n;
+
+      scalar.addScalar(A.data(), 0.3f, expected.data(), n);
+      k->addScalar(A.data(), 0.3f, actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet) << ", n = " << n;
+
+      scalar.multiplyScalar(A.data(), 0.3f, expected.data(), n);
+      k->multiplyScalar(A.data(), 0.3f, actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet) << ", n = " << n;
+
+      scalar.divideScalar(A.data(), 0.3f, expected.data(), n);
+      k->divideScalar(A.data(), 0.3f, actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet) << ", n = " << n;
+
+      scalar.fill(expected.data(), 1.5f, n);
+      k->fill(actual.data(), 1.5f, n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet) << ", n = " << n;
+    }
+  }
+}
+
+TEST_F(SimdTest, reductionKernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  for (const Kernels* k : available) {
+    for (size_t n : { 0, 1, 7, 8, 15, 16, 17, 33, 1027 }) {
+      ASSERT_NEAR(scalar.sum(A.data(), n), k->sum(A.data(), n), FLOAT_TOLERANCE)
+        << instructionSetName(k->instructionSet) << ", n = " << n;
+
+      ASSERT_NEAR(scalar.dot(A.data(), B.data(), n), k->dot(A.data(), B.data(), n),
+        FLOAT_TOLERANCE) << instructionSetName(k->instructionSet) << ", n = " << n;
+    }
+  }
+}
+
+TEST_F(SimdTest, axpyMatchesScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  for (const Kernels* k : available) {
+    for (size_t n : { 0, 1, 7, 8, 15, 16, 17, 33, 1027 }) {
+      std::vector<netfloat_t> expected(B.begin(), B.begin() + n);
+      std::vector<netfloat_t> actual(B.begin(), B.begin() + n);
+
+      scalar.axpy(0.3f, A.data(), expected.data(), n);
+      k->axpy(0.3f, A.data(), actual.data(), n);
+
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_NEAR(expected[i], actual[i], FLOAT_TOLERANCE)
+          << instructionSetName(k->instructionSet) << ", n = " << n;
+      }
+    }
+  }
+}
+
+TEST_F(SimdTest, activationKernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  // Span the saturated regions too, including values beyond exp's clamped range
+  std::vector<netfloat_t> X(A.size());
+  for (size_t i = 0; i < X.size(); ++i) {
+    X[i] = A[i] * 120.f;
+  }
+  X[0] = 0.f;
+  X[1] = -0.f;
+
+  using ActivationKernel = void (*)(const netfloat_t*, netfloat_t*, size_t);
+  const std::vector<ActivationKernel Kernels::*> fns{
+    &Kernels::sigmoid,
+    &Kernels::sigmoidPrime,
+    &Kernels::relu,
+    &Kernels::reluPrime
+  };
+
+  for (const Kernels* k : available) {
+    for (auto fn : fns) {
+      for (size_t n : { 0, 1, 7, 8, 15, 16, 17, 33, 1027 }) {
+        std::vector<netfloat_t> expected(n);
+        std::vector<netfloat_t> actual(n);
+
+        (scalar.*fn)(X.data(), expected.data(), n);
+        (k->*fn)(X.data(), actual.data(), n);
+
+        for (size_t i = 0; i < n; ++i) {
+          ASSERT_NEAR(expected[i], actual[i], 1e-6f)
+            << instructionSetName(k->instructionSet) << ", n = " << n << ", x = " << X[i];
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SimdTest, halfConversionsRoundToNearestEven) {
+  ASSERT_EQ(toFloat16(1.f).bits, 0x3c00);
+  ASSERT_EQ(toFloat16(-2.f).bits, 0xc000);
+  ASSERT_EQ(toFloat16(65504.f).bits, 0x7bff);
+  ASSERT_EQ(toFloat16(1e5f).bits, 0x7c00);
+  ASSERT_EQ(toFloat16(1.f + 1.f / 2048.f).bits, 0x3c00);
+  ASSERT_EQ(toFloat16(1.f + 3.f / 2048.f).bits, 0x3c02);
+  ASSERT_EQ(toFloat16(5.9604645e-8f).bits, 0x0001);
+  ASSERT_EQ(toNetfloat(float16_t{ 0x0001 }), 5.9604645e-8f);
+  ASSERT_EQ(toNetfloat(float16_t{ 0xbc00 }), -1.f);
+
+  ASSERT_EQ(toBfloat16(1.f).bits, 0x3f80);
+  ASSERT_EQ(toBfloat16(1.f + 1.f / 256.f).bits, 0x3f80);
+  ASSERT_EQ(toBfloat16(1.f + 3.f / 256.f).bits, 0x3f82);
+  ASSERT_EQ(toNetfloat(bfloat16_t{ 0xc040 }), -3.f);
+
+  for (netfloat_t x : A) {
+    ASSERT_NEAR(toNetfloat(toFloat16(x)), x, 0.001f);
+    ASSERT_NEAR(toNetfloat(toBfloat16(x)), x, 0.004f);
+  }
+}
+
+TEST_F(SimdTest, packedKernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  // Cover half's subnormal and overflow ranges too
+  std::vector<netfloat_t> X(A.size());
+  for (size_t i = 0; i < X.size(); ++i) {
+    X[i] = A[i] * (i % 3 == 0 ? 1e-5f : (i % 3 == 1 ? 1.f : 1e5f));
+  }
+
+  for (const Kernels* k : available) {
+    for (size_t n : { 0, 1, 7, 8, 15, 16, 17, 33, 1027 }) {
+      std::vector<float16_t> expectedF16(n);
+      std::vector<float16_t> actualF16(n);
+      scalar.toFloat16(X.data(), expectedF16.data(), n);
+      k->toFloat16(X.data(), actualF16.data(), n);
+
+      std::vector<bfloat16_t> expectedBf16(n);
+      std::vector<bfloat16_t> actualBf16(n);
+      scalar.toBfloat16(X.data(), expectedBf16.data(), n);
+      k->toBfloat16(X.data(), actualBf16.data(), n);
+
+      std::vector<netfloat_t> expected(n);
+      std::vector<netfloat_t> actual(n);
+
+      for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(expectedF16[i].bits, actualF16[i].bits)
+          << instructionSetName(k->instructionSet) << ", x = " << X[i];
+        ASSERT_EQ(expectedBf16[i].bits, actualBf16[i].bits)
+          << instructionSetName(k->instructionSet) << ", x = " << X[i];
+      }
+
+      scalar.fromFloat16(expectedF16.data(), expected.data(), n);
+      k->fromFloat16(expectedF16.data(), actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet);
+
+      scalar.fromBfloat16(expectedBf16.data(), expected.data(), n);
+      k->fromBfloat16(expectedBf16.data(), actual.data(), n);
+      ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet);
+    }
+
+    std::vector<float16_t> F16(A.size());
+    std::vector<bfloat16_t> Bf16(A.size());
+    scalar.toFloat16(A.data(), F16.data(), A.size());
+    scalar.toBfloat16(A.data(), Bf16.data(), A.size());
+
+    const size_t lda = 257;
+    for (size_t rows = 1; rows <= TILE_ROWS; ++rows) {
+      for (size_t n : { 1, 17, 255 }) {
+        netfloat_t expected[TILE_ROWS];
+        netfloat_t actual[TILE_ROWS];
+
+        scalar.dotRowsFloat16(F16.data(), lda, B.data(), expected, rows, n);
+        k->dotRowsFloat16(F16.data(), lda, B.data(), actual, rows, n);
+        for (size_t i = 0; i < rows; ++i) {
+          ASSERT_NEAR(expected[i], actual[i], FLOAT_TOLERANCE);
+        }
+
+        scalar.dotRowsBfloat16(Bf16.data(), lda, B.data(), expected, rows, n);
+        k->dotRowsBfloat16(Bf16.data(), lda, B.data(), actual, rows, n);
+        for (size_t i = 0; i < rows; ++i) {
+          ASSERT_NEAR(expected[i], actual[i], FLOAT_TOLERANCE);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SimdTest, int8QuantizationRoundsToNearestEvenAndSaturates) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  std::vector<netfloat_t> X{ 0.5f, 1.5f, -2.5f, 3.49f, 126.6f, 300.f, -300.f };
+  std::vector<int8_t> expected{ 0, 2, -2, 3, 127, 127, -127 };
+
+  for (const Kernels* k : available) {
+    std::vector<int8_t> actual(X.size());
+    k->toInt8(X.data(), actual.data(), 1.f, X.size());
+    ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet);
+  }
+
+  std::vector<int8_t> actual(X.size());
+  scalar.toInt8(X.data(), actual.data(), 1.f, X.size());
+  ASSERT_EQ(expected, actual);
+}
+
+TEST_F(SimdTest, int8KernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  for (const Kernels* k : available) {
+    // A scale of 200 saturates some elements
+    for (netfloat_t scale : { 127.f, 200.f }) {
+      for (size_t n : { 0, 1, 7, 8, 15, 16, 17, 33, 1027 }) {
+        std::vector<int8_t> expected(n);
+        std::vector<int8_t> actual(n);
+        scalar.toInt8(A.data(), expected.data(), scale, n);
+        k->toInt8(A.data(), actual.data(), scale, n);
+        ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet);
+      }
+    }
+
+    std::vector<int8_t> Aq(A.size());
+    std::vector<int8_t> Bq(B.size());
+    scalar.toInt8(A.data(), Aq.data(), 127.f, A.size());
+    scalar.toInt8(B.data(), Bq.data(), 127.f, B.size());
+
+    // The sums are exact, so must match exactly
+    const size_t lda = 257;
+    for (size_t rows = 1; rows <= TILE_ROWS; ++rows) {
+      for (size_t n : { 1, 31, 32, 33, 64, 65, 255 }) {
+        int32_t expected[TILE_ROWS];
+        int32_t actual[TILE_ROWS];
+
+        scalar.dotRowsInt8(Aq.data(), lda, Bq.data(), expected, rows, n);
+        k->dotRowsInt8(Aq.data(), lda, Bq.data(), actual, rows, n);
+        for (size_t i = 0; i < rows; ++i) {
+          ASSERT_EQ(expected[i], actual[i]) << instructionSetName(k->instructionSet);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SimdTest, int8ProductKernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  std::vector<int8_t> Aq(A.size());
+  std::vector<int8_t> Bq(B.size());
+  scalar.toInt8(A.data(), Aq.data(), 127.f, A.size());
+  scalar.toInt8(B.data(), Bq.data(), 127.f, B.size());
+
+  // A's rows are read right up to depth, and B's packed rows are zero beyond it
+  const size_t lda = 37;
+  const size_t ldb = 4 * 40;
+  for (size_t depth : { 1, 3, 4, 27, 32 }) {
+    std::vector<int8_t> packedB(((depth + 3) / 4) * ldb, 0);
+    for (size_t k = 0; k < depth; ++k) {
+      for (size_t j = 0; j < ldb / 4; ++j) {
+        packedB[(k / 4) * ldb + 4 * j + k % 4] = Bq[k * ldb / 4 + j];
+      }
+    }
+
+    for (const Kernels* k : available) {
+      // The sums are exact, so must match exactly
+      for (size_t rows = 1; rows <= TILE_ROWS; ++rows) {
+        for (size_t n : { 1, 7, 8, 17, 33, 40 }) {
+          std::vector<int32_t> expected(TILE_ROWS * 40);
+          std::vector<int32_t> actual(TILE_ROWS * 40);
+
+          scalar.multiplyInt8(Aq.data(), lda, packedB.data(), ldb, expected.data(), 40, rows,
+            depth, n);
+          k->multiplyInt8(Aq.data(), lda, packedB.data(), ldb, actual.data(), 40, rows, depth,
+            n);
+          ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SimdTest, uint8NormalizationMatchesNormalize) {
+  std::vector<uint8_t> X(1027);
+  for (size_t i = 0; i < X.size(); ++i) {
+    X[i] = static_cast<uint8_t>(i * 37);
+  }
+
+  const netfloat_t min = 10.f;
+  const netfloat_t max = 250.f;
+
+  std::vector<netfloat_t> expected(X.size());
+  for (size_t i = 0; i < X.size(); ++i) {
+    expected[i] = (static_cast<netfloat_t>(X[i]) - min) / (max - min);
+  }
+
+  for (const Kernels* k : available) {
+    for (size_t n : { 0, 1, 7, 8, 15, 16, 17, 33, 1027 }) {
+      std::vector<netfloat_t> actual(n);
+      k->normalizeUint8(X.data(), min, max, actual.data(), n);
+      ASSERT_EQ(std::vector<netfloat_t>(expected.begin(), expected.begin() + n), actual)
+        << instructionSetName(k->instructionSet);
+    }
+  }
+}
+
+TEST_F(SimdTest, productKernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+
+  // A is read as a 4x9 matrix, B as a 9x(n) matrix with row stride 37
+  const size_t depth = 9;
+  const size_t ldb = 37;
+
+  for (const Kernels* k : available) {
+    for (size_t rows = 1; rows <= TILE_ROWS; ++rows) {
+      for (size_t n : { 1, 7, 8, 15, 16, 17, 33, 37 }) {
+        std::vector<netfloat_t> expected(rows * ldb, 0.5f);
+        std::vector<netfloat_t> actual(rows * ldb, 0.5f);
+
+        scalar.multiplyAccumulate(A.data(), depth, 1, B.data(), ldb, expected.data(), ldb, rows,
+          depth, n);
+        k->multiplyAccumulate(A.data(), depth, 1, B.data(), ldb, actual.data(), ldb, rows, depth,
+          n);
+
+        for (size_t i = 0; i < expected.size(); ++i) {
+          ASSERT_NEAR(expected[i], actual[i], FLOAT_TOLERANCE)
+            << instructionSetName(k->instructionSet) << ", rows = " << rows << ", n = " << n;
+        }
+
+        scalar.dotRows(A.data(), n, B.data(), expected.data(), rows, n);
+        k->dotRows(A.data(), n, B.data(), actual.data(), rows, n);
+
+        for (size_t i = 0; i < rows; ++i) {
+          ASSERT_NEAR(expected[i], actual[i], FLOAT_TOLERANCE)
+            << instructionSetName(k->instructionSet) << ", rows = " << rows << ", n = " << n;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SimdTest, resultMayAliasInput) {
+  for (const Kernels* k : available) {
+    std::vector<netfloat_t> expected(A.size());
+    kernels(InstructionSet::scalar)->add(A.data(), B.data(), expected.data(), A.size());
+
+    std::vector<netfloat_t> R = A;
+    k->add(R.data(), B.data(), R.data(), R.size());
+
+    ASSERT_EQ(expected, R) << instructionSetName(k->instructionSet);
+  }
+}
+
+TEST_F(SimdTest, philoxKernelsMatchScalar) {
+  const Kernels& scalar = *kernels(InstructionSet::scalar);
+  const uint32_t key[] = { 0x12345678, 0x9abcdef0 };
+
+  for (const Kernels* k : available) {
+    // The second counter makes the low word wrap part way through
+    for (uint64_t counter : { uint64_t(0), uint64_t(0xfffffff5) }) {
+      for (size_t blocks : { 0, 1, 3, 4, 7, 8, 15, 16, 17, 33, 100 }) {
+        std::vector<uint32_t> expected(4 * blocks);
+        std::vector<uint32_t> actual(4 * blocks);
+        scalar.philox(key, 42, counter, expected.data(), blocks);
+        k->philox(key, 42, counter, actual.data(), blocks);
+        ASSERT_EQ(expected, actual) << instructionSetName(k->instructionSet);
+      }
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#include <richard/thread_pool.hpp>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace richard;
+
+class ThreadPoolTest : public testing::Test {
+  public:
+    virtual void SetUp() override {}
+    virtual void TearDown() override {}
+};
+
+TEST_F(ThreadPoolTest, parallelForVisitsEveryIndexOnce) {
+  ThreadPool pool(4);
+
+  ASSERT_EQ(pool.numThreads(), 4);
+
+  for (size_t n : { 0, 1, 3, 4, 100 }) {
+    std::vector<std::atomic<int>> visits(n);
+
+    pool.parallelFor(n, [&](size_t i) {
+      ++visits[i];
+    });
+
+    for (size_t i = 0; i < n; ++i) {
+      ASSERT_EQ(visits[i], 1);
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, parallelForRethrowsException) {
+  ThreadPool pool(3);
+
+  ASSERT_THROW(pool.parallelFor(10, [](size_t i) {
+    if (i == 7) {
+      throw std::runtime_error("Task failed");
+    }
+  }), std::runtime_error);
+
+  // The pool is still usable afterwards
+  std::atomic<size_t> count = 0;
+  pool.parallelFor(10, [&](size_t) { ++count; });
+
+  ASSERT_EQ(count, 10);
+}
@@ -3,8 +3,16 @@
 #include <richard/event_system.hpp>
 #include <richard/file_system.hpp>
 #include <richard/logger.hpp>
+#include <chrono>
 
 namespace richard {
+namespace {
+
+float accuracy(const Classifier::Results& results) {
+  return 100.f * (static_cast<float>(results.good) / (results.good + results.bad));
+}
+
+}
 
 ClassifierEvalApp::ClassifierEvalApp(EventSystem& eventSystem, FileSystem& fileSystem,
   const PlatformPaths& platformPaths, const Options& options, Outputter& outputter, Logger& logger)
@@ -31,6 +39,14 @@ ClassifierEvalApp::ClassifierEvalApp(EventSystem& eventSystem, FileSystem& fileS
     m_opts.samplesPath, *m_dataDetails);
 
   m_dataSet = std::make_unique<LabelledDataSet>(std::move(loader), m_dataDetails->classLabels);
+
+  if (m_opts.quantizationSamples != 0 && !m_opts.calibrationSamplesPath.empty()) {
+    auto calibrationLoader = createDataLoader(m_fileSystem, config.getObject("dataLoader"),
+      m_opts.calibrationSamplesPath, *m_dataDetails);
+
+    m_calibrationSet = std::make_unique<LabelledDataSet>(std::move(calibrationLoader),
+      m_dataDetails->classLabels);
+  }
 }
 
 std::string ClassifierEvalApp::name() const {
@@ -38,7 +54,9 @@ std::string ClassifierEvalApp::name() const {
 }
 
 void ClassifierEvalApp::start() {
+  auto startTime = std::chrono::steady_clock::now();
   Classifier::Results results = m_classifier->test(*m_dataSet);
+  auto elapsed = std::chrono::steady_clock::now() - startTime;
 
   for (bool guess : results.guesses) {
     m_outputter.printLine(guess ? "1" : "0", false);
@@ -47,9 +65,44 @@ void ClassifierEvalApp::start() {
 
   m_outputter.printSeparator();
 
+  printResults(results);
+
+  if (m_opts.quantizationSamples == 0) {
+    return;
+  }
+
+  // Calibrating on the test samples themselves flatters the quantized accuracy, so that's only
+  // done when no other samples are given, and the output says so
+  LabelledDataSet& calibrationSet = m_calibrationSet ? *m_calibrationSet : *m_dataSet;
+
+  calibrationSet.seekToBeginning();
+  m_classifier->quantize(calibrationSet, m_opts.quantizationSamples);
+  m_dataSet->seekToBeginning();
+
+  auto quantizedStartTime = std::chrono::steady_clock::now();
+  Classifier::Results quantized = m_classifier->test(*m_dataSet);
+  auto quantizedElapsed = std::chrono::steady_clock::now() - quantizedStartTime;
+
+  m_outputter.printSeparator();
+  m_outputter.printLine(STR("Int8 quantized, calibrated on up to " << m_opts.quantizationSamples
+    << (m_calibrationSet ? " samples from " + m_opts.calibrationSamplesPath
+                         : " of the test samples themselves")));
+
+  printResults(quantized);
+
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+
+  m_outputter.printLine(STR("Accuracy change vs float32: "
+    << accuracy(quantized) - accuracy(results) << "%"));
+  m_outputter.printLine(STR("Evaluation time: " << duration_cast<milliseconds>(elapsed).count()
+    << "ms float32, " << duration_cast<milliseconds>(quantizedElapsed).count() << "ms int8"));
+}
+
+void ClassifierEvalApp::printResults(const Classifier::Results& results) {
   m_outputter.printLine(STR("Correct classifications: "
     << results.good << "/" << results.good + results.bad
-    << " = " << 100.f * (static_cast<float>(results.good) / (results.good + results.bad)) << "%"));
+    << " = " << accuracy(results) << "%"));
 
   m_outputter.printLine(STR("Average cost: " << results.cost));
 }
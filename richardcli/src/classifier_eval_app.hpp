@@ -20,6 +20,11 @@ class ClassifierEvalApp : public Application {
       std::string samplesPath;
       std::string networkFile;
       bool gpuAccelerated;
+      // If non-zero, the network is also evaluated after int8 quantization, calibrated on
+      // this many samples, and the results compared
+      size_t quantizationSamples;
+      // Samples to calibrate on, such as the training set. If empty, the test samples are used.
+      std::string calibrationSamplesPath;
     };
 
     ClassifierEvalApp(EventSystem& eventSystem, FileSystem& fileSystem,
@@ -30,6 +35,8 @@ class ClassifierEvalApp : public Application {
     void start() override;
 
   private:
+    void printResults(const Classifier::Results& results);
+
     EventSystem& m_eventSystem;
     FileSystem& m_fileSystem;
     Outputter& m_outputter;
@@ -38,6 +45,7 @@ class ClassifierEvalApp : public Application {
     std::unique_ptr<Classifier> m_classifier;
     std::unique_ptr<DataDetails> m_dataDetails;
     std::unique_ptr<LabelledDataSet> m_dataSet;
+    std::unique_ptr<LabelledDataSet> m_calibrationSet;
 };
 
 }
@@ -0,0 +1,35 @@
+#include "data_conversion_app.hpp"
+#include "outputter.hpp"
+#include <richard/binary_data_loader.hpp>
+#include <richard/file_system.hpp>
+#include <richard/utils.hpp>
+
+namespace richard {
+
+DataConversionApp::DataConversionApp(FileSystem& fileSystem, const Options& options,
+  Outputter& outputter)
+  : m_outputter(outputter)
+  , m_fileSystem(fileSystem)
+  , m_opts(options) {
+
+  auto stream = m_fileSystem.openFileForReading(m_opts.configFile);
+  Config config = Config::fromJson(*stream);
+
+  m_dataDetails = std::make_unique<DataDetails>(config.getObject("data"));
+  m_loader = createDataLoader(m_fileSystem, config.getObject("dataLoader"), m_opts.samplesPath,
+    *m_dataDetails);
+}
+
+std::string DataConversionApp::name() const {
+  return "Data Conversion";
+}
+
+void DataConversionApp::start() {
+  m_outputter.printLine(STR("Converting " << m_opts.samplesPath << " to " << m_opts.outputFile));
+
+  auto stream = m_fileSystem.openFileForWriting(m_opts.outputFile);
+  writeBinaryDataSet(*m_loader, *m_dataDetails, *stream);
+  stream->flush();
+}
+
+}
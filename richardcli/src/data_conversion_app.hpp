@@ -0,0 +1,37 @@
+#pragma once
+
+#include "application.hpp"
+#include <richard/data_details.hpp>
+#include <richard/data_loader.hpp>
+#include <richard/config.hpp>
+
+class Outputter;
+
+namespace richard {
+
+class FileSystem;
+
+// Converts a data set to the packed binary format, which createDataLoader then picks up in place
+// of the original
+class DataConversionApp : public Application {
+  public:
+    struct Options {
+      std::string samplesPath;
+      std::string configFile;
+      std::string outputFile;
+    };
+
+    DataConversionApp(FileSystem& fileSystem, const Options& options, Outputter& outputter);
+
+    std::string name() const override;
+    void start() override;
+
+  private:
+    Outputter& m_outputter;
+    FileSystem& m_fileSystem;
+    Options m_opts;
+    std::unique_ptr<DataDetails> m_dataDetails;
+    DataLoaderPtr m_loader;
+};
+
+}
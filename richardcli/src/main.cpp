@@ -1,6 +1,7 @@
 #include "outputter.hpp"
 #include "classifier_training_app.hpp"
 #include "classifier_eval_app.hpp"
+#include "data_conversion_app.hpp"
 #include <richard/exception.hpp>
 #include <richard/utils.hpp>
 #include <richard/file_system.hpp>
@@ -77,14 +78,34 @@ ApplicationPtr constructApp(EventSystem& eventSystem, Outputter& outputter, Logg
     opts.samplesPath = getOpt(vm, "samples", true).as<std::string>();
     opts.networkFile = getOpt(vm, "network", true).as<std::string>();
     opts.gpuAccelerated = vm.count("gpu");
+    opts.quantizationSamples = 0;
 
     vm.erase("gpu");
 
+    if (vm.count("quantize")) {
+      opts.quantizationSamples = getOpt(vm, "quantize", true).as<size_t>();
+
+      if (vm.count("calibration-samples")) {
+        opts.calibrationSamplesPath = getOpt(vm, "calibration-samples", true).as<std::string>();
+      }
+    }
+
     app = std::make_unique<ClassifierEvalApp>(eventSystem, fileSystem, platformPaths, opts,
       outputter, logger);
   }
+  else if (vm.count("convert")) {
+    DataConversionApp::Options opts;
+
+    vm.erase("convert");
+
+    opts.samplesPath = getOpt(vm, "samples", true).as<std::string>();
+    opts.configFile = getOpt(vm, "config", true).as<std::string>();
+    opts.outputFile = getOpt(vm, "output", true).as<std::string>();
+
+    app = std::make_unique<DataConversionApp>(fileSystem, opts, outputter);
+  }
   else {
-    EXCEPTION("Missing required argument: train or eval");
+    EXCEPTION("Missing required argument: train, eval or convert");
   }
 
   for (auto i : vm) {
@@ -119,12 +140,19 @@ po::variables_map parseProgramArgs(po::options_description& desc, int argc, cons
       ("help,h", "Show help")
       ("train,t", "Train a classifier")
       ("eval,e", "Evaluate a classifier with test data")
+      ("convert,v", "Convert data samples to the binary data set format")
       ("gen,g", po::value<std::string>(), "Generate example config file for app type [train]")
       ("samples,s", po::value<std::string>(), "Path to data samples")
       ("config,c", po::value<std::string>(), "JSON configuration file")
       ("network,n", po::value<std::string>()->required(), "File to save/load neural network state")
+      ("output,o", po::value<std::string>(), "With convert, path of the binary data set to write")
       ("log,l", po::value<std::string>(), "Log file path")
-      ("gpu,x", "Use GPU acceleration");
+      ("gpu,x", "Use GPU acceleration")
+      ("quantize,q", po::value<size_t>(),
+        "With eval, also evaluate an int8 quantized network, calibrated on this many samples")
+      ("calibration-samples", po::value<std::string>(),
+        "With quantize, path to samples to calibrate on, such as the training set. Defaults to "
+        "the test samples");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -148,7 +176,7 @@ int main(int argc, const char** argv) {
       return EXIT_SUCCESS;
     }
 
-    optionChoice(vm, { "train", "eval", "gen" });
+    optionChoice(vm, { "train", "eval", "convert", "gen" });
 
     if (vm.count("log")) {
       logStream = std::ofstream{vm.at("log").as<std::string>()};